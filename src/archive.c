@@ -0,0 +1,1504 @@
+#include "archive.h"
+#include "strmap.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/* Segment file (integers little-endian):
+ *   SEG_MAGIC
+ *   blocks, each a zlib stream of rows: i64 id, u16 source and u16 unit
+ *     (positions in the block's dictionaries), i16 pri (-1 for none),
+ *     u16 length + ts, u32 length + message
+ *   index, one entry per block (see writer_flush)
+ *   trailer: u64 index offset, u32 block count, SEG_END */
+#define SEG_MAGIC "LXARCH1\n"
+#define SEG_END "LXARCEND"
+#define SEG_TRAILER (8 + 4 + 8)
+#define BLOOM_HASHES 7
+#define BLOOM_BITS_PER_TOKEN 10
+#define SEV_NONE 0x100  // sev_mask bit for rows without pri
+
+/* ---- byte buffers ---- */
+
+typedef struct {
+    unsigned char *p;
+    size_t len, cap;
+    int oom;
+} Buf;
+
+static void buf_put(Buf *b, const void *src, size_t n) {
+    if (b->oom || n == 0) return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        unsigned char *p = realloc(b->p, cap);
+        if (!p) { b->oom = 1; return; }
+        b->p = p;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, src, n);
+    b->len += n;
+}
+
+static void buf_uint(Buf *b, uint64_t v, int bytes) {
+    unsigned char tmp[8];
+    for (int i = 0; i < bytes; ++i) tmp[i] = (unsigned char)(v >> (8 * i));
+    buf_put(b, tmp, (size_t)bytes);
+}
+
+static void buf_str(Buf *b, const char *s, size_t len, int len_bytes) {
+    buf_uint(b, len, len_bytes);
+    buf_put(b, s, len);
+}
+
+typedef struct {
+    const unsigned char *p, *end;
+    int bad;
+} Reader;
+
+static uint64_t rd_uint(Reader *r, int bytes) {
+    if (r->bad || r->end - r->p < bytes) { r->bad = 1; return 0; }
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint64_t)r->p[i] << (8 * i);
+    r->p += bytes;
+    return v;
+}
+
+static const char *rd_bytes(Reader *r, size_t n) {
+    if (r->bad || (size_t)(r->end - r->p) < n) { r->bad = 1; return NULL; }
+    const char *s = (const char*)r->p;
+    r->p += n;
+    return s;
+}
+
+static char *rd_strdup(Reader *r, int len_bytes) {
+    size_t n = (size_t)rd_uint(r, len_bytes);
+    const char *s = rd_bytes(r, n);
+    if (!s) return NULL;
+    char *out = malloc(n + 1);
+    if (!out) { r->bad = 1; return NULL; }
+    memcpy(out, s, n);
+    out[n] = '\0';
+    return out;
+}
+
+/* ---- tokens and bloom filters ---- */
+
+/* Messages and queries are split by the connection's FTS5 unicode61
+ * tokenizer, the one logs_fts uses, so archived rows fold case and
+ * diacritics exactly as indexed ones do. An instance is not thread-safe:
+ * each scan thread gets its own. */
+typedef struct {
+    fts5_tokenizer api;
+    Fts5Tokenizer *tok;
+} Tokenizer;
+
+typedef int (*TokenFn)(void *ctx, int flags, const char *token, int n, int start, int end);
+
+static fts5_api *fts5_api_of(sqlite3 *db) {
+    fts5_api *api = NULL;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT fts5(?1);", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_pointer(stmt, 1, (void*)&api, "fts5_api_ptr", NULL);
+        sqlite3_step(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return api;
+}
+
+static int tokenizer_open(Tokenizer *t, fts5_api *fts) {
+    void *ud = NULL;
+    t->tok = NULL;
+    if (!fts || fts->xFindTokenizer(fts, "unicode61", &ud, &t->api) != SQLITE_OK) return -1;
+    return t->api.xCreate(ud, NULL, 0, &t->tok) == SQLITE_OK ? 0 : -1;
+}
+
+static void tokenizer_close(Tokenizer *t) {
+    if (t->tok) t->api.xDelete(t->tok);
+    t->tok = NULL;
+}
+
+// Call fn for every folded token of text. Returns 0, or -1 if fn failed.
+static int tokenize(Tokenizer *t, int flags, const char *text, size_t len, TokenFn fn, void *ctx) {
+    if (len > INT32_MAX) len = INT32_MAX;
+    return t->api.xTokenize(t->tok, ctx, flags, text, (int)len, fn) == SQLITE_OK ? 0 : -1;
+}
+
+// FNV-1a; never 0, which marks free slots in HashSet.
+static uint64_t token_hash(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+static void bloom_add(unsigned char *bits, uint32_t nbits, uint64_t h) {
+    uint64_t h2 = ((h * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; ++i) {
+        uint64_t bit = (h + (uint64_t)i * h2) % nbits;
+        bits[bit >> 3] |= (unsigned char)(1u << (bit & 7));
+    }
+}
+
+static int bloom_has(const unsigned char *bits, uint32_t nbits, uint64_t h) {
+    uint64_t h2 = ((h * 0x9E3779B97F4A7C15ULL) >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; ++i) {
+        uint64_t bit = (h + (uint64_t)i * h2) % nbits;
+        if (!(bits[bit >> 3] & (1u << (bit & 7)))) return 0;
+    }
+    return 1;
+}
+
+// Distinct token hashes of the block being written (open addressing).
+typedef struct {
+    uint64_t *v;
+    size_t cap, n;
+} HashSet;
+
+static int hashset_add(HashSet *s, uint64_t h) {
+    if ((s->n + 1) * 2 > s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 1024;
+        uint64_t *v = calloc(cap, sizeof(*v));
+        if (!v) return -1;
+        for (size_t i = 0; i < s->cap; ++i) {
+            if (!s->v[i]) continue;
+            size_t j = s->v[i] & (cap - 1);
+            while (v[j]) j = (j + 1) & (cap - 1);
+            v[j] = s->v[i];
+        }
+        free(s->v);
+        s->v = v;
+        s->cap = cap;
+    }
+    size_t i = h & (s->cap - 1);
+    while (s->v[i] && s->v[i] != h) i = (i + 1) & (s->cap - 1);
+    if (!s->v[i]) {
+        s->v[i] = h;
+        s->n++;
+    }
+    return 0;
+}
+
+static void hashset_clear(HashSet *s) {
+    if (s->v) memset(s->v, 0, s->cap * sizeof(*s->v));
+    s->n = 0;
+}
+
+/* ---- writer ---- */
+
+typedef struct {
+    StrMap *ids;
+    char **names;
+    size_t n, cap;
+} Dict;
+
+static long dict_index(Dict *d, const char *name) {
+    int64_t id;
+    if (!d->ids && !(d->ids = strmap_new())) return -1;
+    if (strmap_get(d->ids, name, &id)) return (long)id;
+    if (d->n == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 16;
+        char **names = realloc(d->names, sizeof(*names) * cap);
+        if (!names) return -1;
+        d->names = names;
+        d->cap = cap;
+    }
+    if (!(d->names[d->n] = strdup(name)) || strmap_put(d->ids, name, (int64_t)d->n) != 0) return -1;
+    return (long)d->n++;
+}
+
+static void dict_clear(Dict *d) {
+    for (size_t i = 0; i < d->n; ++i) free(d->names[i]);
+    d->n = 0;
+    strmap_free(d->ids);
+    d->ids = NULL;
+}
+
+struct ArchiveWriter {
+    FILE *f;
+    char *tmp;
+    Buf block;           // rows of the current block
+    Buf index;           // entries of the finished blocks
+    uint32_t nblocks, nrows;
+    long long min_id, max_id;
+    char *min_ts, *max_ts;
+    unsigned sev_mask;
+    Dict sources, units;
+    HashSet tokens;      // hashes of the block's tokens
+    Tokenizer tok;
+    uint64_t offset;     // where the next block starts
+    ArchiveSegmentInfo info;
+    int failed;
+};
+
+static void set_ts(char **dst, const char *ts) {
+    free(*dst);
+    *dst = strdup(ts);
+}
+
+/* Compress the current block and add its index entry:
+ *   u64 offset, u32 compressed length, u32 length, u32 rows,
+ *   i64 min id, i64 max id, u16 length + min ts, u16 length + max ts,
+ *   u16 severity mask, u16 count + sources, u16 count + units (each u16
+ *   length + name), u32 bloom bits + bloom bytes */
+static int writer_flush(ArchiveWriter *w) {
+    if (w->nrows == 0) return 0;
+    if (w->block.oom || !w->min_ts || !w->max_ts) return -1;
+    uLongf clen = compressBound(w->block.len);
+    unsigned char *c = malloc(clen);
+    if (!c || compress2(c, &clen, w->block.p, w->block.len, Z_DEFAULT_COMPRESSION) != Z_OK ||
+        fwrite(c, 1, clen, w->f) != clen) {
+        free(c);
+        return -1;
+    }
+    free(c);
+    uint32_t nbits = (uint32_t)((w->tokens.n * BLOOM_BITS_PER_TOKEN + 63) / 64 * 64);
+    if (nbits < 64) nbits = 64;
+    unsigned char *bloom = calloc(nbits / 8, 1);
+    if (!bloom) return -1;
+    for (size_t i = 0; i < w->tokens.cap; ++i)
+        if (w->tokens.v[i]) bloom_add(bloom, nbits, w->tokens.v[i]);
+
+    Buf *x = &w->index;
+    buf_uint(x, w->offset, 8);
+    buf_uint(x, clen, 4);
+    buf_uint(x, w->block.len, 4);
+    buf_uint(x, w->nrows, 4);
+    buf_uint(x, (uint64_t)w->min_id, 8);
+    buf_uint(x, (uint64_t)w->max_id, 8);
+    buf_str(x, w->min_ts, strlen(w->min_ts), 2);
+    buf_str(x, w->max_ts, strlen(w->max_ts), 2);
+    buf_uint(x, w->sev_mask, 2);
+    buf_uint(x, w->sources.n, 2);
+    for (size_t i = 0; i < w->sources.n; ++i) buf_str(x, w->sources.names[i], strlen(w->sources.names[i]), 2);
+    buf_uint(x, w->units.n, 2);
+    for (size_t i = 0; i < w->units.n; ++i) buf_str(x, w->units.names[i], strlen(w->units.names[i]), 2);
+    buf_uint(x, nbits, 4);
+    buf_put(x, bloom, nbits / 8);
+    free(bloom);
+    if (x->oom) return -1;
+
+    w->offset += clen;
+    w->nblocks++;
+    w->info.blocks++;
+    w->info.raw_bytes += (long long)w->block.len;
+    w->block.len = 0;
+    w->nrows = 0;
+    w->sev_mask = 0;
+    free(w->min_ts);
+    free(w->max_ts);
+    w->min_ts = w->max_ts = NULL;
+    dict_clear(&w->sources);
+    dict_clear(&w->units);
+    hashset_clear(&w->tokens);
+    return 0;
+}
+
+static int add_token_hash(void *ctx, int flags, const char *token, int n, int start, int end) {
+    (void)flags;
+    (void)start;
+    (void)end;
+    return hashset_add(ctx, token_hash(token, (size_t)n)) == 0 ? SQLITE_OK : SQLITE_NOMEM;
+}
+
+ArchiveWriter *archive_writer_open(sqlite3 *db, const char *dir) {
+    ArchiveWriter *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    if (tokenizer_open(&w->tok, fts5_api_of(db)) != 0) {
+        fprintf(stderr, "archive: FTS5 unicode61 tokenizer not available\n");
+        free(w);
+        return NULL;
+    }
+    size_t n = strlen(dir) + 64;
+    if (!(w->tmp = malloc(n))) {
+        tokenizer_close(&w->tok);
+        free(w);
+        return NULL;
+    }
+    snprintf(w->tmp, n, "%s/.segment-%ld.tmp", dir, (long)getpid());
+    if (!(w->f = fopen(w->tmp, "wb"))) {
+        perror(w->tmp);
+        tokenizer_close(&w->tok);
+        free(w->tmp);
+        free(w);
+        return NULL;
+    }
+    if (fwrite(SEG_MAGIC, 1, 8, w->f) != 8) w->failed = 1;
+    w->offset = 8;
+    return w;
+}
+
+int archive_writer_add(ArchiveWriter *w, long long id, const LogRecord *rec) {
+    if (w->failed) return -1;
+    // positions are u16
+    if ((w->sources.n >= 0xFFFF || w->units.n >= 0xFFFF) && writer_flush(w) != 0) { w->failed = 1; return -1; }
+    long si = dict_index(&w->sources, rec->source ? rec->source : "");
+    long ui = dict_index(&w->units, rec->unit ? rec->unit : "");
+    if (si < 0 || ui < 0) { w->failed = 1; return -1; }
+    const char *ts = rec->ts ? rec->ts : "";
+    const char *msg = rec->message ? rec->message : "";
+    size_t ts_len = strlen(ts), msg_len = strlen(msg);
+    if (ts_len > 0xFFFF) ts_len = 0xFFFF;
+    if (msg_len > 0xFFFFFFFFu) msg_len = 0xFFFFFFFFu;
+    buf_uint(&w->block, (uint64_t)id, 8);
+    buf_uint(&w->block, (uint64_t)si, 2);
+    buf_uint(&w->block, (uint64_t)ui, 2);
+    buf_uint(&w->block, (uint16_t)(int16_t)(rec->pri < 0 ? -1 : rec->pri), 2);
+    buf_str(&w->block, ts, ts_len, 2);
+    buf_str(&w->block, msg, msg_len, 4);
+
+    if (w->nrows == 0 || id < w->min_id) w->min_id = id;
+    if (w->nrows == 0 || id > w->max_id) w->max_id = id;
+    if (!w->min_ts || strcmp(ts, w->min_ts) < 0) set_ts(&w->min_ts, ts);
+    if (!w->max_ts || strcmp(ts, w->max_ts) > 0) set_ts(&w->max_ts, ts);
+    w->sev_mask |= rec->pri < 0 ? SEV_NONE : 1u << (rec->pri & 7);
+    if (tokenize(&w->tok, FTS5_TOKENIZE_DOCUMENT, msg, msg_len, add_token_hash, &w->tokens) != 0) {
+        w->failed = 1;
+        return -1;
+    }
+
+    ArchiveSegmentInfo *info = &w->info;
+    if (info->rows == 0 || id < info->min_id) info->min_id = id;
+    if (info->rows == 0 || id > info->max_id) info->max_id = id;
+    if (info->rows == 0 || strcmp(ts, info->min_ts) < 0) snprintf(info->min_ts, sizeof(info->min_ts), "%s", ts);
+    if (info->rows == 0 || strcmp(ts, info->max_ts) > 0) snprintf(info->max_ts, sizeof(info->max_ts), "%s", ts);
+    info->rows++;
+    w->nrows++;
+    if ((w->block.len >= ARCHIVE_BLOCK_BYTES || w->nrows >= ARCHIVE_BLOCK_ROWS) && writer_flush(w) != 0) {
+        w->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void writer_free(ArchiveWriter *w) {
+    if (w->f) fclose(w->f);
+    free(w->tmp);
+    free(w->block.p);
+    free(w->index.p);
+    free(w->min_ts);
+    free(w->max_ts);
+    dict_clear(&w->sources);
+    dict_clear(&w->units);
+    free(w->sources.names);
+    free(w->units.names);
+    free(w->tokens.v);
+    tokenizer_close(&w->tok);
+    free(w);
+}
+
+int archive_writer_finish(ArchiveWriter *w, const char *path, ArchiveSegmentInfo *info) {
+    int ok = !w->failed && writer_flush(w) == 0;
+    if (ok) {
+        Buf trailer = {0};
+        buf_uint(&trailer, w->offset, 8);
+        buf_uint(&trailer, w->nblocks, 4);
+        buf_put(&trailer, SEG_END, 8);
+        ok = !trailer.oom && fwrite(w->index.p, 1, w->index.len, w->f) == w->index.len &&
+             fwrite(trailer.p, 1, trailer.len, w->f) == trailer.len;
+        free(trailer.p);
+        w->info.file_bytes = (long long)(w->offset + w->index.len + SEG_TRAILER);
+    }
+    ok = ok && fflush(w->f) == 0 && fsync(fileno(w->f)) == 0;
+    ok = fclose(w->f) == 0 && ok;
+    w->f = NULL;
+    if (ok && rename(w->tmp, path) != 0) {
+        perror(path);
+        ok = 0;
+    }
+    if (!ok) unlink(w->tmp);
+    if (ok && info) *info = w->info;
+    writer_free(w);
+    return ok ? 0 : -1;
+}
+
+void archive_writer_abort(ArchiveWriter *w) {
+    if (!w) return;
+    fclose(w->f);
+    w->f = NULL;
+    unlink(w->tmp);
+    writer_free(w);
+}
+
+/* ---- reading segments ---- */
+
+typedef struct Segment Segment;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t clen, ulen, nrows;
+    long long min_id, max_id;
+    char *min_ts, *max_ts;
+    unsigned sev_mask;
+    char **sources, **units;
+    uint16_t nsources, nunits;
+    unsigned char *bloom;
+    uint32_t bloom_bits;
+    /* Per source: rows with an id up to this belong to a dropped source
+     * (archive_dropped) and are left out. NULL if no source is dropped. */
+    long long *dropped_to;
+    int all_dropped;          // no row of the block is left
+    const Segment *seg;
+} BlockMeta;
+
+struct Segment {
+    int fd;
+    BlockMeta *blocks;
+    uint32_t nblocks;
+};
+
+static void segment_free(Segment *s) {
+    for (uint32_t i = 0; i < s->nblocks; ++i) {
+        BlockMeta *b = &s->blocks[i];
+        free(b->min_ts);
+        free(b->max_ts);
+        for (uint16_t j = 0; b->sources && j < b->nsources; ++j) free(b->sources[j]);
+        for (uint16_t j = 0; b->units && j < b->nunits; ++j) free(b->units[j]);
+        free(b->sources);
+        free(b->units);
+        free(b->bloom);
+        free(b->dropped_to);
+    }
+    free(s->blocks);
+    if (s->fd >= 0) close(s->fd);
+}
+
+static char **read_dict(Reader *r, uint16_t *out_n) {
+    uint16_t n = (uint16_t)rd_uint(r, 2);
+    char **names = calloc(n ? n : 1, sizeof(*names));
+    if (!names) { r->bad = 1; return NULL; }
+    *out_n = n;
+    for (uint16_t i = 0; i < n && !r->bad; ++i) names[i] = rd_strdup(r, 2);
+    return names;
+}
+
+// Open a segment and read its index. Returns 0, or -1 if the file is missing or damaged.
+static int segment_load(Segment *s, const char *path) {
+    memset(s, 0, sizeof(*s));
+    s->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (s->fd < 0) return -1;
+    struct stat st;
+    unsigned char head[8], tail[SEG_TRAILER];
+    if (fstat(s->fd, &st) != 0 || st.st_size < 8 + SEG_TRAILER || pread(s->fd, head, 8, 0) != 8 ||
+        memcmp(head, SEG_MAGIC, 8) != 0 ||
+        pread(s->fd, tail, SEG_TRAILER, st.st_size - SEG_TRAILER) != SEG_TRAILER ||
+        memcmp(tail + 12, SEG_END, 8) != 0)
+        return -1;
+    Reader t = { tail, tail + 12, 0 };
+    uint64_t index_off = rd_uint(&t, 8);
+    uint32_t nblocks = (uint32_t)rd_uint(&t, 4);
+    if (index_off < 8 || index_off > (uint64_t)st.st_size - SEG_TRAILER) return -1;
+    size_t index_len = (size_t)((uint64_t)st.st_size - SEG_TRAILER - index_off);
+    unsigned char *index = malloc(index_len ? index_len : 1);
+    if (!index || pread(s->fd, index, index_len, (off_t)index_off) != (ssize_t)index_len) {
+        free(index);
+        return -1;
+    }
+    s->blocks = calloc(nblocks ? nblocks : 1, sizeof(*s->blocks));
+    Reader r = { index, index + index_len, !s->blocks };
+    for (uint32_t i = 0; i < nblocks && !r.bad; ++i) {
+        BlockMeta *b = &s->blocks[i];
+        s->nblocks = i + 1;
+        b->seg = s;
+        b->offset = rd_uint(&r, 8);
+        b->clen = (uint32_t)rd_uint(&r, 4);
+        b->ulen = (uint32_t)rd_uint(&r, 4);
+        b->nrows = (uint32_t)rd_uint(&r, 4);
+        b->min_id = (long long)rd_uint(&r, 8);
+        b->max_id = (long long)rd_uint(&r, 8);
+        b->min_ts = rd_strdup(&r, 2);
+        b->max_ts = rd_strdup(&r, 2);
+        b->sev_mask = (unsigned)rd_uint(&r, 2);
+        b->sources = read_dict(&r, &b->nsources);
+        if (!r.bad) b->units = read_dict(&r, &b->nunits);
+        b->bloom_bits = (uint32_t)rd_uint(&r, 4);
+        const char *bits = rd_bytes(&r, b->bloom_bits / 8);
+        if (bits && b->bloom_bits >= 64 && (b->bloom = malloc(b->bloom_bits / 8)))
+            memcpy(b->bloom, bits, b->bloom_bits / 8);
+        else
+            r.bad = 1;
+        if (b->offset + b->clen > index_off) r.bad = 1;
+    }
+    free(index);
+    return r.bad ? -1 : 0;
+}
+
+/* Segments listed in archive_segments when it was last read, with every
+ * block ordered newest first. Cursors hold a reference, so a reload (after
+ * another archive run) does not pull blocks from under a running scan. */
+typedef struct {
+    int refs;
+    Segment *segs;
+    size_t nsegs;
+    BlockMeta **order;
+    size_t nblocks;
+} Snapshot;
+
+static void snapshot_unref(Snapshot *s) {
+    if (!s || --s->refs > 0) return;
+    for (size_t i = 0; i < s->nsegs; ++i) segment_free(&s->segs[i]);
+    free(s->segs);
+    free(s->order);
+    free(s);
+}
+
+/* Order of rows and blocks: ts, then id. A block sorts at its newest
+ * possible row (max_ts, max_id), at or after every row it holds. */
+static int key_cmp(const char *ts_a, size_t len_a, long long id_a, const char *ts_b, size_t len_b, long long id_b) {
+    int c = memcmp(ts_a, ts_b, len_a < len_b ? len_a : len_b);
+    if (c == 0 && len_a != len_b) c = len_a < len_b ? -1 : 1;
+    if (c == 0 && id_a != id_b) c = id_a < id_b ? -1 : 1;
+    return c;
+}
+
+static int block_newer_first(const void *a, const void *b) {
+    const BlockMeta *x = *(BlockMeta *const *)a, *y = *(BlockMeta *const *)b;
+    return key_cmp(y->max_ts, strlen(y->max_ts), y->max_id, x->max_ts, strlen(x->max_ts), x->max_id);
+}
+
+typedef struct {
+    char dir[4096];
+    Snapshot *snap;
+    long long seen_count, seen_max;  // archive_segments when snap was loaded
+    long long seen_drops;            // archive_dropped rows when snap was loaded
+    fts5_api *fts;                   // owned by the connection
+} Archive;
+
+/* Mark the rows of dropped sources in the blocks of s (see
+ * BlockMeta.dropped_to). Returns 0, or -1 if out of memory. */
+static int snapshot_apply_drops(Snapshot *s, sqlite3 *db) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT source, max(max_id) FROM archive_dropped GROUP BY source;", -1, &stmt, NULL) !=
+        SQLITE_OK)
+        return 0;
+    int rc = 0;
+    while (rc == 0 && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *source = (const char*)sqlite3_column_text(stmt, 0);
+        long long to = sqlite3_column_int64(stmt, 1);
+        for (size_t i = 0; source && rc == 0 && i < s->nblocks; ++i) {
+            BlockMeta *b = s->order[i];
+            if (to < b->min_id) continue;
+            for (uint16_t j = 0; j < b->nsources; ++j) {
+                if (strcmp(b->sources[j], source) != 0) continue;
+                if (!b->dropped_to && !(b->dropped_to = calloc(b->nsources, sizeof(*b->dropped_to)))) rc = -1;
+                else if (to > b->dropped_to[j]) b->dropped_to[j] = to;
+                break;
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    for (size_t i = 0; rc == 0 && i < s->nblocks; ++i) {
+        BlockMeta *b = s->order[i];
+        b->all_dropped = b->dropped_to != NULL;
+        for (uint16_t j = 0; b->dropped_to && j < b->nsources; ++j)
+            if (b->dropped_to[j] < b->max_id) b->all_dropped = 0;
+    }
+    return rc;
+}
+
+// Reload the snapshot if archive_segments or archive_dropped changed. Runs on the connection, from xFilter.
+static int archive_refresh(Archive *ar, sqlite3 *db) {
+    sqlite3_stmt *stmt = NULL;
+    long long count = 0, max = 0, drops = 0;
+    // a database from before the archive tier has no archive_segments: nothing archived
+    if (sqlite3_prepare_v2(db, "SELECT count(*), coalesce(max(id), 0) FROM archive_segments;", -1, &stmt, NULL) ==
+            SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int64(stmt, 0);
+        max = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (count > 0 && sqlite3_prepare_v2(db, "SELECT count(*) FROM archive_dropped;", -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+        drops = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (ar->snap && count == ar->seen_count && max == ar->seen_max && drops == ar->seen_drops) return 0;
+    Snapshot *s = calloc(1, sizeof(*s));
+    if (!s) return -1;
+    s->refs = 1;
+    if (count > 0 && sqlite3_prepare_v2(db, "SELECT file FROM archive_segments ORDER BY id;", -1, &stmt, NULL) == SQLITE_OK) {
+        s->segs = calloc((size_t)count, sizeof(*s->segs));
+        while (s->segs && s->nsegs < (size_t)count && sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *file = (const char*)sqlite3_column_text(stmt, 0);
+            char path[4352];
+            snprintf(path, sizeof(path), "%s/%s", ar->dir, file ? file : "");
+            Segment *seg = &s->segs[s->nsegs];
+            if (segment_load(seg, path) != 0) {
+                // searches go on without it rather than failing as a whole
+                fprintf(stderr, "archive: cannot read segment %s; its rows are left out of searches\n", path);
+                segment_free(seg);
+                continue;
+            }
+            s->nblocks += seg->nblocks;
+            s->nsegs++;
+        }
+        sqlite3_finalize(stmt);
+    }
+    s->order = malloc(sizeof(*s->order) * (s->nblocks ? s->nblocks : 1));
+    if (!s->order) {
+        snapshot_unref(s);
+        return -1;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < s->nsegs; ++i)
+        for (uint32_t j = 0; j < s->segs[i].nblocks; ++j) s->order[k++] = &s->segs[i].blocks[j];
+    qsort(s->order, s->nblocks, sizeof(*s->order), block_newer_first);
+    if (drops > 0 && snapshot_apply_drops(s, db) != 0) {
+        snapshot_unref(s);
+        return -1;
+    }
+    snapshot_unref(ar->snap);
+    ar->snap = s;
+    ar->seen_count = count;
+    ar->seen_max = max;
+    ar->seen_drops = drops;
+    return 0;
+}
+
+/* ---- query expressions ---- */
+
+typedef enum { Q_PHRASE, Q_AND, Q_OR, Q_NOT } QKind;
+
+typedef struct QNode {
+    QKind kind;
+    struct QNode *a, *b;   // operands; a NOT b is "a and not b"
+    char **terms;          // Q_PHRASE: folded tokens in order
+    size_t *lens;
+    uint64_t *hashes;
+    size_t nterms;
+    int prefix;            // the last term is a prefix
+} QNode;
+
+static void qnode_free(QNode *q) {
+    if (!q) return;
+    qnode_free(q->a);
+    qnode_free(q->b);
+    for (size_t i = 0; i < q->nterms; ++i) free(q->terms[i]);
+    free(q->terms);
+    free(q->lens);
+    free(q->hashes);
+    free(q);
+}
+
+typedef struct {
+    const char *p;
+    Tokenizer *tok;
+    char *err;  // sqlite3_mprintf'd
+} Parser;
+
+static int is_bare(unsigned char c) {
+    return c >= 0x80 || isalnum((int)c) || c == '_' || c == 0x1A;
+}
+
+static void skip_ws(Parser *ps) {
+    while (*ps->p && isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static int at_keyword(Parser *ps, const char *kw) {
+    size_t n = strlen(kw);
+    return strncmp(ps->p, kw, n) == 0 && !is_bare((unsigned char)ps->p[n]);
+}
+
+static QNode *qnode_new(QKind kind, QNode *a, QNode *b) {
+    QNode *q = calloc(1, sizeof(*q));
+    if (!q) {
+        qnode_free(a);
+        qnode_free(b);
+        return NULL;
+    }
+    q->kind = kind;
+    q->a = a;
+    q->b = b;
+    return q;
+}
+
+static int add_term(void *ctx, int flags, const char *token, int n, int start, int end) {
+    (void)flags;
+    (void)start;
+    (void)end;
+    QNode *q = ctx;
+    char **terms = realloc(q->terms, sizeof(*terms) * (q->nterms + 1));
+    if (terms) q->terms = terms;
+    size_t *lens = realloc(q->lens, sizeof(*lens) * (q->nterms + 1));
+    if (lens) q->lens = lens;
+    uint64_t *hashes = realloc(q->hashes, sizeof(*hashes) * (q->nterms + 1));
+    if (hashes) q->hashes = hashes;
+    char *term = malloc(n ? (size_t)n : 1);
+    if (!terms || !lens || !hashes || !term) {
+        free(term);
+        return SQLITE_NOMEM;
+    }
+    memcpy(term, token, (size_t)n);
+    q->terms[q->nterms] = term;
+    q->lens[q->nterms] = (size_t)n;
+    q->hashes[q->nterms] = token_hash(token, (size_t)n);
+    q->nterms++;
+    return SQLITE_OK;
+}
+
+// Append the tokens of text[0..len) to a phrase.
+static int phrase_add(Parser *ps, QNode *q, const char *text, size_t len) {
+    return tokenize(ps->tok, FTS5_TOKENIZE_QUERY, text, len, add_term, q);
+}
+
+static QNode *parse_or(Parser *ps);
+
+// One string or bareword, e.g. "disk full" or kernel*.
+static int parse_string(Parser *ps, QNode *q) {
+    if (*ps->p == '"') {
+        const char *s = ++ps->p;
+        // "" inside a string is a literal quote, which the tokenizer drops anyway
+        while (*ps->p && !(ps->p[0] == '"' && ps->p[1] != '"')) ps->p += ps->p[0] == '"' ? 2 : 1;
+        if (!*ps->p) {
+            ps->err = sqlite3_mprintf("unterminated string in query");
+            return -1;
+        }
+        int rc = phrase_add(ps, q, s, (size_t)(ps->p - s));
+        ps->p++;
+        return rc;
+    }
+    const char *s = ps->p;
+    while (is_bare((unsigned char)*ps->p)) ps->p++;
+    if (*ps->p == ':' || (*ps->p == '(' && ps->p - s == 4 && strncmp(s, "NEAR", 4) == 0)) {
+        ps->err = sqlite3_mprintf("NEAR and column filters are not supported on archived rows");
+        return -1;
+    }
+    return phrase_add(ps, q, s, (size_t)(ps->p - s));
+}
+
+static QNode *parse_primary(Parser *ps) {
+    skip_ws(ps);
+    unsigned char c = (unsigned char)*ps->p;
+    if (c == '(') {
+        ps->p++;
+        QNode *q = parse_or(ps);
+        skip_ws(ps);
+        if (q && *ps->p != ')') {
+            qnode_free(q);
+            if (!ps->err) ps->err = sqlite3_mprintf("missing ) in query");
+            return NULL;
+        }
+        ps->p++;
+        return q;
+    }
+    if (c != '"' && (!is_bare(c) || at_keyword(ps, "AND") || at_keyword(ps, "OR") || at_keyword(ps, "NOT"))) {
+        ps->err = c == '^' || c == '{' ? sqlite3_mprintf("^ and column filters are not supported on archived rows")
+                                       : sqlite3_mprintf("syntax error in query near \"%.16s\"", ps->p);
+        return NULL;
+    }
+    QNode *q = qnode_new(Q_PHRASE, NULL, NULL);
+    if (!q) return NULL;
+    for (;;) {
+        if (parse_string(ps, q) != 0) {
+            qnode_free(q);
+            if (!ps->err) ps->err = sqlite3_mprintf("out of memory");
+            return NULL;
+        }
+        if (*ps->p == '*') {
+            q->prefix = 1;
+            ps->p++;
+        }
+        skip_ws(ps);
+        // "a" + "b" is one phrase
+        if (*ps->p != '+' || q->prefix) break;
+        ps->p++;
+        skip_ws(ps);
+    }
+    return q;
+}
+
+// NOT binds tighter than AND, AND tighter than OR, as in FTS5.
+static QNode *parse_not(Parser *ps) {
+    QNode *q = parse_primary(ps);
+    for (;;) {
+        skip_ws(ps);
+        if (!q || !at_keyword(ps, "NOT")) return q;
+        ps->p += 3;
+        QNode *rhs = parse_primary(ps);
+        if (!rhs) {
+            qnode_free(q);
+            return NULL;
+        }
+        q = qnode_new(Q_NOT, q, rhs);
+    }
+}
+
+static QNode *parse_and(Parser *ps) {
+    QNode *q = parse_not(ps);
+    for (;;) {
+        skip_ws(ps);
+        if (!q || !*ps->p || *ps->p == ')' || at_keyword(ps, "OR")) return q;
+        if (at_keyword(ps, "AND")) ps->p += 3;  // else implicit AND
+        QNode *rhs = parse_not(ps);
+        if (!rhs) {
+            qnode_free(q);
+            return NULL;
+        }
+        q = qnode_new(Q_AND, q, rhs);
+    }
+}
+
+static QNode *parse_or(Parser *ps) {
+    QNode *q = parse_and(ps);
+    for (;;) {
+        skip_ws(ps);
+        if (!q || !at_keyword(ps, "OR")) return q;
+        ps->p += 2;
+        QNode *rhs = parse_and(ps);
+        if (!rhs) {
+            qnode_free(q);
+            return NULL;
+        }
+        q = qnode_new(Q_OR, q, rhs);
+    }
+}
+
+static QNode *query_parse(const char *text, Tokenizer *tok, char **err) {
+    Parser ps = { text, tok, NULL };
+    QNode *q = parse_or(&ps);
+    skip_ws(&ps);
+    if (q && *ps.p) {
+        qnode_free(q);
+        q = NULL;
+        ps.err = sqlite3_mprintf("syntax error in query near \"%.16s\"", ps.p);
+    }
+    if (!q && !ps.err) ps.err = sqlite3_mprintf("out of memory");
+    *err = ps.err;
+    return q;
+}
+
+// Whether the block can hold a match, from its bloom filter. Prefixes and NOT operands cannot rule it out.
+static int query_maybe(const QNode *q, const BlockMeta *b) {
+    switch (q->kind) {
+    case Q_PHRASE:
+        if (q->nterms == 0) return 0;
+        for (size_t i = 0; i < q->nterms; ++i) {
+            if (q->prefix && i == q->nterms - 1) break;
+            if (!bloom_has(b->bloom, b->bloom_bits, q->hashes[i])) return 0;
+        }
+        return 1;
+    case Q_AND: return query_maybe(q->a, b) && query_maybe(q->b, b);
+    case Q_OR: return query_maybe(q->a, b) || query_maybe(q->b, b);
+    case Q_NOT: return query_maybe(q->a, b);
+    }
+    return 1;
+}
+
+// Folded tokens of one message.
+typedef struct {
+    char *text;
+    size_t len, cap;
+    size_t *start, *size;
+    size_t n, ncap;
+} Tokens;
+
+static int add_token(void *ctx, int flags, const char *token, int n, int start, int end) {
+    (void)flags;
+    (void)start;
+    (void)end;
+    Tokens *t = ctx;
+    if (t->len + (size_t)n > t->cap) {
+        size_t cap = t->cap ? t->cap : 1024;
+        while (cap < t->len + (size_t)n) cap *= 2;
+        char *text = realloc(t->text, cap);
+        if (!text) return SQLITE_NOMEM;
+        t->text = text;
+        t->cap = cap;
+    }
+    if (t->n == t->ncap) {
+        size_t cap = t->ncap ? t->ncap * 2 : 64;
+        size_t *starts = realloc(t->start, sizeof(*starts) * cap);
+        if (starts) t->start = starts;
+        size_t *sizes = realloc(t->size, sizeof(*sizes) * cap);
+        if (sizes) t->size = sizes;
+        if (!starts || !sizes) return SQLITE_NOMEM;
+        t->ncap = cap;
+    }
+    memcpy(t->text + t->len, token, (size_t)n);
+    t->start[t->n] = t->len;
+    t->size[t->n++] = (size_t)n;
+    t->len += (size_t)n;
+    return SQLITE_OK;
+}
+
+static int tokens_fill(Tokens *t, Tokenizer *tok, const char *msg, size_t len) {
+    t->len = t->n = 0;
+    return tokenize(tok, FTS5_TOKENIZE_DOCUMENT, msg, len, add_token, t);
+}
+
+static int term_matches(const QNode *q, size_t k, const Tokens *t, size_t i) {
+    if (q->prefix && k == q->nterms - 1)
+        return t->size[i] >= q->lens[k] && memcmp(t->text + t->start[i], q->terms[k], q->lens[k]) == 0;
+    return t->size[i] == q->lens[k] && memcmp(t->text + t->start[i], q->terms[k], q->lens[k]) == 0;
+}
+
+static int query_match(const QNode *q, const Tokens *t) {
+    switch (q->kind) {
+    case Q_PHRASE:
+        if (q->nterms == 0 || q->nterms > t->n) return 0;
+        for (size_t i = 0; i + q->nterms <= t->n; ++i) {
+            size_t k = 0;
+            while (k < q->nterms && term_matches(q, k, t, i + k)) k++;
+            if (k == q->nterms) return 1;
+        }
+        return 0;
+    case Q_AND: return query_match(q->a, t) && query_match(q->b, t);
+    case Q_OR: return query_match(q->a, t) || query_match(q->b, t);
+    case Q_NOT: return query_match(q->a, t) && !query_match(q->b, t);
+    }
+    return 0;
+}
+
+/* ---- the virtual table ---- */
+
+enum { COL_ID, COL_SOURCE, COL_UNIT, COL_TS, COL_MESSAGE, COL_PRI, COL_SEVERITY, COL_QUERY };
+
+typedef struct {
+    int empty;                 // a constraint no row can meet (e.g. against NULL)
+    long long id_lo, id_hi;    // inclusive
+    char *ts_lo, *ts_hi;
+    int ts_lo_strict, ts_hi_strict;
+    char *source, *unit;
+    int sev_lo, sev_hi;        // severity range, inclusive
+    char *query_text;
+    QNode *query;
+} Filter;
+
+static void filter_free(Filter *f) {
+    sqlite3_free(f->ts_lo);
+    sqlite3_free(f->ts_hi);
+    sqlite3_free(f->source);
+    sqlite3_free(f->unit);
+    sqlite3_free(f->query_text);
+    qnode_free(f->query);
+    memset(f, 0, sizeof(*f));
+}
+
+static int ts_in_range(const Filter *f, const char *ts, size_t len) {
+    if (f->ts_lo) {
+        int c = key_cmp(ts, len, 0, f->ts_lo, strlen(f->ts_lo), 0);
+        if (c < 0 || (c == 0 && f->ts_lo_strict)) return 0;
+    }
+    if (f->ts_hi) {
+        int c = key_cmp(ts, len, 0, f->ts_hi, strlen(f->ts_hi), 0);
+        if (c > 0 || (c == 0 && f->ts_hi_strict)) return 0;
+    }
+    return 1;
+}
+
+static long dict_find(char **names, uint16_t n, const char *name) {
+    for (uint16_t i = 0; i < n; ++i)
+        if (strcmp(names[i], name) == 0) return i;
+    return -1;
+}
+
+static int block_may_match(const BlockMeta *b, const Filter *f) {
+    if (b->all_dropped || b->max_id < f->id_lo || b->min_id > f->id_hi) return 0;
+    if (f->ts_lo) {
+        int c = strcmp(b->max_ts, f->ts_lo);
+        if (c < 0 || (c == 0 && f->ts_lo_strict)) return 0;
+    }
+    if (f->ts_hi) {
+        int c = strcmp(b->min_ts, f->ts_hi);
+        if (c > 0 || (c == 0 && f->ts_hi_strict)) return 0;
+    }
+    if (f->sev_lo > 0 || f->sev_hi < 7) {
+        unsigned want = 0;
+        for (int s = f->sev_lo; s <= f->sev_hi; ++s) want |= 1u << s;
+        if (!(b->sev_mask & want)) return 0;
+    }
+    if (f->source && dict_find(b->sources, b->nsources, f->source) < 0) return 0;
+    if (f->unit && dict_find(b->units, b->nunits, f->unit) < 0) return 0;
+    return !f->query || query_maybe(f->query, b);
+}
+
+// A decompressed block, freed once its last matching row has been returned.
+typedef struct {
+    unsigned char *data;
+    size_t refs;
+} Decoded;
+
+typedef struct {
+    long long id;
+    const char *ts, *msg;
+    size_t ts_len, msg_len;
+    const char *source, *unit;
+    int pri;
+    Decoded *blk;
+} Row;
+
+// Decompression and matching of one block, run on a scan thread.
+typedef struct {
+    const BlockMeta *b;
+    const Filter *f;
+    Tokenizer *tok;
+    Row *rows;
+    size_t n;
+    Decoded *blk;
+    int err;
+} Job;
+
+static void job_run(Job *j) {
+    const BlockMeta *b = j->b;
+    const Filter *f = j->f;
+    unsigned char *c = malloc(b->clen ? b->clen : 1);
+    unsigned char *data = malloc(b->ulen ? b->ulen : 1);
+    uLongf ulen = b->ulen;
+    j->rows = malloc(sizeof(*j->rows) * (b->nrows ? b->nrows : 1));
+    if (!c || !data || !j->rows || pread(b->seg->fd, c, b->clen, (off_t)b->offset) != (ssize_t)b->clen ||
+        uncompress(data, &ulen, c, b->clen) != Z_OK || ulen != b->ulen) {
+        free(c);
+        free(data);
+        j->err = 1;
+        return;
+    }
+    free(c);
+    long src = f->source ? dict_find(b->sources, b->nsources, f->source) : -1;
+    long unit = f->unit ? dict_find(b->units, b->nunits, f->unit) : -1;
+    Tokens tokens = {0};
+    Reader r = { data, data + ulen, 0 };
+    for (uint32_t i = 0; i < b->nrows && !r.bad; ++i) {
+        Row row;
+        row.id = (long long)rd_uint(&r, 8);
+        uint16_t si = (uint16_t)rd_uint(&r, 2), ui = (uint16_t)rd_uint(&r, 2);
+        row.pri = (int16_t)rd_uint(&r, 2);
+        row.ts_len = (size_t)rd_uint(&r, 2);
+        row.ts = rd_bytes(&r, row.ts_len);
+        row.msg_len = (size_t)rd_uint(&r, 4);
+        row.msg = rd_bytes(&r, row.msg_len);
+        if (r.bad || si >= b->nsources || ui >= b->nunits) {
+            r.bad = 1;
+            break;
+        }
+        row.source = b->sources[si];
+        row.unit = b->units[ui];
+        if (row.id < f->id_lo || row.id > f->id_hi || (f->source && si != src) || (f->unit && ui != unit) ||
+            (b->dropped_to && row.id <= b->dropped_to[si]) || !ts_in_range(f, row.ts, row.ts_len))
+            continue;
+        if (f->sev_lo > 0 || f->sev_hi < 7) {
+            if (row.pri < 0 || (row.pri & 7) < f->sev_lo || (row.pri & 7) > f->sev_hi) continue;
+        }
+        if (f->query) {
+            if (tokens_fill(&tokens, j->tok, row.msg, row.msg_len) != 0) {
+                r.bad = 1;
+                break;
+            }
+            if (!query_match(f->query, &tokens)) continue;
+        }
+        j->rows[j->n++] = row;
+    }
+    free(tokens.text);
+    free(tokens.start);
+    free(tokens.size);
+    if (!r.bad && j->n > 0 && (j->blk = malloc(sizeof(*j->blk)))) {
+        j->blk->data = data;
+        j->blk->refs = j->n;
+        for (size_t i = 0; i < j->n; ++i) j->rows[i].blk = j->blk;
+        return;
+    }
+    j->err = r.bad || j->n > 0;
+    j->n = 0;
+    free(data);
+}
+
+static void *job_thread(void *arg) {
+    job_run(arg);
+    return NULL;
+}
+
+typedef struct {
+    sqlite3_vtab base;
+    sqlite3 *db;
+    Archive *ar;
+} ArchiveTab;
+
+typedef struct {
+    sqlite3_vtab_cursor base;
+    Snapshot *snap;
+    Filter f;
+    const BlockMeta **cand;  // blocks that may match, newest first
+    size_t ncand, next;
+    Row *heap;               // decoded matches, newest on top
+    size_t nheap, heap_cap;
+    int ordered;             // rows must come newest first
+    int eof;
+    Tokenizer tok[ARCHIVE_SCAN_THREADS];  // one per scan thread, opened for the first query
+} Cursor;
+
+static int row_newer(const Row *a, const Row *b) {
+    return key_cmp(a->ts, a->ts_len, a->id, b->ts, b->ts_len, b->id) > 0;
+}
+
+static void heap_push(Cursor *c, Row r) {
+    size_t i = c->nheap++;
+    c->heap[i] = r;
+    while (i > 0 && row_newer(&c->heap[i], &c->heap[(i - 1) / 2])) {
+        Row t = c->heap[i];
+        c->heap[i] = c->heap[(i - 1) / 2];
+        c->heap[(i - 1) / 2] = t;
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_pop(Cursor *c) {
+    Decoded *blk = c->heap[0].blk;
+    if (--blk->refs == 0) {
+        free(blk->data);
+        free(blk);
+    }
+    c->heap[0] = c->heap[--c->nheap];
+    size_t i = 0;
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < c->nheap && row_newer(&c->heap[l], &c->heap[m])) m = l;
+        if (r < c->nheap && row_newer(&c->heap[r], &c->heap[m])) m = r;
+        if (m == i) break;
+        Row t = c->heap[i];
+        c->heap[i] = c->heap[m];
+        c->heap[m] = t;
+        i = m;
+    }
+}
+
+// Decompress and match the next ARCHIVE_SCAN_THREADS candidate blocks in parallel.
+static int cursor_decode(Cursor *c) {
+    Job jobs[ARCHIVE_SCAN_THREADS];
+    pthread_t threads[ARCHIVE_SCAN_THREADS];
+    int started[ARCHIVE_SCAN_THREADS] = {0};
+    size_t k = c->ncand - c->next < ARCHIVE_SCAN_THREADS ? c->ncand - c->next : ARCHIVE_SCAN_THREADS;
+    for (size_t i = 0; i < k; ++i) jobs[i] = (Job){ c->cand[c->next + i], &c->f, &c->tok[i], NULL, 0, NULL, 0 };
+    c->next += k;
+    for (size_t i = 1; i < k; ++i) started[i] = pthread_create(&threads[i], NULL, job_thread, &jobs[i]) == 0;
+    for (size_t i = 0; i < k; ++i) {
+        if (i == 0 || !started[i]) job_run(&jobs[i]);
+        else pthread_join(threads[i], NULL);
+    }
+    int err = 0;
+    size_t more = 0;
+    for (size_t i = 0; i < k; ++i) {
+        err |= jobs[i].err;
+        more += jobs[i].n;
+    }
+    if (!err && c->nheap + more > c->heap_cap) {
+        size_t cap = c->heap_cap ? c->heap_cap : 1024;
+        while (cap < c->nheap + more) cap *= 2;
+        Row *heap = realloc(c->heap, sizeof(*heap) * cap);
+        if (heap) {
+            c->heap = heap;
+            c->heap_cap = cap;
+        } else {
+            err = 1;
+        }
+    }
+    for (size_t i = 0; i < k; ++i) {
+        for (size_t j = 0; j < jobs[i].n; ++j) {
+            if (!err) {
+                heap_push(c, jobs[i].rows[j]);
+            } else if (--jobs[i].blk->refs == 0) {
+                free(jobs[i].blk->data);
+                free(jobs[i].blk);
+            }
+        }
+        free(jobs[i].rows);
+    }
+    return err ? -1 : 0;
+}
+
+/* Put the next row on top of the heap: decode further blocks while the
+ * next one could hold a row newer than the best decoded so far (or, for
+ * unordered scans, while nothing is decoded). */
+static int cursor_fill(Cursor *c) {
+    while (c->next < c->ncand) {
+        const BlockMeta *b = c->cand[c->next];
+        if (c->nheap > 0 && (!c->ordered || key_cmp(b->max_ts, strlen(b->max_ts), b->max_id, c->heap[0].ts,
+                                                    c->heap[0].ts_len, c->heap[0].id) < 0))
+            break;
+        if (cursor_decode(c) != 0) return -1;
+    }
+    c->eof = c->nheap == 0;
+    return 0;
+}
+
+static void cursor_reset(Cursor *c) {
+    while (c->nheap > 0) heap_pop(c);
+    filter_free(&c->f);
+    free(c->cand);
+    c->cand = NULL;
+    c->ncand = c->next = 0;
+    snapshot_unref(c->snap);
+    c->snap = NULL;
+    c->eof = 1;
+}
+
+static int av_connect(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **out, char **err) {
+    (void)argc;
+    (void)argv;
+    (void)err;
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(id INTEGER, source TEXT, unit TEXT, ts TEXT, message TEXT,"
+                                      " pri INTEGER, severity INTEGER, query HIDDEN)");
+    if (rc != SQLITE_OK) return rc;
+    ArchiveTab *t = sqlite3_malloc(sizeof(*t));
+    if (!t) return SQLITE_NOMEM;
+    memset(t, 0, sizeof(*t));
+    t->db = db;
+    t->ar = aux;
+    *out = &t->base;
+    return SQLITE_OK;
+}
+
+static int av_disconnect(sqlite3_vtab *tab) {
+    sqlite3_free(tab);
+    return SQLITE_OK;
+}
+
+/* idxStr lists the constraints passed to xFilter, two characters each:
+ * the column ('0' + COL_*) and the operator (e, g, G, l, L for =, >, >=,
+ * <, <=). idxNum is 1 when rows must come newest first. */
+static int av_best_index(sqlite3_vtab *tab, sqlite3_index_info *info) {
+    (void)tab;
+    char codes[64];
+    int n = 0, argv = 0;
+    double cost = 1e9;
+    for (int i = 0; i < info->nConstraint && n + 2 < (int)sizeof(codes); ++i) {
+        const struct sqlite3_index_constraint *c = &info->aConstraint[i];
+        if (!c->usable) continue;
+        char op;
+        switch (c->op) {
+        case SQLITE_INDEX_CONSTRAINT_EQ: op = 'e'; break;
+        case SQLITE_INDEX_CONSTRAINT_GT: op = 'g'; break;
+        case SQLITE_INDEX_CONSTRAINT_GE: op = 'G'; break;
+        case SQLITE_INDEX_CONSTRAINT_LT: op = 'l'; break;
+        case SQLITE_INDEX_CONSTRAINT_LE: op = 'L'; break;
+        default: continue;
+        }
+        int col = c->iColumn;
+        if (col == COL_SOURCE || col == COL_UNIT || col == COL_QUERY) {
+            if (op != 'e') continue;
+        } else if (col == COL_SEVERITY) {
+            if (op == 'g' || op == 'G') continue;
+        } else if (col != COL_ID && col != COL_TS) {
+            continue;
+        }
+        codes[n++] = (char)('0' + col);
+        codes[n++] = op;
+        info->aConstraintUsage[i].argvIndex = ++argv;
+        // the query column holds no value to check against
+        info->aConstraintUsage[i].omit = col == COL_QUERY;
+        cost /= col == COL_QUERY || (col == COL_ID && op == 'e') ? 100 : 4;
+    }
+    codes[n] = '\0';
+    info->idxStr = sqlite3_mprintf("%s", codes);
+    info->needToFreeIdxStr = 1;
+    info->idxNum = 0;
+    if (info->nOrderBy >= 1 && info->aOrderBy[0].iColumn == COL_TS && info->aOrderBy[0].desc &&
+        (info->nOrderBy == 1 || (info->nOrderBy == 2 && info->aOrderBy[1].iColumn == COL_ID && info->aOrderBy[1].desc))) {
+        info->orderByConsumed = 1;
+        info->idxNum = 1;
+    }
+    info->estimatedCost = cost;
+    return info->idxStr ? SQLITE_OK : SQLITE_NOMEM;
+}
+
+static int av_open(sqlite3_vtab *tab, sqlite3_vtab_cursor **out) {
+    (void)tab;
+    Cursor *c = calloc(1, sizeof(*c));
+    if (!c) return SQLITE_NOMEM;
+    c->eof = 1;
+    *out = &c->base;
+    return SQLITE_OK;
+}
+
+static int av_close(sqlite3_vtab_cursor *cur) {
+    Cursor *c = (Cursor*)cur;
+    cursor_reset(c);
+    for (int i = 0; i < ARCHIVE_SCAN_THREADS; ++i) tokenizer_close(&c->tok[i]);
+    free(c->heap);
+    free(c);
+    return SQLITE_OK;
+}
+
+static void tighten_ts(char **bound, int *strict, sqlite3_value *v, int is_strict, int lower) {
+    const char *s = (const char*)sqlite3_value_text(v);
+    if (!s) return;
+    int c = *bound ? strcmp(s, *bound) : 0;
+    if (*bound && (lower ? c < 0 : c > 0)) return;
+    if (*bound && c == 0 && !is_strict) return;
+    sqlite3_free(*bound);
+    *bound = sqlite3_mprintf("%s", s);
+    *strict = is_strict;
+}
+
+static int av_filter(sqlite3_vtab_cursor *cur, int idx_num, const char *idx_str, int argc, sqlite3_value **argv) {
+    Cursor *c = (Cursor*)cur;
+    ArchiveTab *t = (ArchiveTab*)cur->pVtab;
+    cursor_reset(c);
+    Filter *f = &c->f;
+    f->id_lo = INT64_MIN;
+    f->id_hi = INT64_MAX;
+    f->sev_lo = 0;
+    f->sev_hi = 7;
+    c->ordered = idx_num & 1;
+    for (int i = 0; i < argc && idx_str[2 * i]; ++i) {
+        int col = idx_str[2 * i] - '0';
+        char op = idx_str[2 * i + 1];
+        sqlite3_value *v = argv[i];
+        if (sqlite3_value_type(v) == SQLITE_NULL) {
+            f->empty = 1;
+            continue;
+        }
+        if (col == COL_ID || col == COL_SEVERITY) {
+            long long x = sqlite3_value_int64(v);
+            long long *lo = col == COL_ID ? &f->id_lo : NULL, *hi = col == COL_ID ? &f->id_hi : NULL;
+            long long lo_v = op == 'e' || op == 'G' ? x : op == 'g' ? x + 1 : INT64_MIN;
+            long long hi_v = op == 'e' || op == 'L' ? x : op == 'l' ? x - 1 : INT64_MAX;
+            if (col == COL_ID) {
+                if (lo_v > *lo) *lo = lo_v;
+                if (hi_v < *hi) *hi = hi_v;
+            } else {
+                if (lo_v > f->sev_lo) f->sev_lo = lo_v > 7 ? 8 : (int)lo_v;
+                if (hi_v < f->sev_hi) f->sev_hi = hi_v < 0 ? -1 : (int)hi_v;
+            }
+        } else if (col == COL_TS) {
+            if (op != 'l' && op != 'L') tighten_ts(&f->ts_lo, &f->ts_lo_strict, v, op == 'g', 1);
+            if (op != 'g' && op != 'G') tighten_ts(&f->ts_hi, &f->ts_hi_strict, v, op == 'l', 0);
+        } else if (col == COL_SOURCE || col == COL_UNIT) {
+            char **dst = col == COL_SOURCE ? &f->source : &f->unit;
+            const char *s = (const char*)sqlite3_value_text(v);
+            if (*dst && strcmp(*dst, s ? s : "") != 0) f->empty = 1;
+            sqlite3_free(*dst);
+            *dst = sqlite3_mprintf("%s", s ? s : "");
+        } else if (col == COL_QUERY) {
+            const char *s = (const char*)sqlite3_value_text(v);
+            if (f->query || !s || !*s) continue;
+            for (int k = 0; k < ARCHIVE_SCAN_THREADS; ++k) {
+                if (!c->tok[k].tok && tokenizer_open(&c->tok[k], t->ar->fts) != 0) {
+                    sqlite3_free(t->base.zErrMsg);
+                    t->base.zErrMsg = sqlite3_mprintf("archive: FTS5 unicode61 tokenizer not available");
+                    return SQLITE_ERROR;
+                }
+            }
+            char *err = NULL;
+            f->query_text = sqlite3_mprintf("%s", s);
+            if (!(f->query = query_parse(s, &c->tok[0], &err))) {
+                sqlite3_free(t->base.zErrMsg);
+                t->base.zErrMsg = err;
+                return SQLITE_ERROR;
+            }
+        }
+    }
+    if (f->id_lo > f->id_hi || f->sev_lo > f->sev_hi) f->empty = 1;
+    if (archive_refresh(t->ar, t->db) != 0) return SQLITE_NOMEM;
+    c->snap = t->ar->snap;
+    c->snap->refs++;
+    if (f->empty) return SQLITE_OK;
+    c->cand = malloc(sizeof(*c->cand) * (c->snap->nblocks ? c->snap->nblocks : 1));
+    if (!c->cand) return SQLITE_NOMEM;
+    for (size_t i = 0; i < c->snap->nblocks; ++i)
+        if (block_may_match(c->snap->order[i], f)) c->cand[c->ncand++] = c->snap->order[i];
+    if (cursor_fill(c) != 0) {
+        sqlite3_free(t->base.zErrMsg);
+        t->base.zErrMsg = sqlite3_mprintf("archive: cannot read a block of a segment in %s", t->ar->dir);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+static int av_next(sqlite3_vtab_cursor *cur) {
+    Cursor *c = (Cursor*)cur;
+    if (c->nheap > 0) heap_pop(c);
+    if (cursor_fill(c) != 0) {
+        ArchiveTab *t = (ArchiveTab*)cur->pVtab;
+        sqlite3_free(t->base.zErrMsg);
+        t->base.zErrMsg = sqlite3_mprintf("archive: cannot read a block of a segment in %s", t->ar->dir);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+static int av_eof(sqlite3_vtab_cursor *cur) {
+    return ((Cursor*)cur)->eof;
+}
+
+static int av_column(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int col) {
+    Cursor *c = (Cursor*)cur;
+    const Row *r = &c->heap[0];
+    switch (col) {
+    case COL_ID: sqlite3_result_int64(ctx, r->id); break;
+    case COL_SOURCE: sqlite3_result_text(ctx, r->source, -1, SQLITE_TRANSIENT); break;
+    case COL_UNIT: sqlite3_result_text(ctx, r->unit, -1, SQLITE_TRANSIENT); break;
+    case COL_TS: sqlite3_result_text(ctx, r->ts, (int)r->ts_len, SQLITE_TRANSIENT); break;
+    case COL_MESSAGE: sqlite3_result_text64(ctx, r->msg, r->msg_len, SQLITE_TRANSIENT, SQLITE_UTF8); break;
+    case COL_PRI:
+        if (r->pri < 0) sqlite3_result_null(ctx);
+        else sqlite3_result_int(ctx, r->pri);
+        break;
+    case COL_SEVERITY:
+        if (r->pri < 0) sqlite3_result_null(ctx);
+        else sqlite3_result_int(ctx, r->pri & 7);
+        break;
+    case COL_QUERY:
+        if (c->f.query_text) sqlite3_result_text(ctx, c->f.query_text, -1, SQLITE_TRANSIENT);
+        else sqlite3_result_null(ctx);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int av_rowid(sqlite3_vtab_cursor *cur, sqlite_int64 *out) {
+    *out = ((Cursor*)cur)->heap[0].id;
+    return SQLITE_OK;
+}
+
+static sqlite3_module archive_module = {
+    .iVersion = 0,
+    .xCreate = NULL,  // eponymous only
+    .xConnect = av_connect,
+    .xBestIndex = av_best_index,
+    .xDisconnect = av_disconnect,
+    .xDestroy = av_disconnect,
+    .xOpen = av_open,
+    .xClose = av_close,
+    .xFilter = av_filter,
+    .xNext = av_next,
+    .xEof = av_eof,
+    .xColumn = av_column,
+    .xRowid = av_rowid,
+};
+
+int archive_dir(sqlite3 *db, char *buf, size_t n) {
+    const char *env = getenv("LOG_EXPLORER_ARCHIVE_DIR");
+    if (env && *env) {
+        snprintf(buf, n, "%s", env);
+        return 0;
+    }
+    const char *file = sqlite3_db_filename(db, "main");
+    if (!file || !*file) return -1;
+    snprintf(buf, n, "%s.archive", file);
+    return 0;
+}
+
+static void archive_free(void *p) {
+    Archive *ar = p;
+    snapshot_unref(ar->snap);
+    free(ar);
+}
+
+int archive_register(sqlite3 *db) {
+    Archive *ar = calloc(1, sizeof(*ar));
+    if (!ar) return -1;
+    if (archive_dir(db, ar->dir, sizeof(ar->dir)) != 0) snprintf(ar->dir, sizeof(ar->dir), ".");
+    ar->fts = fts5_api_of(db);
+    // on failure SQLite has already called archive_free
+    return sqlite3_create_module_v2(db, "archive", &archive_module, ar, archive_free) == SQLITE_OK ? 0 : -1;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <stddef.h>
+#include "db.h"
+
+/* Archive tier: old rows moved out of the logs table (db_archive) into
+ * immutable, compressed segment files, which searches still cover.
+ *
+ * A segment holds rows sorted by ts in zlib-compressed blocks of about
+ * ARCHIVE_BLOCK_BYTES, followed by an index with one entry per block: its
+ * id and ts range, the severities that occur in it, its source and unit
+ * dictionaries (rows refer to them by number) and a bloom filter of the
+ * tokens of its messages. A search reads the index only, and decompresses
+ * a block only when nothing in its entry rules it out.
+ *
+ * Segments are searched through the "archive" virtual table, which
+ * db_search_ex and db_count add to their queries while archive_segments
+ * has rows. It is eponymous (there is no CREATE VIRTUAL TABLE), so every
+ * connection registered with archive_register has it:
+ *
+ *     archive(id, source, unit, ts, message, pri, severity, query HIDDEN)
+ *
+ * severity is pri & 7. Constraints on id, ts, source, unit and severity
+ * skip blocks; query = 'expr' takes an FTS5 expression (terms, "phrases",
+ * prefix*, AND/OR/NOT, parentheses) and skips blocks whose bloom filter
+ * lacks a required term. Rows come newest first (ts DESC, id DESC), so a
+ * LIMIT stops decompressing early; blocks are decompressed and matched
+ * ARCHIVE_SCAN_THREADS at a time in parallel.
+ *
+ * Segments are never rewritten: rows of a source dropped after they were
+ * archived (db_drop_source) are listed in archive_dropped by source name
+ * and highest id, and the table leaves them out.
+ *
+ * Tokens come from the same unicode61 tokenizer as logs_fts, so case and
+ * diacritics fold as they do there. NEAR, column filters and ^ are not
+ * supported on archived rows. */
+
+#define ARCHIVE_BLOCK_BYTES (256 * 1024)  // uncompressed rows per block, about
+#define ARCHIVE_BLOCK_ROWS 4096
+#define ARCHIVE_SEGMENT_ROWS 250000       // rows per segment, and per db_archive transaction
+#define ARCHIVE_SCAN_THREADS 4
+
+typedef struct {
+    long long rows, blocks;
+    long long min_id, max_id;
+    char min_ts[64], max_ts[64];
+    long long raw_bytes;   // rows before compression
+    long long file_bytes;  // the segment file, index included
+} ArchiveSegmentInfo;
+
+typedef struct ArchiveWriter ArchiveWriter;
+
+/* Start a segment in dir (under a temporary name until archive_writer_finish);
+ * db provides the FTS5 tokenizer. Returns NULL on error. */
+ArchiveWriter *archive_writer_open(sqlite3 *db, const char *dir);
+// Add a row; rows should come in ts order so blocks cover narrow ranges. Returns 0 or -1.
+int archive_writer_add(ArchiveWriter *w, long long id, const LogRecord *rec);
+/* Write the last block and the index, sync, and rename the file to path.
+ * Fills info. On failure the temporary file is removed; either way w is freed. */
+int archive_writer_finish(ArchiveWriter *w, const char *path, ArchiveSegmentInfo *info);
+void archive_writer_abort(ArchiveWriter *w);
+
+// Directory of the segments of db's main database: LOG_EXPLORER_ARCHIVE_DIR, or "<database file>.archive".
+int archive_dir(sqlite3 *db, char *buf, size_t n);
+// Register the archive virtual table on a connection. Called by db_open and db_open_readonly.
+int archive_register(sqlite3 *db);
@@ -0,0 +1,701 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "db.h"
+#include "metrics.h"
+#include "export.h"
+#include "import.h"
+#include "ingest.h"
+#include "syslog.h"
+#include "multidb.h"
+#include "topk.h"
+#include "saved.h"
+#include "notify.h"
+
+/* Headless front-end for servers without a display. Results are written
+ * straight from the statement's column buffers to stdout, so memory use
+ * does not grow with the size of the result set. */
+
+typedef enum { OUT_TEXT, OUT_NDJSON, OUT_CSV } OutputFormat;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static void usage(FILE *out) {
+    fprintf(out,
+        "Usage: log-explorer-cli [options] [QUERY]\n"
+        "\n"
+        "Search the log database. QUERY is an FTS5 match expression; without it\n"
+        "the most recent logs are listed.\n"
+        "\n"
+        "  -d, --db PATH         database file (default ./log.db); repeat to search several\n"
+        "                        databases at once, read-only, e.g. one per host. Rows are\n"
+        "                        merged newest first and labelled with the file name, or\n"
+        "                        LABEL from LABEL=PATH\n"
+        "      --after CURSOR    with several --db: continue after the cursor printed at\n"
+        "                        the end of the previous page\n"
+        "  -r, --read-only       open an existing database without write access; the\n"
+        "                        default for reading while log-explorer-indexerd runs\n"
+        "  -u, --unit UNIT       only rows from this unit\n"
+        "  -s, --since TS        only rows with ts >= TS\n"
+        "  -U, --until TS        only rows with ts < TS\n"
+        "  -t, --tag TAG         only rows carrying TAG\n"
+        "  -p, --priority LEVEL  only syslog rows at LEVEL or more severe (emerg, alert,\n"
+        "                        crit, err, warning, notice, info, debug, or 0-7)\n"
+        "  -n, --limit N         maximum rows to print (default 100, 0 = no limit)\n"
+        "  -o, --output FORMAT   text (default), ndjson or csv\n"
+        "  -c, --count           print the number of matching rows and exit\n"
+        "      --estimate        print a quick estimate of the number of matching rows\n"
+        "                        (sampled id ranges, milliseconds on large databases)\n"
+        "                        followed by \"estimate\", or \"exact\" if it was cheap\n"
+        "                        enough to count, and exit\n"
+        "  -f, --follow          after the initial results, keep printing new rows\n"
+        "  -i, --interval MS     poll interval for --follow (default 500); with\n"
+        "                        log-explorer-indexerd, new rows are printed as announced\n"
+        "  -e, --export PATH     write all matching rows (no default limit) to PATH in the\n"
+        "                        background, with progress on stderr; .csv selects CSV,\n"
+        "                        .gz/.zst add gzip/zstd compression (see also -o)\n"
+        "      --import FILE     bulk-load FILE (plain or .gz), one row per record, under\n"
+        "                        the source \"import:<file name>\" (see --source)\n"
+        "      --source NAME     source name for --import\n"
+        "      --drop-source NAME  delete every row with this source, e.g. an import\n"
+        "      --archive-before TS move rows older than TS into compressed archive\n"
+        "                        segments (still searched; see the README) and exit\n"
+        "      --syslog-udp ADDR receive syslog on UDP [host:]port (e.g. 5514) into the\n"
+        "                        database until interrupted\n"
+        "      --syslog-tcp ADDR the same over TCP (octet-counted or newline framing);\n"
+        "                        may be combined with --syslog-udp\n"
+        "      --tag-all TAG     add TAG to every row matching QUERY and the filters\n"
+        "                        (--limit does not apply) and print how many were tagged\n"
+        "      --untag-all TAG   remove TAG from every matching row\n"
+        "      --top WHAT        print the loudest units or messages (WHAT: units or\n"
+        "                        messages) of the last few minutes from the sketches the\n"
+        "                        indexer checkpoints, without scanning rows; one line per\n"
+        "                        key: estimated count, possible overcount, key (-n sets\n"
+        "                        how many, default 20)\n"
+        "      --minutes N       time span for --top (default 5, at most 60)\n"
+        "      --save-search NAME  save QUERY and the -u/-t/-p filters as a standing\n"
+        "                        search, evaluated on new rows while ingesting\n"
+        "      --saved-searches  list saved searches: unread matches, name, query\n"
+        "      --delete-search NAME  delete a saved search\n"
+        "      --stats           print metrics and SQLite cache/page statistics in\n"
+        "                        Prometheus text format; with QUERY, the query is run\n"
+        "                        first (output discarded) so its latency is included\n"
+        "      --slow-queries    print the statements of this run that took longer than\n"
+        "                        LOG_EXPLORER_SLOW_QUERY_MS (default 200; 0 for all) with\n"
+        "                        their SQLite counters and query plans; with QUERY, the\n"
+        "                        search (or with -c, the count) is run first\n"
+        "  -h, --help            show this help\n");
+}
+
+/* Write a column without its trailing newline; file lines are stored with
+ * the '\n' read by getline. */
+static void put_text(const unsigned char *s, int len) {
+    while (len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r')) len--;
+    fwrite(s, 1, (size_t)len, stdout);
+}
+
+// host is set for rows merged from several databases.
+static void print_row(sqlite3_stmt *stmt, OutputFormat fmt, const char *host) {
+    if (fmt != OUT_TEXT) {
+        static ExportBuf buf;
+        buf.len = 0;
+        export_append_row_host(&buf, stmt, fmt == OUT_CSV ? EXPORT_CSV : EXPORT_NDJSON, host);
+        fwrite(buf.data, 1, buf.len, stdout);
+        return;
+    }
+    if (host) printf("%s\t", host);
+    long long id = sqlite3_column_int64(stmt, 0);
+    /* id, ts, source, unit, then the message so it can run to end of line */
+    static const int cols[] = { 3, 1, 2 };
+    printf("%lld\t", id);
+    for (size_t i = 0; i < sizeof(cols) / sizeof(cols[0]); ++i) {
+        const unsigned char *v = sqlite3_column_text(stmt, cols[i]);
+        if (v) put_text(v, sqlite3_column_bytes(stmt, cols[i]));
+        putchar('\t');
+    }
+    const unsigned char *msg = sqlite3_column_text(stmt, 4);
+    if (msg) put_text(msg, sqlite3_column_bytes(stmt, 4));
+    putchar('\n');
+}
+
+// Step through stmt, printing every row. Tracks the highest id seen for --follow.
+static long long print_rows(sqlite3_stmt *stmt, OutputFormat fmt, long long max_id) {
+    while (!g_stop && sqlite3_step(stmt) == SQLITE_ROW) {
+        print_row(stmt, fmt, NULL);
+        long long id = sqlite3_column_int64(stmt, 0);
+        if (id > max_id) max_id = id;
+    }
+    sqlite3_finalize(stmt);
+    return max_id;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* --follow: wait until log-explorer-indexerd announces new rows, for
+ * interval_ms at most. Without a daemon, or once it has gone, this is
+ * sleep_ms. */
+static void wait_for_rows(NotifyClient **daemon, int interval_ms) {
+    if (!*daemon) {
+        sleep_ms(interval_ms);
+        return;
+    }
+    struct pollfd pfd = { .fd = notify_client_fd(*daemon), .events = POLLIN };
+    if (poll(&pfd, 1, interval_ms) <= 0) return;
+    long long max_id = 0;
+    if (notify_read(*daemon, &max_id) < 0) {
+        fprintf(stderr, "the indexer daemon went away; polling every %d ms\n", interval_ms);
+        notify_close(*daemon);
+        *daemon = NULL;
+    }
+}
+
+/* --export: run the export job and report progress on stderr until it
+ * finishes or the user interrupts it. */
+static int run_export(DB *db, DBSearchOpts *opts, const char *path, OutputFormat fmt, int limit_set) {
+    ExportFormat efmt;
+    ExportCompression comp;
+    export_guess(path, &efmt, &comp);
+    if (fmt == OUT_CSV) efmt = EXPORT_CSV;
+    else if (fmt == OUT_NDJSON) efmt = EXPORT_NDJSON;
+    if (!export_supported(comp)) {
+        fprintf(stderr, "%s: zstd output is not available in this build\n", path);
+        return 1;
+    }
+    if (!limit_set) opts->limit = 0;
+    ExportJob *job = export_start(db, opts, path, efmt, comp);
+    if (!job) {
+        fprintf(stderr, "cannot start export\n");
+        return 1;
+    }
+    ExportProgress p;
+    int tty = isatty(fileno(stderr));
+    for (;;) {
+        export_poll(job, &p);
+        if (p.state != EXPORT_RUNNING) break;
+        if (g_stop) export_cancel(job);
+        if (tty) fprintf(stderr, "\r%lld rows, %.1f MB written", p.rows, (double)p.out_bytes / (1024.0 * 1024.0));
+        sleep_ms(200);
+    }
+    ExportState state = export_finish(job, &p);
+    if (tty) fputc('\r', stderr);
+    if (state == EXPORT_DONE)
+        fprintf(stderr, "exported %lld rows to %s (%.1f MB)\n", p.rows, path, (double)p.out_bytes / (1024.0 * 1024.0));
+    else if (state == EXPORT_CANCELLED)
+        fprintf(stderr, "export cancelled after %lld rows\n", p.rows);
+    else
+        fprintf(stderr, "export failed: %s\n", p.error);
+    return state == EXPORT_DONE ? 0 : 1;
+}
+
+/* Several --db: one merged page of results, or the summed count. A full
+ * page ends with the cursor for the next one on stderr. */
+static int run_multi(const char *const *paths, size_t n, const DBSearchOpts *opts, OutputFormat fmt,
+                     const char *after_arg, int count_only, int estimate) {
+    MultiDB *m = multidb_open(paths, n);
+    if (!m) return 1;
+    int rc = 0;
+    if (estimate) {
+        long long total = 0;
+        int exact = 0;
+        rc = multidb_count_estimate(m, opts, &total, &exact) == 0 ? 0 : 1;
+        if (rc == 0) printf("%lld\t%s\n", total, exact ? "exact" : "estimate");
+        else fprintf(stderr, "estimate failed\n");
+        multidb_close(m);
+        return rc;
+    }
+    if (count_only) {
+        long long total = 0;
+        rc = multidb_count(m, opts, &total) == 0 ? 0 : 1;
+        if (rc == 0) printf("%lld\n", total);
+        else fprintf(stderr, "count failed\n");
+        multidb_close(m);
+        return rc;
+    }
+    MultiCursor after = {0};
+    if (after_arg && multidb_cursor_parse(after_arg, &after) != 0) {
+        fprintf(stderr, "invalid cursor: %s\n", after_arg);
+        multidb_close(m);
+        return 2;
+    }
+    MultiSearch *s = multidb_search(m, opts, &after);
+    if (!s) {
+        fprintf(stderr, "search failed\n");
+        multidb_close(m);
+        return 1;
+    }
+    sqlite3_stmt *stmt;
+    const char *host;
+    int rows = 0;
+    while (!g_stop && multidb_next(s, &stmt, &host)) {
+        print_row(stmt, fmt, host);
+        rows++;
+    }
+    MultiCursor next;
+    multidb_search_cursor(s, &next);
+    if (multidb_search_finish(s) != 0) {
+        fprintf(stderr, "search failed\n");
+        rc = 1;
+    } else if (opts->limit > 0 && rows == opts->limit && next.valid) {
+        char cur[128];
+        multidb_cursor_format(&next, cur, sizeof(cur));
+        fprintf(stderr, "next page: --after '%s'\n", cur);
+    }
+    multidb_close(m);
+    return rc;
+}
+
+/* --syslog-udp / --syslog-tcp: run the receiver and the ingest writer in
+ * the foreground, with a rate line on stderr, until interrupted. */
+static int run_syslog(DB *db, const char *udp_addr, const char *tcp_addr) {
+    if (ingest_start(db) != 0) {
+        fprintf(stderr, "cannot start the ingest writer\n");
+        return 1;
+    }
+    if (syslog_start(udp_addr, tcp_addr) != 0) {
+        ingest_stop();
+        return 1;
+    }
+    fprintf(stderr, "receiving syslog on%s%s%s%s; Ctrl-C to stop\n", udp_addr ? " udp " : "",
+            udp_addr ? udp_addr : "", tcp_addr ? " tcp " : "", tcp_addr ? tcp_addr : "");
+    int tty = isatty(fileno(stderr));
+    SyslogStats prev = {0}, st;
+    while (!g_stop) {
+        sleep_ms(1000);
+        syslog_get_stats(&st);
+        if (tty) {
+            IngestStats is;
+            ingest_get_stats(&is);
+            fprintf(stderr, "\r%llu msg/s, %llu udp + %llu tcp total, %llu dropped, %lld queued, %lld spilled  ",
+                    (unsigned long long)(st.udp_messages + st.tcp_messages - prev.udp_messages - prev.tcp_messages),
+                    (unsigned long long)st.udp_messages, (unsigned long long)st.tcp_messages,
+                    (unsigned long long)st.udp_dropped, is.queued_rows, is.spill_pending_rows);
+        }
+        prev = st;
+    }
+    syslog_stop();
+    if (tty) fputc('\n', stderr);
+    fprintf(stderr, "stopping: writing queued rows...\n");
+    ingest_stop();
+    syslog_get_stats(&st);
+    printf("received %llu udp and %llu tcp messages (%llu without PRI, %llu udp dropped by the kernel)\n",
+           (unsigned long long)st.udp_messages, (unsigned long long)st.tcp_messages,
+           (unsigned long long)st.malformed, (unsigned long long)st.udp_dropped);
+    return 0;
+}
+
+// --top: heaviest keys from the checkpointed sketches (topk.h).
+static int run_top(DB *db, const char *what, int minutes, int limit) {
+    TopkDim dim;
+    if (strcmp(what, "units") == 0) dim = TOPK_UNITS;
+    else if (strcmp(what, "messages") == 0) dim = TOPK_MESSAGES;
+    else {
+        fprintf(stderr, "--top wants units or messages\n");
+        return 2;
+    }
+    if (limit <= 0) limit = 20;
+    TopkItem *items = malloc(sizeof(*items) * (size_t)limit);
+    if (!items) return 1;
+    uint64_t total = 0;
+    int n = topk_top_db(db, dim, minutes, items, (size_t)limit, &total);
+    if (n < 0) {
+        fprintf(stderr, "no top-talker data in this database\n");
+        free(items);
+        return 1;
+    }
+    fprintf(stderr, "%llu rows in the last %d minutes\n", (unsigned long long)total, minutes);
+    for (int i = 0; i < n; ++i)
+        printf("%llu\t%llu\t%s\n", (unsigned long long)items[i].count, (unsigned long long)items[i].error,
+               items[i].key);
+    free(items);
+    return 0;
+}
+
+// --saved-searches: one line per search, unread count first.
+static void print_saved(void *ctx, const DBSavedSearch *s) {
+    (void)ctx;
+    printf("%lld\t%s\t%s", s->unread, s->name, s->query ? s->query : "");
+    if (s->unit) printf("\tunit=%s", s->unit);
+    if (s->tag) printf("\ttag=%s", s->tag);
+    if (s->severity) printf("\tpriority=%s", s->severity);
+    putchar('\n');
+}
+
+static int run_import(DB *db, const char *path, const char *source) {
+    ImportJob *job = import_start(db, path, source);
+    if (!job) {
+        fprintf(stderr, "cannot start import\n");
+        return 1;
+    }
+    ImportProgress p;
+    int tty = isatty(fileno(stderr));
+    for (;;) {
+        import_poll(job, &p);
+        if (p.state != IMPORT_RUNNING && p.state != IMPORT_INDEXING) break;
+        if (g_stop) import_cancel(job);
+        if (tty) {
+            if (p.state == IMPORT_INDEXING)
+                fprintf(stderr, "\r%lld rows stored, building search index...", p.rows);
+            else
+                fprintf(stderr, "\r%lld rows, %.0f%%", p.rows,
+                        p.total_bytes > 0 ? 100.0 * (double)p.in_bytes / (double)p.total_bytes : 0.0);
+        }
+        sleep_ms(200);
+    }
+    ImportState state = import_finish(job, &p);
+    if (tty) fputc('\n', stderr);
+    if (state == IMPORT_DONE)
+        printf("imported %lld rows as source \"%s\"\n", p.rows, p.source);
+    else if (state == IMPORT_CANCELLED)
+        fprintf(stderr, "import cancelled; %lld rows kept as source \"%s\" (remove with --drop-source)\n",
+                p.rows, p.source);
+    else
+        fprintf(stderr, "import failed: %s\n", p.error);
+    return state == IMPORT_DONE ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    const char *db_paths[64] = { "./log.db" };
+    size_t n_db = 0;
+    const char *after = NULL;
+    int read_only = 0;
+    int count_only = 0;
+    int estimate = 0;
+    int follow = 0;
+    int interval_ms = 500;
+    int stats = 0;
+    int slow_queries = 0;
+    const char *export_path = NULL;
+    int fmt_set = 0, limit_set = 0;
+    const char *import_path = NULL;
+    const char *import_source = NULL;
+    const char *drop_source = NULL;
+    const char *archive_before = NULL;
+    const char *tag_all = NULL;
+    const char *untag_all = NULL;
+    const char *syslog_udp = NULL, *syslog_tcp = NULL;
+    const char *top = NULL;
+    int top_minutes = 5;
+    const char *save_search = NULL, *delete_search = NULL;
+    int list_saved = 0;
+    OutputFormat fmt = OUT_TEXT;
+    DBSearchOpts opts = {0};
+    opts.limit = 100;
+
+    static const struct option long_opts[] = {
+        { "db", required_argument, NULL, 'd' },
+        { "after", required_argument, NULL, 'A' },
+        { "read-only", no_argument, NULL, 'r' },
+        { "unit", required_argument, NULL, 'u' },
+        { "since", required_argument, NULL, 's' },
+        { "until", required_argument, NULL, 'U' },
+        { "tag", required_argument, NULL, 't' },
+        { "priority", required_argument, NULL, 'p' },
+        { "syslog-udp", required_argument, NULL, 'Y' },
+        { "syslog-tcp", required_argument, NULL, 'Z' },
+        { "export", required_argument, NULL, 'e' },
+        { "import", required_argument, NULL, 'I' },
+        { "source", required_argument, NULL, 'N' },
+        { "drop-source", required_argument, NULL, 'D' },
+        { "archive-before", required_argument, NULL, 'B' },
+        { "tag-all", required_argument, NULL, 'T' },
+        { "untag-all", required_argument, NULL, 'R' },
+        { "limit", required_argument, NULL, 'n' },
+        { "output", required_argument, NULL, 'o' },
+        { "count", no_argument, NULL, 'c' },
+        { "estimate", no_argument, NULL, 'E' },
+        { "follow", no_argument, NULL, 'f' },
+        { "interval", required_argument, NULL, 'i' },
+        { "top", required_argument, NULL, 'K' },
+        { "minutes", required_argument, NULL, 'M' },
+        { "save-search", required_argument, NULL, 'V' },
+        { "saved-searches", no_argument, NULL, 'L' },
+        { "delete-search", required_argument, NULL, 'X' },
+        { "stats", no_argument, NULL, 'S' },
+        { "slow-queries", no_argument, NULL, 'Q' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:ru:s:U:t:p:n:o:e:cfi:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd':
+            if (n_db == sizeof(db_paths) / sizeof(db_paths[0])) { fprintf(stderr, "too many databases\n"); return 2; }
+            db_paths[n_db++] = optarg;
+            break;
+        case 'A': after = optarg; break;
+        case 'r': read_only = 1; break;
+        case 'u': opts.unit = optarg; break;
+        case 's': opts.since = optarg; break;
+        case 'U': opts.until = optarg; break;
+        case 't': opts.tag = optarg; break;
+        case 'p':
+            if (db_parse_severity(optarg) < 0) { fprintf(stderr, "unknown priority: %s\n", optarg); return 2; }
+            opts.severity = optarg;
+            break;
+        case 'Y': syslog_udp = optarg; break;
+        case 'Z': syslog_tcp = optarg; break;
+        case 'I': import_path = optarg; break;
+        case 'N': import_source = optarg; break;
+        case 'D': drop_source = optarg; break;
+        case 'B': archive_before = optarg; break;
+        case 'T': tag_all = optarg; break;
+        case 'R': untag_all = optarg; break;
+        case 'n': opts.limit = atoi(optarg); limit_set = 1; break;
+        case 'e': export_path = optarg; break;
+        case 'o':
+            fmt_set = 1;
+            if (strcmp(optarg, "text") == 0) fmt = OUT_TEXT;
+            else if (strcmp(optarg, "ndjson") == 0) fmt = OUT_NDJSON;
+            else if (strcmp(optarg, "csv") == 0) fmt = OUT_CSV;
+            else { fprintf(stderr, "unknown output format: %s\n", optarg); return 2; }
+            break;
+        case 'c': count_only = 1; break;
+        case 'E': estimate = 1; break;
+        case 'f': follow = 1; break;
+        case 'i': interval_ms = atoi(optarg); break;
+        case 'K': top = optarg; break;
+        case 'M': top_minutes = atoi(optarg); break;
+        case 'V': save_search = optarg; break;
+        case 'L': list_saved = 1; break;
+        case 'X': delete_search = optarg; break;
+        case 'S': stats = 1; break;
+        case 'Q': slow_queries = 1; break;
+        case 'h': usage(stdout); return 0;
+        default: usage(stderr); return 2;
+        }
+    }
+    if (optind < argc) opts.query = argv[optind++];
+    if (optind < argc) { usage(stderr); return 2; }
+    if (interval_ms <= 0) interval_ms = 500;
+
+    if (n_db > 1) {
+        if (follow || export_path || import_path || drop_source || archive_before || tag_all || untag_all || stats || slow_queries ||
+            syslog_udp || syslog_tcp || top || save_search || list_saved || delete_search) {
+            fprintf(stderr, "only searches, --count and --estimate are supported with several databases\n");
+            return 2;
+        }
+        signal(SIGINT, on_signal);
+        signal(SIGPIPE, on_signal);
+        return run_multi(db_paths, n_db, &opts, fmt, after, count_only, estimate);
+    }
+    if (after) {
+        fprintf(stderr, "--after needs several --db\n");
+        return 2;
+    }
+    const char *db_path = db_paths[0];
+
+    /* With log-explorer-indexerd running for this database, commands that
+     * only read open it read-only, and --follow waits for the daemon's
+     * announcements rather than polling. */
+    int writes = import_path || drop_source || archive_before || tag_all || untag_all || syslog_udp || syslog_tcp ||
+                 save_search || delete_search;
+    char sock[PATH_MAX];
+    NotifyClient *daemon = NULL;
+    if (!writes && notify_socket_path(db_path, sock, sizeof(sock)) == 0) {
+        daemon = notify_connect(sock);
+        // a daemon this user may not connect to still owns the database; --follow polls
+        if (daemon || errno == EACCES) read_only = 1;
+    }
+    if (!follow) {
+        notify_close(daemon);
+        daemon = NULL;
+    }
+
+    DB db;
+    if ((read_only ? db_open_readonly(&db, db_path) : db_open(&db, db_path)) != 0) {
+        fprintf(stderr, "cannot open %s\n", db_path);
+        return 1;
+    }
+
+    if (stats) {
+        if (opts.query) {
+            sqlite3_stmt *stmt = NULL;
+            if (db_search_ex(&db, &opts, &stmt) == 0) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {}
+                sqlite3_finalize(stmt);
+            }
+        }
+        MetricsSnapshot snap;
+        metrics_snapshot(&snap);
+        metrics_write_prometheus(stdout, &snap);
+        db_write_stats(stdout, &db);
+        db_close(&db);
+        return 0;
+    }
+
+    if (slow_queries) {
+        if (opts.query && count_only) {
+            long long n = 0;
+            db_count(&db, &opts, &n);
+        } else if (opts.query) {
+            sqlite3_stmt *stmt = NULL;
+            if (db_search_ex(&db, &opts, &stmt) == 0) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {}
+                sqlite3_finalize(stmt);
+            }
+        }
+        db_write_slow_queries(stdout, &db);
+        db_close(&db);
+        return 0;
+    }
+
+    if (top) {
+        if (top_minutes < 1) top_minutes = 1;
+        if (top_minutes > TOPK_WINDOWS) top_minutes = TOPK_WINDOWS;
+        int rc = run_top(&db, top, top_minutes, limit_set ? opts.limit : 20);
+        db_close(&db);
+        return rc;
+    }
+
+    if (save_search || delete_search || list_saved) {
+        int rc = 0;
+        if (save_search && saved_add(&db, save_search, &opts) != 0) {
+            fprintf(stderr, "cannot save search %s (invalid query or priority?)\n", save_search);
+            rc = 1;
+        }
+        if (delete_search && db_saved_remove(&db, delete_search) != 0) {
+            fprintf(stderr, "no saved search %s\n", delete_search);
+            rc = 1;
+        }
+        if (list_saved && db_saved_list(&db, print_saved, NULL) != 0) rc = 1;
+        db_close(&db);
+        return rc;
+    }
+
+    if (drop_source) {
+        long long n = 0;
+        int rc = db_drop_source(&db, drop_source, &n);
+        if (rc == 0) printf("dropped %lld rows\n", n);
+        else fprintf(stderr, "drop failed: %s\n", sqlite3_errmsg(db.db));
+        db_close(&db);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (archive_before) {
+        DBArchiveResult r;
+        int rc = db_archive(&db, archive_before, &r);
+        if (rc == 0)
+            printf("archived %lld rows in %lld segments (%.1f MB of rows in %.1f MB)\n", r.rows, r.segments,
+                   (double)r.raw_bytes / (1024.0 * 1024.0), (double)r.file_bytes / (1024.0 * 1024.0));
+        else fprintf(stderr, "archive failed: %s\n", sqlite3_errmsg(db.db));
+        db_close(&db);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (tag_all || untag_all) {
+        const char *tag = tag_all ? tag_all : untag_all;
+        long long n = 0;
+        int rc = tag_all ? db_tag_matching(&db, &opts, tag, &n) : db_untag_matching(&db, &opts, tag, &n);
+        if (rc == 0) printf("%s %lld rows\n", tag_all ? "tagged" : "untagged", n);
+        else fprintf(stderr, "%s failed: %s\n", tag_all ? "tag" : "untag", sqlite3_errmsg(db.db));
+        db_close(&db);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (estimate) {
+        long long n = 0;
+        int exact = 0;
+        int rc = db_count_estimate(&db, &opts, &n, &exact);
+        if (rc == 0) printf("%lld\t%s\n", n, exact ? "exact" : "estimate");
+        else fprintf(stderr, "estimate failed: %s\n", sqlite3_errmsg(db.db));
+        db_close(&db);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (count_only) {
+        long long n = 0;
+        int rc = db_count(&db, &opts, &n);
+        if (rc == 0) printf("%lld\n", n);
+        else fprintf(stderr, "count failed: %s\n", sqlite3_errmsg(db.db));
+        db_close(&db);
+        return rc == 0 ? 0 : 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, on_signal);
+
+    if (syslog_udp || syslog_tcp) {
+        int rc = run_syslog(&db, syslog_udp, syslog_tcp);
+        db_close(&db);
+        return rc;
+    }
+
+    if (import_path) {
+        int rc = run_import(&db, import_path, import_source);
+        db_close(&db);
+        return rc;
+    }
+
+    if (export_path) {
+        int rc = run_export(&db, &opts, export_path, fmt_set ? fmt : OUT_TEXT, limit_set);
+        db_close(&db);
+        return rc;
+    }
+
+    /* Cap the initial query at the current end of the table so rows that
+     * land while it runs are printed once, by the follow loop. */
+    long long last_id = 0;
+    if (follow) {
+        if (db_max_id(&db, &last_id) != 0) {
+            fprintf(stderr, "cannot read max id: %s\n", sqlite3_errmsg(db.db));
+            db_close(&db);
+            return 1;
+        }
+        opts.max_id = last_id;
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    if (db_search_ex(&db, &opts, &stmt) != 0) {
+        fprintf(stderr, "search failed: %s\n", sqlite3_errmsg(db.db));
+        db_close(&db);
+        return 1;
+    }
+    print_rows(stmt, fmt, 0);
+    fflush(stdout);
+
+    if (follow) {
+        /* New rows are found by rowid rather than ts, so file rows without a
+         * timestamp are followed too. The query filter still applies. */
+        DBSearchOpts fopts = opts;
+        fopts.order = DB_ORDER_ID_ASC;
+        fopts.limit = 0;
+        fopts.offset = 0;
+        fopts.max_id = 0;
+        while (!g_stop) {
+            /* Snapshot the end of the table first: rows that don't match the
+             * filter still advance the cursor, but nothing committed after
+             * the search ran can be skipped. */
+            long long upper = last_id;
+            if (db_max_id(&db, &upper) != 0) upper = last_id;
+            fopts.after_id = last_id;
+            if (db_search_ex(&db, &fopts, &stmt) != 0) {
+                fprintf(stderr, "search failed: %s\n", sqlite3_errmsg(db.db));
+                break;
+            }
+            long long seen = print_rows(stmt, fmt, last_id);
+            last_id = seen > upper ? seen : upper;
+            if (fflush(stdout) != 0) break;
+            wait_for_rows(&daemon, interval_ms);
+        }
+    }
+
+    notify_close(daemon);
+    db_close(&db);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "countjob.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct CountJob {
+    pthread_t thread;
+    DB *db;
+    DBSearchOpts opts;   // string fields point at owned copies
+    volatile int cancel;
+    pthread_mutex_t mu;
+    CountProgress progress;
+};
+
+static char *dup_or_null(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void publish(CountJob *job, CountState state, long long count, double done) {
+    pthread_mutex_lock(&job->mu);
+    job->progress.state = state;
+    job->progress.count = count;
+    job->progress.done = done;
+    pthread_mutex_unlock(&job->mu);
+}
+
+static void *count_thread(void *arg) {
+    CountJob *job = arg;
+    long long lo = 0, hi = 0, count = 0;
+    double done = 0;
+    if (db_id_range(job->db, &lo, &hi) != 0) {
+        publish(job, COUNT_FAILED, 0, 0);
+        return NULL;
+    }
+    if (job->opts.after_id >= lo) lo = job->opts.after_id + 1;
+    if (job->opts.max_id > 0 && job->opts.max_id < hi) hi = job->opts.max_id;
+    CountState state = COUNT_DONE;
+    // newest first, so the part of the table a user is most likely looking at is counted first
+    for (long long top = hi; top >= lo; top -= COUNT_STEP_IDS) {
+        if (job->cancel) { state = COUNT_CANCELLED; break; }
+        long long bottom = top - COUNT_STEP_IDS + 1 > lo ? top - COUNT_STEP_IDS + 1 : lo, n = 0;
+        if (db_count_range(job->db, &job->opts, bottom, top, &n) != 0) { state = COUNT_FAILED; break; }
+        count += n;
+        done = (double)(hi - bottom + 1) / (double)(hi - lo + 1);
+        publish(job, COUNT_RUNNING, count, done);
+    }
+    // archived rows last: one scan of the segments, without the database lock
+    long long archived = 0;
+    if (state == COUNT_DONE && !job->cancel) {
+        if (db_count_archived(job->db, &job->opts, &archived) != 0) state = COUNT_FAILED;
+        count += archived;
+    } else if (state == COUNT_DONE) {
+        state = COUNT_CANCELLED;
+    }
+    publish(job, state, count, state == COUNT_DONE ? 1.0 : done);
+    return NULL;
+}
+
+static void free_job(CountJob *job) {
+    free((char*)job->opts.query);
+    free((char*)job->opts.unit);
+    free((char*)job->opts.since);
+    free((char*)job->opts.until);
+    free((char*)job->opts.tag);
+    free((char*)job->opts.severity);
+    free((char*)job->opts.key_ts);
+    pthread_mutex_destroy(&job->mu);
+    free(job);
+}
+
+CountJob *count_start(DB *db, const DBSearchOpts *opts) {
+    if (!db || !db->db || !opts) return NULL;
+    CountJob *job = calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->db = db;
+    job->opts = *opts;
+    job->opts.query = dup_or_null(opts->query);
+    job->opts.unit = dup_or_null(opts->unit);
+    job->opts.since = dup_or_null(opts->since);
+    job->opts.until = dup_or_null(opts->until);
+    job->opts.tag = dup_or_null(opts->tag);
+    job->opts.severity = dup_or_null(opts->severity);
+    job->opts.key_ts = dup_or_null(opts->key_ts);
+    job->progress.state = COUNT_RUNNING;
+    pthread_mutex_init(&job->mu, NULL);
+    if (pthread_create(&job->thread, NULL, count_thread, job) != 0) {
+        free_job(job);
+        return NULL;
+    }
+    return job;
+}
+
+void count_cancel(CountJob *job) {
+    if (job) job->cancel = 1;
+}
+
+void count_poll(CountJob *job, CountProgress *out) {
+    pthread_mutex_lock(&job->mu);
+    *out = job->progress;
+    pthread_mutex_unlock(&job->mu);
+}
+
+CountState count_finish(CountJob *job, CountProgress *out) {
+    pthread_join(job->thread, NULL);
+    CountState state = job->progress.state;
+    if (out) *out = job->progress;
+    free_job(job);
+    return state;
+}
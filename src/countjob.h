@@ -0,0 +1,36 @@
+#pragma once
+
+#include "db.h"
+
+/* Exact match count in the background, to refine db_count_estimate. The
+ * id range is counted in steps of COUNT_STEP_IDS with db_count_range, so
+ * the shared connection is only held for one short query at a time and a
+ * cancel takes effect within a step. Archived rows (archive.h) are counted
+ * at the end, in one pass over the segments. */
+
+#define COUNT_STEP_IDS 262144
+
+typedef enum {
+    COUNT_RUNNING = 0,
+    COUNT_DONE,
+    COUNT_FAILED,
+    COUNT_CANCELLED
+} CountState;
+
+typedef struct {
+    CountState state;
+    long long count;     // rows matched in the part counted so far
+    double done;         // fraction of the id range counted, 0-1
+} CountProgress;
+
+typedef struct CountJob CountJob;
+
+/* Start counting the rows matching opts (limit/offset/order are ignored).
+ * opts is copied, strings included. Rows added after the start are not
+ * counted. */
+CountJob *count_start(DB *db, const DBSearchOpts *opts);
+void count_cancel(CountJob *job);
+// Snapshot of the job's progress; safe to call from any thread.
+void count_poll(CountJob *job, CountProgress *out);
+// Wait for the job to finish, free it and return its final state.
+CountState count_finish(CountJob *job, CountProgress *out);
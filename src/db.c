@@ -3,6 +3,47 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "archive.h"
+#include "slowlog.h"
+#include <sys/stat.h>
+
+/* All access to d->db goes through these so lock contention shows up in
+ * the db_lock_wait / db_lock_hold histograms. lock_acquired_ns is only
+ * touched by the thread holding the lock. */
+static void db_lock(DB *d) {
+    uint64_t t0 = metrics_now_ns();
+    pthread_mutex_lock(&d->lock);
+    d->lock_acquired_ns = metrics_now_ns();
+    metrics_observe_ns(METRIC_HIST_DB_LOCK_WAIT, d->lock_acquired_ns - t0);
+    metrics_add(METRIC_DB_LOCK_ACQUIRES, 1);
+}
+
+static void db_unlock(DB *d) {
+    uint64_t held = metrics_now_ns() - d->lock_acquired_ns;
+    pthread_mutex_unlock(&d->lock);
+    metrics_observe_ns(METRIC_HIST_DB_LOCK_HOLD, held);
+}
+
+/* SQLite reports each statement's run time when it finishes (reset,
+ * finalize or SQLITE_DONE), which also covers statements returned by
+ * db_search and stepped by the caller outside the lock. Slow ones also go
+ * to the slow-query log (slowlog.h). */
+static int db_profile_cb(unsigned type, void *ctx, void *p, void *x) {
+    (void)ctx;
+    if (type != SQLITE_TRACE_PROFILE) return 0;
+    sqlite3_stmt *stmt = (sqlite3_stmt*)p;
+    uint64_t ns = (uint64_t)*(sqlite3_int64*)x;
+    metrics_observe_ns(sqlite3_stmt_readonly(stmt) ? METRIC_HIST_DB_QUERY : METRIC_HIST_DB_WRITE, ns);
+    slowlog_observe(stmt, ns);
+    return 0;
+}
+
+static int db_schema_current(DB *d);
+static int bulk_recover(DB *d);
 
 int db_open(DB *d, const char *path) {
     if (sqlite3_open(path, &d->db) != SQLITE_OK) {
@@ -17,44 +58,228 @@ int db_open(DB *d, const char *path) {
         d->db = NULL;
         return -1;
     }
+    d->lock_acquired_ns = 0;
+    d->tag_ids = strmap_new();
+    d->source_ids = strmap_new();
+    d->unit_ids = strmap_new();
+    d->bulk_start_id = 0;
+    sqlite3_trace_v2(d->db, SQLITE_TRACE_PROFILE, db_profile_cb, NULL);
+    if (archive_register(d->db) != 0) fprintf(stderr, "Failed to register the archive table\n");
+    /* WAL lets readers in other processes (viewers of the indexer daemon,
+     * the CLI) search while rows are committed. The mode is kept in the
+     * file; switching needs the only connection, so it may fail here while
+     * another process has the database open in rollback mode. */
+    sqlite3_exec(d->db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+    /* Usually the schema is already current: skip the DDL transactions,
+     * which take the write lock and sync even when they change nothing. */
+    if (db_schema_current(d)) return bulk_recover(d);
     if (db_init_schema(d) != 0) return -1;
     /* ensure tags tables exist */
     if (db_init_tags(d) != 0) return -1;
     return 0;
 }
 
+int db_open_readonly(DB *d, const char *path) {
+    if (sqlite3_open_v2(path, &d->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to open DB read-only: %s\n", sqlite3_errmsg(d->db));
+        sqlite3_close(d->db);
+        d->db = NULL;
+        return -1;
+    }
+    if (pthread_mutex_init(&d->lock, NULL) != 0) {
+        fprintf(stderr, "Failed to init DB mutex\n");
+        sqlite3_close(d->db);
+        d->db = NULL;
+        return -1;
+    }
+    d->lock_acquired_ns = 0;
+    d->tag_ids = strmap_new();
+    d->source_ids = strmap_new();
+    d->unit_ids = strmap_new();
+    d->bulk_start_id = 0;
+    sqlite3_trace_v2(d->db, SQLITE_TRACE_PROFILE, db_profile_cb, NULL);
+    // In WAL mode a reader only waits while the writer resets the log.
+    sqlite3_busy_timeout(d->db, 1000);
+    if (archive_register(d->db) != 0) fprintf(stderr, "Failed to register the archive table\n");
+    return 0;
+}
+
 int db_close(DB *d) {
     if (!d || !d->db) return 0;
     sqlite3_close(d->db);
     d->db = NULL;
+    strmap_free(d->tag_ids);
+    strmap_free(d->source_ids);
+    strmap_free(d->unit_ids);
+    d->tag_ids = d->source_ids = d->unit_ids = NULL;
     pthread_mutex_destroy(&d->lock);
     return 0;
 }
 
-int db_init_schema(DB *d) {
-    const char *sql =
-        "BEGIN;"
-        "CREATE TABLE IF NOT EXISTS logs(id INTEGER PRIMARY KEY, source TEXT, unit TEXT, ts TEXT, message TEXT);"
-        "CREATE VIRTUAL TABLE IF NOT EXISTS logs_fts USING fts5(message, content='logs', content_rowid='id');"
-        "CREATE TRIGGER IF NOT EXISTS logs_ai AFTER INSERT ON logs BEGIN"
-        "  INSERT INTO logs_fts(rowid, message) VALUES(NEW.id, NEW.message);"
-        "END;"
-        "COMMIT;";
+int db_keep_wal(DB *d) {
+    if (!d || !d->db) return -1;
+    int keep = 1;
+    db_lock(d);
+    int rc = sqlite3_file_control(d->db, "main", SQLITE_FCNTL_PERSIST_WAL, &keep);
+    db_unlock(d);
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+/* The FTS insert trigger is created separately from the rest of the schema:
+ * it is dropped during bulk loads and must not be recreated by another
+ * process opening the database while one is running. */
+static const char *LOGS_AI_SQL =
+    "CREATE TRIGGER IF NOT EXISTS logs_ai AFTER INSERT ON logs BEGIN"
+    "  INSERT INTO logs_fts(rowid, message) VALUES(NEW.id, NEW.message);"
+    "END;";
 
+static int db_exec(DB *d, const char *sql, const char *what) {
     char *errmsg = NULL;
     if (sqlite3_exec(d->db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
-        fprintf(stderr, "Failed init schema: %s\n", errmsg);
+        fprintf(stderr, "%s: %s\n", what, errmsg ? errmsg : sqlite3_errmsg(d->db));
         sqlite3_free(errmsg);
         return -1;
     }
     return 0;
 }
 
+static int bulk_recover(DB *d);
+static int has_archive_locked(DB *d);
+
+// PRAGMA user_version of the current schema; see migrate_v1 and migrate_v2.
+#define DB_SCHEMA_VERSION 2
+// Everything db_init_schema and db_init_tags create, except the FTS insert trigger (see bulk_recover).
+#define DB_SCHEMA_OBJECTS "'sources', 'units', 'logs', 'logs_fts', 'logs_ad', 'logs_source_ts', 'logs_unit_ts'," \
+                           " 'bulk_load', 'top_windows', 'saved_searches', 'archive_segments', 'archive_dropped', 'meta'," \
+                           " 'tags', 'log_tags', 'log_tags_tag'"
+#define DB_SCHEMA_OBJECT_COUNT 16
+
+/* Result columns of searches and context queries. Source and unit are
+ * looked up by primary key only for the rows actually returned. */
+#define LOG_COLUMNS_HEAD "logs.id, (SELECT name FROM sources WHERE id = logs.source_id)," \
+                         " (SELECT name FROM units WHERE id = logs.unit_id), logs.ts, "
+#define LOG_COLUMNS LOG_COLUMNS_HEAD "logs.message, logs.pri"
+
+static long long db_query_int(DB *d, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    long long v = 0;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        v = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return v;
+}
+
+// Read-only check that the database is at DB_SCHEMA_VERSION and has every schema object.
+static int db_schema_current(DB *d) {
+    return db_query_int(d, "PRAGMA user_version;") == DB_SCHEMA_VERSION &&
+           db_query_int(d, "SELECT count(*) FROM sqlite_master WHERE name IN (" DB_SCHEMA_OBJECTS ");") ==
+               DB_SCHEMA_OBJECT_COUNT;
+}
+
+/* Version 0 stored source and unit as TEXT on every row. Version 1 moves
+ * them into the sources/units dictionaries. logs is rebuilt with the same
+ * ids, so the FTS index (keyed by rowid) and log_tags stay valid. Raw
+ * journal timestamps (microseconds) are rewritten in the normalised form
+ * on the way. */
+static int migrate_v1(DB *d) {
+    if (db_query_int(d, "SELECT count(*) FROM pragma_table_info('logs') WHERE name = 'source';") == 0) return 0;
+    fprintf(stderr, "Upgrading database schema (this may take a while for large databases)...\n");
+    const char *sql =
+        "BEGIN IMMEDIATE;"
+        "CREATE TABLE IF NOT EXISTS sources(id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+        "CREATE TABLE IF NOT EXISTS units(id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+        "INSERT OR IGNORE INTO sources(name) SELECT DISTINCT source FROM logs WHERE source IS NOT NULL;"
+        "INSERT OR IGNORE INTO units(name) SELECT DISTINCT unit FROM logs WHERE unit IS NOT NULL;"
+        "CREATE TABLE logs_v1(id INTEGER PRIMARY KEY, source_id INTEGER, unit_id INTEGER, ts TEXT, message TEXT);"
+        "INSERT INTO logs_v1(id, source_id, unit_id, ts, message)"
+        "  SELECT logs.id, sources.id, units.id,"
+        "    CASE WHEN logs.source = 'journal' AND length(logs.ts) = 16 AND logs.ts NOT GLOB '*[^0-9]*'"
+        "      THEN strftime('%Y-%m-%dT%H:%M:%S', logs.ts / 1000000, 'unixepoch') || printf('.%06dZ', logs.ts % 1000000)"
+        "      ELSE logs.ts END,"
+        "    logs.message"
+        "  FROM logs LEFT JOIN sources ON sources.name = logs.source LEFT JOIN units ON units.name = logs.unit;"
+        "DROP TRIGGER IF EXISTS logs_ai;"
+        "DROP TRIGGER IF EXISTS logs_ad;"
+        "DROP TABLE logs;"
+        "ALTER TABLE logs_v1 RENAME TO logs;"
+        "PRAGMA user_version = 1;"
+        "COMMIT;";
+    if (db_exec(d, sql, "Schema upgrade failed") != 0) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+// Version 2 added the syslog PRI of network rows.
+static int migrate_v2(DB *d) {
+    if (db_query_int(d, "SELECT count(*) FROM pragma_table_info('logs');") == 0 ||
+        db_query_int(d, "SELECT count(*) FROM pragma_table_info('logs') WHERE name = 'pri';") > 0) return 0;
+    if (db_exec(d, "BEGIN IMMEDIATE; ALTER TABLE logs ADD COLUMN pri INTEGER; PRAGMA user_version = 2; COMMIT;",
+                "Schema upgrade failed") != 0) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+int db_init_schema(DB *d) {
+    long long version = db_query_int(d, "PRAGMA user_version;");
+    if (version > DB_SCHEMA_VERSION) {
+        fprintf(stderr, "Database schema version %lld is newer than this build supports (%d)\n",
+                version, DB_SCHEMA_VERSION);
+        return -1;
+    }
+    if (version < 1 && migrate_v1(d) != 0) return -1;
+    if (version < 2 && migrate_v2(d) != 0) return -1;
+    const char *sql =
+        "BEGIN;"
+        /* source and unit repeat on nearly every row: store them once */
+        "CREATE TABLE IF NOT EXISTS sources(id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+        "CREATE TABLE IF NOT EXISTS units(id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+        "CREATE TABLE IF NOT EXISTS logs(id INTEGER PRIMARY KEY, source_id INTEGER, unit_id INTEGER, ts TEXT, message TEXT,"
+        "  pri INTEGER);"
+        "CREATE VIRTUAL TABLE IF NOT EXISTS logs_fts USING fts5(message, content='logs', content_rowid='id');"
+        /* External-content FTS needs the old text to remove a row */
+        "CREATE TRIGGER IF NOT EXISTS logs_ad AFTER DELETE ON logs BEGIN"
+        "  INSERT INTO logs_fts(logs_fts, rowid, message) VALUES('delete', OLD.id, OLD.message);"
+        "END;"
+        /* Context view: neighbours of a row within its source/unit. The rowid
+         * is implicitly the last index column, so ties on ts seek by id. */
+        "CREATE INDEX IF NOT EXISTS logs_source_ts ON logs(source_id, unit_id, ts);"
+        // Recent logs of one unit (the unit filter without a text query)
+        "CREATE INDEX IF NOT EXISTS logs_unit_ts ON logs(unit_id, ts);"
+        // At most one row, present while a bulk load is running
+        "CREATE TABLE IF NOT EXISTS bulk_load(start_id INTEGER, pid INTEGER);"
+        // Top-talker sketch checkpoints (topk.h), one blob per minute and dimension
+        "CREATE TABLE IF NOT EXISTS top_windows(start INTEGER, dim INTEGER, data BLOB, PRIMARY KEY(start, dim))"
+        "  WITHOUT ROWID;"
+        // Standing queries evaluated on new rows (saved.h); filters are NULL when unset
+        "CREATE TABLE IF NOT EXISTS saved_searches(id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE, query TEXT,"
+        "  unit TEXT, tag TEXT, severity TEXT, watermark INTEGER NOT NULL DEFAULT 0, unread INTEGER NOT NULL DEFAULT 0);"
+        // Segment files of archived rows (archive.h), by file name in the archive directory
+        "CREATE TABLE IF NOT EXISTS archive_segments(id INTEGER PRIMARY KEY, file TEXT NOT NULL UNIQUE,"
+        "  min_id INTEGER, max_id INTEGER, min_ts TEXT, max_ts TEXT, rows INTEGER, blocks INTEGER,"
+        "  raw_bytes INTEGER, file_bytes INTEGER);"
+        // Archived rows of dropped sources: those of source with an id up to max_id (db_drop_source)
+        "CREATE TABLE IF NOT EXISTS archive_dropped(source TEXT NOT NULL, max_id INTEGER NOT NULL);"
+        // Single values by name; 'max_log_id' is described at next_log_id_locked
+        "CREATE TABLE IF NOT EXISTS meta(key TEXT PRIMARY KEY, value INTEGER) WITHOUT ROWID;"
+        "PRAGMA user_version = 2;"
+        "COMMIT;";
+
+    if (db_exec(d, sql, "Failed init schema") != 0) return -1;
+    return bulk_recover(d);
+}
+
 int db_init_tags(DB *d) {
     const char *sql =
         "BEGIN;"
         "CREATE TABLE IF NOT EXISTS tags(id INTEGER PRIMARY KEY, name TEXT UNIQUE);"
         "CREATE TABLE IF NOT EXISTS log_tags(log_id INTEGER, tag_id INTEGER, UNIQUE(log_id, tag_id));"
+        /* The UNIQUE index serves per-row lookups; tag filters and bulk
+         * untagging go from tag to rows. */
+        "CREATE INDEX IF NOT EXISTS log_tags_tag ON log_tags(tag_id, log_id);"
         "COMMIT;";
     char *errmsg = NULL;
     if (sqlite3_exec(d->db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
@@ -65,62 +290,102 @@ int db_init_tags(DB *d) {
     return 0;
 }
 
-int db_add_tag(DB *d, int log_id, const char *tag) {
-    if (!d || !d->db) return -1;
-    pthread_mutex_lock(&d->lock);
+/* Resolve a name in one of the (id, name) dictionary tables -- tags,
+ * sources, units -- to its id, creating it if create is set. Called with
+ * the lock held. Dictionary rows are never deleted, so a cached id stays
+ * valid even if another process added the name; only misses go to SQLite. */
+static int dict_id_locked(DB *d, const char *table, StrMap *cache, const char *name, int create, long long *out_id) {
+    int64_t cached;
+    if (strmap_get(cache, name, &cached)) { *out_id = cached; return 0; }
     sqlite3_stmt *stmt = NULL;
-    const char *ins_tag = "INSERT OR IGNORE INTO tags(name) VALUES(?);";
-    if (sqlite3_prepare_v2(d->db, ins_tag, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_STATIC);
-    if (sqlite3_step(stmt) == SQLITE_DONE) sqlite3_reset(stmt);
+    char sql[128];
+    if (create) {
+        snprintf(sql, sizeof(sql), "INSERT OR IGNORE INTO %s(name) VALUES(?);", table);
+        if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) return -1;
+    }
+    snprintf(sql, sizeof(sql), "SELECT id FROM %s WHERE name=? LIMIT 1;", table);
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *out_id = sqlite3_column_int64(stmt, 0);
+        strmap_put(cache, name, *out_id);
+        rc = 0;
+    }
     sqlite3_finalize(stmt);
+    return rc;
+}
 
-    const char *get_tagid = "SELECT id FROM tags WHERE name=? LIMIT 1;";
-    if (sqlite3_prepare_v2(d->db, get_tagid, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_STATIC);
-    int tag_id = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) tag_id = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-    if (tag_id < 0) { pthread_mutex_unlock(&d->lock); return -1; }
+static int tag_id_locked(DB *d, const char *tag, int create, long long *out_id) {
+    return dict_id_locked(d, "tags", d->tag_ids, tag, create, out_id);
+}
 
-    const char *link = "INSERT OR IGNORE INTO log_tags(log_id, tag_id) VALUES(?, ?);";
-    if (sqlite3_prepare_v2(d->db, link, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_int(stmt, 1, log_id);
-    sqlite3_bind_int(stmt, 2, tag_id);
-    if (sqlite3_step(stmt) != SQLITE_DONE) { sqlite3_finalize(stmt); pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&d->lock);
+// Id for a filter value; an unknown name gives 0, which matches no row.
+static long long lookup_id_locked(DB *d, const char *table, StrMap *cache, const char *name) {
+    long long id = 0;
+    if (!name || dict_id_locked(d, table, cache, name, 0, &id) != 0) id = 0;
+    return id;
+}
+
+/* Bind a source or unit as its dictionary id, interning new names. Ids
+ * created inside a transaction that is rolled back must not stay cached:
+ * see reset_intern_caches. */
+static int bind_interned(DB *d, sqlite3_stmt *stmt, int i, const char *table, StrMap *cache, const char *name) {
+    if (!name) return sqlite3_bind_null(stmt, i) == SQLITE_OK ? 0 : -1;
+    long long id;
+    if (dict_id_locked(d, table, cache, name, 1, &id) != 0) return -1;
+    sqlite3_bind_int64(stmt, i, id);
     return 0;
 }
 
-int db_remove_tag(DB *d, int log_id, const char *tag) {
-    if (!d || !d->db) return -1;
-    pthread_mutex_lock(&d->lock);
-    sqlite3_stmt *stmt = NULL;
-    const char *get_tagid = "SELECT id FROM tags WHERE name=? LIMIT 1;";
-    if (sqlite3_prepare_v2(d->db, get_tagid, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_text(stmt, 1, tag, -1, SQLITE_STATIC);
-    int tag_id = -1;
-    if (sqlite3_step(stmt) == SQLITE_ROW) tag_id = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-    if (tag_id < 0) { pthread_mutex_unlock(&d->lock); return -1; }
+static void reset_intern_caches(DB *d) {
+    strmap_free(d->source_ids);
+    strmap_free(d->unit_ids);
+    d->source_ids = strmap_new();
+    d->unit_ids = strmap_new();
+}
 
-    const char *del = "DELETE FROM log_tags WHERE log_id=? AND tag_id=?;";
-    if (sqlite3_prepare_v2(d->db, del, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
+// Run a one-row log_tags statement whose parameters are (log_id, tag_id).
+static int tag_link_locked(DB *d, const char *sql, int log_id, long long tag_id) {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
     sqlite3_bind_int(stmt, 1, log_id);
-    sqlite3_bind_int(stmt, 2, tag_id);
-    if (sqlite3_step(stmt) != SQLITE_DONE) { sqlite3_finalize(stmt); pthread_mutex_unlock(&d->lock); return -1; }
+    sqlite3_bind_int64(stmt, 2, tag_id);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&d->lock);
-    return 0;
+    return rc;
+}
+
+int db_add_tag(DB *d, int log_id, const char *tag) {
+    if (!d || !d->db || !tag || !*tag) return -1;
+    db_lock(d);
+    long long tag_id;
+    int rc = tag_id_locked(d, tag, 1, &tag_id);
+    if (rc == 0) rc = tag_link_locked(d, "INSERT OR IGNORE INTO log_tags(log_id, tag_id) VALUES(?, ?);", log_id, tag_id);
+    db_unlock(d);
+    return rc;
+}
+
+int db_remove_tag(DB *d, int log_id, const char *tag) {
+    if (!d || !d->db || !tag) return -1;
+    db_lock(d);
+    long long tag_id;
+    int rc = tag_id_locked(d, tag, 0, &tag_id);
+    if (rc == 0) rc = tag_link_locked(d, "DELETE FROM log_tags WHERE log_id=? AND tag_id=?;", log_id, tag_id);
+    db_unlock(d);
+    return rc;
 }
 
 char **db_list_tags(DB *d, int log_id) {
     if (!d || !d->db) return NULL;
-    pthread_mutex_lock(&d->lock);
+    db_lock(d);
     sqlite3_stmt *stmt = NULL;
     const char *sql = "SELECT tags.name FROM tags JOIN log_tags ON tags.id = log_tags.tag_id WHERE log_tags.log_id = ?;";
-    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return NULL; }
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { db_unlock(d); return NULL; }
     sqlite3_bind_int(stmt, 1, log_id);
     char **arr = NULL;
     size_t n = 0;
@@ -132,7 +397,7 @@ char **db_list_tags(DB *d, int log_id) {
         arr[n] = NULL;
     }
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&d->lock);
+    db_unlock(d);
     return arr;
 }
 
@@ -142,63 +407,1090 @@ void db_free_string_array(char **arr) {
     free(arr);
 }
 
+/* Ids of rows that left logs (archived or dropped) are never given out
+ * again, or searches, keyset cursors and watermarks would confuse an old
+ * row with a new one. SQLite picks max(id) + 1, so meta 'max_log_id'
+ * keeps the highest id removed, and while nothing in logs is above it
+ * the next row is inserted with the id after it. Returns that id, or 0
+ * for SQLite's own choice. Called with the lock held. */
+static long long next_log_id_locked(DB *d) {
+    return db_query_int(d, "SELECT value + 1 FROM meta WHERE key = 'max_log_id'"
+                           " AND value > (SELECT coalesce(max(id), 0) FROM logs);");
+}
+
+// Record that ids up to max_id may have left logs. Called with the lock held, in the removing transaction.
+static int raise_log_id_floor_locked(DB *d, long long max_id) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db,
+                           "INSERT INTO meta(key, value) VALUES('max_log_id', ?)"
+                           " ON CONFLICT(key) DO UPDATE SET value = max(value, excluded.value);",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, max_id);
+        if (sqlite3_step(stmt) == SQLITE_DONE) rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
 int db_insert_log(DB *d, const char *source, const char *unit, const char *message, const char *ts) {
     if (!d || !d->db) return -1;
-    pthread_mutex_lock(&d->lock);
-    const char *sql = "INSERT INTO logs(source, unit, ts, message) VALUES(?, ?, ?, ?);";
+    db_lock(d);
+    const char *sql = "INSERT INTO logs(source_id, unit_id, ts, message, id) VALUES(?, ?, ?, ?, ?);";
     sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_text(stmt, 1, source, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, unit, -1, SQLITE_STATIC);
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
+    // autocommit: interned names are committed even if the insert fails
+    int rc = bind_interned(d, stmt, 1, "sources", d->source_ids, source);
+    if (rc == 0) rc = bind_interned(d, stmt, 2, "units", d->unit_ids, unit);
     sqlite3_bind_text(stmt, 3, ts, -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 4, message, -1, SQLITE_STATIC);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
+    long long next_id = next_log_id_locked(d);
+    if (next_id > 0) sqlite3_bind_int64(stmt, 5, next_id);
+    if (rc != 0 || sqlite3_step(stmt) != SQLITE_DONE) {
         sqlite3_finalize(stmt);
-        pthread_mutex_unlock(&d->lock);
+        db_unlock(d);
         return -1;
     }
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&d->lock);
+    db_unlock(d);
     return 0;
 }
 
-int db_search(DB *d, const char *query, int limit, int offset, sqlite3_stmt **out_stmt) {
+int db_insert_logs(DB *d, const LogRecord *recs, size_t n) {
+    if (!d || !d->db) return -1;
+    if (n == 0) return 0;
+    db_lock(d);
+    if (sqlite3_exec(d->db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
+    const char *sql = "INSERT INTO logs(source_id, unit_id, ts, message, pri, id) VALUES(?, ?, ?, ?, ?, ?);";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        db_unlock(d);
+        return -1;
+    }
+    // only the first row can need it; the rest follow on from there
+    long long next_id = next_log_id_locked(d);
+    if (next_id > 0) sqlite3_bind_int64(stmt, 6, next_id);
+    int rc = 0;
+    int interned = 0; // set once a miss may have created a dictionary row
+    for (size_t i = 0; i < n && rc == 0; ++i) {
+        /* Consecutive rows usually share source and unit; the id binding
+         * survives sqlite3_reset, so only a change needs a lookup. */
+        if (i == 0 || !recs[i].source != !recs[i - 1].source ||
+            (recs[i].source && strcmp(recs[i].source, recs[i - 1].source) != 0)) {
+            interned = 1;
+            rc = bind_interned(d, stmt, 1, "sources", d->source_ids, recs[i].source);
+        }
+        if (rc == 0 && (i == 0 || !recs[i].unit != !recs[i - 1].unit ||
+                        (recs[i].unit && strcmp(recs[i].unit, recs[i - 1].unit) != 0))) {
+            interned = 1;
+            rc = bind_interned(d, stmt, 2, "units", d->unit_ids, recs[i].unit);
+        }
+        if (rc != 0) break;
+        sqlite3_bind_text(stmt, 3, recs[i].ts, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, recs[i].message, -1, SQLITE_STATIC);
+        if (recs[i].pri >= 0) sqlite3_bind_int(stmt, 5, recs[i].pri);
+        else sqlite3_bind_null(stmt, 5);
+        if (sqlite3_step(stmt) != SQLITE_DONE) rc = -1;
+        sqlite3_reset(stmt);
+        if (i == 0 && next_id > 0) sqlite3_bind_null(stmt, 6);
+    }
+    sqlite3_finalize(stmt);
+    if (sqlite3_exec(d->db, rc == 0 ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL) != SQLITE_OK) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        rc = -1;
+    }
+    if (rc != 0 && interned) reset_intern_caches(d);
+    db_unlock(d);
+    return rc;
+}
+
+/* Index rows inserted since start_id, clear the bulk_load marker and put
+ * the insert trigger back, all in one transaction. */
+static int bulk_finish(DB *d, long long start_id) {
+    if (db_exec(d, "BEGIN IMMEDIATE;", "bulk load") != 0) return -1;
+    int rc;
+    if (start_id <= 1) {
+        // the table was empty: a full rebuild is the cheapest way to index it
+        rc = db_exec(d, "INSERT INTO logs_fts(logs_fts) VALUES('rebuild');", "FTS rebuild");
+    } else {
+        sqlite3_stmt *stmt = NULL;
+        rc = -1;
+        if (sqlite3_prepare_v2(d->db, "INSERT INTO logs_fts(rowid, message) SELECT id, message FROM logs WHERE id >= ?;",
+                               -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, start_id);
+            if (sqlite3_step(stmt) == SQLITE_DONE) rc = 0;
+            else fprintf(stderr, "FTS index: %s\n", sqlite3_errmsg(d->db));
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (rc == 0) rc = db_exec(d, "DELETE FROM bulk_load;", "bulk load");
+    if (rc == 0) rc = db_exec(d, LOGS_AI_SQL, "bulk load");
+    if (rc == 0) rc = db_exec(d, "COMMIT;", "bulk load");
+    if (rc != 0) sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+    return rc;
+}
+
+/* Called from db_init_schema. A bulk_load row left by a process that is
+ * gone means an import was interrupted: finish indexing its rows. If the
+ * importing process is still alive, leave the trigger alone. */
+static int bulk_recover(DB *d) {
+    sqlite3_stmt *stmt = NULL;
+    long long start_id = 0, pid = 0;
+    int found = 0;
+    if (sqlite3_prepare_v2(d->db, "SELECT start_id, pid FROM bulk_load LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK) return -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        start_id = sqlite3_column_int64(stmt, 0);
+        pid = sqlite3_column_int64(stmt, 1);
+        found = 1;
+    }
+    sqlite3_finalize(stmt);
+    if (found) {
+        if (pid == (long long)getpid() || kill((pid_t)pid, 0) == 0 || errno == EPERM) return 0;
+        fprintf(stderr, "Finishing interrupted bulk load (rows from id %lld)\n", start_id);
+        return bulk_finish(d, start_id);
+    }
+    return db_exec(d, LOGS_AI_SQL, "Failed init schema");
+}
+
+int db_bulk_begin(DB *d) {
     if (!d || !d->db) return -1;
+    db_lock(d);
+    if (d->bulk_start_id > 0) { db_unlock(d); return -1; }
+    sqlite3_stmt *stmt = NULL;
+    int prev_sync = 2; // FULL, SQLite's default
+    if (sqlite3_prepare_v2(d->db, "PRAGMA synchronous;", -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+        prev_sync = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+
+    if (db_exec(d, "BEGIN IMMEDIATE;", "bulk load") != 0) { db_unlock(d); return -1; }
+    long long running = 0, start_id = 0;
+    if (sqlite3_prepare_v2(d->db, "SELECT (SELECT count(*) FROM bulk_load), (SELECT coalesce(max(id), 0) + 1 FROM logs);",
+                           -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        running = sqlite3_column_int64(stmt, 0);
+        start_id = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    if (running > 0 || start_id <= 0) {
+        if (running > 0) fprintf(stderr, "bulk load: another import is already running\n");
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        db_unlock(d);
+        return -1;
+    }
+    char sql[256];
+    snprintf(sql, sizeof(sql), "INSERT INTO bulk_load(start_id, pid) VALUES(%lld, %lld); DROP TRIGGER IF EXISTS logs_ai; COMMIT;",
+             start_id, (long long)getpid());
+    if (db_exec(d, sql, "bulk load") != 0) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        db_unlock(d);
+        return -1;
+    }
+    // Losing the tail of an import on power failure is fine: it can be rerun.
+    sqlite3_exec(d->db, "PRAGMA synchronous=OFF;", NULL, NULL, NULL);
+    d->bulk_start_id = start_id;
+    d->bulk_prev_sync = prev_sync;
+    db_unlock(d);
+    return 0;
+}
+
+int db_bulk_end(DB *d) {
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    if (d->bulk_start_id <= 0) { db_unlock(d); return -1; }
+    int rc = bulk_finish(d, d->bulk_start_id);
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA synchronous=%d;", d->bulk_prev_sync);
+    sqlite3_exec(d->db, sql, NULL, NULL, NULL);
+    d->bulk_start_id = 0;
+    db_unlock(d);
+    return rc;
+}
+
+/* Rows loaded during a bulk load are not in the FTS index yet, and the
+ * delete trigger would remove entries that do not exist: deleting rows
+ * must wait for it. Called with the lock held. */
+static int bulk_load_running_locked(DB *d, const char *what) {
+    if (db_query_int(d, "SELECT count(*) FROM bulk_load;") == 0) return 0;
+    fprintf(stderr, "%s: an import is running; try again when it has finished\n", what);
+    return 1;
+}
+
+int db_drop_source(DB *d, const char *source, long long *out_rows) {
+    if (!d || !d->db || !source) return -1;
+    if (out_rows) *out_rows = 0;
+    db_lock(d);
+    if (bulk_load_running_locked(d, "drop source")) {
+        db_unlock(d);
+        return -1;
+    }
+    sqlite3_stmt *stmt = NULL;
+    long long source_id = lookup_id_locked(d, "sources", d->source_ids, source);
+    if (db_exec(d, "BEGIN IMMEDIATE;", "drop source") != 0) { db_unlock(d); return -1; }
+    // The newest row may be among those dropped; its id must not come back.
+    if (raise_log_id_floor_locked(d, db_query_int(d, "SELECT coalesce(max(id), 0) FROM logs;")) != 0) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        db_unlock(d);
+        return -1;
+    }
+    // The sources row stays: dictionary ids are cached and never reused.
+    static const char *sqls[] = {
+        "DELETE FROM log_tags WHERE log_id IN (SELECT id FROM logs WHERE source_id = ?);",
+        "DELETE FROM logs WHERE source_id = ?;",
+    };
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(sqls) / sizeof(sqls[0]) && rc == 0; ++i) {
+        rc = -1;
+        if (sqlite3_prepare_v2(d->db, sqls[i], -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, source_id);
+            if (sqlite3_step(stmt) == SQLITE_DONE) rc = 0;
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (rc == 0 && out_rows) *out_rows = sqlite3_changes64(d->db);
+    // Segments are not rewritten: their rows of this source are marked dropped, which the archive table honours.
+    if (rc == 0 && has_archive_locked(d)) {
+        long long archived = -1;
+        if (sqlite3_prepare_v2(d->db, "SELECT count(*) FROM archive WHERE source = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, source, -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) == SQLITE_ROW) archived = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+        if (archived > 0 &&
+            sqlite3_prepare_v2(d->db, "INSERT INTO archive_dropped(source, max_id)"
+                                      " SELECT ?, coalesce(max(max_id), 0) FROM archive_segments;",
+                               -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, source, -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) == SQLITE_DONE && out_rows) *out_rows += archived;
+            else archived = -1;
+        }
+        sqlite3_finalize(stmt);
+        if (archived < 0) {
+            fprintf(stderr, "drop source: cannot drop the archived rows of %s: %s\n", source, sqlite3_errmsg(d->db));
+            rc = -1;
+        }
+    }
+    if (rc == 0) rc = db_exec(d, "COMMIT;", "drop source");
+    if (rc != 0) sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+    db_unlock(d);
+    return rc;
+}
+
+/* Rows db_archive moves: older than ?1, with a timestamp (rows without
+ * one cannot be placed in time), without tags (tags stay editable), and
+ * never the newest row, so db_max_id does not go back. Archived ids are
+ * not reused either way (see next_log_id_locked). */
+#define ARCHIVE_ROWS_WHERE "ts < ?1 AND ts <> '' AND id < (SELECT max(id) FROM logs)" \
+                           " AND id NOT IN (SELECT log_id FROM log_tags)"
+
+/* Move one segment's worth of rows: write the segment, then record it and
+ * delete the rows in the same transaction. Returns the rows moved, or -1.
+ * Called with the lock held. */
+static long long archive_segment_locked(DB *d, const char *before, const char *dir, DBArchiveResult *out) {
+    static const char *select_sql =
+        "SELECT " LOG_COLUMNS " FROM logs WHERE " ARCHIVE_ROWS_WHERE " ORDER BY ts, id LIMIT ?2;";
+    static const char *delete_sql =
+        "DELETE FROM logs WHERE id IN (SELECT id FROM logs WHERE " ARCHIVE_ROWS_WHERE " ORDER BY ts, id LIMIT ?2);";
+    static const char *insert_sql =
+        "INSERT INTO archive_segments(file, min_id, max_id, min_ts, max_ts, rows, blocks, raw_bytes, file_bytes)"
+        " VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?);";
+    if (db_exec(d, "BEGIN IMMEDIATE;", "archive") != 0) return -1;
+    ArchiveWriter *w = archive_writer_open(d->db, dir);
+    sqlite3_stmt *stmt = NULL;
+    long long rows = -1, min_id = 0, max_id = 0;
+    if (w && sqlite3_prepare_v2(d->db, select_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, before, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, ARCHIVE_SEGMENT_ROWS);
+        int rc;
+        rows = 0;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            long long id = sqlite3_column_int64(stmt, 0);
+            LogRecord rec = {
+                .source = (const char*)sqlite3_column_text(stmt, 1),
+                .unit = (const char*)sqlite3_column_text(stmt, 2),
+                .ts = (const char*)sqlite3_column_text(stmt, 3),
+                .message = (const char*)sqlite3_column_text(stmt, 4),
+                .pri = sqlite3_column_type(stmt, 5) == SQLITE_NULL ? -1 : sqlite3_column_int(stmt, 5),
+            };
+            if (archive_writer_add(w, id, &rec) != 0) break;
+            if (rows == 0 || id < min_id) min_id = id;
+            if (rows == 0 || id > max_id) max_id = id;
+            rows++;
+        }
+        if (rc != SQLITE_DONE) rows = -1;
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (rows <= 0) {
+        if (w) archive_writer_abort(w);
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        return rows;
+    }
+    // archived id ranges never overlap, so the range names the segment
+    char file[96], path[4200];
+    snprintf(file, sizeof(file), "seg-%012lld-%012lld.lxa", min_id, max_id);
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    ArchiveSegmentInfo info;
+    int ok = archive_writer_finish(w, path, &info) == 0;
+    if (ok && sqlite3_prepare_v2(d->db, delete_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, before, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, ARCHIVE_SEGMENT_ROWS);
+        ok = sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes64(d->db) == rows;
+    } else {
+        ok = 0;
+    }
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (ok && sqlite3_prepare_v2(d->db, insert_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, file, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, info.min_id);
+        sqlite3_bind_int64(stmt, 3, info.max_id);
+        sqlite3_bind_text(stmt, 4, info.min_ts, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 5, info.max_ts, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 6, info.rows);
+        sqlite3_bind_int64(stmt, 7, info.blocks);
+        sqlite3_bind_int64(stmt, 8, info.raw_bytes);
+        sqlite3_bind_int64(stmt, 9, info.file_bytes);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    } else {
+        ok = 0;
+    }
+    sqlite3_finalize(stmt);
+    if (ok) ok = raise_log_id_floor_locked(d, info.max_id) == 0;
+    if (ok) ok = db_exec(d, "COMMIT;", "archive") == 0;
+    if (!ok) {
+        sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+        unlink(path);
+        return -1;
+    }
+    out->rows += rows;
+    out->segments++;
+    out->raw_bytes += info.raw_bytes;
+    out->file_bytes += info.file_bytes;
+    return rows;
+}
+
+int db_archive(DB *d, const char *before, DBArchiveResult *out) {
+    if (!d || !d->db || !before || !*before || !out) return -1;
+    memset(out, 0, sizeof(*out));
+    char dir[4096];
+    if (archive_dir(d->db, dir, sizeof(dir)) != 0) return -1;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror(dir);
+        return -1;
+    }
+    // one transaction per segment, so ingest is held up for one segment at a time
+    for (;;) {
+        db_lock(d);
+        long long rows = bulk_load_running_locked(d, "archive") ? -1 : archive_segment_locked(d, before, dir, out);
+        db_unlock(d);
+        if (rows < 0) return -1;
+        if (rows < ARCHIVE_SEGMENT_ROWS) break;
+    }
+    /* The deletes leave FTS5 tombstones in new index segments, which every
+     * MATCH on the remaining rows has to skip until they are merged away
+     * (searches were over ten times slower). Merge in bounded steps, each
+     * its own transaction; a step that changes fewer than two rows had
+     * nothing left to merge. */
+    while (out->rows > 0) {
+        db_lock(d);
+        int changes_before = sqlite3_total_changes(d->db);
+        int rc = db_exec(d, "INSERT INTO logs_fts(logs_fts, rank) VALUES('merge', -500);", "archive merge");
+        int done = rc != 0 || sqlite3_total_changes(d->db) - changes_before < 2;
+        db_unlock(d);
+        if (done) break;
+    }
+    return 0;
+}
+
+int db_top_save(DB *d, const DBTopWindow *w, size_t n, long long keep_since) {
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    if (db_exec(d, "BEGIN IMMEDIATE;", "top windows") != 0) { db_unlock(d); return -1; }
+    sqlite3_stmt *ins = NULL, *del = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "INSERT OR REPLACE INTO top_windows(start, dim, data) VALUES(?, ?, ?);", -1,
+                           &ins, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(d->db, "DELETE FROM top_windows WHERE start < ?;", -1, &del, NULL) == SQLITE_OK) {
+        rc = 0;
+        for (size_t i = 0; i < n && rc == 0; ++i) {
+            sqlite3_bind_int64(ins, 1, w[i].start);
+            sqlite3_bind_int(ins, 2, w[i].dim);
+            sqlite3_bind_blob(ins, 3, w[i].data, (int)w[i].len, SQLITE_STATIC);
+            if (sqlite3_step(ins) != SQLITE_DONE) rc = -1;
+            sqlite3_reset(ins);
+        }
+        sqlite3_bind_int64(del, 1, keep_since);
+        if (rc == 0 && sqlite3_step(del) != SQLITE_DONE) rc = -1;
+    }
+    sqlite3_finalize(ins);
+    sqlite3_finalize(del);
+    if (rc == 0) rc = db_exec(d, "COMMIT;", "top windows");
+    if (rc != 0) sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+    db_unlock(d);
+    return rc;
+}
+
+int db_top_load(DB *d, long long since, DBTopFn fn, void *ctx) {
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "SELECT start, dim, data FROM top_windows WHERE start >= ? ORDER BY start;", -1,
+                           &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, since);
+        int step;
+        while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+            DBTopWindow w = { sqlite3_column_int64(stmt, 0), sqlite3_column_int(stmt, 1),
+                              sqlite3_column_blob(stmt, 2), (size_t)sqlite3_column_bytes(stmt, 2) };
+            fn(ctx, &w);
+        }
+        if (step == SQLITE_DONE) rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+// Bind s, or NULL for an unset (NULL or empty) filter.
+static void bind_opt_text(sqlite3_stmt *stmt, int i, const char *s) {
+    if (s && *s) sqlite3_bind_text(stmt, i, s, -1, SQLITE_TRANSIENT);
+    else sqlite3_bind_null(stmt, i);
+}
+
+int db_saved_add(DB *d, const char *name, const DBSearchOpts *opts, long long watermark) {
+    if (!d || !d->db || !name || !*name || !opts) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db,
+                           "INSERT OR REPLACE INTO saved_searches(name, query, unit, tag, severity, watermark, unread)"
+                           " VALUES(?, ?, ?, ?, ?, ?, 0);", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_TRANSIENT);
+        bind_opt_text(stmt, 2, opts->query);
+        bind_opt_text(stmt, 3, opts->unit);
+        bind_opt_text(stmt, 4, opts->tag);
+        bind_opt_text(stmt, 5, opts->severity);
+        sqlite3_bind_int64(stmt, 6, watermark);
+        if (sqlite3_step(stmt) == SQLITE_DONE) rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_saved_remove(DB *d, const char *name) {
+    if (!d || !d->db || !name) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "DELETE FROM saved_searches WHERE name = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_DONE) rc = sqlite3_changes(d->db) > 0 ? 0 : -1;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_saved_list(DB *d, DBSavedFn fn, void *ctx) {
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "SELECT id, name, query, unit, tag, severity, watermark, unread FROM saved_searches"
+                           " ORDER BY name;", -1, &stmt, NULL) == SQLITE_OK) {
+        int step;
+        while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+            DBSavedSearch s = { sqlite3_column_int64(stmt, 0), (const char*)sqlite3_column_text(stmt, 1),
+                                (const char*)sqlite3_column_text(stmt, 2), (const char*)sqlite3_column_text(stmt, 3),
+                                (const char*)sqlite3_column_text(stmt, 4), (const char*)sqlite3_column_text(stmt, 5),
+                                sqlite3_column_int64(stmt, 6), sqlite3_column_int64(stmt, 7) };
+            fn(ctx, &s);
+        }
+        if (step == SQLITE_DONE) rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_saved_advance(DB *d, const DBSavedAdvance *a, size_t n) {
+    if (!d || !d->db) return -1;
+    if (n == 0) return 0;
+    db_lock(d);
+    if (db_exec(d, "BEGIN IMMEDIATE;", "saved searches") != 0) { db_unlock(d); return -1; }
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    // the watermark never moves back, should two evaluations overlap
+    if (sqlite3_prepare_v2(d->db, "UPDATE saved_searches SET watermark = ?, unread = unread + ?"
+                           " WHERE id = ? AND watermark < ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        rc = 0;
+        for (size_t i = 0; i < n && rc == 0; ++i) {
+            sqlite3_bind_int64(stmt, 1, a[i].watermark);
+            sqlite3_bind_int64(stmt, 2, a[i].matches);
+            sqlite3_bind_int64(stmt, 3, a[i].id);
+            sqlite3_bind_int64(stmt, 4, a[i].watermark);
+            if (sqlite3_step(stmt) != SQLITE_DONE) rc = -1;
+            sqlite3_reset(stmt);
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (rc == 0) rc = db_exec(d, "COMMIT;", "saved searches");
+    if (rc != 0) sqlite3_exec(d->db, "ROLLBACK;", NULL, NULL, NULL);
+    db_unlock(d);
+    return rc;
+}
+
+int db_saved_mark_read(DB *d, long long id) {
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "UPDATE saved_searches SET unread = 0 WHERE id = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_DONE) rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_parse_severity(const char *s) {
+    static const char *names[] = { "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug" };
+    if (!s || !*s) return -1;
+    if (s[0] >= '0' && s[0] <= '7' && s[1] == '\0') return s[0] - '0';
+    for (int i = 0; i < 8; ++i)
+        if (strcmp(s, names[i]) == 0) return i;
+    if (strcmp(s, "error") == 0) return 3;
+    if (strcmp(s, "warn") == 0) return 4;
+    return -1;
+}
+
+int db_search(DB *d, const char *query, int limit, int offset, sqlite3_stmt **out_stmt) {
+    DBSearchOpts opts = {0};
+    opts.query = query;
+    opts.limit = limit;
+    opts.offset = offset;
+    return db_search_ex(d, &opts, out_stmt);
+}
+
+/* Append the FROM/WHERE part shared by searches and counts. Filters are
+ * added only when set so the plain "recent logs" query stays a simple scan
+ * of logs without touching the FTS table.
+ *
+ * after_id and max_id select new rows (follow mode, saved searches), so
+ * they must cost what the new rows cost: with a query they bound
+ * logs_fts.rowid, which FTS5 seeks to, rather than logs.id, which would
+ * only filter the whole doclist; and the unit filter is kept off the unit
+ * index, which would read all of a unit's rows instead of the id range. */
+static void build_filter_sql(const DBSearchOpts *opts, char *buf, size_t n) {
+    int has_query = opts->query && opts->query[0];
+    const char *id_col = has_query ? "logs_fts.rowid" : "logs.id";
+    size_t len = 0;
+    len += snprintf(buf + len, n - len, has_query
+        ? " FROM logs JOIN logs_fts ON logs.rowid = logs_fts.rowid WHERE logs_fts MATCH ?"
+        : " FROM logs WHERE 1");
+    if (opts->unit && opts->unit[0])
+        len += snprintf(buf + len, n - len, opts->after_id > 0 ? " AND +logs.unit_id = ?" : " AND logs.unit_id = ?");
+    if (opts->since && opts->since[0]) len += snprintf(buf + len, n - len, " AND logs.ts >= ?");
+    if (opts->until && opts->until[0]) len += snprintf(buf + len, n - len, " AND logs.ts < ?");
+    if (opts->tag && opts->tag[0])
+        len += snprintf(buf + len, n - len, " AND logs.id IN (SELECT log_id FROM log_tags WHERE tag_id = ?)");
+    if (opts->severity && opts->severity[0]) len += snprintf(buf + len, n - len, " AND (logs.pri & 7) <= ?");
+    // NULL ts sorts after every stamp in ts DESC order
+    if (opts->keyset)
+        len += snprintf(buf + len, n - len, opts->key_ts
+            ? " AND (logs.ts < ? OR logs.ts IS NULL OR (logs.ts = ? AND logs.id < ?))"
+            : " AND logs.ts IS NULL AND logs.id < ?");
+    if (opts->after_id > 0) len += snprintf(buf + len, n - len, " AND %s > ?", id_col);
+    if (opts->max_id > 0) snprintf(buf + len, n - len, " AND %s <= ?", id_col);
+}
+
+/* Bind filter values in the same order build_filter_sql emitted them,
+ * starting at parameter i. Returns the next free index. Called with the
+ * lock held: the unit and tag filters are bound by id, resolved through
+ * the caches; an unknown name binds 0, which matches no row. */
+static int bind_filter(DB *d, sqlite3_stmt *stmt, const DBSearchOpts *opts, int i) {
+    if (opts->query && opts->query[0]) sqlite3_bind_text(stmt, i++, opts->query, -1, SQLITE_TRANSIENT);
+    if (opts->unit && opts->unit[0]) sqlite3_bind_int64(stmt, i++, lookup_id_locked(d, "units", d->unit_ids, opts->unit));
+    if (opts->since && opts->since[0]) sqlite3_bind_text(stmt, i++, opts->since, -1, SQLITE_TRANSIENT);
+    if (opts->until && opts->until[0]) sqlite3_bind_text(stmt, i++, opts->until, -1, SQLITE_TRANSIENT);
+    if (opts->tag && opts->tag[0]) {
+        long long tag_id = 0;
+        if (tag_id_locked(d, opts->tag, 0, &tag_id) != 0) tag_id = 0;
+        sqlite3_bind_int64(stmt, i++, tag_id);
+    }
+    // NULL pri (not from syslog) never matches; an invalid severity binds -1, matching nothing
+    if (opts->severity && opts->severity[0]) sqlite3_bind_int(stmt, i++, db_parse_severity(opts->severity));
+    if (opts->keyset) {
+        if (opts->key_ts) {
+            sqlite3_bind_text(stmt, i++, opts->key_ts, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, i++, opts->key_ts, -1, SQLITE_TRANSIENT);
+        }
+        sqlite3_bind_int64(stmt, i++, opts->key_id);
+    }
+    if (opts->after_id > 0) sqlite3_bind_int64(stmt, i++, opts->after_id);
+    if (opts->max_id > 0) sqlite3_bind_int64(stmt, i++, opts->max_id);
+    return i;
+}
+
+// Whether rows have been archived (db_archive), so searches must include the archive table. Called with the lock held.
+static int has_archive_locked(DB *d) {
+    return db_query_int(d, "SELECT EXISTS(SELECT 1 FROM archive_segments);") > 0;
+}
+
+/* FROM/WHERE of the archive arm of a search or count: the filters of
+ * build_filter_sql as constraints the archive table uses to skip blocks.
+ * Returns 0 if no archived row can match: a tag filter (archived rows have
+ * no tags), or a keyset after a row without ts (all archived rows have one
+ * and sort before those). */
+static int build_archive_sql(const DBSearchOpts *opts, char *buf, size_t n) {
+    if ((opts->tag && opts->tag[0]) || (opts->keyset && !opts->key_ts)) return 0;
+    size_t len = 0;
+    len += snprintf(buf + len, n - len, " FROM archive WHERE 1");
+    if (opts->query && opts->query[0]) len += snprintf(buf + len, n - len, " AND query = ?");
+    if (opts->unit && opts->unit[0]) len += snprintf(buf + len, n - len, " AND unit = ?");
+    if (opts->since && opts->since[0]) len += snprintf(buf + len, n - len, " AND ts >= ?");
+    if (opts->until && opts->until[0]) len += snprintf(buf + len, n - len, " AND ts < ?");
+    if (opts->severity && opts->severity[0]) len += snprintf(buf + len, n - len, " AND severity <= ?");
+    // ts <= key_ts is implied by the OR but, unlike it, reaches the table
+    if (opts->keyset) len += snprintf(buf + len, n - len, " AND ts <= ? AND (ts < ? OR (ts = ? AND id < ?))");
+    if (opts->after_id > 0) len += snprintf(buf + len, n - len, " AND id > ?");
+    if (opts->max_id > 0) snprintf(buf + len, n - len, " AND id <= ?");
+    return 1;
+}
+
+// Bind the values of build_archive_sql from parameter i; returns the next free index.
+static int bind_archive(sqlite3_stmt *stmt, const DBSearchOpts *opts, int i) {
+    if (opts->query && opts->query[0]) sqlite3_bind_text(stmt, i++, opts->query, -1, SQLITE_TRANSIENT);
+    if (opts->unit && opts->unit[0]) sqlite3_bind_text(stmt, i++, opts->unit, -1, SQLITE_TRANSIENT);
+    if (opts->since && opts->since[0]) sqlite3_bind_text(stmt, i++, opts->since, -1, SQLITE_TRANSIENT);
+    if (opts->until && opts->until[0]) sqlite3_bind_text(stmt, i++, opts->until, -1, SQLITE_TRANSIENT);
+    if (opts->severity && opts->severity[0]) sqlite3_bind_int(stmt, i++, db_parse_severity(opts->severity));
+    if (opts->keyset)
+        for (int k = 0; k < 3; ++k) sqlite3_bind_text(stmt, i++, opts->key_ts, -1, SQLITE_TRANSIENT);
+    if (opts->keyset) sqlite3_bind_int64(stmt, i++, opts->key_id);
+    if (opts->after_id > 0) sqlite3_bind_int64(stmt, i++, opts->after_id);
+    if (opts->max_id > 0) sqlite3_bind_int64(stmt, i++, opts->max_id);
+    return i;
+}
+
+int db_search_ex(DB *d, const DBSearchOpts *opts, sqlite3_stmt **out_stmt) {
+    if (!d || !d->db || !opts) return -1;
+    int has_query = opts->query && opts->query[0];
+    char filter[512];
+    char archive[512];
+    char message[512];
+    char columns[1024];
+    char sql[3072];
+    build_filter_sql(opts, filter, sizeof(filter));
+    /* Previews are computed in the outer query, so only for the rows of the
+     * page. snippet() needs its own MATCH on logs_fts, hence the correlated
+     * lookup by rowid (a seek in the FTS index); ?1 binds the query again.
+     * FTS5 allows at most 64 tokens per snippet; assume about 8 bytes each. */
+    if (opts->preview > 0 && has_query) {
+        int tokens = opts->preview / 8 < 1 ? 1 : opts->preview / 8 > 64 ? 64 : opts->preview / 8;
+        snprintf(message, sizeof(message),
+                 "(SELECT snippet(logs_fts, 0, '" DB_MARK_START "', '" DB_MARK_END "', '...', %d)"
+                 " FROM logs_fts WHERE logs_fts MATCH ?1 AND logs_fts.rowid = logs.id)", tokens);
+    } else if (opts->preview > 0) {
+        snprintf(message, sizeof(message), "substr(logs.message, 1, %d)", opts->preview + 1);
+    } else {
+        snprintf(message, sizeof(message), "logs.message");
+    }
+    snprintf(columns, sizeof(columns), LOG_COLUMNS_HEAD "%s, logs.pri", message);
     /* Protect the prepare phase with the DB lock. The caller will step
      * through and finalize the returned statement; we do not hold the
-     * lock across that use. */
-    pthread_mutex_lock(&d->lock);
-    if (!query || query[0] == '\0') {
-        const char *sql_recent = "SELECT id, source, unit, ts, message FROM logs ORDER BY ts DESC LIMIT ? OFFSET ?;";
-        if (sqlite3_prepare_v2(d->db, sql_recent, -1, out_stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-        sqlite3_bind_int(*out_stmt, 1, limit);
-        sqlite3_bind_int(*out_stmt, 2, offset);
-        pthread_mutex_unlock(&d->lock);
+     * lock across that use. Values are bound SQLITE_TRANSIENT because the
+     * options struct may not outlive the statement. */
+    db_lock(d);
+    /* Following new rows (id order) never reaches archived ones. */
+    int with_archive = opts->order == DB_ORDER_TS_DESC && has_archive_locked(d) &&
+                       build_archive_sql(opts, archive, sizeof(archive));
+    if (!with_archive) {
+        /* The page is chosen in a subquery so source and unit names are only
+         * looked up for the rows returned, not for every row fed to the sort.
+         * SQLite runs it as a co-routine, which yields rows in its order. */
+        snprintf(sql, sizeof(sql), "SELECT %s FROM (SELECT logs.*%s ORDER BY %s LIMIT ? OFFSET ?) AS logs;", columns,
+                 filter, opts->order == DB_ORDER_ID_ASC ? "logs.id ASC" : "logs.ts DESC, logs.id DESC");
+    } else {
+        /* Each arm yields at most limit + offset rows newest first (the
+         * archive table in that order by itself, decompressing no further
+         * than needed), and the compound merges them. */
+        snprintf(sql, sizeof(sql),
+                 "SELECT * FROM (SELECT %s FROM (SELECT logs.*%s ORDER BY logs.ts DESC, logs.id DESC LIMIT ?) AS logs)"
+                 " UNION ALL SELECT * FROM (SELECT id, source, unit, ts, %s, pri%s ORDER BY ts DESC, id DESC LIMIT ?)"
+                 " ORDER BY 4 DESC, 1 DESC LIMIT ? OFFSET ?;",
+                 columns, filter, opts->preview > 0 ? "substr(message, 1, ?)" : "message", archive);
+    }
+    if (sqlite3_prepare_v2(d->db, sql, -1, out_stmt, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
+    int i = 1;
+    int limit = opts->limit > 0 ? opts->limit : -1, offset = opts->offset > 0 ? opts->offset : 0;
+    if (opts->preview > 0 && has_query) sqlite3_bind_text(*out_stmt, i++, opts->query, -1, SQLITE_TRANSIENT);
+    i = bind_filter(d, *out_stmt, opts, i);
+    if (with_archive) {
+        sqlite3_bind_int(*out_stmt, i++, limit < 0 ? -1 : limit + offset);
+        if (opts->preview > 0) sqlite3_bind_int(*out_stmt, i++, opts->preview + 1);
+        i = bind_archive(*out_stmt, opts, i);
+        sqlite3_bind_int(*out_stmt, i++, limit < 0 ? -1 : limit + offset);
+    }
+    sqlite3_bind_int(*out_stmt, i++, limit);
+    sqlite3_bind_int(*out_stmt, i, offset);
+    db_unlock(d);
+    return 0;
+}
+
+int db_count(DB *d, const DBSearchOpts *opts, long long *out_count) {
+    if (!d || !d->db || !opts || !out_count) return -1;
+    char filter[512];
+    char archive[512];
+    char sql[1280];
+    build_filter_sql(opts, filter, sizeof(filter));
+    db_lock(d);
+    int with_archive = has_archive_locked(d) && build_archive_sql(opts, archive, sizeof(archive));
+    if (with_archive)
+        snprintf(sql, sizeof(sql), "SELECT (SELECT count(*)%s) + (SELECT count(*)%s);", filter, archive);
+    else
+        snprintf(sql, sizeof(sql), "SELECT count(*)%s;", filter);
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
+    int i = bind_filter(d, stmt, opts, 1);
+    if (with_archive) bind_archive(stmt, opts, i);
+    int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *out_count = sqlite3_column_int64(stmt, 0);
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_count_archived(DB *d, const DBSearchOpts *opts, long long *out_count) {
+    if (!d || !d->db || !opts || !out_count) return -1;
+    char archive[512];
+    char sql[640];
+    *out_count = 0;
+    db_lock(d);
+    if (!has_archive_locked(d) || !build_archive_sql(opts, archive, sizeof(archive))) {
+        db_unlock(d);
         return 0;
     }
-    const char *sql = "SELECT logs.id, logs.source, logs.unit, logs.ts, logs.message FROM logs JOIN logs_fts ON logs.rowid = logs_fts.rowid WHERE logs_fts MATCH ? ORDER BY ts DESC LIMIT ? OFFSET ?;";
-    if (sqlite3_prepare_v2(d->db, sql, -1, out_stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_text(*out_stmt, 1, query, -1, SQLITE_STATIC);
-    sqlite3_bind_int(*out_stmt, 2, limit);
-    sqlite3_bind_int(*out_stmt, 3, offset);
-    pthread_mutex_unlock(&d->lock);
+    snprintf(sql, sizeof(sql), "SELECT count(*)%s;", archive);
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
+    bind_archive(stmt, opts, 1);
+    db_unlock(d);
+    // stepped without the lock, like a search: the scan reads segment files, not the database
+    int rc = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        *out_count = sqlite3_column_int64(stmt, 0);
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* Count statement for the rows matching opts within an id range, given as
+ * the last two parameters. With a query the range is put on the FTS side,
+ * where FTS5 uses it to seek in the doclists instead of reading them whole.
+ * Without one, NOT INDEXED keeps the planner on the rowid range: through
+ * the unit index it would read all of a unit's rows for every range.
+ * Called with the lock held. */
+static sqlite3_stmt *prepare_count_range(DB *d, const DBSearchOpts *opts) {
+    static const char plain[] = " FROM logs";
+    char filter[512];
+    char sql[1024];
+    build_filter_sql(opts, filter, sizeof(filter));
+    if (opts->query && opts->query[0])
+        snprintf(sql, sizeof(sql), "SELECT count(*)%s AND logs_fts.rowid BETWEEN ? AND ?;", filter);
+    else
+        snprintf(sql, sizeof(sql), "SELECT count(*)%s NOT INDEXED%s AND logs.id BETWEEN ? AND ?;", plain,
+                 filter + strlen(plain));
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) return NULL;
+    bind_filter(d, stmt, opts, 1);
+    return stmt;
+}
+
+static int count_range_step(sqlite3_stmt *stmt, long long lo, long long hi, long long *out_count) {
+    int n = sqlite3_bind_parameter_count(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, n - 1, lo);
+    sqlite3_bind_int64(stmt, n, hi);
+    if (sqlite3_step(stmt) != SQLITE_ROW) return -1;
+    *out_count = sqlite3_column_int64(stmt, 0);
     return 0;
 }
 
-int db_get_message(DB *d, int log_id, char **out_message) {
-    if (!d || !d->db) return -1;
-    pthread_mutex_lock(&d->lock);
+int db_count_range(DB *d, const DBSearchOpts *opts, long long lo, long long hi, long long *out_count) {
+    if (!d || !d->db || !opts || !out_count) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = prepare_count_range(d, opts);
+    int rc = stmt ? count_range_step(stmt, lo, hi, out_count) : -1;
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_id_range(DB *d, long long *out_min, long long *out_max) {
+    if (!d || !d->db || !out_min || !out_max) return -1;
+    db_lock(d);
     sqlite3_stmt *stmt = NULL;
-    const char *sql = "SELECT message FROM logs WHERE id = ? LIMIT 1;";
-    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { pthread_mutex_unlock(&d->lock); return -1; }
-    sqlite3_bind_int(stmt, 1, log_id);
+    // two subqueries: min() and max() together in one SELECT would scan the table
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "SELECT (SELECT coalesce(min(id), 0) FROM logs), (SELECT coalesce(max(id), 0) FROM logs);",
+                           -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        *out_min = sqlite3_column_int64(stmt, 0);
+        *out_max = sqlite3_column_int64(stmt, 1);
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+int db_indexed_max_id(DB *d, long long *out_id) {
+    if (!d || !d->db || !out_id) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    int rc = -1;
+    if (sqlite3_prepare_v2(d->db, "SELECT coalesce((SELECT min(start_id) - 1 FROM bulk_load), (SELECT max(id) FROM logs), 0);",
+                           -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        *out_id = sqlite3_column_int64(stmt, 0);
+        rc = 0;
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc;
+}
+
+/* Estimates count DB_ESTIMATE_WINDOWS windows of ids spread evenly over the
+ * range, starting small and growing the windows until enough rows match to
+ * scale from, or the windows would cover the whole range and an exact count
+ * is as cheap. */
+#define DB_ESTIMATE_WINDOWS 16
+#define DB_ESTIMATE_FIRST_WINDOW 1024
+#define DB_ESTIMATE_MAX_WINDOW 65536
+#define DB_ESTIMATE_MIN_HITS 200
+
+int db_count_estimate(DB *d, const DBSearchOpts *opts, long long *out_count, int *out_exact) {
+    if (!d || !d->db || !opts || !out_count) return -1;
+    long long lo, hi;
+    if (db_id_range(d, &lo, &hi) != 0) return -1;
+    if (opts->after_id >= lo) lo = opts->after_id + 1;
+    if (opts->max_id > 0 && opts->max_id < hi) hi = opts->max_id;
+    if (out_exact) *out_exact = 1;
+    *out_count = 0;
+    if (hi < lo) {
+        db_lock(d);
+        if (out_exact && has_archive_locked(d)) *out_exact = 0;
+        db_unlock(d);
+        return 0;
+    }
+    long long span = hi - lo + 1;
+    db_lock(d);
+    sqlite3_stmt *stmt = prepare_count_range(d, opts);
+    int rc = stmt ? 0 : -1;
+    for (long long w = DB_ESTIMATE_FIRST_WINDOW; rc == 0; w *= 4) {
+        if (w * DB_ESTIMATE_WINDOWS >= span) {
+            rc = count_range_step(stmt, lo, hi, out_count);
+            break;
+        }
+        long long stride = span / DB_ESTIMATE_WINDOWS, hits = 0;
+        for (int i = 0; i < DB_ESTIMATE_WINDOWS && rc == 0; ++i) {
+            long long a = lo + i * stride + (stride - w) / 2, n = 0;
+            rc = count_range_step(stmt, a, a + w - 1, &n);
+            hits += n;
+        }
+        if (rc == 0 && (hits >= DB_ESTIMATE_MIN_HITS || w >= DB_ESTIMATE_MAX_WINDOW)) {
+            *out_count = (long long)((double)hits * (double)span / (double)(w * DB_ESTIMATE_WINDOWS) + 0.5);
+            if (out_exact) *out_exact = 0;
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    // archived rows are left to db_count_archived, so the count is not complete
+    if (rc == 0 && out_exact && *out_exact && has_archive_locked(d)) *out_exact = 0;
+    db_unlock(d);
+    return rc;
+}
+
+/* Shared by the bulk tag operations: sql_fmt has a single %s for the
+ * filter clause, and its first parameter is the tag id. */
+static int tag_matching(DB *d, const DBSearchOpts *opts, const char *tag, int create,
+                        const char *sql_fmt, long long *out_changed) {
+    if (!d || !d->db || !opts || !tag || !*tag) return -1;
+    char filter[512];
+    char sql[1024];
+    build_filter_sql(opts, filter, sizeof(filter));
+    snprintf(sql, sizeof(sql), sql_fmt, filter);
+    if (out_changed) *out_changed = 0;
+    db_lock(d);
+    long long tag_id;
+    if (tag_id_locked(d, tag, create, &tag_id) != 0) {
+        db_unlock(d);
+        // untagging a tag that was never created changes nothing
+        return create ? -1 : 0;
+    }
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
+    sqlite3_bind_int64(stmt, 1, tag_id);
+    bind_filter(d, stmt, opts, 2);
+    int rc = sqlite3_step(stmt) == SQLITE_DONE ? 0 : -1;
+    sqlite3_finalize(stmt);
+    if (rc == 0 && out_changed) *out_changed = sqlite3_changes64(d->db);
+    db_unlock(d);
+    return rc;
+}
+
+int db_tag_matching(DB *d, const DBSearchOpts *opts, const char *tag, long long *out_changed) {
+    return tag_matching(d, opts, tag, 1,
+                        "INSERT OR IGNORE INTO log_tags(log_id, tag_id) SELECT logs.id, ?%s;", out_changed);
+}
+
+int db_untag_matching(DB *d, const DBSearchOpts *opts, const char *tag, long long *out_changed) {
+    return tag_matching(d, opts, tag, 0,
+                        "DELETE FROM log_tags WHERE tag_id = ? AND log_id IN (SELECT logs.id%s);", out_changed);
+}
+
+int db_context(DB *d, const DBContextKey *key, int direction, int limit, sqlite3_stmt **out_stmt) {
+    if (!d || !d->db || !key || !out_stmt || direction == 0) return -1;
+    /* Two seeks instead of a (ts, id) row-value comparison: SQLite only
+     * uses ts for the range of a row value, which scans every row sharing
+     * the anchor's ts -- for file sources, whose ts is empty, that is the
+     * whole file. The first arm finishes the anchor's ts by id, the second
+     * continues with the neighbouring timestamps. */
+    static const char *before_sql =
+        "SELECT * FROM (SELECT " LOG_COLUMNS " FROM logs"
+        "  WHERE source_id = ?1 AND unit_id IS ?2 AND ts = ?3 AND id < ?4 ORDER BY id DESC LIMIT ?5)"
+        " UNION ALL SELECT * FROM (SELECT " LOG_COLUMNS " FROM logs"
+        "  WHERE source_id = ?1 AND unit_id IS ?2 AND ts < ?3 ORDER BY ts DESC, id DESC LIMIT ?5)"
+        " LIMIT ?5;";
+    static const char *after_sql =
+        "SELECT * FROM (SELECT " LOG_COLUMNS " FROM logs"
+        "  WHERE source_id = ?1 AND unit_id IS ?2 AND ts = ?3 AND id > ?4 ORDER BY id ASC LIMIT ?5)"
+        " UNION ALL SELECT * FROM (SELECT " LOG_COLUMNS " FROM logs"
+        "  WHERE source_id = ?1 AND unit_id IS ?2 AND ts > ?3 ORDER BY ts ASC, id ASC LIMIT ?5)"
+        " LIMIT ?5;";
+    db_lock(d);
+    if (sqlite3_prepare_v2(d->db, direction < 0 ? before_sql : after_sql, -1, out_stmt, NULL) != SQLITE_OK) {
+        db_unlock(d);
+        return -1;
+    }
+    sqlite3_bind_int64(*out_stmt, 1, lookup_id_locked(d, "sources", d->source_ids, key->source));
+    /* Rows stored without a unit (syslog without APP-NAME, before it was
+     * stored as "") have a NULL unit_id and come back with unit "". */
+    long long unit_id = lookup_id_locked(d, "units", d->unit_ids, key->unit ? key->unit : "");
+    if (unit_id == 0 && (!key->unit || !key->unit[0])) sqlite3_bind_null(*out_stmt, 2);
+    else sqlite3_bind_int64(*out_stmt, 2, unit_id);
+    sqlite3_bind_text(*out_stmt, 3, key->ts ? key->ts : "", -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(*out_stmt, 4, key->id);
+    sqlite3_bind_int(*out_stmt, 5, limit > 0 ? limit : -1);
+    db_unlock(d);
+    return 0;
+}
+
+int db_max_id(DB *d, long long *out_id) {
+    if (!d || !d->db || !out_id) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(d->db, "SELECT coalesce(max(id), 0) FROM logs;", -1, &stmt, NULL) != SQLITE_OK) { db_unlock(d); return -1; }
     int rc = -1;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        const char *msg = (const char*)sqlite3_column_text(stmt, 0);
-        if (msg) *out_message = strdup(msg); else *out_message = strdup("");
+        *out_id = sqlite3_column_int64(stmt, 0);
         rc = 0;
     }
     sqlite3_finalize(stmt);
-    pthread_mutex_unlock(&d->lock);
+    db_unlock(d);
     return rc;
 }
+
+int db_get_message(DB *d, int log_id, char **out_message) {
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    // a row not in logs may have been archived
+    static const char *sqls[] = {
+        "SELECT message FROM logs WHERE id = ? LIMIT 1;",
+        "SELECT message FROM archive WHERE id = ? LIMIT 1;",
+    };
+    int rc = -1;
+    for (int k = 0; k < 2 && rc != 0 && (k == 0 || has_archive_locked(d)); ++k) {
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(d->db, sqls[k], -1, &stmt, NULL) != SQLITE_OK) break;
+        sqlite3_bind_int(stmt, 1, log_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *msg = (const char*)sqlite3_column_text(stmt, 0);
+            if (msg) *out_message = strdup(msg); else *out_message = strdup("");
+            rc = 0;
+        }
+        sqlite3_finalize(stmt);
+    }
+    db_unlock(d);
+    return rc;
+}
+
+int db_get_message_marked(DB *d, int log_id, const char *query, char **out_message) {
+    if (!query || !query[0]) return db_get_message(d, log_id, out_message);
+    if (!d || !d->db) return -1;
+    db_lock(d);
+    sqlite3_stmt *stmt = NULL;
+    const char *sql = "SELECT highlight(logs_fts, 0, '" DB_MARK_START "', '" DB_MARK_END "') FROM logs_fts"
+                      " WHERE logs_fts MATCH ? AND rowid = ?;";
+    int rc = -1;
+    // A query that is not valid FTS5 syntax fails to step; show the message unmarked then.
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, query, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, log_id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *msg = (const char*)sqlite3_column_text(stmt, 0);
+            *out_message = strdup(msg ? msg : "");
+            rc = *out_message ? 0 : -1;
+        }
+    }
+    sqlite3_finalize(stmt);
+    db_unlock(d);
+    return rc == 0 ? 0 : db_get_message(d, log_id, out_message);
+}
+
+void db_write_stats(FILE *out, void *ctx) {
+    DB *d = (DB*)ctx;
+    if (!d || !d->db) return;
+    static const struct { int op; const char *name; } status[] = {
+        { SQLITE_DBSTATUS_CACHE_USED, "cache_used_bytes" },
+        { SQLITE_DBSTATUS_CACHE_HIT, "cache_hit_total" },
+        { SQLITE_DBSTATUS_CACHE_MISS, "cache_miss_total" },
+        { SQLITE_DBSTATUS_CACHE_WRITE, "cache_write_total" },
+        { SQLITE_DBSTATUS_CACHE_SPILL, "cache_spill_total" },
+    };
+    db_lock(d);
+    for (size_t i = 0; i < sizeof(status) / sizeof(status[0]); ++i) {
+        int cur = 0, hi = 0;
+        if (sqlite3_db_status(d->db, status[i].op, &cur, &hi, 0) == SQLITE_OK)
+            fprintf(out, "logexplorer_sqlite_%s %d\n", status[i].name, cur);
+    }
+    sqlite3_stmt *stmt = NULL;
+    const char *sql = "SELECT (SELECT page_count FROM pragma_page_count()), (SELECT page_size FROM pragma_page_size()),"
+                      " (SELECT freelist_count FROM pragma_freelist_count()), (SELECT coalesce(max(id), 0) FROM logs);";
+    if (sqlite3_prepare_v2(d->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            fprintf(out, "logexplorer_sqlite_page_count %lld\n", sqlite3_column_int64(stmt, 0));
+            fprintf(out, "logexplorer_sqlite_page_size_bytes %lld\n", sqlite3_column_int64(stmt, 1));
+            fprintf(out, "logexplorer_sqlite_freelist_pages %lld\n", sqlite3_column_int64(stmt, 2));
+            fprintf(out, "logexplorer_logs_max_id %lld\n", sqlite3_column_int64(stmt, 3));
+        }
+        sqlite3_finalize(stmt);
+    }
+    db_unlock(d);
+}
+
+void db_write_slow_queries(FILE *out, DB *d) {
+    if (d && d->db) {
+        db_lock(d);
+        slowlog_explain(d->db);
+        db_unlock(d);
+    }
+    slowlog_write(out);
+}
@@ -2,25 +2,214 @@
 
 #include <sqlite3.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "strmap.h"
 
 typedef struct {
     sqlite3 *db;
     pthread_mutex_t lock;
+    uint64_t lock_acquired_ns; // set while the lock is held, for lock hold-time metrics
+    StrMap *tag_ids;           // tag name -> tags.id cache, guarded by lock
+    StrMap *source_ids;        // source name -> sources.id cache, guarded by lock
+    StrMap *unit_ids;          // unit name -> units.id cache, guarded by lock
+    long long bulk_start_id;   // first id of the running bulk load (db_bulk_begin), else 0
+    int bulk_prev_sync;        // PRAGMA synchronous to restore after the bulk load
 } DB;
 
+// One row for batched inserts.
+typedef struct {
+    const char *source;
+    const char *unit;
+    const char *ts;
+    const char *message;
+    int pri;             // syslog PRI (facility * 8 + severity), or -1 for none
+} LogRecord;
+
+// Search filters shared by db_search_ex and db_count. NULL/zero fields are ignored.
+typedef enum {
+    DB_ORDER_TS_DESC = 0, // newest first (default, used by the UI)
+    DB_ORDER_ID_ASC       // insertion order, used when following new rows
+} DBOrder;
+
+typedef struct {
+    const char *query;   // FTS5 MATCH expression; NULL or empty matches everything
+    const char *unit;    // exact unit name
+    const char *since;   // inclusive lower bound, compared against the stored ts text
+    const char *until;   // exclusive upper bound, compared against the stored ts text
+    const char *tag;     // only rows carrying this tag
+    const char *severity; // syslog severity name or number (0-7): rows at this level or more urgent
+    long long after_id;  // only rows with id > after_id
+    long long max_id;    // only rows with id <= max_id (0 = no bound)
+    /* Keyset cursor for DB_ORDER_TS_DESC: only rows that sort after the row
+     * (key_ts, key_id), i.e. older, or as old with a smaller id. key_ts is
+     * NULL for a row without a timestamp. Used instead of offset to page
+     * through merged results (multidb.h). */
+    int keyset;
+    const char *key_ts;
+    long long key_id;
+    int limit;           // <= 0 means no limit
+    int offset;
+    DBOrder order;
+    /* > 0: return a preview instead of the whole message. With a query it
+     * is an FTS5 snippet around the best match, matched terms wrapped in
+     * DB_MARK_START/DB_MARK_END; otherwise the first preview + 1 characters,
+     * so a caller cutting to preview bytes can still tell it was longer. */
+    int preview;
+} DBSearchOpts;
+
+// Match markers in previews and db_get_message_marked (ASCII STX/ETX, which log text practically never holds).
+#define DB_MARK_START "\x02"
+#define DB_MARK_END "\x03"
+
 int db_open(DB *d, const char *path);
+// Open an existing database without write access. The schema is not created or migrated.
+int db_open_readonly(DB *d, const char *path);
 int db_close(DB *d);
+/* Keep the -wal and -shm files when this connection closes, so read-only
+ * connections can still open the database where they cannot create them. */
+int db_keep_wal(DB *d);
+/* Creates the schema, or migrates an older database to it (PRAGMA
+ * user_version). Rows store source and unit as ids into the sources and
+ * units dictionary tables; the search API still returns the names. */
 int db_init_schema(DB *d);
 int db_insert_log(DB *d, const char *source, const char *unit, const char *message, const char *ts);
+// Insert n rows in a single transaction. Either all rows are stored or none (returns -1).
+int db_insert_logs(DB *d, const LogRecord *recs, size_t n);
+/* Bulk-load mode for imports. db_bulk_begin drops the FTS insert trigger,
+ * relaxes synchronous and records the first id of the load in the
+ * bulk_load table; rows are then added with db_insert_logs in large
+ * batches. db_bulk_end indexes everything inserted since then in one pass
+ * (an FTS 'rebuild' if the table was empty) and restores the trigger and
+ * settings. Only one bulk load can run per database; if the process dies
+ * during one, the next db_open finishes the indexing. While it runs, new
+ * rows (including the indexer's) are not yet searchable by text. */
+int db_bulk_begin(DB *d);
+int db_bulk_end(DB *d);
+/* Delete every row with this source (e.g. one imported file) and its tags.
+ * Archived rows of the source stay in their segments but are recorded in
+ * archive_dropped, so searches and counts no longer return them; out_rows
+ * includes them. */
+int db_drop_source(DB *d, const char *source, long long *out_rows);
+/* Move rows with ts before `before` (and a ts at all, and no tags) out of
+ * the logs table into archive segments (archive.h), ARCHIVE_SEGMENT_ROWS
+ * per segment and transaction. Searches keep finding them; the freed
+ * pages are reused by new rows. */
+typedef struct {
+    long long rows, segments;
+    long long raw_bytes, file_bytes;
+} DBArchiveResult;
+int db_archive(DB *d, const char *before, DBArchiveResult *out);
 // Search with pagination: limit and offset. If query is NULL or empty, returns recent logs.
 int db_search(DB *d, const char *query, int limit, int offset, sqlite3_stmt **out_stmt);
+/* Search with the full filter set. Columns are the same as db_search: id,
+ * source, unit, ts, message, pri (NULL unless the row came from syslog).
+ * DB_ORDER_TS_DESC breaks ties in ts by id, newest first, and includes
+ * archived rows unless a tag filter is set (archived rows have no tags);
+ * their previews are the start of the message, without match markers. */
+int db_search_ex(DB *d, const DBSearchOpts *opts, sqlite3_stmt **out_stmt);
+// Count rows matching opts (limit/offset/order are ignored), archived ones included.
+int db_count(DB *d, const DBSearchOpts *opts, long long *out_count);
+/* Quick estimate of db_count for large databases: rows are counted exactly
+ * in a few windows of ids spread over the table and the result is scaled
+ * to the whole id range. Costs at most a few hundred thousand id lookups
+ * however large the table; small tables, or the id range left by
+ * after_id/max_id, are counted exactly. *out_exact (may be NULL) is set
+ * when the count is exact. Rare matches may be estimated as 0; refine with
+ * db_count or db_count_range. Archived rows are not counted, and the
+ * count is not exact while there are any. */
+int db_count_estimate(DB *d, const DBSearchOpts *opts, long long *out_count, int *out_exact);
+// Count only the archived rows matching opts (0 if nothing is archived).
+int db_count_archived(DB *d, const DBSearchOpts *opts, long long *out_count);
+// db_count restricted to lo <= id <= hi, for counting a large table in short steps.
+int db_count_range(DB *d, const DBSearchOpts *opts, long long lo, long long hi, long long *out_count);
+// Smallest and largest log id, both 0 for an empty database.
+int db_id_range(DB *d, long long *out_min, long long *out_max);
+/* Largest id below which every row is searchable by text: db_max_id, except
+ * during a bulk load (by any process), whose rows are not indexed yet. */
+int db_indexed_max_id(DB *d, long long *out_id);
+// Parse a syslog severity ("err", "warning", "3", ...) for DBSearchOpts.severity. Returns 0-7, or -1.
+int db_parse_severity(const char *s);
+/* Position in the per-source context order (source, unit, ts, id). Rows
+ * without a timestamp (file lines, ts "") fall back to insertion order. */
+typedef struct {
+    const char *source;
+    const char *unit;
+    const char *ts;
+    long long id;
+} DBContextKey;
+
+/* Rows next to key from the same source and unit, for the context view.
+ * direction < 0 returns up to limit rows before key, nearest first;
+ * direction > 0 returns rows after it in order. Columns are the same as
+ * db_search. Each call is an index seek on (source_id, unit_id, ts), so the view
+ * can page outward from any position without rescanning. */
+int db_context(DB *d, const DBContextKey *key, int direction, int limit, sqlite3_stmt **out_stmt);
+// Highest log id currently stored, or 0 for an empty database.
+int db_max_id(DB *d, long long *out_id);
 // Fetch full message text for a given log id. Caller receives a newly allocated string and must free it.
 int db_get_message(DB *d, int log_id, char **out_message);
+/* As db_get_message, with the terms matching query wrapped in DB_MARK_START
+ * and DB_MARK_END (FTS5 highlight). Without a query, or if the row does not
+ * match it, the message comes back unmarked. */
+int db_get_message_marked(DB *d, int log_id, const char *query, char **out_message);
 // Tagging APIs
 int db_init_tags(DB *d);
 int db_add_tag(DB *d, int log_id, const char *tag);
 int db_remove_tag(DB *d, int log_id, const char *tag);
+/* Bulk tagging: tag or untag every row matching opts (limit/offset/order are
+ * ignored, as in db_count) with one set-based statement. out_changed, if not
+ * NULL, receives the number of rows actually tagged or untagged. */
+int db_tag_matching(DB *d, const DBSearchOpts *opts, const char *tag, long long *out_changed);
+int db_untag_matching(DB *d, const DBSearchOpts *opts, const char *tag, long long *out_changed);
 // Returns a newly allocated char** array terminated by NULL; caller frees with db_free_string_array
 char **db_list_tags(DB *d, int log_id);
 void db_free_string_array(char **arr);
 
+/* Checkpointed top-talker windows (see topk.h): an opaque blob per window
+ * start (unix seconds) and dimension. db_top_save writes n windows and
+ * deletes those older than keep_since in one transaction; db_top_load calls
+ * fn for every window starting at or after since, oldest first. */
+typedef struct {
+    long long start;
+    int dim;
+    const void *data;
+    size_t len;
+} DBTopWindow;
+typedef void (*DBTopFn)(void *ctx, const DBTopWindow *w);
+int db_top_save(DB *d, const DBTopWindow *w, size_t n, long long keep_since);
+int db_top_load(DB *d, long long since, DBTopFn fn, void *ctx);
+
+/* Saved searches (see saved.h): a named query and filters, the id up to
+ * which rows have been evaluated (watermark) and the matches found since
+ * the user last looked (unread). Adding a name that exists replaces it.
+ * db_saved_list calls fn for each, by name; the strings are only valid
+ * during the call and unset filters are NULL. */
+typedef struct {
+    long long id;
+    const char *name;
+    const char *query;
+    const char *unit;
+    const char *tag;
+    const char *severity;
+    long long watermark;
+    long long unread;
+} DBSavedSearch;
+typedef void (*DBSavedFn)(void *ctx, const DBSavedSearch *s);
+int db_saved_add(DB *d, const char *name, const DBSearchOpts *opts, long long watermark);
+int db_saved_remove(DB *d, const char *name);
+int db_saved_list(DB *d, DBSavedFn fn, void *ctx);
+// Move a search's watermark and add new matches to its unread count; n at once, in one transaction.
+typedef struct {
+    long long id;
+    long long watermark;
+    long long matches;
+} DBSavedAdvance;
+int db_saved_advance(DB *d, const DBSavedAdvance *a, size_t n);
+int db_saved_mark_read(DB *d, long long id);
+
+// Append SQLite cache/page statistics in Prometheus text format. ctx is a DB*;
+// the signature matches MetricsExtraFn so it can be passed to the metrics exporter.
+void db_write_stats(FILE *out, void *ctx);
+// Print the slow-query log (slowlog.h), after taking the query plans of new entries on d.
+void db_write_slow_queries(FILE *out, DB *d);
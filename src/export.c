@@ -0,0 +1,402 @@
+#include "export.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Formatted rows are handed to the compressor in chunks of about this size.
+#define EXPORT_CHUNK (64 * 1024)
+// Progress is published every this many rows.
+#define EXPORT_PROGRESS_ROWS 4096
+
+static void buf_reserve(ExportBuf *b, size_t extra) {
+    if (b->len + extra <= b->cap) return;
+    size_t cap = b->cap ? b->cap : 1024;
+    while (cap < b->len + extra) cap *= 2;
+    char *p = realloc(b->data, cap);
+    if (!p) abort();
+    b->data = p;
+    b->cap = cap;
+}
+
+static void buf_put(ExportBuf *b, const char *s, size_t n) {
+    buf_reserve(b, n);
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void buf_putc(ExportBuf *b, char c) {
+    buf_reserve(b, 1);
+    b->data[b->len++] = c;
+}
+
+void export_buf_free(ExportBuf *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+/* File lines are stored with the '\n' read by getline; drop it (and any
+ * '\r') so every exported record is one line. */
+static int trim_eol(const unsigned char *s, int len) {
+    while (len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r')) len--;
+    return len > 0 ? len : 0;
+}
+
+static void put_json_string(ExportBuf *b, const unsigned char *s, int len) {
+    static const char hex[] = "0123456789abcdef";
+    len = trim_eol(s, len);
+    buf_reserve(b, (size_t)len + 2);
+    buf_putc(b, '"');
+    for (int i = 0; i < len; ++i) {
+        unsigned char c = s[i];
+        switch (c) {
+        case '"': buf_put(b, "\\\"", 2); break;
+        case '\\': buf_put(b, "\\\\", 2); break;
+        case '\n': buf_put(b, "\\n", 2); break;
+        case '\r': buf_put(b, "\\r", 2); break;
+        case '\t': buf_put(b, "\\t", 2); break;
+        default:
+            if (c < 0x20) {
+                char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                buf_put(b, esc, sizeof(esc));
+            } else {
+                buf_putc(b, (char)c);
+            }
+        }
+    }
+    buf_putc(b, '"');
+}
+
+// RFC 4180: quote fields containing a separator, quote or line break; double inner quotes.
+static void put_csv_field(ExportBuf *b, const unsigned char *s, int len) {
+    len = trim_eol(s, len);
+    if (!memchr(s, ',', (size_t)len) && !memchr(s, '"', (size_t)len) &&
+        !memchr(s, '\n', (size_t)len) && !memchr(s, '\r', (size_t)len)) {
+        buf_put(b, (const char*)s, (size_t)len);
+        return;
+    }
+    buf_putc(b, '"');
+    for (int i = 0; i < len; ++i) {
+        if (s[i] == '"') buf_putc(b, '"');
+        buf_putc(b, (char)s[i]);
+    }
+    buf_putc(b, '"');
+}
+
+void export_append_row(ExportBuf *b, sqlite3_stmt *stmt, ExportFormat fmt) {
+    export_append_row_host(b, stmt, fmt, NULL);
+}
+
+void export_append_row_host(ExportBuf *b, sqlite3_stmt *stmt, ExportFormat fmt, const char *host) {
+    static const char *keys[] = { NULL, "source", "unit", "ts", "message" };
+    char id[32];
+    int n = snprintf(id, sizeof(id), "%lld", (long long)sqlite3_column_int64(stmt, 0));
+    if (fmt == EXPORT_NDJSON) {
+        buf_putc(b, '{');
+        if (host) {
+            buf_put(b, "\"host\":", 7);
+            put_json_string(b, (const unsigned char *)host, (int)strlen(host));
+            buf_putc(b, ',');
+        }
+        buf_put(b, "\"id\":", 5);
+        buf_put(b, id, (size_t)n);
+    } else {
+        if (host) {
+            put_csv_field(b, (const unsigned char *)host, (int)strlen(host));
+            buf_putc(b, ',');
+        }
+        buf_put(b, id, (size_t)n);
+    }
+    for (int col = 1; col <= 4; ++col) {
+        const unsigned char *v = sqlite3_column_text(stmt, col);
+        int len = v ? sqlite3_column_bytes(stmt, col) : 0;
+        if (!v) v = (const unsigned char*)"";
+        if (fmt == EXPORT_NDJSON) {
+            buf_put(b, ",\"", 2);
+            buf_put(b, keys[col], strlen(keys[col]));
+            buf_put(b, "\":", 2);
+            put_json_string(b, v, len);
+        } else {
+            buf_putc(b, ',');
+            put_csv_field(b, v, len);
+        }
+    }
+    if (fmt == EXPORT_NDJSON) {
+        // syslog PRI, only for rows that have one; CSV keeps its fixed columns
+        if (sqlite3_column_count(stmt) > 5 && sqlite3_column_type(stmt, 5) != SQLITE_NULL) {
+            n = snprintf(id, sizeof(id), ",\"pri\":%d", sqlite3_column_int(stmt, 5));
+            buf_put(b, id, (size_t)n);
+        }
+        buf_putc(b, '}');
+    }
+    buf_putc(b, '\n');
+}
+
+const char *export_header(ExportFormat fmt) {
+    return fmt == EXPORT_CSV ? "id,source,unit,ts,message\n" : "";
+}
+
+static int ends_with(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+void export_guess(const char *path, ExportFormat *fmt, ExportCompression *comp) {
+    size_t n = strlen(path);
+    *comp = EXPORT_PLAIN;
+    if (ends_with(path, ".gz")) { *comp = EXPORT_GZIP; n -= 3; }
+    else if (ends_with(path, ".zst")) { *comp = EXPORT_ZSTD; n -= 4; }
+    *fmt = n >= 4 && strncmp(path + n - 4, ".csv", 4) == 0 ? EXPORT_CSV : EXPORT_NDJSON;
+}
+
+int export_supported(ExportCompression comp) {
+#ifdef HAVE_ZSTD
+    (void)comp;
+    return 1;
+#else
+    return comp != EXPORT_ZSTD;
+#endif
+}
+
+/* Output file with optional compression. Plain and zstd output go through
+ * stdio; gzip through zlib's own buffered gzFile. */
+typedef struct {
+    ExportCompression comp;
+    FILE *f;
+    gzFile gz;
+    long long out_bytes;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zc;
+    void *zout;
+    size_t zout_cap;
+#endif
+} Sink;
+
+static int sink_open(Sink *s, const char *path, ExportCompression comp, char *err, size_t errlen) {
+    memset(s, 0, sizeof(*s));
+    s->comp = comp;
+    if (!export_supported(comp)) {
+        snprintf(err, errlen, "zstd output is not available in this build");
+        return -1;
+    }
+    if (comp == EXPORT_GZIP) {
+        s->gz = gzopen(path, "wb");
+        if (!s->gz) { snprintf(err, errlen, "%s: %s", path, strerror(errno)); return -1; }
+        gzbuffer(s->gz, 128 * 1024);
+        return 0;
+    }
+    s->f = fopen(path, "wb");
+    if (!s->f) { snprintf(err, errlen, "%s: %s", path, strerror(errno)); return -1; }
+#ifdef HAVE_ZSTD
+    if (comp == EXPORT_ZSTD) {
+        s->zc = ZSTD_createCCtx();
+        s->zout_cap = ZSTD_CStreamOutSize();
+        s->zout = malloc(s->zout_cap);
+        if (!s->zc || !s->zout) { snprintf(err, errlen, "out of memory"); return -1; }
+        ZSTD_CCtx_setParameter(s->zc, ZSTD_c_compressionLevel, 3);
+    }
+#endif
+    return 0;
+}
+
+#ifdef HAVE_ZSTD
+static int zstd_write(Sink *s, const void *data, size_t n, ZSTD_EndDirective mode, char *err, size_t errlen) {
+    ZSTD_inBuffer in = { data, n, 0 };
+    size_t remaining;
+    do {
+        ZSTD_outBuffer out = { s->zout, s->zout_cap, 0 };
+        remaining = ZSTD_compressStream2(s->zc, &out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            snprintf(err, errlen, "zstd: %s", ZSTD_getErrorName(remaining));
+            return -1;
+        }
+        if (fwrite(s->zout, 1, out.pos, s->f) != out.pos) {
+            snprintf(err, errlen, "write failed: %s", strerror(errno));
+            return -1;
+        }
+        s->out_bytes += (long long)out.pos;
+    } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    return 0;
+}
+#endif
+
+static int sink_write(Sink *s, const void *data, size_t n, char *err, size_t errlen) {
+    if (n == 0) return 0;
+    if (s->comp == EXPORT_GZIP) {
+        if (gzwrite(s->gz, data, (unsigned)n) != (int)n) {
+            int zerr;
+            snprintf(err, errlen, "gzip: %s", gzerror(s->gz, &zerr));
+            return -1;
+        }
+        s->out_bytes = (long long)gzoffset(s->gz);
+        return 0;
+    }
+#ifdef HAVE_ZSTD
+    if (s->comp == EXPORT_ZSTD) return zstd_write(s, data, n, ZSTD_e_continue, err, errlen);
+#endif
+    if (fwrite(data, 1, n, s->f) != n) {
+        snprintf(err, errlen, "write failed: %s", strerror(errno));
+        return -1;
+    }
+    s->out_bytes += (long long)n;
+    return 0;
+}
+
+// Finish the stream and close the file. With ok == 0 the output is just closed.
+static int sink_close(Sink *s, int ok, char *err, size_t errlen) {
+    int rc = 0;
+    if (s->gz) {
+        if (gzclose(s->gz) != Z_OK && ok) { snprintf(err, errlen, "gzip: close failed"); rc = -1; }
+        return rc;
+    }
+#ifdef HAVE_ZSTD
+    if (s->zc) {
+        if (ok && zstd_write(s, NULL, 0, ZSTD_e_end, err, errlen) != 0) rc = -1;
+        ZSTD_freeCCtx(s->zc);
+        free(s->zout);
+    }
+#endif
+    if (s->f && fclose(s->f) != 0 && ok && rc == 0) {
+        snprintf(err, errlen, "write failed: %s", strerror(errno));
+        rc = -1;
+    }
+    return rc;
+}
+
+struct ExportJob {
+    pthread_t thread;
+    DB *db;
+    DBSearchOpts opts;   // string fields point at owned copies
+    char *path;
+    ExportFormat fmt;
+    ExportCompression comp;
+    volatile int cancel;
+    pthread_mutex_t mu;
+    ExportProgress progress;
+};
+
+static char *dup_or_null(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void publish(ExportJob *job, long long rows, long long out_bytes) {
+    pthread_mutex_lock(&job->mu);
+    job->progress.rows = rows;
+    job->progress.out_bytes = out_bytes;
+    pthread_mutex_unlock(&job->mu);
+}
+
+static void *export_thread(void *arg) {
+    ExportJob *job = arg;
+    char err[256] = "";
+    ExportState state = EXPORT_DONE;
+    Sink sink;
+    ExportBuf buf = {0};
+    long long rows = 0;
+    sqlite3_stmt *stmt = NULL;
+
+    int opened = sink_open(&sink, job->path, job->comp, err, sizeof(err)) == 0;
+    if (!opened) {
+        state = EXPORT_FAILED;
+    } else if (db_search_ex(job->db, &job->opts, &stmt) != 0) {
+        snprintf(err, sizeof(err), "search failed: %s", sqlite3_errmsg(job->db->db));
+        state = EXPORT_FAILED;
+        stmt = NULL;
+    }
+    if (stmt) {
+        buf_put(&buf, export_header(job->fmt), strlen(export_header(job->fmt)));
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (job->cancel) { state = EXPORT_CANCELLED; break; }
+            export_append_row(&buf, stmt, job->fmt);
+            rows++;
+            if (buf.len >= EXPORT_CHUNK) {
+                if (sink_write(&sink, buf.data, buf.len, err, sizeof(err)) != 0) { state = EXPORT_FAILED; break; }
+                buf.len = 0;
+            }
+            if (rows % EXPORT_PROGRESS_ROWS == 0) publish(job, rows, sink.out_bytes);
+        }
+        if (state == EXPORT_DONE && rc != SQLITE_DONE) {
+            snprintf(err, sizeof(err), "query failed: %s", sqlite3_errmsg(job->db->db));
+            state = EXPORT_FAILED;
+        }
+        sqlite3_finalize(stmt);
+        if (state == EXPORT_DONE && sink_write(&sink, buf.data, buf.len, err, sizeof(err)) != 0) state = EXPORT_FAILED;
+    }
+    if (sink_close(&sink, state == EXPORT_DONE, err, sizeof(err)) != 0 && state == EXPORT_DONE) state = EXPORT_FAILED;
+    // never leave a truncated file behind; a file we could not open is not ours to remove
+    if (state != EXPORT_DONE && opened) unlink(job->path);
+    /* gzip and zstd flush their last block on close; report the real size */
+    struct stat st;
+    if (state == EXPORT_DONE && stat(job->path, &st) == 0) sink.out_bytes = (long long)st.st_size;
+
+    export_buf_free(&buf);
+    pthread_mutex_lock(&job->mu);
+    job->progress.rows = rows;
+    job->progress.out_bytes = sink.out_bytes;
+    job->progress.state = state;
+    snprintf(job->progress.error, sizeof(job->progress.error), "%s", err);
+    pthread_mutex_unlock(&job->mu);
+    return NULL;
+}
+
+static void free_job(ExportJob *job) {
+    free((char*)job->opts.query);
+    free((char*)job->opts.unit);
+    free((char*)job->opts.since);
+    free((char*)job->opts.until);
+    free((char*)job->opts.tag);
+    free(job->path);
+    pthread_mutex_destroy(&job->mu);
+    free(job);
+}
+
+ExportJob *export_start(DB *db, const DBSearchOpts *opts, const char *path,
+                        ExportFormat fmt, ExportCompression comp) {
+    if (!db || !db->db || !opts || !path) return NULL;
+    ExportJob *job = calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->db = db;
+    job->opts = *opts;
+    job->opts.query = dup_or_null(opts->query);
+    job->opts.unit = dup_or_null(opts->unit);
+    job->opts.since = dup_or_null(opts->since);
+    job->opts.until = dup_or_null(opts->until);
+    job->opts.tag = dup_or_null(opts->tag);
+    job->path = strdup(path);
+    job->fmt = fmt;
+    job->comp = comp;
+    job->progress.state = EXPORT_RUNNING;
+    pthread_mutex_init(&job->mu, NULL);
+    if (!job->path || pthread_create(&job->thread, NULL, export_thread, job) != 0) {
+        free_job(job);
+        return NULL;
+    }
+    return job;
+}
+
+void export_cancel(ExportJob *job) {
+    if (job) job->cancel = 1;
+}
+
+void export_poll(ExportJob *job, ExportProgress *out) {
+    pthread_mutex_lock(&job->mu);
+    *out = job->progress;
+    pthread_mutex_unlock(&job->mu);
+}
+
+ExportState export_finish(ExportJob *job, ExportProgress *out) {
+    pthread_join(job->thread, NULL);
+    ExportState state = job->progress.state;
+    if (out) *out = job->progress;
+    free_job(job);
+    return state;
+}
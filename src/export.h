@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include "db.h"
+
+/* Streaming export of search results. Rows go from the db_search_ex
+ * statement through a fixed-size buffer into the (optionally compressed)
+ * output file, so memory use does not depend on the size of the result.
+ * zstd output is available when built with libzstd (HAVE_ZSTD). */
+
+typedef enum { EXPORT_NDJSON = 0, EXPORT_CSV } ExportFormat;
+typedef enum { EXPORT_PLAIN = 0, EXPORT_GZIP, EXPORT_ZSTD } ExportCompression;
+
+// Growable byte buffer used to format rows.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} ExportBuf;
+
+void export_buf_free(ExportBuf *b);
+/* Append the current row of a db_search/db_search_ex statement (id, source,
+ * unit, ts, message) as one NDJSON object or CSV record, with a trailing
+ * newline. The message's own trailing newline is dropped. */
+void export_append_row(ExportBuf *b, sqlite3_stmt *stmt, ExportFormat fmt);
+// The same with a leading host field, for rows merged from several databases (multidb.h).
+void export_append_row_host(ExportBuf *b, sqlite3_stmt *stmt, ExportFormat fmt, const char *host);
+// CSV header line; empty for NDJSON.
+const char *export_header(ExportFormat fmt);
+
+// Pick format and compression from a file name: *.csv[.gz|.zst] is CSV, anything else NDJSON.
+void export_guess(const char *path, ExportFormat *fmt, ExportCompression *comp);
+// 1 if this build can write the given compression.
+int export_supported(ExportCompression comp);
+
+typedef enum {
+    EXPORT_RUNNING = 0,
+    EXPORT_DONE,
+    EXPORT_FAILED,
+    EXPORT_CANCELLED
+} ExportState;
+
+typedef struct {
+    ExportState state;
+    long long rows;        // rows written so far
+    long long out_bytes;   // bytes written to the file (after compression)
+    char error[256];       // set when state is EXPORT_FAILED
+} ExportProgress;
+
+/* Background export job. opts is copied (strings included), so the caller's
+ * options do not need to outlive the job. The statement is stepped on the
+ * shared connection rather than a second one: a separate long-running read
+ * transaction would make the indexer's commits fail with SQLITE_BUSY. */
+typedef struct ExportJob ExportJob;
+
+ExportJob *export_start(DB *db, const DBSearchOpts *opts, const char *path,
+                        ExportFormat fmt, ExportCompression comp);
+void export_cancel(ExportJob *job);
+// Snapshot of the job's progress; safe to call from any thread.
+void export_poll(ExportJob *job, ExportProgress *out);
+/* Wait for the job to finish, free it and return its final state. A
+ * cancelled or failed export removes the partial file. */
+ExportState export_finish(ExportJob *job, ExportProgress *out);
@@ -0,0 +1,247 @@
+#include "import.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "multiline.h"
+#include "timestamp.h"
+
+/* Rows per transaction. Large batches amortise the commit; the DB lock is
+ * released between batches so searches and the indexer are not starved. */
+#define IMPORT_BATCH 50000
+// Flush a batch early once its text reaches this size.
+#define IMPORT_BATCH_BYTES (32 << 20)
+
+struct ImportJob {
+    pthread_t thread;
+    DB *db;
+    char *path;
+    time_t mtime;
+    volatile int cancel;
+    pthread_mutex_t mu;
+    ImportProgress progress;
+};
+
+/* Record text for one batch, NUL-separated, plus the offset and stamp of
+ * each record. */
+typedef struct {
+    char *text;
+    size_t len, cap;
+    size_t *offs;
+    char (*ts)[TS_BUF];
+    size_t n;
+} Batch;
+
+static int batch_add(Batch *b, const char *line, size_t n, TsParser *tp) {
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : (1 << 20);
+        while (cap < b->len + n + 1) cap *= 2;
+        char *p = realloc(b->text, cap);
+        if (!p) return -1;
+        b->text = p;
+        b->cap = cap;
+    }
+    if (!b->offs) {
+        b->offs = malloc(sizeof(size_t) * IMPORT_BATCH);
+        b->ts = malloc(sizeof(*b->ts) * IMPORT_BATCH);
+        if (!b->offs || !b->ts) return -1;
+    }
+    ts_parse(tp, line, n, b->ts[b->n]);
+    b->offs[b->n++] = b->len;
+    memcpy(b->text + b->len, line, n);
+    b->len += n;
+    b->text[b->len++] = '\0';
+    return 0;
+}
+
+static int batch_flush(ImportJob *job, Batch *b, LogRecord *recs, const char *source, const char *unit) {
+    if (b->n == 0) return 0;
+    for (size_t i = 0; i < b->n; ++i) {
+        recs[i].source = source;
+        recs[i].unit = unit;
+        recs[i].ts = b->ts[i];
+        recs[i].message = b->text + b->offs[i];
+        recs[i].pri = -1;
+    }
+    int rc = db_insert_logs(job->db, recs, b->n);
+    // a failed batch is rolled back; it stays in b so the caller can leave its rows out of the count
+    if (rc != 0) return rc;
+    b->len = 0;
+    b->n = 0;
+    return 0;
+}
+
+typedef struct {
+    Batch *batch;
+    TsParser *ts;
+    long long rows;
+    int oom;
+} ImportCtx;
+
+static void import_emit(void *arg, const char *rec, size_t len) {
+    ImportCtx *c = arg;
+    if (batch_add(c->batch, rec, len, c->ts) != 0) c->oom = 1;
+    else c->rows++;
+}
+
+static void set_state(ImportJob *job, ImportState state, const char *err) {
+    pthread_mutex_lock(&job->mu);
+    job->progress.state = state;
+    if (err) snprintf(job->progress.error, sizeof(job->progress.error), "%s", err);
+    pthread_mutex_unlock(&job->mu);
+}
+
+static void *import_thread(void *arg) {
+    ImportJob *job = arg;
+    const char *base = strrchr(job->path, '/');
+    base = base ? base + 1 : job->path;
+    const char *source = job->progress.source; // fixed before the thread starts
+    char err[256] = "";
+
+    /* gzopen reads uncompressed files transparently, so .gz dumps need no
+     * separate path. */
+    gzFile gz = gzopen(job->path, "rb");
+    if (!gz) {
+        snprintf(err, sizeof(err), "%s: %s", job->path, strerror(errno));
+        set_state(job, IMPORT_FAILED, err);
+        return NULL;
+    }
+    gzbuffer(gz, 256 * 1024);
+    if (db_bulk_begin(job->db) != 0) {
+        gzclose(gz);
+        set_state(job, IMPORT_FAILED, "cannot start bulk load (is another import running?)");
+        return NULL;
+    }
+
+    Batch batch = {0};
+    LogRecord *recs = malloc(sizeof(LogRecord) * IMPORT_BATCH);
+    size_t line_cap = 64 * 1024;
+    char *line = malloc(line_cap);
+    // Continuation lines are joined as the file indexer does; see multiline.h.
+    ImportCtx ctx = { &batch, ts_parser_new(job->mtime), 0, 0 };
+    Multiline *ml = multiline_new(multiline_rule_for(job->path), import_emit, &ctx);
+    ImportState state = IMPORT_DONE;
+    if (!recs || !line || !ml || !ctx.ts) { snprintf(err, sizeof(err), "out of memory"); state = IMPORT_FAILED; }
+
+    while (state == IMPORT_DONE) {
+        if (job->cancel) { state = IMPORT_CANCELLED; break; }
+        /* Read one line; gzgets stops at the buffer size, so keep growing
+         * the buffer until the line ends. Lines keep their '\n', as the
+         * file indexer stores them. */
+        size_t len = 0;
+        int eof = 0;
+        for (;;) {
+            if (!gzgets(gz, line + len, (int)(line_cap - len))) { eof = 1; break; }
+            len += strlen(line + len);
+            if (len > 0 && line[len - 1] == '\n') break;
+            if (len + 1 < line_cap) continue; // short read at end of file; gzgets returns NULL next
+            char *p = realloc(line, line_cap * 2);
+            if (!p) { snprintf(err, sizeof(err), "out of memory"); state = IMPORT_FAILED; break; }
+            line = p;
+            line_cap *= 2;
+        }
+        if (state != IMPORT_DONE) break;
+        if (eof && len == 0) {
+            int zerr = Z_OK;
+            const char *msg = gzerror(gz, &zerr);
+            if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                snprintf(err, sizeof(err), "%s: %s", job->path, msg);
+                state = IMPORT_FAILED;
+            }
+            break;
+        }
+        multiline_push(ml, line, len);
+        if (ctx.oom) { snprintf(err, sizeof(err), "out of memory"); state = IMPORT_FAILED; break; }
+        if (batch.n >= IMPORT_BATCH || batch.len >= IMPORT_BATCH_BYTES) {
+            if (batch_flush(job, &batch, recs, source, base) != 0) {
+                snprintf(err, sizeof(err), "insert failed: %s", sqlite3_errmsg(job->db->db));
+                state = IMPORT_FAILED;
+                break;
+            }
+            pthread_mutex_lock(&job->mu);
+            job->progress.rows = ctx.rows;
+            job->progress.in_bytes = (long long)gzoffset(gz);
+            pthread_mutex_unlock(&job->mu);
+        }
+    }
+    if (ml && state != IMPORT_FAILED) multiline_flush(ml);
+    if (ctx.oom && state != IMPORT_FAILED) { snprintf(err, sizeof(err), "out of memory"); state = IMPORT_FAILED; }
+    if (state != IMPORT_FAILED && batch_flush(job, &batch, recs, source, base) != 0) {
+        snprintf(err, sizeof(err), "insert failed: %s", sqlite3_errmsg(job->db->db));
+        state = IMPORT_FAILED;
+    }
+    long long rows = ctx.rows;
+    if (state == IMPORT_FAILED) rows -= (long long)batch.n; // rolled back, or never written
+    if (ml) multiline_discard(ml);
+    multiline_free(ml);
+    ts_parser_free(ctx.ts);
+    gzclose(gz);
+    free(batch.text);
+    free(batch.offs);
+    free(batch.ts);
+    free(recs);
+    free(line);
+
+    pthread_mutex_lock(&job->mu);
+    job->progress.rows = rows;
+    job->progress.in_bytes = job->progress.total_bytes;
+    job->progress.state = IMPORT_INDEXING;
+    pthread_mutex_unlock(&job->mu);
+    // Stored rows are indexed even after a failure or cancel, so they are never left unsearchable.
+    if (db_bulk_end(job->db) != 0 && state != IMPORT_FAILED) {
+        snprintf(err, sizeof(err), "FTS indexing failed: %s", sqlite3_errmsg(job->db->db));
+        state = IMPORT_FAILED;
+    }
+    set_state(job, state, err[0] ? err : NULL);
+    return NULL;
+}
+
+ImportJob *import_start(DB *db, const char *path, const char *source) {
+    if (!db || !db->db || !path) return NULL;
+    ImportJob *job = calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->db = db;
+    job->path = strdup(path);
+    if (!job->path) { free(job); return NULL; }
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    if (source && *source) snprintf(job->progress.source, sizeof(job->progress.source), "%s", source);
+    else snprintf(job->progress.source, sizeof(job->progress.source), "import:%s", base);
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        job->progress.total_bytes = (long long)st.st_size;
+        job->mtime = st.st_mtime;
+    }
+    job->progress.state = IMPORT_RUNNING;
+    pthread_mutex_init(&job->mu, NULL);
+    if (pthread_create(&job->thread, NULL, import_thread, job) != 0) {
+        pthread_mutex_destroy(&job->mu);
+        free(job->path);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+void import_cancel(ImportJob *job) {
+    if (job) job->cancel = 1;
+}
+
+void import_poll(ImportJob *job, ImportProgress *out) {
+    pthread_mutex_lock(&job->mu);
+    *out = job->progress;
+    pthread_mutex_unlock(&job->mu);
+}
+
+ImportState import_finish(ImportJob *job, ImportProgress *out) {
+    pthread_join(job->thread, NULL);
+    ImportState state = job->progress.state;
+    if (out) *out = job->progress;
+    pthread_mutex_destroy(&job->mu);
+    free(job->path);
+    free(job);
+    return state;
+}
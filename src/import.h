@@ -0,0 +1,36 @@
+#pragma once
+
+#include "db.h"
+
+/* Bulk import of an external log file (plain or gzip-compressed), one row
+ * per record (continuation lines joined, see multiline.h), using the
+ * database's bulk-load mode (db_bulk_begin/_end). Rows get their own source, "import:<file name>" by default, so an import can
+ * be removed again with db_drop_source. Runs on a background thread with
+ * the same start/poll/cancel/finish shape as ExportJob. */
+
+typedef enum {
+    IMPORT_RUNNING = 0,
+    IMPORT_INDEXING,   // all rows stored, building the FTS index
+    IMPORT_DONE,
+    IMPORT_FAILED,
+    IMPORT_CANCELLED
+} ImportState;
+
+typedef struct {
+    ImportState state;
+    long long rows;         // rows stored so far
+    long long in_bytes;     // file bytes consumed (compressed size for .gz)
+    long long total_bytes;  // file size, for a progress fraction
+    char source[512];       // source name the rows were stored under
+    char error[256];
+} ImportProgress;
+
+typedef struct ImportJob ImportJob;
+
+// source may be NULL for the default "import:<basename>".
+ImportJob *import_start(DB *db, const char *path, const char *source);
+/* Stop reading. Rows already stored are kept and indexed; drop them with
+ * db_drop_source if the partial import is not wanted. */
+void import_cancel(ImportJob *job);
+void import_poll(ImportJob *job, ImportProgress *out);
+ImportState import_finish(ImportJob *job, ImportProgress *out);
@@ -1,5 +1,5 @@
+#define _GNU_SOURCE
 #include "indexer.h"
-#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -8,7 +8,30 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/inotify.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include "ingest.h"
+#include "multiline.h"
+#include "reactor.h"
+#include "strmap.h"
+#include "syslog.h"
+#include "timestamp.h"
+
+extern char **environ;
+
+// Until the startup hold ends, inputs check back this often (see ingest_hold).
+#define HELD_POLL_MS 100
+
+static int64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 // helper: check whether an executable exists in PATH
 static int program_in_path(const char *prog) {
@@ -58,9 +81,13 @@ static char *json_extract_value(const char *json, const char *key) {
     return NULL;
 }
 
-static void ingest_log(DB *db, const char *source, const char *unit, const char *message, const char *ts) {
+/* Rows are handed to the ingest writer (src/ingest.c), which batches them
+ * into the database and spills to disk when it falls behind, so input
+ * threads never wait on DB.lock. */
+static void ingest_log(DB *db, MetricSource kind, const char *source, const char *unit, const char *message, const char *ts) {
+    (void)db;
     if (!message) return;
-    db_insert_log(db, source ? source : "unknown", unit ? unit : "", message, ts ? ts : "");
+    ingest_submit(kind, source, unit, message, ts);
 }
 
 // Journal reader: uses `journalctl -o json -f` to follow new entries.
@@ -79,54 +106,143 @@ static char *read_journal_cursor(void) {
     return strdup(buf);
 }
 
-static void write_journal_cursor(const char *cursor) {
-    if (!cursor) return;
+// ingest_checkpoint callback; ctx is the cursor.
+static void write_journal_cursor(void *cursor) {
     FILE *f = fopen(".journal_cursor", "w");
     if (!f) return;
-    fprintf(f, "%s\n", cursor);
+    fprintf(f, "%s\n", (const char *)cursor);
     fclose(f);
 }
 
-static pthread_t g_jth = 0;
-static pthread_t g_fth = 0;
-static volatile int g_indexer_running = 0;
+/* Save a cursor (taking ownership) once the entries up to it are
+ * committed, so rows lost from the ingest queue are read again. */
+static void checkpoint_journal_cursor(char *cursor) {
+    if (cursor) ingest_checkpoint(".journal_cursor", write_journal_cursor, cursor);
+}
+
+// Ingest one journal entry. Returns its cursor (to be freed), or NULL.
+static char *journal_entry(DB *db, const char *line) {
+    // line is a JSON object
+    char *msg = json_extract_value(line, "MESSAGE");
+    char *unit = json_extract_value(line, "_SYSTEMD_UNIT");
+    char *ts = json_extract_value(line, "__REALTIME_TIMESTAMP");
+    // microseconds since the epoch, stored in the same form as file stamps
+    char tsbuf[TS_BUF] = "";
+    if (ts && *ts) ts_format_us(strtoll(ts, NULL, 10), tsbuf);
+    ingest_log(db, METRIC_SRC_JOURNAL, "journal", unit, msg, tsbuf);
+    free(msg); free(unit); free(ts);
+    return json_extract_value(line, "__CURSOR");
+}
+
+void indexer_ingest_journal_line(DB *db, const char *line) {
+    checkpoint_journal_cursor(journal_entry(db, line));
+}
+
+/* Journal source: follows `journalctl -o json -f` through a pipe. The
+ * cursor is checkpointed (ingest_checkpoint) when the pipe goes idle and on
+ * close rather than per entry, and close stops journalctl instead of
+ * waiting for its next line. */
+#define JOURNAL_CHUNK (64 * 1024)
+
+typedef struct {
+    DB *db;
+    pid_t pid;           // journalctl, 0 until started
+    int fd;              // read end of its stdout, -1 until started
+    char *buf;
+    size_t len, cap;
+    char *cursor;        // of the last entry ingested, until checkpointed
+} JournalSource;
 
-static void *journal_thread(void *arg) {
-    DB *db = (DB*)arg;
-    // Try to follow journal; if not available or permissions, exit thread.
+static int journal_spawn(JournalSource *j) {
     char *cursor = read_journal_cursor();
-    char cmd[8192];
-    if (cursor) {
-        snprintf(cmd, sizeof(cmd), "journalctl -o json --after-cursor='%s' -f", cursor);
-    } else {
-        snprintf(cmd, sizeof(cmd), "journalctl -o json -f");
+    char *after = NULL;
+    if (cursor && asprintf(&after, "--after-cursor=%s", cursor) < 0) after = NULL;
+    free(cursor);
+    char *argv[] = { "journalctl", "-o", "json", "-f", after, NULL };
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) != 0) { free(after); return -1; }
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, p[1], STDOUT_FILENO);
+    int rc = posix_spawnp(&j->pid, "journalctl", &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    free(after);
+    close(p[1]);
+    if (rc != 0) {
+        fprintf(stderr, "indexer: cannot run journalctl: %s\n", strerror(rc));
+        j->pid = 0;
+        close(p[0]);
+        return -1;
     }
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return NULL;
-    char *line = NULL;
-    size_t cap = 0;
-    ssize_t len;
-    g_indexer_running = 1;
-    while (g_indexer_running && (len = getline(&line, &cap, fp)) > 0) {
-        // line is a JSON object
-        char *msg = json_extract_value(line, "MESSAGE");
-        char *unit = json_extract_value(line, "_SYSTEMD_UNIT");
-        char *ts = json_extract_value(line, "__REALTIME_TIMESTAMP");
-        char *cursor_line = json_extract_value(line, "__CURSOR");
-        // convert microsecond epoch to iso string? keep raw for prototype
-        ingest_log(db, "journal", unit, msg, ts);
-        if (cursor_line) {
-            write_journal_cursor(cursor_line);
+    // Only our end is non-blocking; journalctl keeps a blocking stdout.
+    fcntl(p[0], F_SETFL, fcntl(p[0], F_GETFL) | O_NONBLOCK);
+    j->fd = p[0];
+    return 0;
+}
+
+static int journal_fd(void *ctx) {
+    return ((JournalSource *)ctx)->fd;
+}
+
+static int journal_timeout_ms(void *ctx) {
+    return ((JournalSource *)ctx)->pid ? -1 : HELD_POLL_MS;
+}
+
+static int journal_read_batch(void *ctx) {
+    JournalSource *j = ctx;
+    if (!j->pid) {
+        if (ingest_held()) return 0;
+        return journal_spawn(j) == 0 ? 0 : -1;
+    }
+    if (j->cap - j->len < JOURNAL_CHUNK) {
+        size_t cap = j->cap ? j->cap * 2 : 2 * JOURNAL_CHUNK;
+        char *b = realloc(j->buf, cap);
+        if (!b) return -1;
+        j->buf = b;
+        j->cap = cap;
+    }
+    ssize_t n = read(j->fd, j->buf + j->len, JOURNAL_CHUNK);
+    if (n < 0) return errno == EINTR ? 1 : errno == EAGAIN ? 0 : -1;
+    if (n == 0) return -1; // journalctl exited
+    j->len += (size_t)n;
+    char *line = j->buf, *end = j->buf + j->len, *nl;
+    while ((nl = memchr(line, '\n', (size_t)(end - line)))) {
+        *nl = '\0';
+        char *cursor = journal_entry(j->db, line);
+        if (cursor) {
+            free(j->cursor);
+            j->cursor = cursor;
         }
-        free(msg); free(unit); free(ts);
-        free(cursor_line);
+        line = nl + 1;
     }
-    free(line);
-    pclose(fp);
-    free(cursor);
-    return NULL;
+    j->len = (size_t)(end - line);
+    memmove(j->buf, line, j->len);
+    return n == JOURNAL_CHUNK;
+}
+
+static void journal_checkpoint(void *ctx) {
+    JournalSource *j = ctx;
+    checkpoint_journal_cursor(j->cursor);
+    j->cursor = NULL;
+}
+
+static void journal_close(void *ctx) {
+    JournalSource *j = ctx;
+    if (j->pid) {
+        kill(j->pid, SIGTERM);
+        close(j->fd);
+        waitpid(j->pid, NULL, 0);
+    }
+    free(j->buf);
+    free(j->cursor);
+    free(j);
 }
 
+static const SourceOps journal_ops = {
+    .name = "journal", .fd = journal_fd, .timeout_ms = journal_timeout_ms,
+    .read_batch = journal_read_batch, .checkpoint = journal_checkpoint, .close = journal_close,
+};
+
 // Simple file tailer: read plain text files under /var/log and ingest lines. Tracks inode+offset in a simple .offset file per logfile.
 // helper: ensure .offsets directory exists
 static void ensure_offsets_dir(void) {
@@ -148,91 +264,329 @@ static off_t read_offset(const char *basename) {
     return (off >= 0) ? (off_t)off : -1;
 }
 
-static void write_offset(const char *basename, off_t off) {
+typedef struct {
+    off_t off;
+    char basename[];
+} OffsetCheckpoint;
+
+// ingest_checkpoint callback; ctx is an OffsetCheckpoint.
+static void write_offset(void *ctx) {
+    OffsetCheckpoint *c = ctx;
     char path[1024];
-    snprintf(path, sizeof(path), ".offsets/%s.offset", basename);
+    snprintf(path, sizeof(path), ".offsets/%s.offset", c->basename);
     FILE *f = fopen(path, "w");
     if (!f) return;
-    fprintf(f, "%ld\n", (long)off);
+    fprintf(f, "%ld\n", (long)c->off);
     fclose(f);
 }
 
-static void tail_file_once(DB *db, const char *path) {
+/* How far each file has been read, by basename. The .offset files lag
+ * behind until the rows read are committed; the next pass starts here. */
+static pthread_mutex_t g_read_mu = PTHREAD_MUTEX_INITIALIZER;
+static StrMap *g_read_offsets = NULL;
+
+static off_t read_position(const char *basename) {
+    int64_t off;
+    pthread_mutex_lock(&g_read_mu);
+    int found = g_read_offsets && strmap_get(g_read_offsets, basename, &off);
+    pthread_mutex_unlock(&g_read_mu);
+    return found ? (off_t)off : read_offset(basename);
+}
+
+// Continue from off next pass; store it once the rows before it are committed.
+static void checkpoint_offset(const char *basename, off_t off) {
+    size_t len = strlen(basename);
+    OffsetCheckpoint *c = malloc(sizeof(*c) + len + 1);
+    if (!c) return;
+    c->off = off;
+    memcpy(c->basename, basename, len + 1);
+    if (ingest_checkpoint(basename, write_offset, c) != 0) return;
+    pthread_mutex_lock(&g_read_mu);
+    if (!g_read_offsets) g_read_offsets = strmap_new();
+    if (g_read_offsets) strmap_put(g_read_offsets, basename, (int64_t)off);
+    pthread_mutex_unlock(&g_read_mu);
+}
+
+typedef struct {
+    DB *db;
+    const char *path;
+    const char *unit;
+    TsParser *ts;
+} TailCtx;
+
+static void tail_emit(void *arg, const char *rec, size_t len) {
+    TailCtx *t = arg;
+    char ts[TS_BUF];
+    ts_parse(t->ts, rec, len, ts);
+    ingest_log(t->db, METRIC_SRC_FILE, t->path, t->unit, rec, ts);
+}
+
+// tail_file_once results
+enum { TAIL_DONE = 0, TAIL_MORE, TAIL_HELD };
+
+/* Ingest a file from its stored offset. With a byte budget (0 for none),
+ * stop at the first record boundary past it and return TAIL_MORE. With
+ * hold_last (files followed by the file source), returns TAIL_HELD if the
+ * last record may still be growing and was left for a later pass; without,
+ * everything up to end of file is stored. */
+static int tail_file_once(DB *db, const char *path, off_t budget, int hold_last) {
     ensure_offsets_dir();
     const char *fname = strrchr(path, '/');
     const char *basename = fname ? fname + 1 : path;
-    off_t stored = read_offset(basename);
+    off_t stored = read_position(basename);
 
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) return;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return TAIL_DONE;
     struct stat st;
-    if (fstat(fd, &st) != 0) { close(fd); return; }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(fd); return TAIL_DONE; }
     off_t size = st.st_size;
     off_t start = 0;
     if (stored >= 0 && stored <= size) start = stored;
 
     FILE *f = fdopen(fd, "r");
-    if (!f) { close(fd); return; }
+    if (!f) { close(fd); return TAIL_DONE; }
     if (start > 0) fseeko(f, start, SEEK_SET);
 
+    /* Continuation lines (stack traces etc.) are joined into the record
+     * they belong to; see multiline.h. */
+    TailCtx ctx = { db, path, basename, ts_parser_new(st.st_mtime) };
+    Multiline *ml = ctx.ts ? multiline_new(multiline_rule_for(path), tail_emit, &ctx) : NULL;
+    if (!ml) { ts_parser_free(ctx.ts); fclose(f); return TAIL_DONE; }
     char *line = NULL;
     size_t cap = 0;
-    off_t lastpos = start;
-    while (getline(&line, &cap, f) > 0) {
-        const char *unit = basename;
-        ingest_log(db, path, unit, line, "");
-        lastpos = ftello(f);
+    ssize_t n;
+    off_t pos = start, lastpos = start, record_start = start;
+    int rc = TAIL_DONE;
+    while ((n = getline(&line, &cap, f)) > 0) {
+        if (multiline_push(ml, line, (size_t)n)) {
+            record_start = pos;
+            if (budget && pos - start >= budget) {
+                // the record this line starts is re-read by the next pass
+                multiline_discard(ml);
+                lastpos = record_start;
+                rc = TAIL_MORE;
+                break;
+            }
+        }
+        pos = ftello(f);
+        lastpos = pos;
     }
+    /* The last record may still be growing. If the file was written to
+     * within the flush timeout, leave it for the next pass and store the
+     * offset of its first line so it is re-read whole. */
+    if (hold_last && rc == TAIL_DONE && multiline_pending(ml)) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t idle_ms = (int64_t)(now.tv_sec - st.st_mtim.tv_sec) * 1000 +
+                          (now.tv_nsec - st.st_mtim.tv_nsec) / 1000000;
+        if (idle_ms >= 0 && (uint64_t)idle_ms < multiline_timeout_ms()) {
+            multiline_discard(ml);
+            lastpos = record_start;
+            rc = TAIL_HELD;
+        }
+    }
+    multiline_free(ml); // emits the trailing record unless it was discarded
+    ts_parser_free(ctx.ts);
     if (line) free(line);
-    write_offset(basename, lastpos);
+    checkpoint_offset(basename, lastpos);
     fclose(f);
+    return rc;
 }
 
-static void *varlog_thread(void *arg) {
-    DB *db = (DB*)arg;
-    const char *dir = "/var/log";
-    // For prototype: iterate files directly in /var/log (no recursion)
-    DIR *d = opendir(dir);
-    if (!d) return NULL;
-    struct dirent *ent;
-    char path[1024];
-    while (g_indexer_running && (ent = readdir(d)) != NULL) {
-        if (ent->d_name[0] == '.') continue;
-        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
-        tail_file_once(db, path);
+void indexer_ingest_file(DB *db, const char *path) {
+    tail_file_once(db, path, 0, 0); // no later pass would pick up a held record
+}
+
+/* File source: plain-text files directly under /var/log (no recursion).
+ * Every file is read once at start, then inotify reports the ones written
+ * to. Files wait in a queue and each batch tails one of them for at most
+ * FILE_BATCH_BYTES, so a large backlog does not hold up other inputs. */
+#define FILE_BATCH_BYTES (4 << 20)
+#define VARLOG_DIR "/var/log"
+
+typedef struct PendingFile {
+    struct PendingFile *next;
+    int64_t due_ms;      // 0 = now; later for a held-back trailing record
+    char name[];
+} PendingFile;
+
+typedef struct {
+    DB *db;
+    int started;
+    int ifd;             // inotify, -1 if unavailable
+    PendingFile *head, *tail;
+} FileSource;
+
+static void pending_append(FileSource *f, PendingFile *p) {
+    p->next = NULL;
+    if (f->tail) f->tail->next = p; else f->head = p;
+    f->tail = p;
+}
+
+static void pending_add(FileSource *f, const char *name) {
+    if (name[0] == '.') return;
+    for (PendingFile *p = f->head; p; p = p->next) {
+        if (strcmp(p->name, name) == 0) {
+            p->due_ms = 0;
+            return;
+        }
     }
+    size_t len = strlen(name);
+    PendingFile *p = malloc(sizeof(*p) + len + 1);
+    if (!p) return;
+    p->due_ms = 0;
+    memcpy(p->name, name, len + 1);
+    pending_append(f, p);
+}
+
+static void files_scan(FileSource *f) {
+    DIR *d = opendir(VARLOG_DIR);
+    if (!d) return;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) pending_add(f, ent->d_name);
     closedir(d);
-    return NULL;
 }
 
+static void files_start(FileSource *f) {
+    f->started = 1;
+    // Watch before scanning so nothing written in between is missed.
+    f->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f->ifd >= 0 && inotify_add_watch(f->ifd, VARLOG_DIR, IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "indexer: cannot watch %s: %s; reading it once\n", VARLOG_DIR, strerror(errno));
+        close(f->ifd);
+        f->ifd = -1;
+    }
+    files_scan(f);
+}
+
+static void files_drain_events(FileSource *f) {
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n = read(f->ifd, buf, sizeof(buf));
+    for (char *p = buf; n > 0 && p < buf + n;) {
+        struct inotify_event *ev = (struct inotify_event *)p;
+        if (ev->mask & IN_Q_OVERFLOW) files_scan(f);
+        else if (ev->len > 0) pending_add(f, ev->name);
+        p += sizeof(*ev) + ev->len;
+    }
+}
+
+static int files_fd(void *ctx) {
+    return ((FileSource *)ctx)->ifd;
+}
+
+static int files_timeout_ms(void *ctx) {
+    FileSource *f = ctx;
+    if (!f->started) return HELD_POLL_MS;
+    int64_t next = -1;
+    for (PendingFile *p = f->head; p; p = p->next) {
+        if (next < 0 || p->due_ms < next) next = p->due_ms;
+    }
+    if (next < 0) return -1;
+    int64_t wait = next - mono_ms();
+    return wait < 0 ? 0 : (int)wait;
+}
+
+static int files_read_batch(void *ctx) {
+    FileSource *f = ctx;
+    if (!f->started) {
+        if (ingest_held()) return 0;
+        files_start(f);
+    }
+    if (f->ifd >= 0) files_drain_events(f);
+    int64_t now = mono_ms();
+    for (PendingFile **pp = &f->head, *prev = NULL; *pp; prev = *pp, pp = &(*pp)->next) {
+        PendingFile *p = *pp;
+        if (p->due_ms > now) continue;
+        *pp = p->next;
+        if (f->tail == p) f->tail = prev;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", VARLOG_DIR, p->name);
+        switch (tail_file_once(f->db, path, FILE_BATCH_BYTES, 1)) {
+        case TAIL_MORE: pending_append(f, p); break;   // behind the other files
+        case TAIL_HELD:
+            p->due_ms = now + (int64_t)multiline_timeout_ms();
+            pending_append(f, p);
+            break;
+        default: free(p);
+        }
+        break;
+    }
+    for (PendingFile *p = f->head; p; p = p->next) {
+        if (p->due_ms <= now) return 1;
+    }
+    // Without inotify the source is done once the initial scan is read.
+    return f->ifd < 0 && !f->head ? -1 : 0;
+}
+
+static void files_close(void *ctx) {
+    FileSource *f = ctx;
+    while (f->head) {
+        PendingFile *p = f->head;
+        f->head = p->next;
+        free(p);
+    }
+    if (f->ifd >= 0) close(f->ifd);
+    free(f);
+}
+
+static const SourceOps files_ops = {
+    .name = "files", .fd = files_fd, .timeout_ms = files_timeout_ms,
+    .read_batch = files_read_batch, .close = files_close,
+};
+
+static Reactor *g_reactor = NULL;
+
 int indexer_start(DB *db) {
-    if (g_indexer_running) return 0;
-    g_indexer_running = 1;
-    /* Start journal thread only if journalctl is available in PATH. In
+    if (g_reactor) return 0;
+    if (ingest_start(db) != 0) return -1;
+    // The last ingest_stop saved every offset whose rows it kept; start from the files.
+    pthread_mutex_lock(&g_read_mu);
+    strmap_free(g_read_offsets);
+    g_read_offsets = NULL;
+    pthread_mutex_unlock(&g_read_mu);
+    g_reactor = reactor_new();
+    if (!g_reactor) {
+        ingest_stop();
+        return -1;
+    }
+    /* Follow the journal only if journalctl is available in PATH. In
      * sandboxed environments (Flatpak build/run sandbox) journalctl may not
      * be present; avoid spawning it and instead continue with file-based
      * indexing. This makes the app behave more gracefully when run in a
      * restricted environment. */
     if (program_in_path("journalctl")) {
-        if (pthread_create(&g_jth, NULL, journal_thread, db) != 0) {
-            g_jth = 0;
+        JournalSource *j = calloc(1, sizeof(*j));
+        if (j) {
+            j->db = db;
+            j->fd = -1;
+            if (reactor_add(g_reactor, &journal_ops, j) != 0) free(j);
         }
     } else {
-        fprintf(stderr, "indexer: journalctl not found in PATH, skipping journal thread\n");
-        g_jth = 0;
+        fprintf(stderr, "indexer: journalctl not found in PATH, skipping the journal\n");
+    }
+    FileSource *f = calloc(1, sizeof(*f));
+    if (f) {
+        f->db = db;
+        f->ifd = -1;
+        if (reactor_add(g_reactor, &files_ops, f) != 0) free(f);
     }
-    if (pthread_create(&g_fth, NULL, varlog_thread, db) != 0) {
-        g_fth = 0;
+    // Network syslog, if LOG_EXPLORER_SYSLOG_UDP/_TCP are set; a bad address is reported and skipped.
+    syslog_add_from_env(g_reactor);
+    if (reactor_start(g_reactor) != 0) {
+        reactor_free(g_reactor);
+        g_reactor = NULL;
+        ingest_stop();
+        return -1;
     }
     return 0;
 }
 
 int indexer_stop(void) {
-    if (!g_indexer_running) return 0;
-    g_indexer_running = 0;
-    // join threads if they were started
-    if (g_jth) pthread_join(g_jth, NULL);
-    if (g_fth) pthread_join(g_fth, NULL);
-    g_jth = g_fth = 0;
+    if (!g_reactor) return 0;
+    // stops journalctl, closes connections and files, writes the journal cursor
+    reactor_free(g_reactor);
+    g_reactor = NULL;
+    // write out whatever the inputs queued or spilled
+    ingest_stop();
     return 0;
 }
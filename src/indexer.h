@@ -2,11 +2,21 @@
 
 #include "db.h"
 
-// Start the indexer. This will spawn background threads to:
-//  - read systemd journal (if available) using `journalctl -o json -f --since ...`
-//  - scan and tail files under /var/log
-// Returns 0 on success (threads started) or -1 on failure to start.
+// Start the indexer. One reactor thread (see reactor.h) runs the inputs:
+//  - the systemd journal (if available), followed with `journalctl -o json -f`
+//  - files under /var/log, read once and then tailed as inotify reports writes
+//  - network syslog listeners, if configured (see syslog.h)
+// Returns 0 on success or -1 on failure to start.
 int indexer_start(DB *db);
-// Stop the indexer and wait for background threads to finish. Returns 0 on success.
+// Stop the inputs, which takes at most one batch, and write out everything queued. Returns 0 on success.
 int indexer_stop(void);
 
+
+// Single-shot entry points into the ingest paths used by the indexer's
+// inputs, exposed for tools and benchmarks that need to drive them directly.
+// Rows go through the ingest writer, so ingest_start must have been called
+// (indexer_start does this); ingest_flush waits until they are stored.
+// Ingest one `journalctl -o json` line (also advances .journal_cursor once the row is committed).
+void indexer_ingest_journal_line(DB *db, const char *line);
+// Ingest new lines of a plain-text log file from its stored offset (see .offsets/), up to end of file.
+void indexer_ingest_file(DB *db, const char *path);
@@ -0,0 +1,104 @@
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "db.h"
+#include "indexer.h"
+#include "metrics.h"
+#include "notify.h"
+
+/* log-explorer-indexerd: the indexer as a daemon of its own.
+ *
+ * Reading the journal and /var/log needs privileges the viewers should not
+ * have. The daemon runs the inputs (indexer.h) on the only writer
+ * connection to the database and announces committed rows on a Unix
+ * socket (notify.h). The GUI and the CLI find the socket next to the
+ * database, open it read-only and search while the daemon writes (the
+ * database is in WAL mode), so any number of viewers share one indexing
+ * pass. Runs until SIGINT or SIGTERM. */
+
+static void usage(FILE *out) {
+    fprintf(out,
+        "Usage: log-explorer-indexerd [options]\n"
+        "\n"
+        "Index the journal, /var/log and configured syslog listeners into the log\n"
+        "database and announce new rows to read-only viewers.\n"
+        "\n"
+        "  -d, --db PATH         database file (default ./log.db)\n"
+        "  -S, --socket PATH     notification socket (default $LOG_EXPLORER_SOCKET,\n"
+        "                        or the database path followed by .sock)\n"
+        "  -h, --help            show this help\n");
+}
+
+int main(int argc, char **argv) {
+    const char *db_path = "./log.db";
+    const char *socket_path = NULL;
+    static const struct option long_opts[] = {
+        { "db", required_argument, NULL, 'd' },
+        { "socket", required_argument, NULL, 'S' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:S:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd': db_path = optarg; break;
+        case 'S': socket_path = optarg; break;
+        case 'h': usage(stdout); return 0;
+        default: usage(stderr); return 2;
+        }
+    }
+    if (optind < argc) { usage(stderr); return 2; }
+
+    char sock[PATH_MAX];
+    if (socket_path) snprintf(sock, sizeof(sock), "%s", socket_path);
+    else if (notify_socket_path(db_path, sock, sizeof(sock)) != 0) {
+        fprintf(stderr, "socket path for %s is too long; use --socket\n", db_path);
+        return 2;
+    }
+
+    /* Every thread started below inherits the blocked signals, so they
+     * are only ever taken by sigwait at the end of main. */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    DB db;
+    if (db_open(&db, db_path) != 0) {
+        fprintf(stderr, "cannot open %s\n", db_path);
+        return 1;
+    }
+    // Viewers cannot create the WAL files next to a database they may only read.
+    if (db_keep_wal(&db) != 0) fprintf(stderr, "warning: %s will drop its WAL files on exit\n", db_path);
+    if (notify_server_start(&db, sock) != 0) {
+        db_close(&db);
+        return 1;
+    }
+    if (indexer_start(&db) != 0) {
+        fprintf(stderr, "cannot start the indexer\n");
+        notify_server_stop();
+        db_close(&db);
+        return 1;
+    }
+    const char *metrics_file = getenv("LOG_EXPLORER_METRICS_FILE");
+    if (metrics_file && *metrics_file) {
+        const char *iv = getenv("LOG_EXPLORER_METRICS_INTERVAL");
+        metrics_exporter_start(metrics_file, iv ? atoi(iv) : 10, db_write_stats, &db);
+    }
+    fprintf(stderr, "indexing into %s, announcing rows on %s\n", db_path, sock);
+
+    int sig = 0;
+    sigwait(&stop_signals, &sig);
+
+    // The rows written out while stopping are still announced.
+    indexer_stop();
+    notify_server_stop();
+    metrics_exporter_stop();
+    db_close(&db);
+    return 0;
+}
@@ -0,0 +1,741 @@
+#include "ingest.h"
+#include "ratelimit.h"
+#include "timestamp.h"
+#include "topk.h"
+#include "saved.h"
+#include "notify.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// Rows per transaction for the writer.
+#define INGEST_BATCH 512
+// Spill file layout: 8-byte replay offset, then SpillHdr + string data per row.
+#define SPILL_DATA_START 8
+// Largest chunk read from the spill file per replay batch.
+#define SPILL_READ_CHUNK (1 << 20)
+// Pause before trying a batch again that the database refused.
+#define WRITE_RETRY_MS 1000
+
+/* One queued row. The four strings live NUL-terminated in data, in the
+ * order source, unit, ts, message; the same bytes are written to the
+ * spill file after a SpillHdr. */
+typedef struct IngestRec {
+    struct IngestRec *next;
+    uint32_t kind;
+    uint32_t len[4];
+    int32_t pri;         // LogRecord.pri
+    uint64_t submit_ms;  // wall clock, for replay lag
+    size_t data_len;
+    char data[];
+} IngestRec;
+
+/* Work to run once the rows submitted before it are committed (see
+ * ingest_checkpoint). Kept in submission order. */
+typedef struct Checkpoint {
+    struct Checkpoint *next;
+    long long seq;           // runs once g_committed reaches it
+    void (*fn)(void *ctx);
+    void *ctx;
+    char key[];
+} Checkpoint;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t len[4];
+    uint32_t pri1;       // syslog PRI + 1, 0 for none (zero in files from before PRI existed)
+    uint64_t submit_ms;
+} SpillHdr;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cv_work = PTHREAD_COND_INITIALIZER;  // writer: rows available or stopping
+static pthread_cond_t g_cv_space = PTHREAD_COND_INITIALIZER; // producers blocked on a full queue
+static pthread_cond_t g_cv_idle = PTHREAD_COND_INITIALIZER;  // flush waiters
+static pthread_t g_writer;
+static DB *g_db = NULL;
+static int g_running = 0;
+static int g_busy = 0;   // writer is inserting a batch outside the lock
+static int g_waiters = 0; // producers blocked in ingest_submit; the writer outlives them
+
+static IngestRec *g_head = NULL, *g_tail = NULL;
+static long long g_q_rows = 0, g_q_bytes = 0;
+static long long g_max_rows = 8192, g_max_bytes = 16LL << 20;
+static uint64_t g_hold_until_ms = 0; // wall clock end of ingest_hold, 0 when not held
+
+static char *g_spill_path = NULL;
+static int g_spill_fd = -1;
+static off_t g_spill_read = SPILL_DATA_START;  // next record to replay
+static off_t g_spill_write = SPILL_DATA_START; // end of data
+static long long g_spill_rows = 0;  // rows between read and write offsets
+static long long g_spilled_total = 0, g_replayed_total = 0;
+static double g_replay_lag = 0;
+static int g_write_failing = 0;  // the last batch could not be inserted
+
+// Rows accepted and rows stored (or kept in the spill file at stop), counted from ingest_start.
+static long long g_submitted = 0, g_committed = 0;
+static Checkpoint *g_cp_head = NULL, *g_cp_tail = NULL;
+
+static void enqueue_summaries(int all);
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+// Called with g_mu held. Ends an expired hold.
+static int held_locked(void) {
+    if (g_hold_until_ms && wall_ms() >= g_hold_until_ms) g_hold_until_ms = 0;
+    return g_hold_until_ms != 0;
+}
+
+// Wait on cv until it is signalled or the hold expires. Called with g_mu held.
+static void hold_wait_locked(pthread_cond_t *cv) {
+    struct timespec until = { (time_t)(g_hold_until_ms / 1000), (long)(g_hold_until_ms % 1000) * 1000000L };
+    pthread_cond_timedwait(cv, &g_mu, &until);
+}
+
+static int spilling(void) {
+    return g_spill_write > g_spill_read;
+}
+
+static void update_gauges(void) {
+    metrics_gauge_set(METRIC_GAUGE_INGEST_QUEUE_DEPTH, g_q_rows);
+    metrics_gauge_set(METRIC_GAUGE_SPILL_PENDING_BYTES, (int64_t)(g_spill_write - g_spill_read));
+    metrics_gauge_set(METRIC_GAUGE_REPLAY_LAG_MS, (int64_t)(g_replay_lag * 1000.0));
+}
+
+static int write_full(int fd, const void *buf, size_t n, off_t off) {
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t w = pwrite(fd, p, n, off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+        off += w;
+    }
+    return 0;
+}
+
+static void spill_store_read_offset(void) {
+    uint64_t off = (uint64_t)g_spill_read;
+    write_full(g_spill_fd, &off, sizeof(off), 0);
+}
+
+/* Open the spill file and pick up rows a previous run did not replay. A
+ * record cut short by a crash is dropped from the end of the file. */
+static void spill_open(void) {
+    g_spill_fd = open(g_spill_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (g_spill_fd < 0) {
+        fprintf(stderr, "ingest: cannot open spill file %s: %s\n", g_spill_path, strerror(errno));
+        return;
+    }
+    struct stat st;
+    uint64_t off = 0;
+    if (fstat(g_spill_fd, &st) != 0 || st.st_size < SPILL_DATA_START ||
+        pread(g_spill_fd, &off, sizeof(off), 0) != (ssize_t)sizeof(off) ||
+        off < SPILL_DATA_START || (off_t)off > st.st_size) {
+        off = SPILL_DATA_START;
+        st.st_size = SPILL_DATA_START;
+    }
+    off_t pos = (off_t)off;
+    long long rows = 0;
+    SpillHdr h;
+    while (pos + (off_t)sizeof(h) <= st.st_size &&
+           pread(g_spill_fd, &h, sizeof(h), pos) == (ssize_t)sizeof(h)) {
+        off_t next = pos + (off_t)sizeof(h) + h.len[0] + h.len[1] + h.len[2] + h.len[3] + 4;
+        if (next > st.st_size) break;
+        pos = next;
+        rows++;
+    }
+    if (ftruncate(g_spill_fd, pos) != 0) { /* keep going; the tail is ignored anyway */ }
+    g_spill_read = (off_t)off;
+    g_spill_write = pos;
+    g_spill_rows = rows;
+    if (!spilling()) {
+        g_spill_read = g_spill_write = SPILL_DATA_START;
+        if (ftruncate(g_spill_fd, SPILL_DATA_START) != 0) { /* ignore */ }
+    } else {
+        fprintf(stderr, "ingest: replaying %lld rows left in %s\n", rows, g_spill_path);
+    }
+    spill_store_read_offset();
+}
+
+static size_t spill_record(char *out, const IngestRec *rec) {
+    SpillHdr h = { rec->kind, { rec->len[0], rec->len[1], rec->len[2], rec->len[3] },
+                   (uint32_t)(rec->pri + 1), rec->submit_ms };
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + sizeof(h), rec->data, rec->data_len);
+    return sizeof(h) + rec->data_len;
+}
+
+/* Append the n records starting at recs to the spill file with one write.
+ * Called with g_mu held. */
+static int spill_append(IngestRec *const *recs, size_t n) {
+    if (g_spill_fd < 0) return -1;
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) total += sizeof(SpillHdr) + recs[i]->data_len;
+    char stackbuf[4096];
+    char *buf = total <= sizeof(stackbuf) ? stackbuf : malloc(total);
+    if (!buf) return -1;
+    size_t pos = 0;
+    for (size_t i = 0; i < n; ++i) pos += spill_record(buf + pos, recs[i]);
+    int rc = write_full(g_spill_fd, buf, total, g_spill_write);
+    if (buf != stackbuf) free(buf);
+    if (rc != 0) return -1;
+    if (!spilling())
+        fprintf(stderr, "ingest: writer is behind (%lld rows queued), spilling to %s\n", g_q_rows, g_spill_path);
+    g_spill_write += (off_t)total;
+    g_spill_rows += (long long)n;
+    g_spilled_total += (long long)n;
+    metrics_add(METRIC_INGEST_SPILLED, n);
+    return 0;
+}
+
+/* Insert a batch, retrying a few times so a transient SQLITE_BUSY does not
+ * stall the writer. Returns -1 if every attempt failed; the caller keeps
+ * the rows and tries again later. Called without g_mu. */
+static int write_batch(const LogRecord *recs, size_t n) {
+    uint64_t t0 = metrics_now_ns();
+    for (int attempt = 0; attempt < 5; ++attempt) {
+        if (db_insert_logs(g_db, recs, n) == 0) {
+            metrics_observe_ns(METRIC_HIST_INGEST_BATCH, metrics_now_ns() - t0);
+            topk_observe(recs, n);
+            topk_checkpoint(g_db, 0);
+            saved_notify();
+            notify_committed(g_db);
+            if (g_write_failing) fprintf(stderr, "ingest: inserting rows again\n");
+            g_write_failing = 0;
+            return 0;
+        }
+        usleep(100000 << attempt);
+    }
+    if (!g_write_failing)
+        fprintf(stderr, "ingest: cannot insert %zu rows, keeping them to retry: %s\n", n, sqlite3_errmsg(g_db->db));
+    g_write_failing = 1;
+    metrics_add(METRIC_INGEST_ERRORS, n);
+    return -1;
+}
+
+// Wait before retrying a refused batch; stopping cuts the wait short. Called with g_mu held.
+static void retry_wait_locked(void) {
+    uint64_t until_ms = wall_ms() + WRITE_RETRY_MS;
+    struct timespec until = { (time_t)(until_ms / 1000), (long)(until_ms % 1000) * 1000000L };
+    if (g_running) pthread_cond_timedwait(&g_cv_work, &g_mu, &until);
+}
+
+/* Stopping while the database refuses rows: move the queue to the spill
+ * file, which the next start replays. Rows spilled earlier were submitted
+ * after the queued ones, so only then do they replay out of order. Returns
+ * -1 if the rows were dropped. Called with g_mu held. */
+static int park_queue_locked(void) {
+    size_t n = 0;
+    for (IngestRec *r = g_head; r; r = r->next) n++;
+    if (!n) return 0;
+    IngestRec **recs = malloc(sizeof(*recs) * n);
+    size_t i = 0;
+    for (IngestRec *r = g_head; r && recs; r = r->next) recs[i++] = r;
+    int rc = recs && spill_append(recs, n) == 0 ? 0 : -1;
+    if (rc == 0) {
+        if (fsync(g_spill_fd) != 0) { /* written; only a power failure can still lose it */ }
+        fprintf(stderr, "ingest: %zu unwritten rows kept in %s for the next start\n", n, g_spill_path);
+    } else {
+        fprintf(stderr, "ingest: cannot keep %zu unwritten rows, dropping them\n", n);
+        metrics_add(METRIC_INGEST_ERRORS, n);
+    }
+    free(recs);
+    while (g_head) {
+        IngestRec *next = g_head->next;
+        free(g_head);
+        g_head = next;
+    }
+    g_tail = NULL;
+    g_q_rows = g_q_bytes = 0;
+    return rc;
+}
+
+static void fill_record(LogRecord *r, const char *data, const uint32_t *len, int pri) {
+    r->source = data;
+    r->unit = r->source + len[0] + 1;
+    r->ts = r->unit + len[1] + 1;
+    r->message = r->ts + len[2] + 1;
+    r->pri = pri;
+}
+
+/* Replay up to INGEST_BATCH rows from [from, to) of the spill file. Returns
+ * the offset after the last replayed row, or from with *failed set if the
+ * database refused them. Called without g_mu. */
+static off_t replay_batch(off_t from, off_t to, char **buf, size_t *cap, long long *rows, uint64_t *last_ms,
+                          int *failed) {
+    size_t want = (size_t)(to - from);
+    if (want > SPILL_READ_CHUNK) want = SPILL_READ_CHUNK;
+    if (*cap < want) {
+        char *nb = realloc(*buf, want);
+        if (!nb) return from;
+        *buf = nb;
+        *cap = want;
+    }
+    ssize_t got = pread(g_spill_fd, *buf, want, from);
+    if (got <= 0) return from;
+    LogRecord recs[INGEST_BATCH];
+    size_t n = 0;
+    size_t pos = 0;
+    while (n < INGEST_BATCH && pos + sizeof(SpillHdr) <= (size_t)got) {
+        SpillHdr h;
+        memcpy(&h, *buf + pos, sizeof(h));
+        size_t rec_len = sizeof(h) + h.len[0] + h.len[1] + h.len[2] + h.len[3] + 4;
+        if (pos + rec_len > (size_t)got) {
+            if (n == 0) {
+                /* A single row larger than the chunk: grow and read it whole. */
+                char *nb = realloc(*buf, rec_len);
+                if (!nb) return from;
+                *buf = nb;
+                *cap = rec_len;
+                if (pread(g_spill_fd, *buf, rec_len, from) != (ssize_t)rec_len) return from;
+                got = (ssize_t)rec_len;
+                continue;
+            }
+            break;
+        }
+        fill_record(&recs[n++], *buf + pos + sizeof(h), h.len, (int)h.pri1 - 1);
+        *last_ms = h.submit_ms;
+        pos += rec_len;
+    }
+    if (write_batch(recs, n) != 0) {
+        *failed = 1;
+        return from;
+    }
+    *rows = (long long)n;
+    return from + (off_t)pos;
+}
+
+static int checkpoint_due_locked(void) {
+    return g_cp_head && g_cp_head->seq <= g_committed;
+}
+
+/* Run the checkpoints whose rows are committed, in order, outside the
+ * lock. Called with g_mu held. */
+static void run_checkpoints_locked(void) {
+    if (!checkpoint_due_locked()) return;
+    Checkpoint *due = g_cp_head, *last = g_cp_head;
+    while (last->next && last->next->seq <= g_committed) last = last->next;
+    g_cp_head = last->next;
+    if (!g_cp_head) g_cp_tail = NULL;
+    last->next = NULL;
+    g_busy = 1;
+    pthread_mutex_unlock(&g_mu);
+    while (due) {
+        Checkpoint *next = due->next;
+        due->fn(due->ctx);
+        free(due->ctx);
+        free(due);
+        due = next;
+    }
+    pthread_mutex_lock(&g_mu);
+}
+
+static void *writer_thread(void *arg) {
+    (void)arg;
+    char *spill_buf = NULL;
+    size_t spill_cap = 0;
+    int give_up = 0;  // stopping, and the database still refuses rows
+    pthread_mutex_lock(&g_mu);
+    while (!give_up) {
+        // Rows wait in the queue (or spill) while held; stopping writes them regardless.
+        for (;;) {
+            if (g_running && held_locked()) hold_wait_locked(&g_cv_work);
+            else if (!g_head && !spilling() && !checkpoint_due_locked() && (g_running || g_waiters > 0))
+                pthread_cond_wait(&g_cv_work, &g_mu);
+            else break;
+        }
+        if (!g_head && !spilling()) {
+            // Only checkpoints registered after their rows were already committed.
+            if (!checkpoint_due_locked()) break; /* stopping and fully drained */
+        } else if (g_head) {
+            /* Queued rows were submitted before any spilled row, so they go first. */
+            IngestRec *batch = g_head;
+            IngestRec *last = g_head;
+            size_t n = 1;
+            long long bytes = (long long)last->data_len;
+            while (n < INGEST_BATCH && last->next) {
+                last = last->next;
+                bytes += (long long)last->data_len;
+                n++;
+            }
+            g_head = last->next;
+            if (!g_head) g_tail = NULL;
+            last->next = NULL;
+            g_q_rows -= (long long)n;
+            g_q_bytes -= bytes;
+            g_busy = 1;
+            update_gauges();
+            pthread_cond_broadcast(&g_cv_space);
+            pthread_mutex_unlock(&g_mu);
+
+            LogRecord recs[INGEST_BATCH];
+            size_t i = 0;
+            for (IngestRec *r = batch; r; r = r->next) fill_record(&recs[i++], r->data, r->len, r->pri);
+            int ok = write_batch(recs, n) == 0;
+            pthread_mutex_lock(&g_mu);
+            if (ok) g_committed += (long long)n;
+            else {
+                /* Back in front of the queue, ahead of everything submitted
+                 * after it, to be tried again (or parked when stopping). */
+                last->next = g_head;
+                g_head = batch;
+                if (!g_tail) g_tail = last;
+                g_q_rows += (long long)n;
+                g_q_bytes += bytes;
+                batch = NULL;
+                if (g_running) {
+                    retry_wait_locked();
+                } else {
+                    if (park_queue_locked() == 0) g_committed = g_submitted;
+                    give_up = 1;
+                }
+            }
+            while (batch) {
+                IngestRec *next = batch->next;
+                free(batch);
+                batch = next;
+            }
+        } else {
+            off_t from = g_spill_read, to = g_spill_write;
+            g_busy = 1;
+            pthread_mutex_unlock(&g_mu);
+
+            long long rows = 0;
+            uint64_t last_ms = 0;
+            int failed = 0;
+            off_t next = replay_batch(from, to, &spill_buf, &spill_cap, &rows, &last_ms, &failed);
+
+            pthread_mutex_lock(&g_mu);
+            if (failed) {
+                // The rows stay in the file, for the next attempt or the next start.
+                if (g_running) {
+                    retry_wait_locked();
+                } else {
+                    g_committed = g_submitted;
+                    give_up = 1;
+                }
+            } else {
+                if (next == from) {
+                    /* Unreadable spill data: give up on it rather than spin. */
+                    fprintf(stderr, "ingest: cannot read spill file %s, discarding %lld rows\n",
+                            g_spill_path, g_spill_rows);
+                    metrics_add(METRIC_INGEST_ERRORS, (uint64_t)g_spill_rows);
+                    next = g_spill_write;
+                    rows = g_spill_rows;
+                }
+                g_spill_read = next;
+                g_spill_rows -= rows;
+                g_committed += rows;
+                g_replayed_total += rows;
+                metrics_add(METRIC_INGEST_REPLAYED, (uint64_t)rows);
+                if (last_ms) g_replay_lag = (double)(wall_ms() - last_ms) / 1000.0;
+                if (!spilling()) {
+                    /* Caught up: reset the file so new rows go back to the queue. */
+                    g_spill_read = g_spill_write = SPILL_DATA_START;
+                    g_spill_rows = 0;
+                    if (ftruncate(g_spill_fd, SPILL_DATA_START) != 0) { /* offsets are reset anyway */ }
+                    fprintf(stderr, "ingest: spill replayed (%lld rows total), back to in-memory queue\n",
+                            g_replayed_total);
+                }
+                spill_store_read_offset();
+            }
+        }
+        run_checkpoints_locked();
+        g_busy = 0;
+        update_gauges();
+        pthread_cond_broadcast(&g_cv_space);
+        pthread_cond_broadcast(&g_cv_idle);
+    }
+    // Rows that could not be kept: their inputs read them again next time.
+    while (g_cp_head) {
+        Checkpoint *next = g_cp_head->next;
+        free(g_cp_head->ctx);
+        free(g_cp_head);
+        g_cp_head = next;
+    }
+    g_cp_tail = NULL;
+    pthread_mutex_unlock(&g_mu);
+    free(spill_buf);
+    return NULL;
+}
+
+static long long env_ll(const char *name, long long def) {
+    const char *v = getenv(name);
+    if (!v || !*v) return def;
+    long long n = atoll(v);
+    return n > 0 ? n : def;
+}
+
+int ingest_start(DB *db) {
+    pthread_mutex_lock(&g_mu);
+    if (g_running) { pthread_mutex_unlock(&g_mu); return 0; }
+    g_db = db;
+    g_max_rows = env_ll("LOG_EXPLORER_INGEST_QUEUE", 8192);
+    g_max_bytes = env_ll("LOG_EXPLORER_INGEST_QUEUE_MB", 16) << 20;
+    const char *sp = getenv("LOG_EXPLORER_SPILL_FILE");
+    free(g_spill_path);
+    g_spill_path = strdup(sp && *sp ? sp : ".ingest_spill");
+    spill_open();
+    // Rows left in the spill file come before anything checkpointed from now on.
+    g_submitted = g_spill_rows;
+    g_committed = 0;
+    topk_load(db);
+    saved_start(db);
+    g_running = 1;
+    if (pthread_create(&g_writer, NULL, writer_thread, NULL) != 0) {
+        g_running = 0;
+        pthread_mutex_unlock(&g_mu);
+        saved_stop();
+        return -1;
+    }
+    pthread_mutex_unlock(&g_mu);
+    return 0;
+}
+
+void ingest_hold(int max_ms) {
+    pthread_mutex_lock(&g_mu);
+    g_hold_until_ms = max_ms > 0 ? wall_ms() + (uint64_t)max_ms : 0;
+    pthread_mutex_unlock(&g_mu);
+}
+
+void ingest_release(void) {
+    pthread_mutex_lock(&g_mu);
+    if (g_hold_until_ms) {
+        g_hold_until_ms = 0;
+        pthread_cond_broadcast(&g_cv_work);
+    }
+    pthread_mutex_unlock(&g_mu);
+}
+
+int ingest_held(void) {
+    pthread_mutex_lock(&g_mu);
+    int held = g_running && held_locked();
+    pthread_mutex_unlock(&g_mu);
+    return held;
+}
+
+void ingest_flush(void) {
+    ingest_release();
+    pthread_mutex_lock(&g_mu);
+    while (g_head || spilling() || g_busy || checkpoint_due_locked()) pthread_cond_wait(&g_cv_idle, &g_mu);
+    pthread_mutex_unlock(&g_mu);
+}
+
+void ingest_stop(void) {
+    // Account for everything suppressed so far before the writer goes.
+    enqueue_summaries(1);
+    pthread_mutex_lock(&g_mu);
+    if (!g_running) { pthread_mutex_unlock(&g_mu); return; }
+    g_running = 0;
+    pthread_cond_broadcast(&g_cv_work);
+    pthread_cond_broadcast(&g_cv_space);
+    pthread_mutex_unlock(&g_mu);
+    pthread_join(g_writer, NULL);
+    topk_checkpoint(g_db, 1);
+    saved_stop();
+    if (g_spill_fd >= 0) {
+        // Rows the database refused while stopping stay in the file for the next start.
+        pthread_mutex_lock(&g_mu);
+        int keep = spilling();
+        pthread_mutex_unlock(&g_mu);
+        close(g_spill_fd);
+        g_spill_fd = -1;
+        if (!keep) unlink(g_spill_path);
+    }
+    update_gauges();
+}
+
+static IngestRec *rec_new(MetricSource kind, const LogRecord *in) {
+    const char *f[4] = { in->source ? in->source : "unknown", in->unit ? in->unit : "", in->ts ? in->ts : "",
+                         in->message };
+    uint32_t len[4];
+    size_t data_len = 0;
+    for (int i = 0; i < 4; ++i) {
+        len[i] = (uint32_t)strlen(f[i]);
+        data_len += len[i] + 1;
+    }
+    IngestRec *rec = malloc(sizeof(*rec) + data_len);
+    if (!rec) return NULL;
+    rec->next = NULL;
+    rec->kind = (uint32_t)kind;
+    rec->pri = in->pri;
+    rec->submit_ms = wall_ms();
+    rec->data_len = data_len;
+    char *p = rec->data;
+    for (int i = 0; i < 4; ++i) {
+        rec->len[i] = len[i];
+        memcpy(p, f[i], len[i] + 1);
+        p += len[i] + 1;
+    }
+    return rec;
+}
+
+/* Queue recs[0..n) in order, spilling when the queue is full. Takes
+ * ownership of the records. Called with g_mu held. */
+static void enqueue_locked(IngestRec **recs, size_t n) {
+    for (size_t i = 0; i < n; ++i) metrics_ingest((MetricSource)recs[i]->kind, recs[i]->len[3]);
+    g_submitted += (long long)n;
+    for (size_t i = 0; i < n; ++i) {
+        IngestRec *rec = recs[i];
+        int full = g_q_rows >= g_max_rows || g_q_bytes + (long long)rec->data_len > g_max_bytes;
+        // Once spilling, every later row goes to the file too, so write the rest in one go.
+        if ((spilling() || full) && spill_append(recs + i, n - i) == 0) {
+            for (; i < n; ++i) free(recs[i]);
+            break;
+        }
+        /* No spill possible: wait for the writer to drain the spill file
+         * and make room, so ordering is kept and nothing is dropped. */
+        g_waiters++;
+        while (spilling() || g_q_rows >= g_max_rows ||
+               (g_q_rows > 0 && g_q_bytes + (long long)rec->data_len > g_max_bytes)) {
+            pthread_cond_wait(&g_cv_space, &g_mu);
+        }
+        g_waiters--;
+        if (g_tail) g_tail->next = rec; else g_head = rec;
+        g_tail = rec;
+        g_q_rows++;
+        g_q_bytes += (long long)rec->data_len;
+    }
+    pthread_cond_signal(&g_cv_work);
+}
+
+typedef struct {
+    IngestRec **recs;
+    size_t n, cap;
+} RecVec;
+
+static void summary_rec(void *ctx, MetricSource kind, const char *source, const char *unit, uint64_t suppressed,
+                        uint64_t window_ms) {
+    RecVec *v = ctx;
+    if (v->n == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 16;
+        IngestRec **r = realloc(v->recs, sizeof(*r) * cap);
+        if (!r) return;
+        v->recs = r;
+        v->cap = cap;
+    }
+    // "48,213"
+    char digits[32], count[48];
+    int nd = snprintf(digits, sizeof(digits), "%llu", (unsigned long long)suppressed), k = 0;
+    for (int i = 0; i < nd; ++i) {
+        if (i > 0 && (nd - i) % 3 == 0) count[k++] = ',';
+        count[k++] = digits[i];
+    }
+    count[k] = '\0';
+    unsigned long long sec = (window_ms + 500) / 1000;
+    char msg[1024], ts[TS_BUF];
+    snprintf(msg, sizeof(msg), "suppressed %s messages from %s in %llus", count, *unit ? unit : source,
+             sec ? sec : 1);
+    ts_format_us((int64_t)wall_ms() * 1000, ts);
+    LogRecord r = { source, unit, ts, msg, -1 };
+    IngestRec *rec = rec_new(kind, &r);
+    if (rec) v->recs[v->n++] = rec;
+}
+
+/* Queue one summary row per rate-limited bucket whose report is due (see
+ * ratelimit.h), or for every bucket with suppressed rows. */
+static void enqueue_summaries(int all) {
+    RecVec v = { 0 };
+    ratelimit_report(all, summary_rec, &v);
+    if (!v.n) return;
+    pthread_mutex_lock(&g_mu);
+    if (g_running) enqueue_locked(v.recs, v.n);
+    else
+        for (size_t i = 0; i < v.n; ++i) free(v.recs[i]);
+    pthread_mutex_unlock(&g_mu);
+    free(v.recs);
+}
+
+int ingest_submit(MetricSource kind, const char *source, const char *unit, const char *message, const char *ts) {
+    if (!message) return -1;
+    LogRecord r = { source, unit, ts, message, -1 };
+    return ingest_submit_many(kind, &r, 1);
+}
+
+int ingest_submit_many(MetricSource kind, const LogRecord *recs, size_t n) {
+    IngestRec *stackrecs[64];
+    IngestRec **built = n <= 64 ? stackrecs : malloc(sizeof(*built) * n);
+    size_t m = 0, i = 0;
+    for (; built && i < n; ++i) {
+        if (!recs[i].message || !ratelimit_allow(kind, recs[i].source, recs[i].unit)) continue;
+        if (!(built[m] = rec_new(kind, &recs[i]))) break;
+        m++;
+    }
+    // Out of memory: the rows built so far are still queued, the rest are lost.
+    size_t lost = 0;
+    for (; i < n; ++i)
+        if (recs[i].message) lost++;
+    if (lost) {
+        fprintf(stderr, "ingest: out of memory, dropping %zu rows\n", lost);
+        metrics_add(METRIC_INGEST_ERRORS, lost);
+    }
+    pthread_mutex_lock(&g_mu);
+    int rc = g_running ? 0 : -1;
+    if (rc == 0) enqueue_locked(built, m);
+    pthread_mutex_unlock(&g_mu);
+    if (rc != 0)
+        for (size_t i = 0; i < m; ++i) free(built[i]);
+    if (built != stackrecs) free(built);
+    if (rc == 0) enqueue_summaries(0);
+    return lost ? -1 : rc;
+}
+
+int ingest_checkpoint(const char *key, void (*fn)(void *ctx), void *ctx) {
+    pthread_mutex_lock(&g_mu);
+    if (!g_running) {
+        pthread_mutex_unlock(&g_mu);
+        free(ctx);
+        return -1;
+    }
+    Checkpoint *t = g_cp_tail;
+    if (t && t->fn == fn && strcmp(t->key, key) == 0) {
+        // Supersedes the one before it, which has not run yet.
+        free(t->ctx);
+        t->ctx = ctx;
+        t->seq = g_submitted;
+    } else {
+        size_t klen = strlen(key);
+        if (!(t = malloc(sizeof(*t) + klen + 1))) {
+            pthread_mutex_unlock(&g_mu);
+            free(ctx);
+            return -1;
+        }
+        t->next = NULL;
+        t->seq = g_submitted;
+        t->fn = fn;
+        t->ctx = ctx;
+        memcpy(t->key, key, klen + 1);
+        if (g_cp_tail) g_cp_tail->next = t; else g_cp_head = t;
+        g_cp_tail = t;
+    }
+    pthread_cond_signal(&g_cv_work);
+    pthread_mutex_unlock(&g_mu);
+    return 0;
+}
+
+void ingest_get_stats(IngestStats *out) {
+    pthread_mutex_lock(&g_mu);
+    out->queued_rows = g_q_rows;
+    out->queued_bytes = g_q_bytes;
+    out->spill_pending_rows = g_spill_rows;
+    out->spill_pending_bytes = (long long)(g_spill_write - g_spill_read);
+    out->spilled_total = g_spilled_total;
+    out->replayed_total = g_replayed_total;
+    out->replay_lag_sec = g_replay_lag;
+    out->spilling = spilling();
+    pthread_mutex_unlock(&g_mu);
+    out->suppressed_total = (long long)ratelimit_suppressed_total();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "db.h"
+#include "metrics.h"
+
+/* Ingest pipeline between the input threads and SQLite.
+ *
+ * Inputs call ingest_submit, which never waits on the database: records go
+ * into a bounded in-memory queue drained by a single writer thread that
+ * inserts them in batches. When the queue is full (the writer is behind),
+ * records are appended to an on-disk spill file instead, and everything
+ * submitted after that also goes to the spill file until the writer has
+ * replayed it, so rows reach the database in submission order. If the
+ * spill file cannot be written, ingest_submit blocks until the queue has
+ * room: logs are delayed, never dropped. The only rows not stored are those
+ * over a configured rate limit, and they are counted into summary rows
+ * (see ratelimit.h), and those that find no memory to be queued in.
+ *
+ * Tunables (environment):
+ *   LOG_EXPLORER_INGEST_QUEUE      max queued rows (default 8192)
+ *   LOG_EXPLORER_INGEST_QUEUE_MB   max queued message bytes (default 16)
+ *   LOG_EXPLORER_SPILL_FILE        spill file path (default ./.ingest_spill)
+ *   LOG_EXPLORER_RATELIMIT         per-source/unit rate limit rules file (default none)
+ */
+
+typedef struct {
+    long long queued_rows;       // rows currently in memory
+    long long queued_bytes;
+    long long spill_pending_rows; // rows in the spill file not yet replayed
+    long long spill_pending_bytes;
+    long long spilled_total;     // rows ever written to the spill file
+    long long replayed_total;    // rows replayed from the spill file
+    double replay_lag_sec;       // age of the spilled row replayed most recently
+    int spilling;                // new rows currently go to the spill file
+    long long suppressed_total;  // rows dropped by rate limits (see ratelimit.h)
+} IngestStats;
+
+// Start the writer thread. Any rows left in the spill file by a previous run are replayed first.
+int ingest_start(DB *db);
+// Stop accepting rows, write everything queued or spilled, and join the writer.
+void ingest_stop(void);
+/* Startup hold: until ingest_release is called, or for at most max_ms, the
+ * writer leaves rows queued (spilling as usual when the queue fills) and
+ * does not touch the database, so the first interactive query does not
+ * queue behind ingest batches for DB.lock. Can be set before ingest_start.
+ * Stopping or flushing ends the hold. */
+void ingest_hold(int max_ms);
+void ingest_release(void);
+// Whether the writer is held, for inputs whose rows would only pile up meanwhile.
+int ingest_held(void);
+// Wait until every row submitted so far has been written.
+void ingest_flush(void);
+// Queue one row. Strings are copied. Returns 0 on success, -1 if the writer is not running.
+int ingest_submit(MetricSource kind, const char *source, const char *unit, const char *message, const char *ts);
+/* Queue n rows in order under one lock acquisition, for inputs that read in
+ * batches (the syslog receiver). Rows without a message are skipped.
+ * Returns 0, or -1 if the writer is not running, or if memory ran out:
+ * the rows before that point are queued and the rest are counted in
+ * METRIC_INGEST_ERRORS. */
+int ingest_submit_many(MetricSource kind, const LogRecord *recs, size_t n);
+/* Run fn(ctx) on the writer thread once every row submitted so far is
+ * committed (or kept in the spill file by ingest_stop), for inputs that
+ * persist how far they have read: a journal cursor or file offset saved
+ * any earlier would skip rows a crash loses from the queue. Checkpoints
+ * run in the order they were made; one with the same key and fn as the
+ * last still pending replaces it. ctx is malloc'd and freed by ingest,
+ * also when fn never runs because the rows could not be kept. Returns 0,
+ * or -1 if the writer is not running. */
+int ingest_checkpoint(const char *key, void (*fn)(void *ctx), void *ctx);
+void ingest_get_stats(IngestStats *out);
@@ -2,31 +2,122 @@
 #ifndef G_APPLICATION_DEFAULT_FLAGS
 #define G_APPLICATION_DEFAULT_FLAGS G_APPLICATION_FLAGS_NONE
 #endif
+#include <errno.h>
+#include <glib-unix.h>
+#include <limits.h>
 #include <stdlib.h>
 #include "db.h"
 #include "ui.h"
 #include "indexer.h"
+#include "metrics.h"
+#include "ingest.h"
+#include "notify.h"
+#include "topk.h"
+
+/* How long background indexing may be held back at startup waiting for the
+ * first search (LOG_EXPLORER_STARTUP_HOLD, seconds; 0 disables the hold). */
+static int startup_hold_ms(void) {
+    const char *v = getenv("LOG_EXPLORER_STARTUP_HOLD");
+    int sec = v && *v ? atoi(v) : 30;
+    return sec > 0 ? sec * 1000 : 0;
+}
+
+/* Viewer of log-explorer-indexerd: the daemon announces committed rows on
+ * its socket. The top talkers are reloaded from its checkpoints, at most
+ * every TOP_RELOAD_MS. */
+#define TOP_RELOAD_MS 2000
+
+typedef struct {
+    NotifyClient *client;  // NULL when indexing in-process, or once the daemon has gone
+    DB *db;
+    gint64 top_loaded_us;
+    gboolean read_only;    // db is the daemon's, opened read-only
+} Viewer;
+
+static gboolean on_daemon_notify(gint fd, GIOCondition cond, gpointer user_data) {
+    (void)fd; (void)cond;
+    Viewer *v = user_data;
+    long long max_id = 0;
+    int rc = notify_read(v->client, &max_id);
+    if (rc < 0) {
+        g_warning("The indexer daemon went away; new rows will not be announced");
+        notify_close(v->client);
+        v->client = NULL;
+        return G_SOURCE_REMOVE;
+    }
+    if (rc == 0) return G_SOURCE_CONTINUE;
+    gint64 now = g_get_monotonic_time();
+    if (now - v->top_loaded_us >= TOP_RELOAD_MS * 1000) {
+        topk_load(v->db);
+        v->top_loaded_us = now;
+    }
+    ui_rows_committed(max_id);
+    return G_SOURCE_CONTINUE;
+}
+
+// Saved searches are marked read by the daemon (ui_set_mark_read).
+static int viewer_mark_read(void *ctx, long long id) {
+    Viewer *v = ctx;
+    return v->client ? notify_mark_read(v->client, id) : -1;
+}
 
 static void app_activate(GApplication *app, gpointer user_data) {
-    DB *db = (DB*)user_data;
-    GtkWidget *win = create_main_window(db);
+    Viewer *v = user_data;
+    GtkWidget *win = create_main_window(v->db, v->read_only);
     gtk_window_set_application(GTK_WINDOW(win), GTK_APPLICATION(app));
     gtk_window_present(GTK_WINDOW(win));
 }
 
 int main(int argc, char **argv) {
+    uint64_t start_ns = metrics_now_ns();
     /* Let GtkApplication initialize GTK when started via g_application_run().
      * Avoid calling gtk_init() here to prevent double-initialization and to
      * ensure the application id used by GApplication matches the Flatpak
      * app-id below. */
 
+    const char *db_path = "./log.db";
     DB db;
-    if (db_open(&db, "./log.db") != 0) {
-        return 1;
+    /* With log-explorer-indexerd running for this database, only view it:
+     * read-only, without privileges, sharing the daemon's indexing. */
+    char sock[PATH_MAX];
+    Viewer viewer = { NULL, &db, 0, FALSE };
+    int denied = 0;  // a daemon whose socket this user may not connect to (not in the database's group)
+    if (notify_socket_path(db_path, sock, sizeof(sock)) == 0) {
+        viewer.client = notify_connect(sock);
+        denied = !viewer.client && errno == EACCES;
+    }
+    int indexing = viewer.client == NULL && !denied;
+    if (!indexing) {
+        if (db_open_readonly(&db, db_path) != 0) {
+            notify_close(viewer.client);
+            return 1;
+        }
+        topk_load(&db);
+        viewer.read_only = TRUE;
+        viewer.top_loaded_us = g_get_monotonic_time();
+        ui_set_mark_read(viewer_mark_read, &viewer);
+        if (viewer.client)
+            g_unix_fd_add(notify_client_fd(viewer.client), G_IO_IN | G_IO_HUP | G_IO_ERR, on_daemon_notify, &viewer);
+        else
+            g_warning("Not allowed to connect to the indexer daemon on %s; new rows will not be announced", sock);
+    } else {
+        if (db_open(&db, db_path) != 0) {
+            return 1;
+        }
+        /* Start background indexing (journalctl + /var/log), held back until the
+         * first search has been served so it does not compete for DB.lock. */
+        ingest_hold(startup_hold_ms());
+        indexer_start(&db);
     }
+    ui_set_startup_ns(start_ns);
 
-    // Start background indexing (journalctl + /var/log)
-    indexer_start(&db);
+    /* Optional Prometheus text file, rewritten periodically for node_exporter's
+     * textfile collector or similar scrapers. */
+    const char *metrics_file = getenv("LOG_EXPLORER_METRICS_FILE");
+    if (metrics_file && *metrics_file) {
+        const char *iv = getenv("LOG_EXPLORER_METRICS_INTERVAL");
+        metrics_exporter_start(metrics_file, iv ? atoi(iv) : 10, db_write_stats, &db);
+    }
 
      /* G_APPLICATION_FLAGS_NONE is deprecated in newer glib; use the replacement
          macro to avoid deprecation warnings. */
@@ -37,13 +128,15 @@ int main(int argc, char **argv) {
      * and is a small, local CSS provider that doesn't depend on external files. Calling it
      * early ensures styles are applied before widgets are realized. */
     setup_css();
-    g_signal_connect(app, "activate", G_CALLBACK(app_activate), &db);
+    g_signal_connect(app, "activate", G_CALLBACK(app_activate), &viewer);
 
     int status = g_application_run(G_APPLICATION(app), argc, argv);
 
     g_object_unref(app);
     // stop indexer threads before closing DB
-    indexer_stop();
+    if (indexing) indexer_stop();
+    notify_close(viewer.client);
+    metrics_exporter_stop();
     db_close(&db);
     return status;
 }
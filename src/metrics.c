@@ -0,0 +1,308 @@
+#include "metrics.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct MetricsShard {
+    _Atomic uint64_t ingest_rows[METRIC_SRC_COUNT];
+    _Atomic uint64_t ingest_bytes[METRIC_SRC_COUNT];
+    _Atomic uint64_t counters[METRIC_COUNTER_COUNT];
+    _Atomic uint64_t hist[METRIC_HIST_COUNT][METRIC_HIST_BUCKETS];
+    _Atomic uint64_t hist_sum_ns[METRIC_HIST_COUNT];
+    struct MetricsShard *next;
+} MetricsShard;
+
+/* Threads add to their own shard without locking. g_mu guards the list,
+ * which changes only when a thread first records something or exits: an
+ * exiting thread's counts are folded into g_retired and its shard freed,
+ * so the list (and metrics_snapshot) covers live threads only, however
+ * many short-lived workers searches, counts and exports start. */
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static MetricsShard *g_shards = NULL;
+static MetricsShard g_retired;
+static _Atomic int64_t g_gauges[METRIC_GAUGE_COUNT];
+static __thread MetricsShard *t_shard = NULL;
+static pthread_key_t g_shard_key;
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+static void add_shard(MetricsShard *dst, MetricsShard *src) {
+    for (int i = 0; i < METRIC_SRC_COUNT; ++i) {
+        atomic_fetch_add_explicit(&dst->ingest_rows[i], atomic_load_explicit(&src->ingest_rows[i], memory_order_relaxed),
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&dst->ingest_bytes[i], atomic_load_explicit(&src->ingest_bytes[i], memory_order_relaxed),
+                                  memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_COUNTER_COUNT; ++i)
+        atomic_fetch_add_explicit(&dst->counters[i], atomic_load_explicit(&src->counters[i], memory_order_relaxed),
+                                  memory_order_relaxed);
+    for (int h = 0; h < METRIC_HIST_COUNT; ++h) {
+        for (int b = 0; b < METRIC_HIST_BUCKETS; ++b)
+            atomic_fetch_add_explicit(&dst->hist[h][b], atomic_load_explicit(&src->hist[h][b], memory_order_relaxed),
+                                      memory_order_relaxed);
+        atomic_fetch_add_explicit(&dst->hist_sum_ns[h], atomic_load_explicit(&src->hist_sum_ns[h], memory_order_relaxed),
+                                  memory_order_relaxed);
+    }
+}
+
+// Thread exit (the pthread key destructor): fold the shard into g_retired and unlink it.
+static void retire_shard(void *p) {
+    MetricsShard *s = p;
+    pthread_mutex_lock(&g_mu);
+    add_shard(&g_retired, s);
+    for (MetricsShard **pp = &g_shards; *pp; pp = &(*pp)->next) {
+        if (*pp != s) continue;
+        *pp = s->next;
+        break;
+    }
+    pthread_mutex_unlock(&g_mu);
+    t_shard = NULL;
+    free(s);
+}
+
+static void create_key(void) {
+    pthread_key_create(&g_shard_key, retire_shard);
+}
+
+// Register a shard for the calling thread on first use.
+static MetricsShard *shard(void) {
+    MetricsShard *s = t_shard;
+    if (s) return s;
+    pthread_once(&g_key_once, create_key);
+    s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    pthread_mutex_lock(&g_mu);
+    s->next = g_shards;
+    g_shards = s;
+    pthread_mutex_unlock(&g_mu);
+    pthread_setspecific(g_shard_key, s);
+    t_shard = s;
+    return s;
+}
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_ingest(MetricSource src, uint64_t bytes) {
+    MetricsShard *s = shard();
+    if (!s || src >= METRIC_SRC_COUNT) return;
+    atomic_fetch_add_explicit(&s->ingest_rows[src], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->ingest_bytes[src], bytes, memory_order_relaxed);
+}
+
+void metrics_add(MetricCounter c, uint64_t n) {
+    MetricsShard *s = shard();
+    if (!s || c >= METRIC_COUNTER_COUNT) return;
+    atomic_fetch_add_explicit(&s->counters[c], n, memory_order_relaxed);
+}
+
+void metrics_gauge_set(MetricGauge g, int64_t v) {
+    if (g >= METRIC_GAUGE_COUNT) return;
+    atomic_store_explicit(&g_gauges[g], v, memory_order_relaxed);
+}
+
+static int bucket_for(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int b = 0;
+    while (b < METRIC_HIST_BUCKETS - 1 && (1ULL << b) <= us) b++;
+    return b;
+}
+
+void metrics_observe_ns(MetricHist h, uint64_t ns) {
+    MetricsShard *s = shard();
+    if (!s || h >= METRIC_HIST_COUNT) return;
+    atomic_fetch_add_explicit(&s->hist[h][bucket_for(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->hist_sum_ns[h], ns, memory_order_relaxed);
+}
+
+static void snapshot_add(MetricsSnapshot *out, MetricsShard *s) {
+    for (int i = 0; i < METRIC_SRC_COUNT; ++i) {
+        out->ingest_rows[i] += atomic_load_explicit(&s->ingest_rows[i], memory_order_relaxed);
+        out->ingest_bytes[i] += atomic_load_explicit(&s->ingest_bytes[i], memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_COUNTER_COUNT; ++i)
+        out->counters[i] += atomic_load_explicit(&s->counters[i], memory_order_relaxed);
+    for (int h = 0; h < METRIC_HIST_COUNT; ++h) {
+        for (int b = 0; b < METRIC_HIST_BUCKETS; ++b) {
+            uint64_t v = atomic_load_explicit(&s->hist[h][b], memory_order_relaxed);
+            out->hist[h][b] += v;
+            out->hist_count[h] += v;
+        }
+        out->hist_sum_ns[h] += atomic_load_explicit(&s->hist_sum_ns[h], memory_order_relaxed);
+    }
+}
+
+void metrics_snapshot(MetricsSnapshot *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&g_mu);
+    snapshot_add(out, &g_retired);
+    for (MetricsShard *s = g_shards; s; s = s->next) snapshot_add(out, s);
+    pthread_mutex_unlock(&g_mu);
+    for (int i = 0; i < METRIC_GAUGE_COUNT; ++i)
+        out->gauges[i] = atomic_load_explicit(&g_gauges[i], memory_order_relaxed);
+}
+
+uint64_t metrics_hist_quantile_ns(const MetricsSnapshot *s, MetricHist h, double q) {
+    if (h >= METRIC_HIST_COUNT || s->hist_count[h] == 0) return 0;
+    uint64_t target = (uint64_t)(q * (double)s->hist_count[h]);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRIC_HIST_BUCKETS; ++b) {
+        seen += s->hist[h][b];
+        if (seen >= target) return (1ULL << b) * 1000ULL;
+    }
+    return (1ULL << (METRIC_HIST_BUCKETS - 1)) * 1000ULL;
+}
+
+const char *metrics_source_name(MetricSource src) {
+    switch (src) {
+    case METRIC_SRC_JOURNAL: return "journal";
+    case METRIC_SRC_FILE: return "file";
+    case METRIC_SRC_SYSLOG: return "syslog";
+    default: return "unknown";
+    }
+}
+
+const char *metrics_hist_name(MetricHist h) {
+    switch (h) {
+    case METRIC_HIST_DB_LOCK_WAIT: return "db_lock_wait";
+    case METRIC_HIST_DB_LOCK_HOLD: return "db_lock_hold";
+    case METRIC_HIST_DB_QUERY: return "db_query";
+    case METRIC_HIST_DB_WRITE: return "db_write";
+    case METRIC_HIST_INGEST_BATCH: return "ingest_batch";
+    case METRIC_HIST_UI_SEARCH: return "ui_search";
+    default: return "unknown";
+    }
+}
+
+void metrics_write_prometheus(FILE *out, const MetricsSnapshot *s) {
+    fprintf(out, "# HELP logexplorer_ingest_rows_total Rows handed to the DB writer, by source.\n");
+    fprintf(out, "# TYPE logexplorer_ingest_rows_total counter\n");
+    for (int i = 0; i < METRIC_SRC_COUNT; ++i)
+        fprintf(out, "logexplorer_ingest_rows_total{source=\"%s\"} %llu\n",
+                metrics_source_name((MetricSource)i), (unsigned long long)s->ingest_rows[i]);
+    fprintf(out, "# HELP logexplorer_ingest_bytes_total Message bytes handed to the DB writer, by source.\n");
+    fprintf(out, "# TYPE logexplorer_ingest_bytes_total counter\n");
+    for (int i = 0; i < METRIC_SRC_COUNT; ++i)
+        fprintf(out, "logexplorer_ingest_bytes_total{source=\"%s\"} %llu\n",
+                metrics_source_name((MetricSource)i), (unsigned long long)s->ingest_bytes[i]);
+    fprintf(out, "# TYPE logexplorer_ingest_errors_total counter\n");
+    fprintf(out, "logexplorer_ingest_errors_total %llu\n",
+            (unsigned long long)s->counters[METRIC_INGEST_ERRORS]);
+    fprintf(out, "# TYPE logexplorer_db_lock_acquires_total counter\n");
+    fprintf(out, "logexplorer_db_lock_acquires_total %llu\n",
+            (unsigned long long)s->counters[METRIC_DB_LOCK_ACQUIRES]);
+    fprintf(out, "# TYPE logexplorer_ingest_spilled_total counter\n");
+    fprintf(out, "logexplorer_ingest_spilled_total %llu\n",
+            (unsigned long long)s->counters[METRIC_INGEST_SPILLED]);
+    fprintf(out, "# TYPE logexplorer_ingest_replayed_total counter\n");
+    fprintf(out, "logexplorer_ingest_replayed_total %llu\n",
+            (unsigned long long)s->counters[METRIC_INGEST_REPLAYED]);
+    fprintf(out, "# TYPE logexplorer_ingest_suppressed_total counter\n");
+    fprintf(out, "logexplorer_ingest_suppressed_total %llu\n",
+            (unsigned long long)s->counters[METRIC_INGEST_SUPPRESSED]);
+    fprintf(out, "# TYPE logexplorer_ingest_queue_depth gauge\n");
+    fprintf(out, "logexplorer_ingest_queue_depth %lld\n",
+            (long long)s->gauges[METRIC_GAUGE_INGEST_QUEUE_DEPTH]);
+    fprintf(out, "# TYPE logexplorer_ingest_spill_pending_bytes gauge\n");
+    fprintf(out, "logexplorer_ingest_spill_pending_bytes %lld\n",
+            (long long)s->gauges[METRIC_GAUGE_SPILL_PENDING_BYTES]);
+    fprintf(out, "# TYPE logexplorer_ingest_replay_lag_seconds gauge\n");
+    fprintf(out, "logexplorer_ingest_replay_lag_seconds %.3f\n",
+            (double)s->gauges[METRIC_GAUGE_REPLAY_LAG_MS] / 1e3);
+    fprintf(out, "# TYPE logexplorer_ui_first_view_seconds gauge\n");
+    fprintf(out, "logexplorer_ui_first_view_seconds %.3f\n",
+            (double)s->gauges[METRIC_GAUGE_UI_FIRST_VIEW_MS] / 1e3);
+    fprintf(out, "# TYPE logexplorer_ui_first_results_seconds gauge\n");
+    fprintf(out, "logexplorer_ui_first_results_seconds %.3f\n",
+            (double)s->gauges[METRIC_GAUGE_UI_FIRST_RESULTS_MS] / 1e3);
+    for (int h = 0; h < METRIC_HIST_COUNT; ++h) {
+        const char *name = metrics_hist_name((MetricHist)h);
+        fprintf(out, "# TYPE logexplorer_%s_seconds histogram\n", name);
+        uint64_t cum = 0;
+        for (int b = 0; b < METRIC_HIST_BUCKETS; ++b) {
+            cum += s->hist[h][b];
+            fprintf(out, "logexplorer_%s_seconds_bucket{le=\"%g\"} %llu\n", name,
+                    (double)(1ULL << b) / 1e6, (unsigned long long)cum);
+        }
+        fprintf(out, "logexplorer_%s_seconds_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cum);
+        fprintf(out, "logexplorer_%s_seconds_sum %.9f\n", name, (double)s->hist_sum_ns[h] / 1e9);
+        fprintf(out, "logexplorer_%s_seconds_count %llu\n", name, (unsigned long long)s->hist_count[h]);
+    }
+}
+
+/* Exporter thread. Sleeps on a condition variable so stop is immediate. */
+static pthread_t g_exp_th;
+static int g_exp_running = 0;
+static pthread_mutex_t g_exp_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_exp_cv = PTHREAD_COND_INITIALIZER;
+static char *g_exp_path = NULL;
+static int g_exp_interval = 10;
+static MetricsExtraFn g_exp_extra = NULL;
+static void *g_exp_ctx = NULL;
+
+static void export_once(void) {
+    size_t n = strlen(g_exp_path) + 5;
+    char *tmp = malloc(n);
+    if (!tmp) return;
+    snprintf(tmp, n, "%s.tmp", g_exp_path);
+    FILE *f = fopen(tmp, "w");
+    if (f) {
+        MetricsSnapshot s;
+        metrics_snapshot(&s);
+        metrics_write_prometheus(f, &s);
+        if (g_exp_extra) g_exp_extra(f, g_exp_ctx);
+        if (fclose(f) == 0) rename(tmp, g_exp_path);
+    }
+    free(tmp);
+}
+
+static void *exporter_thread(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_exp_mu);
+    while (g_exp_running) {
+        pthread_mutex_unlock(&g_exp_mu);
+        export_once();
+        pthread_mutex_lock(&g_exp_mu);
+        struct timespec dl;
+        clock_gettime(CLOCK_REALTIME, &dl);
+        dl.tv_sec += g_exp_interval;
+        while (g_exp_running && pthread_cond_timedwait(&g_exp_cv, &g_exp_mu, &dl) == 0) {}
+    }
+    pthread_mutex_unlock(&g_exp_mu);
+    return NULL;
+}
+
+int metrics_exporter_start(const char *path, int interval_sec, MetricsExtraFn extra, void *ctx) {
+    if (!path || !*path || g_exp_running) return -1;
+    g_exp_path = strdup(path);
+    if (!g_exp_path) return -1;
+    g_exp_interval = interval_sec > 0 ? interval_sec : 10;
+    g_exp_extra = extra;
+    g_exp_ctx = ctx;
+    g_exp_running = 1;
+    if (pthread_create(&g_exp_th, NULL, exporter_thread, NULL) != 0) {
+        g_exp_running = 0;
+        free(g_exp_path);
+        g_exp_path = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_exporter_stop(void) {
+    pthread_mutex_lock(&g_exp_mu);
+    if (!g_exp_running) { pthread_mutex_unlock(&g_exp_mu); return; }
+    g_exp_running = 0;
+    pthread_cond_signal(&g_exp_cv);
+    pthread_mutex_unlock(&g_exp_mu);
+    pthread_join(g_exp_th, NULL);
+    /* Final write so the file reflects the state at shutdown. */
+    export_once();
+    free(g_exp_path);
+    g_exp_path = NULL;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Process-wide metrics for the indexer, database and UI hot paths.
+ *
+ * Every thread updates its own shard of counters and histogram buckets with
+ * relaxed atomics, so recording never contends with other threads. Readers
+ * (the stats panel, --stats, the Prometheus exporter) sum all shards on
+ * demand. When a thread exits its shard is folded into a shared one and
+ * freed, so counts from finished threads are kept without the number of
+ * shards growing with every worker thread. */
+
+// Ingest sources, used to break down ingest rates.
+typedef enum {
+    METRIC_SRC_JOURNAL = 0,
+    METRIC_SRC_FILE,
+    METRIC_SRC_SYSLOG,   // network syslog receiver
+    METRIC_SRC_COUNT
+} MetricSource;
+
+typedef enum {
+    METRIC_INGEST_ERRORS = 0,  // rows the writer failed to insert, or dropped
+    METRIC_DB_LOCK_ACQUIRES,
+    METRIC_INGEST_SPILLED,     // rows written to the spill file because the queue was full
+    METRIC_INGEST_REPLAYED,    // rows replayed from the spill file
+    METRIC_INGEST_SUPPRESSED,  // rows dropped by a rate limit (and counted into a summary row)
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    METRIC_GAUGE_INGEST_QUEUE_DEPTH = 0, // rows waiting for the DB writer
+    METRIC_GAUGE_SPILL_PENDING_BYTES,    // spill file bytes not yet replayed
+    METRIC_GAUGE_REPLAY_LAG_MS,          // age of the most recently replayed spilled row
+    METRIC_GAUGE_UI_FIRST_VIEW_MS,       // process start to the first frame of the main window
+    METRIC_GAUGE_UI_FIRST_RESULTS_MS,    // process start to the first search results shown
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+
+typedef enum {
+    METRIC_HIST_DB_LOCK_WAIT = 0, // time spent waiting for DB.lock
+    METRIC_HIST_DB_LOCK_HOLD,     // time DB.lock was held
+    METRIC_HIST_DB_QUERY,         // read-only statement run time (prepare excluded)
+    METRIC_HIST_DB_WRITE,         // write statement run time
+    METRIC_HIST_INGEST_BATCH,     // one batched insert by the ingest writer
+    METRIC_HIST_UI_SEARCH,        // search + list population in the UI
+    METRIC_HIST_COUNT
+} MetricHist;
+
+// Log2 buckets: bucket i counts samples with duration < 2^i microseconds.
+#define METRIC_HIST_BUCKETS 28
+
+typedef struct {
+    uint64_t ingest_rows[METRIC_SRC_COUNT];
+    uint64_t ingest_bytes[METRIC_SRC_COUNT];
+    uint64_t counters[METRIC_COUNTER_COUNT];
+    int64_t gauges[METRIC_GAUGE_COUNT];
+    uint64_t hist[METRIC_HIST_COUNT][METRIC_HIST_BUCKETS];
+    uint64_t hist_sum_ns[METRIC_HIST_COUNT];
+    uint64_t hist_count[METRIC_HIST_COUNT];
+} MetricsSnapshot;
+
+uint64_t metrics_now_ns(void);
+void metrics_ingest(MetricSource src, uint64_t bytes);
+void metrics_add(MetricCounter c, uint64_t n);
+void metrics_gauge_set(MetricGauge g, int64_t v);
+void metrics_observe_ns(MetricHist h, uint64_t ns);
+
+// Sum all thread shards into out.
+void metrics_snapshot(MetricsSnapshot *out);
+// Approximate quantile (0..1) of a histogram in nanoseconds, from bucket upper bounds.
+uint64_t metrics_hist_quantile_ns(const MetricsSnapshot *s, MetricHist h, double q);
+
+const char *metrics_source_name(MetricSource src);
+const char *metrics_hist_name(MetricHist h);
+
+// Write the snapshot in Prometheus text exposition format.
+void metrics_write_prometheus(FILE *out, const MetricsSnapshot *s);
+
+/* Periodically write the Prometheus text to path (via a temp file and
+ * rename, so scrapers never see a partial file). extra, if set, is called
+ * after the process metrics to append more series, e.g. db_write_stats. */
+typedef void (*MetricsExtraFn)(FILE *out, void *ctx);
+int metrics_exporter_start(const char *path, int interval_sec, MetricsExtraFn extra, void *ctx);
+void metrics_exporter_stop(void);
@@ -0,0 +1,294 @@
+#include "multidb.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+struct MultiDB {
+    size_t n;            // databases opened
+    size_t cap;
+    DB *dbs;
+    char **hosts;
+};
+
+// "/backup/web01.db" -> "web01"
+static char *host_label(const char *spec, const char **path) {
+    const char *eq = strchr(spec, '=');
+    if (eq && eq != spec) {
+        *path = eq + 1;
+        return strndup(spec, (size_t)(eq - spec));
+    }
+    *path = spec;
+    const char *base = strrchr(spec, '/');
+    base = base ? base + 1 : spec;
+    const char *dot = strrchr(base, '.');
+    return strndup(base, dot && dot != base ? (size_t)(dot - base) : strlen(base));
+}
+
+MultiDB *multidb_open(const char *const *specs, size_t n) {
+    MultiDB *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->dbs = calloc(n ? n : 1, sizeof(*m->dbs));
+    m->hosts = calloc(n ? n : 1, sizeof(*m->hosts));
+    if (!m->dbs || !m->hosts) { multidb_close(m); return NULL; }
+    m->cap = n;
+    for (size_t i = 0; i < n; ++i) {
+        const char *path;
+        m->hosts[i] = host_label(specs[i], &path);
+        if (!m->hosts[i] || db_open_readonly(&m->dbs[i], path) != 0) {
+            fprintf(stderr, "cannot open %s\n", path);
+            multidb_close(m);
+            return NULL;
+        }
+        m->n = i + 1;
+    }
+    return m;
+}
+
+void multidb_close(MultiDB *m) {
+    if (!m) return;
+    for (size_t i = 0; i < m->n; ++i) db_close(&m->dbs[i]);
+    for (size_t i = 0; i < m->cap; ++i) free(m->hosts[i]);
+    free(m->dbs);
+    free(m->hosts);
+    free(m);
+}
+
+size_t multidb_size(const MultiDB *m) { return m->n; }
+const char *multidb_host(const MultiDB *m, size_t i) { return i < m->n ? m->hosts[i] : NULL; }
+
+void multidb_cursor_format(const MultiCursor *c, char *buf, size_t n) {
+    if (c->ts_null) snprintf(buf, n, "%zu:%lld", c->shard, c->id);
+    else snprintf(buf, n, "%zu:%lld:%s", c->shard, c->id, c->ts);
+}
+
+int multidb_cursor_parse(const char *s, MultiCursor *out) {
+    memset(out, 0, sizeof(*out));
+    char *end;
+    unsigned long long shard = strtoull(s, &end, 10);
+    if (end == s || *end != ':') return -1;
+    s = end + 1;
+    long long id = strtoll(s, &end, 10);
+    if (end == s || (*end != ':' && *end != '\0')) return -1;
+    if (*end == ':') {
+        if (strlen(end + 1) >= sizeof(out->ts)) return -1;
+        strcpy(out->ts, end + 1);
+    } else {
+        out->ts_null = 1;
+    }
+    out->shard = (size_t)shard;
+    out->id = id;
+    out->valid = 1;
+    return 0;
+}
+
+// ---- parallel phase ----
+
+typedef struct {
+    DB *db;
+    DBSearchOpts opts;
+    sqlite3_stmt *stmt;
+    int rc;              // SQLITE_ROW / SQLITE_DONE, or an error
+    long long count;     // for multidb_count and multidb_count_estimate
+    int exact;           // for multidb_count_estimate
+} Shard;
+
+struct MultiSearch {
+    MultiDB *m;
+    Shard *shards;
+    size_t *heap;        // shards positioned on a row, newest on top
+    size_t heap_n;
+    size_t cur;          // shard of the row last returned, or SIZE_MAX
+    int limit;
+    int returned;
+    int failed;
+    MultiCursor last;
+};
+
+/* Preparing and the first step do the expensive part of a query (the FTS
+ * match and the sort), so they run on one thread per database; the merge
+ * then only steps each statement for its next, already sorted row. */
+static void *search_thread(void *arg) {
+    Shard *sh = arg;
+    if (db_search_ex(sh->db, &sh->opts, &sh->stmt) != 0) {
+        sh->stmt = NULL;
+        sh->rc = SQLITE_ERROR;
+        return NULL;
+    }
+    sh->rc = sqlite3_step(sh->stmt);
+    return NULL;
+}
+
+static void *count_thread(void *arg) {
+    Shard *sh = arg;
+    sh->rc = db_count(sh->db, &sh->opts, &sh->count);
+    return NULL;
+}
+
+static void *count_estimate_thread(void *arg) {
+    Shard *sh = arg;
+    sh->rc = db_count_estimate(sh->db, &sh->opts, &sh->count, &sh->exact);
+    return NULL;
+}
+
+static void run_parallel(Shard *shards, size_t n, void *(*fn)(void *)) {
+    pthread_t *th = calloc(n, sizeof(*th));
+    int *started = calloc(n, sizeof(*started));
+    for (size_t i = 0; i < n; ++i) {
+        // Without threads (or memory for them) the databases are queried in turn.
+        if (th && started && pthread_create(&th[i], NULL, fn, &shards[i]) == 0) started[i] = 1;
+        else fn(&shards[i]);
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (started && started[i]) pthread_join(th[i], NULL);
+    free(th);
+    free(started);
+}
+
+// ---- merge ----
+
+// Row order across databases: ts DESC (no ts last), then database index, as the cursor assumes.
+static int shard_before(const MultiSearch *s, size_t a, size_t b) {
+    const unsigned char *ta = sqlite3_column_text(s->shards[a].stmt, 3);
+    const unsigned char *tb = sqlite3_column_text(s->shards[b].stmt, 3);
+    if (!ta != !tb) return ta != NULL;
+    if (ta) {
+        int c = strcmp((const char *)ta, (const char *)tb);
+        if (c != 0) return c > 0;
+    }
+    return a < b;
+}
+
+static void heap_push(MultiSearch *s, size_t shard) {
+    size_t i = s->heap_n++;
+    s->heap[i] = shard;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!shard_before(s, s->heap[i], s->heap[parent])) break;
+        size_t t = s->heap[i]; s->heap[i] = s->heap[parent]; s->heap[parent] = t;
+        i = parent;
+    }
+}
+
+static size_t heap_pop(MultiSearch *s) {
+    size_t top = s->heap[0];
+    s->heap[0] = s->heap[--s->heap_n];
+    size_t i = 0;
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, best = i;
+        if (l < s->heap_n && shard_before(s, s->heap[l], s->heap[best])) best = l;
+        if (r < s->heap_n && shard_before(s, s->heap[r], s->heap[best])) best = r;
+        if (best == i) break;
+        size_t t = s->heap[i]; s->heap[i] = s->heap[best]; s->heap[best] = t;
+        i = best;
+    }
+    return top;
+}
+
+MultiSearch *multidb_search(MultiDB *m, const DBSearchOpts *opts, const MultiCursor *after) {
+    MultiSearch *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->m = m;
+    s->cur = SIZE_MAX;
+    s->limit = opts->limit;
+    s->shards = calloc(m->n ? m->n : 1, sizeof(*s->shards));
+    s->heap = calloc(m->n ? m->n : 1, sizeof(*s->heap));
+    if (!s->shards || !s->heap) { multidb_search_finish(s); return NULL; }
+    for (size_t i = 0; i < m->n; ++i) {
+        Shard *sh = &s->shards[i];
+        sh->db = &m->dbs[i];
+        sh->opts = *opts;
+        sh->opts.order = DB_ORDER_TS_DESC;
+        sh->opts.offset = 0;
+        sh->opts.keyset = 0;
+        /* Each database needs at most a page of rows after the cursor. At the
+         * cursor's ts, databases before the cursor's one have already been
+         * returned entirely, and those after it not at all. */
+        if (after && after->valid) {
+            sh->opts.keyset = 1;
+            sh->opts.key_ts = after->ts_null ? NULL : after->ts;
+            sh->opts.key_id = i < after->shard ? 0 : i > after->shard ? LLONG_MAX : after->id;
+        }
+    }
+    run_parallel(s->shards, m->n, search_thread);
+    for (size_t i = 0; i < m->n; ++i) {
+        if (s->shards[i].rc == SQLITE_ROW) heap_push(s, i);
+        else if (s->shards[i].rc != SQLITE_DONE) s->failed = 1;
+    }
+    if (s->failed) {
+        multidb_search_finish(s);
+        return NULL;
+    }
+    return s;
+}
+
+int multidb_next(MultiSearch *s, sqlite3_stmt **out_stmt, const char **out_host) {
+    if (s->cur != SIZE_MAX) {
+        Shard *sh = &s->shards[s->cur];
+        sh->rc = sqlite3_step(sh->stmt);
+        if (sh->rc == SQLITE_ROW) heap_push(s, s->cur);
+        else if (sh->rc != SQLITE_DONE) s->failed = 1;
+        s->cur = SIZE_MAX;
+    }
+    if (s->heap_n == 0 || (s->limit > 0 && s->returned >= s->limit)) return 0;
+    size_t i = heap_pop(s);
+    sqlite3_stmt *stmt = s->shards[i].stmt;
+    const unsigned char *ts = sqlite3_column_text(stmt, 3);
+    s->last.valid = 1;
+    s->last.shard = i;
+    s->last.id = sqlite3_column_int64(stmt, 0);
+    s->last.ts_null = ts == NULL;
+    snprintf(s->last.ts, sizeof(s->last.ts), "%s", ts ? (const char *)ts : "");
+    s->cur = i;
+    s->returned++;
+    *out_stmt = stmt;
+    *out_host = s->m->hosts[i];
+    return 1;
+}
+
+void multidb_search_cursor(const MultiSearch *s, MultiCursor *out) {
+    *out = s->last;
+}
+
+int multidb_search_finish(MultiSearch *s) {
+    if (!s) return 0;
+    int rc = s->failed ? -1 : 0;
+    if (s->shards)
+        for (size_t i = 0; i < s->m->n; ++i) sqlite3_finalize(s->shards[i].stmt);
+    free(s->shards);
+    free(s->heap);
+    free(s);
+    return rc;
+}
+
+static int count_shards(MultiDB *m, const DBSearchOpts *opts, void *(*fn)(void *), long long *out_count,
+                        int *out_exact) {
+    Shard *shards = calloc(m->n ? m->n : 1, sizeof(*shards));
+    if (!shards) return -1;
+    for (size_t i = 0; i < m->n; ++i) {
+        shards[i].db = &m->dbs[i];
+        shards[i].opts = *opts;
+        shards[i].exact = 1;
+    }
+    run_parallel(shards, m->n, fn);
+    int rc = 0;
+    *out_count = 0;
+    if (out_exact) *out_exact = 1;
+    for (size_t i = 0; i < m->n; ++i) {
+        if (shards[i].rc != 0) rc = -1;
+        *out_count += shards[i].count;
+        if (out_exact && !shards[i].exact) *out_exact = 0;
+    }
+    free(shards);
+    return rc;
+}
+
+int multidb_count(MultiDB *m, const DBSearchOpts *opts, long long *out_count) {
+    return count_shards(m, opts, count_thread, out_count, NULL);
+}
+
+int multidb_count_estimate(MultiDB *m, const DBSearchOpts *opts, long long *out_count, int *out_exact) {
+    return count_shards(m, opts, count_estimate_thread, out_count, out_exact);
+}
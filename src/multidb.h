@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include "db.h"
+
+/* Search over a set of databases, e.g. one per host copied to an analysis
+ * machine. Every database is opened read-only; a search runs the same
+ * db_search_ex query on each of them in parallel threads and merges the
+ * results newest first, so the caller sees one result list.
+ *
+ * Each row carries the host label of its database, taken from the file
+ * name ("web01.db" -> "web01") or given as "label=path".
+ *
+ * Paging is by keyset rather than offset: a page ends with a MultiCursor,
+ * and the next page asks every database only for rows after it. Rows are
+ * ordered by ts (newest first), then host, then id, so equal timestamps
+ * from different hosts are neither repeated nor skipped across pages. */
+
+typedef struct MultiDB MultiDB;
+
+// Open every spec ("path" or "label=path"). Returns NULL if any of them cannot be opened.
+MultiDB *multidb_open(const char *const *specs, size_t n);
+void multidb_close(MultiDB *m);
+size_t multidb_size(const MultiDB *m);
+const char *multidb_host(const MultiDB *m, size_t i);
+
+// Position after the last row of a page.
+typedef struct {
+    int valid;           // 0 = start from the newest row
+    size_t shard;        // index of the row's database
+    long long id;
+    int ts_null;
+    char ts[64];
+} MultiCursor;
+
+// "shard:id:ts" ("shard:id" for a row without ts), for passing a cursor on the command line.
+void multidb_cursor_format(const MultiCursor *c, char *buf, size_t n);
+int multidb_cursor_parse(const char *s, MultiCursor *out);
+
+typedef struct MultiSearch MultiSearch;
+
+/* Start a merged search. opts->limit is the page size (<= 0: everything);
+ * order, offset and the keyset fields are ignored (the order is ts DESC).
+ * after, if valid, continues from the end of a previous page. Returns NULL
+ * if a query could not be prepared on some database. */
+MultiSearch *multidb_search(MultiDB *m, const DBSearchOpts *opts, const MultiCursor *after);
+/* Advance to the next merged row. Returns 1 and sets *out_stmt to the
+ * statement positioned on the row (columns as db_search_ex; valid until the
+ * next call) and *out_host to its host label; 0 at the end of the page. */
+int multidb_next(MultiSearch *s, sqlite3_stmt **out_stmt, const char **out_host);
+// Cursor after the last row returned; valid is 0 if no row was returned.
+void multidb_search_cursor(const MultiSearch *s, MultiCursor *out);
+// Finalize every statement. Returns 0, or -1 if stepping a database failed.
+int multidb_search_finish(MultiSearch *s);
+
+// Sum of db_count over all databases, counted in parallel.
+int multidb_count(MultiDB *m, const DBSearchOpts *opts, long long *out_count);
+// Sum of db_count_estimate; *out_exact (may be NULL) is set if every database was counted exactly.
+int multidb_count_estimate(MultiDB *m, const DBSearchOpts *opts, long long *out_count, int *out_exact);
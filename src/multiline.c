@@ -0,0 +1,173 @@
+#include "multiline.h"
+#include <pthread.h>
+#include <regex.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Caps on one assembled record.
+#define MULTILINE_MAX_LINES 1000
+#define MULTILINE_MAX_BYTES (1 << 20)
+
+typedef enum { ML_SINGLE, ML_INDENT, ML_REGEX } MultilineKind;
+
+struct MultilineRule {
+    char *glob;
+    MultilineKind kind;
+    regex_t start;
+};
+
+static const MultilineRule g_default_rule = { NULL, ML_INDENT, { 0 } };
+static MultilineRule *g_rules = NULL;
+static size_t g_nrules = 0;
+static uint64_t g_timeout_ms = 2000;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static void load_rules(void) {
+    const char *t = getenv("LOG_EXPLORER_MULTILINE_TIMEOUT_MS");
+    if (t && atoll(t) >= 0) g_timeout_ms = (uint64_t)atoll(t);
+    const char *path = getenv("LOG_EXPLORER_MULTILINE");
+    if (!path || !*path) return;
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return; }
+    char *line = NULL;
+    size_t cap = 0;
+    int lineno = 0;
+    while (getline(&line, &cap, f) > 0) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p || *p == '#') continue;
+        char *glob = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        if (*p) *p++ = '\0';
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) {
+            fprintf(stderr, "%s:%d: missing start pattern\n", path, lineno);
+            continue;
+        }
+        MultilineRule r = { 0 };
+        if (strcmp(p, "single") == 0) r.kind = ML_SINGLE;
+        else if (strcmp(p, "indent") == 0) r.kind = ML_INDENT;
+        else {
+            r.kind = ML_REGEX;
+            int rc = regcomp(&r.start, p, REG_EXTENDED | REG_NOSUB);
+            if (rc != 0) {
+                char msg[256];
+                regerror(rc, &r.start, msg, sizeof(msg));
+                fprintf(stderr, "%s:%d: bad pattern: %s\n", path, lineno, msg);
+                continue;
+            }
+        }
+        MultilineRule *rules = realloc(g_rules, sizeof(*rules) * (g_nrules + 1));
+        if (!rules) {
+            if (r.kind == ML_REGEX) regfree(&r.start);
+            break;
+        }
+        r.glob = strdup(glob);
+        g_rules = rules;
+        g_rules[g_nrules++] = r;
+    }
+    free(line);
+    fclose(f);
+}
+
+const MultilineRule *multiline_rule_for(const char *path) {
+    pthread_once(&g_once, load_rules);
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    for (size_t i = 0; i < g_nrules; ++i)
+        if (g_rules[i].glob && fnmatch(g_rules[i].glob, base, 0) == 0) return &g_rules[i];
+    return &g_default_rule;
+}
+
+uint64_t multiline_timeout_ms(void) {
+    pthread_once(&g_once, load_rules);
+    return g_timeout_ms;
+}
+
+struct Multiline {
+    const MultilineRule *rule;
+    MultilineEmit emit;
+    void *ctx;
+    char *buf;
+    size_t len, cap;
+    int lines;
+    char *scratch;   // NUL-terminated copy of a line for regexec
+    size_t scratch_cap;
+};
+
+Multiline *multiline_new(const MultilineRule *rule, MultilineEmit emit, void *ctx) {
+    Multiline *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->rule = rule ? rule : &g_default_rule;
+    m->emit = emit;
+    m->ctx = ctx;
+    return m;
+}
+
+void multiline_free(Multiline *m) {
+    if (!m) return;
+    multiline_flush(m);
+    free(m->buf);
+    free(m->scratch);
+    free(m);
+}
+
+static int starts_record(Multiline *m, const char *line, size_t len) {
+    switch (m->rule->kind) {
+    case ML_SINGLE:
+        return 1;
+    case ML_INDENT:
+        // blank lines also continue, so paragraphs in a trace stay together
+        return len > 0 && line[0] != ' ' && line[0] != '\t' && line[0] != '\n' && line[0] != '\r';
+    case ML_REGEX:
+        if (len + 1 > m->scratch_cap) {
+            char *p = realloc(m->scratch, len + 1);
+            if (!p) return 1;
+            m->scratch = p;
+            m->scratch_cap = len + 1;
+        }
+        memcpy(m->scratch, line, len);
+        m->scratch[len] = '\0';
+        return regexec(&m->rule->start, m->scratch, 0, NULL, 0) == 0;
+    }
+    return 1;
+}
+
+int multiline_push(Multiline *m, const char *line, size_t len) {
+    int start = m->len == 0 || starts_record(m, line, len) ||
+                m->lines >= MULTILINE_MAX_LINES || m->len + len > MULTILINE_MAX_BYTES;
+    if (start) multiline_flush(m);
+    if (m->len + len + 1 > m->cap) {
+        size_t cap = m->cap ? m->cap : 1024;
+        while (cap < m->len + len + 1) cap *= 2;
+        char *p = realloc(m->buf, cap);
+        if (!p) return start; // drop the line rather than the whole record
+        m->buf = p;
+        m->cap = cap;
+    }
+    memcpy(m->buf + m->len, line, len);
+    m->len += len;
+    m->lines++;
+    return start;
+}
+
+void multiline_flush(Multiline *m) {
+    if (m->len == 0) return;
+    m->buf[m->len] = '\0';
+    m->emit(m->ctx, m->buf, m->len);
+    multiline_discard(m);
+}
+
+void multiline_discard(Multiline *m) {
+    m->len = 0;
+    m->lines = 0;
+}
+
+int multiline_pending(const Multiline *m) {
+    return m->len > 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Multi-line record assembly for file sources. Physical lines are joined
+ * into one record until a line starts a new one, so a stack trace is one
+ * row (and one FTS document) instead of one row per line.
+ *
+ * What starts a record is chosen per file name from the rules file named
+ * by LOG_EXPLORER_MULTILINE, one rule per line:
+ *
+ *     # <file name glob>  <start pattern>
+ *     app*.log            ^[0-9]{4}-[0-9]{2}-[0-9]{2}
+ *     dpkg.log            single
+ *
+ * The pattern is a POSIX extended regex matched against each line; "single"
+ * keeps one row per line and "indent" is the default: lines starting with
+ * a space or tab continue the previous record. The first matching rule
+ * wins. LOG_EXPLORER_MULTILINE_TIMEOUT_MS (default 2000) is how long a
+ * trailing record may wait for more continuation lines. */
+
+typedef struct MultilineRule MultilineRule;
+
+// Rule for a file (matched on its base name); never NULL. Rules are loaded once.
+const MultilineRule *multiline_rule_for(const char *path);
+uint64_t multiline_timeout_ms(void);
+
+// Receives each assembled record; rec is NUL-terminated and only valid during the call.
+typedef void (*MultilineEmit)(void *ctx, const char *rec, size_t len);
+
+typedef struct Multiline Multiline;
+
+Multiline *multiline_new(const MultilineRule *rule, MultilineEmit emit, void *ctx);
+// Emits whatever is pending, then frees.
+void multiline_free(Multiline *m);
+/* Feed one physical line. If it starts a new record, the pending one is
+ * emitted first and 1 is returned; 0 means it was appended as a
+ * continuation. Records are also cut at a size/line cap so a file that
+ * never matches the start pattern cannot grow one record without bound. */
+int multiline_push(Multiline *m, const char *line, size_t len);
+// Emit the pending record, if any.
+void multiline_flush(Multiline *m);
+// Drop the pending record without emitting it (it will be re-read later).
+void multiline_discard(Multiline *m);
+int multiline_pending(const Multiline *m);
@@ -0,0 +1,316 @@
+#define _GNU_SOURCE
+#include "notify.h"
+#include "reactor.h"
+#include "saved.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define ACCEPT_BATCH 16
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static Reactor *g_reactor = NULL;
+static DB *g_db = NULL;          // the daemon's writer connection
+static int g_clients[NOTIFY_MAX_CLIENTS];
+static size_t g_n_clients = 0;
+static long long g_max_id = 0;   // last id announced
+static int g_serving = 0;
+
+int notify_socket_path(const char *db_path, char *buf, size_t n) {
+    const char *env = getenv("LOG_EXPLORER_SOCKET");
+    int w = env && *env ? snprintf(buf, n, "%s", env) : snprintf(buf, n, "%s.sock", db_path);
+    if (w < 0 || (size_t)w >= n || (size_t)w >= sizeof(((struct sockaddr_un *)0)->sun_path)) return -1;
+    return 0;
+}
+
+static int unix_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* "rows N\n", without waiting: a line that does not fit in the socket
+ * buffer is dropped, the next one supersedes it. Returns -1 if the
+ * connection is unusable. Called with g_mu held. */
+static int send_rows(int fd, long long max_id) {
+    char line[32];
+    int n = snprintf(line, sizeof(line), "rows %lld\n", max_id);
+    ssize_t w = send(fd, line, (size_t)n, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (w == n) return 0;
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    return -1;
+}
+
+// ---- server sources (see reactor.h) ----
+
+typedef struct {
+    Reactor *reactor;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    gid_t gid;      // group of the database file, or (gid_t)-1
+    int fd;
+} Listener;
+
+static int listener_open(void *ctx) {
+    Listener *l = ctx;
+    struct sockaddr_un addr;
+    if (unix_address(l->path, &addr) != 0) return -1;
+    l->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (l->fd < 0) return -1;
+    /* A socket file left by a daemon that died is replaced; one that still
+     * accepts connections belongs to a running daemon. */
+    struct stat st;
+    if (lstat(l->path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            fprintf(stderr, "notify: another indexer is listening on %s\n", l->path);
+            close(l->fd);
+            return -1;
+        }
+        unlink(l->path);
+    }
+    if (bind(l->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "notify: cannot listen on %s: %s\n", l->path, strerror(errno));
+        close(l->fd);
+        return -1;
+    }
+    /* Only the owner and the database file's group may connect, so "read
+     * ID" comes from users trusted with the rows. Nobody can connect yet:
+     * that takes listen. */
+    if (l->gid != (gid_t)-1 && chown(l->path, (uid_t)-1, l->gid) != 0)
+        fprintf(stderr, "notify: cannot give %s to group %u, only the daemon's group can connect: %s\n", l->path,
+                (unsigned)l->gid, strerror(errno));
+    if (chmod(l->path, 0660) != 0 || listen(l->fd, 16) != 0) {
+        fprintf(stderr, "notify: cannot listen on %s: %s\n", l->path, strerror(errno));
+        close(l->fd);
+        unlink(l->path);
+        return -1;
+    }
+    return 0;
+}
+
+static int listener_fd(void *ctx) {
+    return ((Listener *)ctx)->fd;
+}
+
+static void listener_close(void *ctx) {
+    Listener *l = ctx;
+    close(l->fd);
+    unlink(l->path);
+    free(l);
+}
+
+typedef struct {
+    int fd;
+    char buf[64];   // an incomplete request line
+    size_t len;
+} Conn;
+
+static int conn_fd(void *ctx) {
+    return ((Conn *)ctx)->fd;
+}
+
+/* Requests from a viewer, which cannot write the database itself: "read
+ * ID\n" marks saved search ID read. Anything else is ignored. */
+static void conn_request(const char *line) {
+    long long id;
+    if (sscanf(line, "read %lld", &id) == 1 && saved_mark_read(g_db, id) != 0)
+        fprintf(stderr, "notify: cannot mark saved search %lld read\n", id);
+}
+
+static int conn_read_batch(void *ctx) {
+    Conn *c = ctx;
+    for (;;) {
+        ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        c->len += (size_t)n;
+        char *p = c->buf, *nl;
+        while ((nl = memchr(p, '\n', c->len - (size_t)(p - c->buf))) != NULL) {
+            *nl = '\0';
+            conn_request(p);
+            p = nl + 1;
+        }
+        c->len -= (size_t)(p - c->buf);
+        memmove(c->buf, p, c->len);
+        if (c->len == sizeof(c->buf)) c->len = 0;  // not a line of ours
+    }
+}
+
+static void conn_close(void *ctx) {
+    Conn *c = ctx;
+    pthread_mutex_lock(&g_mu);
+    for (size_t i = 0; i < g_n_clients; ++i) {
+        if (g_clients[i] != c->fd) continue;
+        g_clients[i] = g_clients[--g_n_clients];
+        break;
+    }
+    pthread_mutex_unlock(&g_mu);
+    close(c->fd);
+    free(c);
+}
+
+static const SourceOps conn_ops = {
+    .name = "notify-conn", .fd = conn_fd, .read_batch = conn_read_batch, .close = conn_close,
+};
+
+static int accept_batch(void *ctx) {
+    Listener *l = ctx;
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        int fd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return 0;
+        Conn *c = calloc(1, sizeof(*c));
+        pthread_mutex_lock(&g_mu);
+        int ok = c && g_n_clients < NOTIFY_MAX_CLIENTS && send_rows(fd, g_max_id) == 0;
+        if (ok) g_clients[g_n_clients++] = fd;
+        pthread_mutex_unlock(&g_mu);
+        if (!ok) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        c->fd = fd;
+        if (reactor_add(l->reactor, &conn_ops, c) != 0) conn_close(c);
+    }
+    return 1;
+}
+
+static const SourceOps listener_ops = {
+    .name = "notify", .open = listener_open, .fd = listener_fd,
+    .read_batch = accept_batch, .close = listener_close,
+};
+
+// ---- server lifecycle ----
+
+int notify_server_start(DB *db, const char *path) {
+    if (g_reactor) return 0;
+    long long max_id = 0;
+    if (db_max_id(db, &max_id) != 0) return -1;
+    Listener *l = calloc(1, sizeof(*l));
+    if (!l) return -1;
+    snprintf(l->path, sizeof(l->path), "%s", path);
+    const char *file = sqlite3_db_filename(db->db, "main");
+    struct stat st;
+    l->gid = file && *file && stat(file, &st) == 0 ? st.st_gid : (gid_t)-1;
+    g_reactor = reactor_new();
+    l->reactor = g_reactor;
+    if (!g_reactor || reactor_add(g_reactor, &listener_ops, l) != 0) {
+        free(l);
+        notify_server_stop();
+        return -1;
+    }
+    g_db = db;
+    pthread_mutex_lock(&g_mu);
+    g_max_id = max_id;
+    g_serving = 1;
+    pthread_mutex_unlock(&g_mu);
+    if (reactor_start(g_reactor) != 0) {
+        notify_server_stop();
+        return -1;
+    }
+    return 0;
+}
+
+void notify_server_stop(void) {
+    pthread_mutex_lock(&g_mu);
+    g_serving = 0;
+    pthread_mutex_unlock(&g_mu);
+    reactor_free(g_reactor);
+    g_reactor = NULL;
+}
+
+void notify_committed(DB *db) {
+    pthread_mutex_lock(&g_mu);
+    int serving = g_serving;
+    pthread_mutex_unlock(&g_mu);
+    long long max_id = 0;
+    if (!serving || db_max_id(db, &max_id) != 0) return;
+    pthread_mutex_lock(&g_mu);
+    if (max_id > g_max_id) {
+        g_max_id = max_id;
+        /* A viewer whose connection failed is shut down here and closed by
+         * the reactor thread, which then sees end of file. */
+        for (size_t i = 0; i < g_n_clients; ++i)
+            if (send_rows(g_clients[i], max_id) != 0) shutdown(g_clients[i], SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&g_mu);
+}
+
+// ---- client ----
+
+struct NotifyClient {
+    int fd;
+    char buf[128];   // an incomplete line
+    size_t len;
+};
+
+NotifyClient *notify_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) != 0) return NULL;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    NotifyClient *c = calloc(1, sizeof(*c));
+    if (!c || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        int err = errno;
+        close(fd);
+        free(c);
+        errno = err;
+        return NULL;
+    }
+    c->fd = fd;
+    return c;
+}
+
+int notify_client_fd(const NotifyClient *c) {
+    return c->fd;
+}
+
+int notify_read(NotifyClient *c, long long *max_id) {
+    int got = 0;
+    for (;;) {
+        ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return got;
+        if (n <= 0) return -1;
+        c->len += (size_t)n;
+        char *p = c->buf, *nl;
+        while ((nl = memchr(p, '\n', c->len - (size_t)(p - c->buf))) != NULL) {
+            *nl = '\0';
+            long long id;
+            if (sscanf(p, "rows %lld", &id) == 1 && (!got || id > *max_id)) {
+                *max_id = id;
+                got = 1;
+            }
+            p = nl + 1;
+        }
+        c->len -= (size_t)(p - c->buf);
+        memmove(c->buf, p, c->len);
+        if (c->len == sizeof(c->buf)) c->len = 0;  // not a line of ours
+    }
+}
+
+int notify_mark_read(NotifyClient *c, long long id) {
+    char line[32];
+    int n = snprintf(line, sizeof(line), "read %lld\n", id);
+    ssize_t w;
+    do w = send(c->fd, line, (size_t)n, MSG_NOSIGNAL);
+    while (w < 0 && errno == EINTR);
+    return w == n ? 0 : -1;
+}
+
+void notify_close(NotifyClient *c) {
+    if (!c) return;
+    close(c->fd);
+    free(c);
+}
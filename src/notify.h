@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include "db.h"
+
+/* New-row notifications from the indexer daemon (log-explorer-indexerd)
+ * to read-only viewers on the same host.
+ *
+ * The daemon owns the only writer connection and listens on a Unix stream
+ * socket. After every batch the ingest writer stores, each connected
+ * viewer is sent one line, "rows N\n": every row with id <= N is
+ * committed (and, outside a bulk load, searchable). A viewer is also sent
+ * the current N when it connects. Lines are never queued for a viewer that
+ * does not read: a later line supersedes an earlier one, so one that
+ * cannot be written at once is dropped.
+ *
+ * Viewers open the database read-only, so the one change they can ask of
+ * the daemon goes the other way: "read ID\n" marks saved search ID read
+ * (saved_mark_read). Closing the connection is the rest of the protocol.
+ *
+ * The listener and requests run on a reactor thread of its own
+ * (reactor.h); sending happens on the ingest writer's thread. */
+
+#define NOTIFY_MAX_CLIENTS 64
+
+// Socket of the daemon for db_path: LOG_EXPLORER_SOCKET, or "<db_path>.sock". Returns 0 or -1.
+int notify_socket_path(const char *db_path, char *buf, size_t n);
+
+/* Listen on path, replacing a stale socket file but not a live daemon's.
+ * The socket gets mode 0660 and the database file's group, so only the
+ * daemon's user and that group can connect (and send "read ID"). Returns
+ * 0 or -1. */
+int notify_server_start(DB *db, const char *path);
+// Close every connection and remove the socket file. Safe to call if never started.
+void notify_server_stop(void);
+// Rows were committed: send the new max id to every viewer. Called by the ingest writer; a no-op without a server.
+void notify_committed(DB *db);
+
+typedef struct NotifyClient NotifyClient;
+
+/* Connect to a daemon. Returns NULL if none is listening on path; errno is
+ * EACCES if one may be but this user is not allowed to connect. */
+NotifyClient *notify_connect(const char *path);
+// Descriptor to wait on for readability (poll, g_unix_fd_add). It is non-blocking.
+int notify_client_fd(const NotifyClient *c);
+/* Read what has arrived without blocking. Returns 1 and sets *max_id to
+ * the newest announced id, 0 if nothing new arrived, -1 once the daemon
+ * has gone away. */
+int notify_read(NotifyClient *c, long long *max_id);
+// Ask the daemon to mark saved search id read. Returns 0, or -1 if the request could not be sent.
+int notify_mark_read(NotifyClient *c, long long id);
+void notify_close(NotifyClient *c);
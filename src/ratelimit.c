@@ -0,0 +1,196 @@
+#include "ratelimit.h"
+#include "strmap.h"
+#include <pthread.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+// Distinct (source, unit) buckets; pairs seen after that share their rule's bucket.
+#define RATELIMIT_MAX_BUCKETS 65536
+
+typedef struct {
+    char *source_glob, *unit_glob;
+    double rate, burst;  // rate < 0: unlimited
+    int64_t overflow;    // shared bucket once the table is full, -1 until needed
+} Rule;
+
+typedef struct {
+    char *source, *unit;
+    MetricSource kind;
+    size_t rule;
+    double tokens;
+    uint64_t last_ms;
+    uint64_t suppressed;       // since the last report
+    uint64_t window_start_ms;  // first of those, valid while suppressed > 0
+} Bucket;
+
+static Rule *g_rules = NULL;
+static size_t g_nrules = 0;
+static uint64_t g_report_ms = 60000;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static StrMap *g_keys = NULL;  // "source\x1funit" -> bucket index, -1 for unlimited pairs
+static Bucket *g_buckets = NULL;
+static size_t g_nbuckets = 0, g_bucket_cap = 0;
+static uint64_t g_suppressed_total = 0;
+static uint64_t g_next_report_ms = 0;
+
+static uint64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static char *next_field(char **p) {
+    while (isspace((unsigned char)**p)) (*p)++;
+    if (!**p) return NULL;
+    char *start = *p;
+    while (**p && !isspace((unsigned char)**p)) (*p)++;
+    if (**p) *(*p)++ = '\0';
+    return start;
+}
+
+static void load_rules(void) {
+    const char *r = getenv("LOG_EXPLORER_RATELIMIT_REPORT_SEC");
+    if (r && atoll(r) > 0) g_report_ms = (uint64_t)atoll(r) * 1000;
+    const char *path = getenv("LOG_EXPLORER_RATELIMIT");
+    if (!path || !*path) return;
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return; }
+    char *line = NULL;
+    size_t cap = 0;
+    int lineno = 0;
+    while (getline(&line, &cap, f) > 0) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line;
+        char *src = next_field(&p);
+        if (!src || *src == '#') continue;
+        char *unit = next_field(&p), *rate = next_field(&p), *burst = next_field(&p);
+        if (!unit || !rate) {
+            fprintf(stderr, "%s:%d: expected <source glob> <unit glob> <messages/s> [burst]\n", path, lineno);
+            continue;
+        }
+        Rule rule = { .rate = -1, .overflow = -1 };
+        if (strcmp(rate, "unlimited") != 0) {
+            rule.rate = atof(rate);
+            rule.burst = burst ? atof(burst) : rule.rate;
+            if (rule.rate <= 0 || rule.burst < 1) {
+                fprintf(stderr, "%s:%d: bad rate or burst\n", path, lineno);
+                continue;
+            }
+        }
+        Rule *rules = realloc(g_rules, sizeof(*rules) * (g_nrules + 1));
+        if (!rules) break;
+        rule.source_glob = strdup(src);
+        rule.unit_glob = strdup(unit);
+        g_rules = rules;
+        g_rules[g_nrules++] = rule;
+    }
+    free(line);
+    fclose(f);
+    if (g_nrules && !(g_keys = strmap_new())) g_nrules = 0;
+}
+
+static int64_t bucket_new(MetricSource kind, const char *source, const char *unit, size_t rule, uint64_t now) {
+    if (g_nbuckets == g_bucket_cap) {
+        size_t cap = g_bucket_cap ? g_bucket_cap * 2 : 64;
+        Bucket *b = realloc(g_buckets, sizeof(*b) * cap);
+        if (!b) return -1;
+        g_buckets = b;
+        g_bucket_cap = cap;
+    }
+    Bucket *b = &g_buckets[g_nbuckets];
+    *b = (Bucket){ strdup(source), strdup(unit), kind, rule, g_rules[rule].burst, now, 0, 0 };
+    if (!b->source || !b->unit) {
+        free(b->source);
+        free(b->unit);
+        return -1;
+    }
+    return (int64_t)g_nbuckets++;
+}
+
+// Bucket for a pair not in g_keys, or -1 if it is not limited. Called with g_mu held.
+static int64_t bucket_for(MetricSource kind, const char *source, const char *unit, const char *key, uint64_t now) {
+    size_t r = 0;
+    while (r < g_nrules && (fnmatch(g_rules[r].source_glob, source, 0) != 0 ||
+                            fnmatch(g_rules[r].unit_glob, unit, 0) != 0))
+        r++;
+    int64_t idx = -1;
+    int full = g_nbuckets >= RATELIMIT_MAX_BUCKETS;
+    if (r < g_nrules && g_rules[r].rate >= 0) {
+        if (!full) {
+            idx = bucket_new(kind, source, unit, r, now);
+        } else {
+            if (g_rules[r].overflow < 0)
+                g_rules[r].overflow = bucket_new(kind, g_rules[r].source_glob, g_rules[r].unit_glob, r, now);
+            return g_rules[r].overflow;
+        }
+    }
+    // Once the table is full, unknown pairs are matched again each time rather than remembered.
+    if (!full) strmap_put(g_keys, key, idx);
+    return idx;
+}
+
+static int bucket_take(Bucket *b, uint64_t now) {
+    const Rule *r = &g_rules[b->rule];
+    b->tokens += (double)(now - b->last_ms) * r->rate / 1000.0;
+    if (b->tokens > r->burst) b->tokens = r->burst;
+    b->last_ms = now;
+    if (b->tokens >= 1) {
+        b->tokens -= 1;
+        return 1;
+    }
+    if (b->suppressed++ == 0) b->window_start_ms = now;
+    g_suppressed_total++;
+    metrics_add(METRIC_INGEST_SUPPRESSED, 1);
+    return 0;
+}
+
+int ratelimit_allow(MetricSource kind, const char *source, const char *unit) {
+    pthread_once(&g_once, load_rules);
+    if (!g_nrules) return 1;
+    if (!source) source = "unknown";
+    if (!unit) unit = "";
+    char stack[512];
+    size_t need = strlen(source) + strlen(unit) + 2;
+    char *key = need <= sizeof(stack) ? stack : malloc(need);
+    if (!key) return 1;
+    snprintf(key, need, "%s\x1f%s", source, unit);
+    uint64_t now = mono_ms();
+    pthread_mutex_lock(&g_mu);
+    int64_t idx;
+    if (!strmap_get(g_keys, key, &idx)) idx = bucket_for(kind, source, unit, key, now);
+    int ok = idx < 0 || bucket_take(&g_buckets[idx], now);
+    pthread_mutex_unlock(&g_mu);
+    if (key != stack) free(key);
+    return ok;
+}
+
+void ratelimit_report(int all, RateLimitReportFn fn, void *ctx) {
+    pthread_once(&g_once, load_rules);
+    if (!g_nrules) return;
+    uint64_t now = mono_ms();
+    pthread_mutex_lock(&g_mu);
+    if (all || now >= g_next_report_ms) {
+        g_next_report_ms = now + 1000;
+        for (size_t i = 0; i < g_nbuckets; ++i) {
+            Bucket *b = &g_buckets[i];
+            if (!b->suppressed || (!all && now - b->window_start_ms < g_report_ms)) continue;
+            fn(ctx, b->kind, b->source, b->unit, b->suppressed, now - b->window_start_ms);
+            b->suppressed = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_mu);
+}
+
+uint64_t ratelimit_suppressed_total(void) {
+    pthread_mutex_lock(&g_mu);
+    uint64_t n = g_suppressed_total;
+    pthread_mutex_unlock(&g_mu);
+    return n;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include "metrics.h"
+
+/* Per-source/unit rate limiting for the ingest path, so one unit spamming
+ * the same line cannot take most of the writer's capacity and index space.
+ *
+ * Every (source, unit) pair has a token bucket. Rates come from the rules
+ * file named by LOG_EXPLORER_RATELIMIT, one rule per line:
+ *
+ *     # <source glob>    <unit glob>     <messages/s>  [burst]
+ *     *                  chatty.service  100           1000
+ *     syslog:*           *               500
+ *     /var/log/auth.log  *               unlimited
+ *
+ * The first matching rule wins; pairs no rule matches, and every pair when
+ * the variable is unset, are not limited. Burst defaults to one second's
+ * worth. Each pair gets a bucket of its own (up to a cap, after which new
+ * pairs share one bucket per rule).
+ *
+ * Suppressed rows are counted exactly. Once LOG_EXPLORER_RATELIMIT_REPORT_SEC
+ * (default 60) have passed since a bucket's first suppressed row, the count
+ * is handed to ratelimit_report, which the ingest path stores as a single
+ * summary row ("suppressed 48,213 messages from foo.service in 60s"). */
+
+// Returns 1 if the row may be stored, 0 if it is suppressed (and counted).
+int ratelimit_allow(MetricSource kind, const char *source, const char *unit);
+
+typedef void (*RateLimitReportFn)(void *ctx, MetricSource kind, const char *source, const char *unit,
+                                  uint64_t suppressed, uint64_t window_ms);
+/* Call fn for every bucket whose report interval is over, or with all set
+ * for every bucket with suppressed rows (e.g. at shutdown). Without all,
+ * buckets are looked at no more than once a second. fn runs with the
+ * limiter's lock held and must not call back into it. */
+void ratelimit_report(int all, RateLimitReportFn fn, void *ctx);
+
+// Rows suppressed since start, including those not reported yet.
+uint64_t ratelimit_suppressed_total(void);
@@ -0,0 +1,177 @@
+#include "reactor.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define MAX_EVENTS 64
+
+typedef struct Source {
+    const SourceOps *ops;
+    void *ctx;
+    int fd;              // registered with epoll, or -1
+    int ready;           // read_batch is due regardless of the descriptor
+    int64_t deadline_ms; // from timeout_ms, or -1
+    struct Source *next;
+} Source;
+
+struct Reactor {
+    int ep;
+    int stop_fd;
+    pthread_t th;
+    int running;
+    Source *head;        // most recently added first
+};
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Bring the epoll registration and deadline in line with what the source wants now.
+static void source_sync(Reactor *r, Source *s) {
+    int fd = s->ops->fd ? s->ops->fd(s->ctx) : -1;
+    if (fd != s->fd) {
+        if (s->fd >= 0) epoll_ctl(r->ep, EPOLL_CTL_DEL, s->fd, NULL);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+        if (fd >= 0 && epoll_ctl(r->ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            fprintf(stderr, "reactor: %s: cannot watch fd %d: %s\n", s->ops->name, fd, strerror(errno));
+            fd = -1;
+        }
+        s->fd = fd;
+    }
+    int t = s->ops->timeout_ms ? s->ops->timeout_ms(s->ctx) : -1;
+    s->deadline_ms = t >= 0 ? now_ms() + t : -1;
+}
+
+static void source_close(Reactor *r, Source *s) {
+    if (s->fd >= 0) epoll_ctl(r->ep, EPOLL_CTL_DEL, s->fd, NULL);
+    s->ops->close(s->ctx);
+    free(s);
+}
+
+Reactor *reactor_new(void) {
+    Reactor *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->ep = epoll_create1(EPOLL_CLOEXEC);
+    r->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &r->stop_fd };
+    if (r->ep < 0 || r->stop_fd < 0 || epoll_ctl(r->ep, EPOLL_CTL_ADD, r->stop_fd, &ev) != 0) {
+        reactor_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+int reactor_add(Reactor *r, const SourceOps *ops, void *ctx) {
+    Source *s = calloc(1, sizeof(*s));
+    if (!s) return -1;
+    if (ops->open && ops->open(ctx) != 0) {
+        free(s);
+        return -1;
+    }
+    s->ops = ops;
+    s->ctx = ctx;
+    s->fd = -1;
+    s->ready = 1; // first read_batch right away, e.g. for an initial scan
+    s->next = r->head;
+    r->head = s;
+    source_sync(r, s);
+    return 0;
+}
+
+static void *reactor_thread(void *arg) {
+    Reactor *r = arg;
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int any_ready = 0;
+        int64_t next = -1;
+        for (Source *s = r->head; s; s = s->next) {
+            if (s->ready) any_ready = 1;
+            if (s->deadline_ms >= 0 && (next < 0 || s->deadline_ms < next)) next = s->deadline_ms;
+        }
+        int timeout = -1;
+        if (any_ready) {
+            timeout = 0;
+        } else if (next >= 0) {
+            int64_t wait = next - now_ms();
+            timeout = wait < 0 ? 0 : wait > INT_MAX ? INT_MAX : (int)wait;
+        }
+        int n = epoll_wait(r->ep, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("reactor: epoll_wait");
+            break;
+        }
+        int stop = 0;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == &r->stop_fd) stop = 1;
+            else ((Source *)events[i].data.ptr)->ready = 1;
+        }
+        if (stop) break;
+
+        // One batch per due source, so a busy input cannot starve the others.
+        int64_t now = now_ms();
+        for (Source **pp = &r->head; *pp;) {
+            Source *s = *pp;
+            if (!s->ready && !(s->deadline_ms >= 0 && now >= s->deadline_ms)) {
+                pp = &s->next;
+                continue;
+            }
+            int rc = s->ops->read_batch(s->ctx);
+            // Sources added by read_batch went in at the head, before s.
+            while (*pp != s) pp = &(*pp)->next;
+            s->ready = rc > 0;
+            if (rc <= 0 && s->ops->checkpoint) s->ops->checkpoint(s->ctx);
+            if (rc < 0) {
+                *pp = s->next;
+                source_close(r, s);
+                continue;
+            }
+            source_sync(r, s);
+            pp = &s->next;
+        }
+    }
+    return NULL;
+}
+
+int reactor_start(Reactor *r) {
+    if (r->running) return 0;
+    if (pthread_create(&r->th, NULL, reactor_thread, r) != 0) return -1;
+    r->running = 1;
+    return 0;
+}
+
+void reactor_stop(Reactor *r) {
+    if (!r) return;
+    if (r->running) {
+        uint64_t one = 1;
+        if (write(r->stop_fd, &one, sizeof(one)) < 0) perror("reactor: stop");
+        pthread_join(r->th, NULL);
+        r->running = 0;
+        uint64_t drain;
+        if (read(r->stop_fd, &drain, sizeof(drain)) < 0) { /* already drained */ }
+    }
+    while (r->head) {
+        Source *s = r->head;
+        r->head = s->next;
+        if (s->ops->checkpoint) s->ops->checkpoint(s->ctx);
+        source_close(r, s);
+    }
+}
+
+void reactor_free(Reactor *r) {
+    if (!r) return;
+    reactor_stop(r);
+    if (r->ep >= 0) close(r->ep);
+    if (r->stop_fd >= 0) close(r->stop_fd);
+    free(r);
+}
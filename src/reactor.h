@@ -0,0 +1,48 @@
+#pragma once
+
+/* One thread multiplexing every input with epoll. An input is a source: a
+ * set of callbacks around a context, registered with reactor_add; adding
+ * an input means implementing SourceOps, not writing another thread.
+ *
+ * The reactor waits for a source's descriptor to become readable (or for
+ * the time it asked for) and calls read_batch. read_batch must not block
+ * and must do a bounded amount of work; a source with more input ready
+ * returns 1 and is called again after the other ready sources had their
+ * turn. Stopping is signalled on an eventfd and takes effect after the
+ * batch in progress, so reactor_stop returns in bounded time even when an
+ * input is idle.
+ *
+ * Callbacks run on the reactor thread, except open, which runs in
+ * reactor_add so errors (e.g. a port in use) reach the caller, and the
+ * final checkpoint and close, which reactor_stop runs after the thread has
+ * exited. */
+typedef struct Reactor Reactor;
+
+typedef struct {
+    const char *name;
+    // Open the input. Returns 0, or -1; close is then not called and ctx stays the caller's.
+    int (*open)(void *ctx);
+    /* Descriptor to wait on for input, or -1 for none. Queried again after
+     * every call, so a source may change it, e.g. once it has started. */
+    int (*fd)(void *ctx);
+    // Milliseconds until read_batch should run even without input, or -1. May be NULL.
+    int (*timeout_ms)(void *ctx);
+    // Read and submit a bounded batch. Returns 1 if more input is ready, 0 to wait, -1 when finished.
+    int (*read_batch)(void *ctx);
+    // Persist the read position (journal cursor, ...) after a source goes idle and before close. May be NULL.
+    void (*checkpoint)(void *ctx);
+    // Release the source and ctx.
+    void (*close)(void *ctx);
+} SourceOps;
+
+Reactor *reactor_new(void);
+/* Register and open a source. Before reactor_start this may be called from
+ * any thread; afterwards only from a callback on the reactor thread (e.g. a
+ * listener adding its connections). Returns 0, or -1 if open failed (the
+ * caller frees ctx). */
+int reactor_add(Reactor *r, const SourceOps *ops, void *ctx);
+int reactor_start(Reactor *r);
+/* Stop the thread and close every source, most recently added first (so
+ * connections close before their listener). Safe to call if never started. */
+void reactor_stop(Reactor *r);
+void reactor_free(Reactor *r);
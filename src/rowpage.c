@@ -0,0 +1,214 @@
+#include "rowpage.h"
+#include "strmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    long long id;
+    uint32_t source;     // offsets into text
+    uint32_t unit;
+    uint32_t preview;
+    char ts[TS_BUF];
+} RowEntry;
+
+struct RowPage {
+    int refs;
+    size_t n, cap;
+    RowEntry *rows;
+    char *text;          // NUL-terminated strings back to back
+    size_t text_len, text_cap;
+};
+
+static int text_reserve(RowPage *p, size_t more) {
+    if (p->text_len + more <= p->text_cap) return 0;
+    size_t cap = p->text_cap ? p->text_cap : 4096;
+    while (cap < p->text_len + more) cap *= 2;
+    if (cap > UINT32_MAX) return -1;
+    char *t = realloc(p->text, cap);
+    if (!t) return -1;
+    p->text = t;
+    p->text_cap = cap;
+    return 0;
+}
+
+// Copy len bytes of s plus an optional "..." into the text chunk. Returns the offset, or -1.
+static int64_t text_add(RowPage *p, const char *s, size_t len, int ellipsis) {
+    if (text_reserve(p, len + (ellipsis ? 3 : 0) + 1) != 0) return -1;
+    int64_t off = (int64_t)p->text_len;
+    memcpy(p->text + p->text_len, s, len);
+    p->text_len += len;
+    if (ellipsis) {
+        memcpy(p->text + p->text_len, "...", 3);
+        p->text_len += 3;
+    }
+    p->text[p->text_len++] = '\0';
+    return off;
+}
+
+static int64_t text_intern(RowPage *p, StrMap *names, const char *s) {
+    int64_t off;
+    if (strmap_get(names, s, &off)) return off;
+    off = text_add(p, s, strlen(s), 0);
+    if (off >= 0 && strmap_put(names, s, off) != 0) return -1;
+    return off;
+}
+
+// Back up to the start of a UTF-8 sequence so a cut never splits a character.
+static size_t utf8_floor(const char *s, size_t len) {
+    while (len > 0 && ((unsigned char)s[len] & 0xC0) == 0x80) len--;
+    return len;
+}
+
+static int64_t add_preview(RowPage *p, const char *msg, size_t max, unsigned flags) {
+    size_t len = strlen(msg);
+    if (flags & ROWPAGE_FIRST_LINE) len = strcspn(msg, "\r\n");
+    if (len <= max) return text_add(p, msg, len, 0);
+    int ellipsis = (flags & ROWPAGE_ELLIPSIS) && max >= 3;
+    return text_add(p, msg, utf8_floor(msg, ellipsis ? max - 3 : max), ellipsis);
+}
+
+static const char *col_text(sqlite3_stmt *stmt, int col) {
+    const char *s = (const char *)sqlite3_column_text(stmt, col);
+    return s ? s : "";
+}
+
+static RowPage *page_new(size_t cap) {
+    RowPage *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->refs = 1;
+    p->cap = cap ? cap : 1;
+    p->rows = malloc(p->cap * sizeof(*p->rows));
+    if (!p->rows) { free(p); return NULL; }
+    return p;
+}
+
+static int page_add(RowPage *p, StrMap *names, long long id, const char *source, const char *unit, const char *ts,
+                    const char *message, size_t preview_max, unsigned flags) {
+    RowEntry *r = &p->rows[p->n];
+    r->id = id;
+    int64_t s = text_intern(p, names, source);
+    int64_t u = text_intern(p, names, unit);
+    int64_t preview = add_preview(p, message, preview_max, flags);
+    if (s < 0 || u < 0 || preview < 0) return -1;
+    r->source = (uint32_t)s;
+    r->unit = (uint32_t)u;
+    r->preview = (uint32_t)preview;
+    size_t tl = strlen(ts);
+    if (tl > TS_LEN) tl = TS_LEN;
+    memcpy(r->ts, ts, tl);
+    r->ts[tl] = '\0';
+    p->n++;
+    return 0;
+}
+
+RowPage *rowpage_from_stmt(sqlite3_stmt *stmt, size_t max_rows, size_t preview_max, unsigned flags) {
+    RowPage *p = page_new(max_rows);
+    StrMap *names = strmap_new();
+    if (!p || !names) goto fail;
+    while (p->n < max_rows && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (page_add(p, names, sqlite3_column_int64(stmt, 0), col_text(stmt, 1), col_text(stmt, 2),
+                     col_text(stmt, 3), col_text(stmt, 4), preview_max, flags) != 0)
+            goto fail;
+    }
+    strmap_free(names);
+    return p;
+fail:
+    strmap_free(names);
+    rowpage_unref(p);
+    return NULL;
+}
+
+// ---- save/load: one row per line, tab-separated, with \\ \t \n \r escaped ----
+
+static void put_field(FILE *out, const char *s) {
+    for (; *s; ++s) {
+        switch (*s) {
+        case '\\': fputs("\\\\", out); break;
+        case '\t': fputs("\\t", out); break;
+        case '\n': fputs("\\n", out); break;
+        case '\r': fputs("\\r", out); break;
+        default: fputc(*s, out);
+        }
+    }
+}
+
+int rowpage_save(const RowPage *p, FILE *out) {
+    for (size_t i = 0; i < p->n; ++i) {
+        fprintf(out, "%lld\t", rowpage_id(p, i));
+        put_field(out, rowpage_source(p, i));
+        fputc('\t', out);
+        put_field(out, rowpage_unit(p, i));
+        fputc('\t', out);
+        put_field(out, rowpage_ts(p, i));
+        fputc('\t', out);
+        put_field(out, rowpage_preview(p, i));
+        fputc('\n', out);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+// Split line at tabs into up to n fields, unescaping in place. Returns the number of fields.
+static int split_fields(char *line, char **fields, int n) {
+    int k = 0;
+    char *w = line;
+    fields[k++] = w;
+    for (char *r = line; *r && *r != '\n'; ++r) {
+        if (*r == '\t') {
+            *w++ = '\0';
+            if (k == n) return -1;
+            fields[k++] = w;
+        } else if (*r == '\\' && r[1]) {
+            ++r;
+            *w++ = *r == 't' ? '\t' : *r == 'n' ? '\n' : *r == 'r' ? '\r' : *r;
+        } else {
+            *w++ = *r;
+        }
+    }
+    *w = '\0';
+    return k;
+}
+
+RowPage *rowpage_load(FILE *in, size_t max_rows) {
+    RowPage *p = page_new(max_rows);
+    StrMap *names = strmap_new();
+    char *line = NULL;
+    size_t cap = 0;
+    if (!p || !names) goto fail;
+    while (p->n < max_rows && getline(&line, &cap, in) > 0) {
+        char *f[5];
+        if (split_fields(line, f, 5) != 5) goto fail;
+        if (page_add(p, names, strtoll(f[0], NULL, 10), f[1], f[2], f[3], f[4], SIZE_MAX, 0) != 0) goto fail;
+    }
+    free(line);
+    strmap_free(names);
+    return p;
+fail:
+    free(line);
+    strmap_free(names);
+    rowpage_unref(p);
+    return NULL;
+}
+
+RowPage *rowpage_ref(RowPage *p) {
+    if (p) p->refs++;
+    return p;
+}
+
+void rowpage_unref(RowPage *p) {
+    if (!p || --p->refs > 0) return;
+    free(p->rows);
+    free(p->text);
+    free(p);
+}
+
+size_t rowpage_size(const RowPage *p) { return p->n; }
+
+size_t rowpage_bytes(const RowPage *p) {
+    return sizeof(*p) + p->cap * sizeof(*p->rows) + p->text_cap;
+}
+
+long long rowpage_id(const RowPage *p, size_t i) { return p->rows[i].id; }
+const char *rowpage_source(const RowPage *p, size_t i) { return p->text + p->rows[i].source; }
+const char *rowpage_unit(const RowPage *p, size_t i) { return p->text + p->rows[i].unit; }
+const char *rowpage_ts(const RowPage *p, size_t i) { return p->rows[i].ts; }
+const char *rowpage_preview(const RowPage *p, size_t i) { return p->text + p->rows[i].preview; }
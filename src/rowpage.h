@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sqlite3.h>
+#include "timestamp.h"
+
+/* A page of result rows held in one arena, for list models that keep many
+ * rows loaded. Rows are fixed-size entries; source and unit names are
+ * interned once per page and previews are packed into a single text chunk,
+ * so a page costs three allocations however many rows it has, and it is
+ * freed as a whole when its last reference goes.
+ *
+ * Pages are immutable once built and refcounted (not atomically: a page
+ * belongs to the thread that built it). */
+typedef struct RowPage RowPage;
+
+enum {
+    ROWPAGE_ELLIPSIS   = 1 << 0,  // a cut preview ends in "..." (within preview_max)
+    ROWPAGE_FIRST_LINE = 1 << 1,  // preview stops at the first line break
+};
+
+/* Read up to max_rows rows from stmt (columns as db_search_ex: id, source,
+ * unit, ts, message). Previews are at most preview_max bytes, cut on a UTF-8
+ * character boundary. Timestamps longer than TS_LEN are truncated. The
+ * statement is stepped but not finalized. Returns NULL on allocation failure. */
+RowPage *rowpage_from_stmt(sqlite3_stmt *stmt, size_t max_rows, size_t preview_max, unsigned flags);
+/* Write the rows as text, one per line, e.g. to persist the last view
+ * across restarts, and read them back (up to max_rows). rowpage_load
+ * returns NULL on a malformed line or allocation failure. */
+int rowpage_save(const RowPage *p, FILE *out);
+RowPage *rowpage_load(FILE *in, size_t max_rows);
+RowPage *rowpage_ref(RowPage *p);
+void rowpage_unref(RowPage *p);
+
+size_t rowpage_size(const RowPage *p);
+// Heap bytes held by the page.
+size_t rowpage_bytes(const RowPage *p);
+
+// Accessors; strings point into the page and are never NULL.
+long long rowpage_id(const RowPage *p, size_t i);
+const char *rowpage_source(const RowPage *p, size_t i);
+const char *rowpage_unit(const RowPage *p, size_t i);
+const char *rowpage_ts(const RowPage *p, size_t i);
+const char *rowpage_preview(const RowPage *p, size_t i);
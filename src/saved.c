@@ -0,0 +1,242 @@
+#include "saved.h"
+#include "rowpage.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    long long search;              // DBSavedSearch.id
+    size_t n;
+    SavedHit hits[SAVED_RECENT];   // newest first
+} Recent;
+
+// A saved search as listed, with owned strings, for one evaluation.
+typedef struct {
+    long long id, watermark;
+    char *query, *unit, *tag, *severity;
+} Search;
+
+typedef struct {
+    Search *v;
+    size_t n, cap;
+} SearchList;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t g_thread;
+static int g_running = 0, g_pending = 0;
+static Recent *g_recent = NULL;  // guarded by g_mu, like the rest
+static size_t g_nrecent = 0, g_recent_cap = 0;
+static uint64_t g_generation = 0;
+
+static char *dup_or_null(const char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void list_add(void *ctx, const DBSavedSearch *s) {
+    SearchList *l = ctx;
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 16;
+        Search *v = realloc(l->v, sizeof(*v) * cap);
+        if (!v) return;
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = (Search){ s->id, s->watermark, dup_or_null(s->query), dup_or_null(s->unit),
+                             dup_or_null(s->tag), dup_or_null(s->severity) };
+}
+
+static void list_free(SearchList *l) {
+    for (size_t i = 0; i < l->n; ++i) {
+        free(l->v[i].query);
+        free(l->v[i].unit);
+        free(l->v[i].tag);
+        free(l->v[i].severity);
+    }
+    free(l->v);
+}
+
+// Buffer of a search, created if needed. Called with g_mu held.
+static Recent *recent_for(long long search) {
+    for (size_t i = 0; i < g_nrecent; ++i)
+        if (g_recent[i].search == search) return &g_recent[i];
+    if (g_nrecent == g_recent_cap) {
+        size_t cap = g_recent_cap ? g_recent_cap * 2 : 16;
+        Recent *r = realloc(g_recent, sizeof(*r) * cap);
+        if (!r) return NULL;
+        g_recent = r;
+        g_recent_cap = cap;
+    }
+    Recent *r = &g_recent[g_nrecent++];
+    r->search = search;
+    r->n = 0;
+    return r;
+}
+
+// Put the newest matches of one evaluation (newest first) in front of the older ones.
+static void recent_push(long long search, RowPage *page) {
+    size_t k = page ? rowpage_size(page) : 0;
+    if (k > SAVED_RECENT) k = SAVED_RECENT;
+    pthread_mutex_lock(&g_mu);
+    Recent *r = recent_for(search);
+    if (r && k > 0) {
+        size_t keep = r->n + k > SAVED_RECENT ? SAVED_RECENT - k : r->n;
+        memmove(&r->hits[k], &r->hits[0], keep * sizeof(r->hits[0]));
+        for (size_t i = 0; i < k; ++i) {
+            SavedHit *h = &r->hits[i];
+            h->id = rowpage_id(page, i);
+            snprintf(h->ts, sizeof(h->ts), "%s", rowpage_ts(page, i));
+            snprintf(h->preview, sizeof(h->preview), "%s", rowpage_preview(page, i));
+        }
+        r->n = k + keep;
+    }
+    pthread_mutex_unlock(&g_mu);
+}
+
+/* Run every saved search over the rows between its watermark and the
+ * newest indexed row, then move the watermarks in one transaction. A
+ * search whose query fails keeps its watermark. */
+static void evaluate(DB *d) {
+    long long max_id = 0;
+    SearchList list = {0};
+    if (db_indexed_max_id(d, &max_id) != 0 || db_saved_list(d, list_add, &list) != 0) {
+        list_free(&list);
+        return;
+    }
+    DBSavedAdvance *adv = calloc(list.n ? list.n : 1, sizeof(*adv));
+    size_t n_adv = 0;
+    int found = 0;
+    for (size_t i = 0; adv && i < list.n; ++i) {
+        const Search *s = &list.v[i];
+        if (s->watermark >= max_id) continue;
+        DBSearchOpts opts = {0};
+        opts.query = s->query;
+        opts.unit = s->unit;
+        opts.tag = s->tag;
+        opts.severity = s->severity;
+        opts.after_id = s->watermark;
+        opts.max_id = max_id;
+        long long matches = 0;
+        if (db_count(d, &opts, &matches) != 0) continue;
+        if (matches > 0) {
+            opts.limit = SAVED_RECENT;
+            opts.preview = SAVED_PREVIEW_MAX;
+            sqlite3_stmt *stmt = NULL;
+            if (db_search_ex(d, &opts, &stmt) == 0) {
+                RowPage *page = rowpage_from_stmt(stmt, SAVED_RECENT, SAVED_PREVIEW_MAX - 1,
+                                                  ROWPAGE_ELLIPSIS | ROWPAGE_FIRST_LINE);
+                sqlite3_finalize(stmt);
+                recent_push(s->id, page);
+                rowpage_unref(page);
+            }
+            found = 1;
+        }
+        adv[n_adv++] = (DBSavedAdvance){ s->id, max_id, matches };
+    }
+    if (adv && db_saved_advance(d, adv, n_adv) == 0 && found) {
+        pthread_mutex_lock(&g_mu);
+        g_generation++;
+        pthread_mutex_unlock(&g_mu);
+    }
+    free(adv);
+    list_free(&list);
+}
+
+static void *saved_thread(void *arg) {
+    DB *d = arg;
+    pthread_mutex_lock(&g_mu);
+    for (;;) {
+        while (g_running && !g_pending) pthread_cond_wait(&g_cv, &g_mu);
+        if (!g_pending) break;
+        g_pending = 0;
+        pthread_mutex_unlock(&g_mu);
+        evaluate(d);
+        pthread_mutex_lock(&g_mu);
+        // batches committed meanwhile only set g_pending; they are evaluated together after the pause
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += (long)SAVED_MIN_INTERVAL_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        while (g_running && pthread_cond_timedwait(&g_cv, &g_mu, &until) != ETIMEDOUT) {}
+    }
+    pthread_mutex_unlock(&g_mu);
+    return NULL;
+}
+
+void saved_start(DB *db) {
+    pthread_mutex_lock(&g_mu);
+    if (g_running) { pthread_mutex_unlock(&g_mu); return; }
+    g_running = 1;
+    g_pending = 1;  // catch up on rows stored while nothing was running
+    if (pthread_create(&g_thread, NULL, saved_thread, db) != 0) g_running = 0;
+    pthread_mutex_unlock(&g_mu);
+}
+
+void saved_stop(void) {
+    pthread_mutex_lock(&g_mu);
+    if (!g_running) { pthread_mutex_unlock(&g_mu); return; }
+    g_running = 0;
+    g_pending = 1;
+    pthread_cond_broadcast(&g_cv);
+    pthread_mutex_unlock(&g_mu);
+    pthread_join(g_thread, NULL);
+}
+
+void saved_notify(void) {
+    pthread_mutex_lock(&g_mu);
+    if (g_running) {
+        g_pending = 1;
+        pthread_cond_signal(&g_cv);
+    }
+    pthread_mutex_unlock(&g_mu);
+}
+
+int saved_add(DB *d, const char *name, const DBSearchOpts *opts) {
+    if (!name || !*name || !opts) return -1;
+    if (opts->severity && opts->severity[0] && db_parse_severity(opts->severity) < 0) return -1;
+    long long max_id = 0;
+    if (db_indexed_max_id(d, &max_id) != 0) return -1;
+    /* An FTS5 syntax error only shows when the query runs: count over an
+     * empty id range to check it cheaply. */
+    DBSearchOpts check = {0};
+    check.query = opts->query;
+    check.unit = opts->unit;
+    check.tag = opts->tag;
+    check.severity = opts->severity;
+    check.after_id = max_id;
+    check.max_id = max_id > 0 ? max_id : 1;
+    long long n = 0;
+    if (db_count(d, &check, &n) != 0) return -1;
+    return db_saved_add(d, name, opts, max_id);
+}
+
+int saved_mark_read(DB *d, long long id) {
+    int rc = db_saved_mark_read(d, id);
+    pthread_mutex_lock(&g_mu);
+    g_generation++;
+    pthread_mutex_unlock(&g_mu);
+    return rc;
+}
+
+size_t saved_recent(long long id, SavedHit *out, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&g_mu);
+    for (size_t i = 0; i < g_nrecent; ++i) {
+        if (g_recent[i].search != id) continue;
+        n = g_recent[i].n < max ? g_recent[i].n : max;
+        memcpy(out, g_recent[i].hits, n * sizeof(*out));
+        break;
+    }
+    pthread_mutex_unlock(&g_mu);
+    return n;
+}
+
+uint64_t saved_generation(void) {
+    pthread_mutex_lock(&g_mu);
+    uint64_t g = g_generation;
+    pthread_mutex_unlock(&g_mu);
+    return g;
+}
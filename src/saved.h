@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "db.h"
+#include "timestamp.h"
+
+/* Saved searches: standing queries (OOM kills, segfaults, auth failures)
+ * kept in the saved_searches table and evaluated as rows arrive.
+ *
+ * After each ingest batch a background thread runs every saved search over
+ * the rows above its watermark only, then moves the watermark to the
+ * newest indexed id and adds the matches to the search's unread count.
+ * With a query the id range is a seek in the FTS index, so the cost of an
+ * evaluation follows the number of new rows, not the size of the table.
+ * Batches arriving while an evaluation runs are covered by the next one,
+ * at most every SAVED_MIN_INTERVAL_MS.
+ *
+ * The newest SAVED_RECENT matches of each search since start are kept in
+ * memory for the UI; unread counts and watermarks are in the database. */
+
+#define SAVED_RECENT 10
+#define SAVED_PREVIEW_MAX 160
+#define SAVED_MIN_INTERVAL_MS 250
+
+typedef struct {
+    long long id;                      // log id
+    char ts[TS_BUF];
+    char preview[SAVED_PREVIEW_MAX];   // start of the message, cut on a UTF-8 boundary
+} SavedHit;
+
+// Start and stop the evaluation thread. Called by ingest_start/ingest_stop; stopping evaluates once more.
+void saved_start(DB *db);
+void saved_stop(void);
+// New rows were committed. Called by the ingest writer after each batch.
+void saved_notify(void);
+
+/* Save the query and filters of opts (limit/offset/order and id bounds
+ * are ignored) under name, replacing a search of that name. Only rows
+ * stored after this call count as matches. Returns -1 if the query is
+ * not valid FTS5 syntax or the row cannot be written. */
+int saved_add(DB *d, const char *name, const DBSearchOpts *opts);
+// Mark a search's matches as read: db_saved_mark_read plus a change of saved_generation.
+int saved_mark_read(DB *d, long long id);
+// The newest matches of saved search id (DBSavedSearch.id), newest first. Returns how many.
+size_t saved_recent(long long id, SavedHit *out, size_t max);
+// Changes whenever an evaluation found matches or a search was read, so a UI can skip redrawing.
+uint64_t saved_generation(void);
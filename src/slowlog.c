@@ -0,0 +1,152 @@
+#include "slowlog.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int g_threshold_ms = SLOWLOG_DEFAULT_MS;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static SlowQuery g_ring[SLOWLOG_SIZE];
+static uint64_t g_recorded = 0;  // g_ring[g_recorded % SLOWLOG_SIZE] is the next slot
+
+// Set while this thread runs EXPLAIN QUERY PLAN, whose own statement is reported too.
+static __thread int t_explaining = 0;
+
+static void load_threshold(void) {
+    const char *v = getenv("LOG_EXPLORER_SLOW_QUERY_MS");
+    if (v && *v) g_threshold_ms = atoi(v);
+}
+
+int slowlog_threshold_ms(void) {
+    pthread_once(&g_once, load_threshold);
+    return g_threshold_ms;
+}
+
+/* EXPLAIN QUERY PLAN of sql on db (bound values do not change the plan
+ * shape). Steps are indented two spaces per level below the top. */
+static void explain(sqlite3 *db, const char *sql, char *out, size_t n) {
+    out[0] = '\0';
+    char *eqp = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", sql);
+    sqlite3_stmt *plan = NULL;
+    t_explaining = 1;
+    if (eqp && sqlite3_prepare_v2(db, eqp, -1, &plan, NULL) == SQLITE_OK) {
+        int ids[64], depths[64], nids = 0;
+        size_t len = 0;
+        while (sqlite3_step(plan) == SQLITE_ROW && len < n) {
+            int id = sqlite3_column_int(plan, 0), parent = sqlite3_column_int(plan, 1);
+            const char *detail = (const char*)sqlite3_column_text(plan, 3);
+            int depth = 0;
+            for (int i = nids - 1; i >= 0; --i)
+                if (ids[i] == parent) { depth = depths[i] + 1; break; }
+            if (nids < 64) {
+                ids[nids] = id;
+                depths[nids++] = depth;
+            }
+            int w = snprintf(out + len, n - len, "%*s%s\n", depth * 2, "", detail ? detail : "");
+            len += w > 0 ? (size_t)w : 0;
+        }
+    } else {
+        snprintf(out, n, "(no plan: %s)\n", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(plan);
+    t_explaining = 0;
+    sqlite3_free(eqp);
+}
+
+void slowlog_observe(sqlite3_stmt *stmt, uint64_t ns) {
+    int ms = slowlog_threshold_ms();
+    if (ms < 0 || t_explaining || ns < (uint64_t)ms * 1000000ULL) return;
+    /* FTS5 runs statements of its own on its shadow tables, always named
+     * as 'main'.'logs_fts_idx' and so on, for every MATCH; their time is
+     * part of the statement that issued the MATCH. */
+    const char *text = sqlite3_sql(stmt);
+    if (!text || strstr(text, "'.'")) return;
+    SlowQuery *q = malloc(sizeof(*q));
+    if (!q) return;
+    q->when = (int64_t)time(NULL);
+    q->ns = ns;
+    q->readonly = sqlite3_stmt_readonly(stmt);
+    q->fullscan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+    q->sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+    q->autoindex = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+    q->vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+    char *sql = sqlite3_expanded_sql(stmt);
+    snprintf(q->sql, sizeof(q->sql), "%s", sql ? sql : text);
+    sqlite3_free(sql);
+    snprintf(q->shape, sizeof(q->shape), "%s", text);
+    q->explained = 0;
+    q->plan[0] = '\0';
+    pthread_mutex_lock(&g_mu);
+    q->seq = g_recorded;
+    g_ring[g_recorded++ % SLOWLOG_SIZE] = *q;
+    pthread_mutex_unlock(&g_mu);
+    free(q);
+}
+
+/* Plans are taken without g_mu, which the profile callback of another
+ * thread may be waiting for while it holds the connection; an entry that
+ * was overwritten meanwhile is recognised by its seq. */
+void slowlog_explain(sqlite3 *db) {
+    char *shape = malloc(SLOWLOG_SQL_MAX), *plan = malloc(SLOWLOG_PLAN_MAX);
+    if (!shape || !plan) {
+        free(shape);
+        free(plan);
+        return;
+    }
+    for (size_t i = 0; i < SLOWLOG_SIZE; ++i) {
+        pthread_mutex_lock(&g_mu);
+        SlowQuery *q = &g_ring[i];
+        int todo = i < g_recorded && !q->explained;
+        uint64_t seq = q->seq;
+        if (todo) memcpy(shape, q->shape, SLOWLOG_SQL_MAX);
+        pthread_mutex_unlock(&g_mu);
+        if (!todo) continue;
+        explain(db, shape, plan, SLOWLOG_PLAN_MAX);
+        pthread_mutex_lock(&g_mu);
+        if (q->seq == seq && !q->explained) {
+            memcpy(q->plan, plan, SLOWLOG_PLAN_MAX);
+            q->explained = 1;
+        }
+        pthread_mutex_unlock(&g_mu);
+    }
+    free(shape);
+    free(plan);
+}
+
+size_t slowlog_snapshot(SlowQuery *out, size_t max) {
+    pthread_mutex_lock(&g_mu);
+    size_t n = g_recorded < SLOWLOG_SIZE ? (size_t)g_recorded : SLOWLOG_SIZE;
+    if (n > max) n = max;
+    for (size_t i = 0; i < n; ++i) out[i] = g_ring[(g_recorded - 1 - i) % SLOWLOG_SIZE];
+    pthread_mutex_unlock(&g_mu);
+    return n;
+}
+
+void slowlog_write(FILE *out) {
+    SlowQuery *qs = malloc(sizeof(*qs) * SLOWLOG_SIZE);
+    if (!qs) return;
+    size_t n = slowlog_snapshot(qs, SLOWLOG_SIZE);
+    int ms = slowlog_threshold_ms();
+    if (ms < 0) fprintf(out, "slow-query log disabled (LOG_EXPLORER_SLOW_QUERY_MS < 0)\n");
+    else fprintf(out, "%zu statements over %d ms\n", n, ms);
+    for (size_t i = 0; i < n; ++i) {
+        const SlowQuery *q = &qs[i];
+        char when[32];
+        time_t t = (time_t)q->when;
+        struct tm tm;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+        fprintf(out, "\n%s  %.1f ms  %s  fullscan steps %d  sorts %d  autoindex %d  vm steps %d\n", when,
+                (double)q->ns / 1e6, q->readonly ? "read" : "write", q->fullscan_steps, q->sorts, q->autoindex,
+                q->vm_steps);
+        fprintf(out, "  %s\n", q->sql);
+        for (const char *p = q->plan; *p;) {
+            const char *nl = strchr(p, '\n');
+            size_t len = nl ? (size_t)(nl - p) : strlen(p);
+            fprintf(out, "    %.*s\n", (int)len, p);
+            p += len + (nl ? 1 : 0);
+        }
+    }
+    free(qs);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Slow-query log: statements that ran longer than a threshold, with the
+ * SQLite counters and query plan needed to tell why.
+ *
+ * db.c's profile callback reports every finished statement on every
+ * connection, so searches stepped by the caller outside the DB lock are
+ * covered as well as the db_* entry points. A statement above
+ * LOG_EXPLORER_SLOW_QUERY_MS (default SLOWLOG_DEFAULT_MS; 0 records every
+ * statement, a negative value none) is copied into a process-wide ring of
+ * the last SLOWLOG_SIZE. Its EXPLAIN QUERY PLAN is filled in later, by
+ * slowlog_explain when the log is read: a statement run from inside the
+ * profile callback would reset sqlite3_changes() and the error message of
+ * the connection under its caller. The stats panel and log-explorer-cli
+ * --slow-queries print the ring through db_write_slow_queries. */
+
+#define SLOWLOG_SIZE 64
+#define SLOWLOG_DEFAULT_MS 200
+#define SLOWLOG_SQL_MAX 2048    // longer statements are cut
+#define SLOWLOG_PLAN_MAX 2048
+
+typedef struct {
+    uint64_t seq;              // position in the order of recording
+    int64_t when;              // wall clock, seconds since the epoch
+    uint64_t ns;               // run time, from the first step to reset or finalize
+    int readonly;
+    // sqlite3_stmt_status counters since the statement was prepared
+    int fullscan_steps, sorts, autoindex, vm_steps;
+    char sql[SLOWLOG_SQL_MAX];    // with the bound values (sqlite3_expanded_sql)
+    char shape[SLOWLOG_SQL_MAX];  // as prepared, with ? placeholders
+    int explained;
+    char plan[SLOWLOG_PLAN_MAX];  // one line per plan step, indented by depth
+} SlowQuery;
+
+// Threshold in milliseconds, from LOG_EXPLORER_SLOW_QUERY_MS; < 0 when disabled.
+int slowlog_threshold_ms(void);
+// Record stmt if it ran for longer than the threshold. Called from the SQLite profile callback.
+void slowlog_observe(sqlite3_stmt *stmt, uint64_t ns);
+// Fill in the query plans of entries recorded since the last call, on db. Called with the DB lock held.
+void slowlog_explain(sqlite3 *db);
+// Copy the recorded statements into out, newest first. Returns how many were copied.
+size_t slowlog_snapshot(SlowQuery *out, size_t max);
+// Print the recorded statements, newest first.
+void slowlog_write(FILE *out);
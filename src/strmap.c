@@ -0,0 +1,89 @@
+#include "strmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *key;      // NULL for an empty slot
+    uint64_t hash;
+    int64_t value;
+} StrMapSlot;
+
+struct StrMap {
+    StrMapSlot *slots;
+    size_t cap;     // always a power of two
+    size_t count;
+};
+
+static uint64_t str_hash(const char *s) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (; *s; ++s) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+StrMap *strmap_new(void) {
+    StrMap *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->cap = 64;
+    m->slots = calloc(m->cap, sizeof(StrMapSlot));
+    if (!m->slots) { free(m); return NULL; }
+    return m;
+}
+
+void strmap_free(StrMap *m) {
+    if (!m) return;
+    for (size_t i = 0; i < m->cap; ++i) free(m->slots[i].key);
+    free(m->slots);
+    free(m);
+}
+
+static StrMapSlot *find_slot(StrMapSlot *slots, size_t cap, const char *key, uint64_t h) {
+    size_t i = (size_t)h & (cap - 1);
+    while (slots[i].key && (slots[i].hash != h || strcmp(slots[i].key, key) != 0))
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+int strmap_get(const StrMap *m, const char *key, int64_t *out) {
+    if (!m || !key) return 0;
+    StrMapSlot *s = find_slot(m->slots, m->cap, key, str_hash(key));
+    if (!s->key) return 0;
+    if (out) *out = s->value;
+    return 1;
+}
+
+static int grow(StrMap *m) {
+    size_t cap = m->cap * 2;
+    StrMapSlot *slots = calloc(cap, sizeof(StrMapSlot));
+    if (!slots) return -1;
+    for (size_t i = 0; i < m->cap; ++i) {
+        if (!m->slots[i].key) continue;
+        *find_slot(slots, cap, m->slots[i].key, m->slots[i].hash) = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->cap = cap;
+    return 0;
+}
+
+int strmap_put(StrMap *m, const char *key, int64_t value) {
+    if (!m || !key) return -1;
+    // keep the load factor under 3/4 so probe chains stay short
+    if ((m->count + 1) * 4 > m->cap * 3 && grow(m) != 0) return -1;
+    uint64_t h = str_hash(key);
+    StrMapSlot *s = find_slot(m->slots, m->cap, key, h);
+    if (!s->key) {
+        s->key = strdup(key);
+        if (!s->key) return -1;
+        s->hash = h;
+        m->count++;
+    }
+    s->value = value;
+    return 0;
+}
+
+size_t strmap_size(const StrMap *m) {
+    return m ? m->count : 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Small string -> int64 hash map (open addressing, keys copied). Used for
+ * name -> id caches in front of lookup tables. Not thread-safe: callers
+ * guard it with whatever lock protects the table it caches. */
+typedef struct StrMap StrMap;
+
+StrMap *strmap_new(void);
+void strmap_free(StrMap *m);
+// Returns 1 and sets *out if key is present, 0 otherwise.
+int strmap_get(const StrMap *m, const char *key, int64_t *out);
+// Insert or overwrite. Returns 0, or -1 on allocation failure.
+int strmap_put(StrMap *m, const char *key, int64_t value);
+size_t strmap_size(const StrMap *m);
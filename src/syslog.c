@@ -0,0 +1,566 @@
+#define _GNU_SOURCE
+#include "syslog.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "ingest.h"
+#include "timestamp.h"
+
+#define BATCH 64               // datagrams per recvmmsg and rows per ingest_submit_many
+#define UDP_MAX 8192           // larger datagrams are truncated (rsyslog's default limit)
+#define TCP_MAX_FRAME (1 << 20)
+#define RCVBUF (8 << 20)
+#define SRC_MAX 272            // "syslog:" + a 255-byte host name
+#define UNIT_MAX 64            // RFC 5424 allows 48 bytes of APP-NAME
+
+static _Atomic uint64_t g_udp_messages, g_tcp_messages, g_tcp_connections, g_udp_dropped, g_malformed;
+
+static Reactor *g_reactor = NULL; // syslog_start's own reactor
+
+// ---- parsing ----
+
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static size_t token_len(const char *p, const char *end) {
+    const char *s = p;
+    while (p < end && *p != ' ') p++;
+    return (size_t)(p - s);
+}
+
+// "Oct 17 12:00:01" (day may be space-padded), followed by a space or the end.
+static int is_bsd_stamp(const char *p, const char *end) {
+    if (end - p < 15) return 0;
+    return p[0] >= 'A' && p[0] <= 'Z' && p[1] >= 'a' && p[1] <= 'z' && p[2] >= 'a' && p[2] <= 'z' &&
+           p[3] == ' ' && (p[4] == ' ' || is_digit(p[4])) && is_digit(p[5]) && p[6] == ' ' &&
+           is_digit(p[7]) && is_digit(p[8]) && p[9] == ':' && is_digit(p[10]) && is_digit(p[11]) &&
+           p[12] == ':' && is_digit(p[13]) && is_digit(p[14]) && (end - p == 15 || p[15] == ' ');
+}
+
+// "2025-10-17T..." as sent by rsyslog's RFC 3339 forwarding templates.
+static int is_iso_stamp(const char *p, const char *end) {
+    return end - p >= 19 && is_digit(p[0]) && is_digit(p[1]) && is_digit(p[2]) && is_digit(p[3]) &&
+           p[4] == '-' && is_digit(p[5]) && p[7] == '-' && (p[10] == 'T' || p[10] == ' ');
+}
+
+/* RFC 3164 tag: "name:" or "name[pid]:" (the colon is sometimes missing
+ * after the pid). Returns the name length, or 0 if tok is not a tag. */
+static size_t tag_len(const char *tok, size_t n) {
+    if (n == 0) return 0;
+    const char *br = memchr(tok, '[', n);
+    if (br) return (size_t)(br - tok);
+    return tok[n - 1] == ':' ? n - 1 : 0;
+}
+
+static void parse_5424(const char *p, const char *end, SyslogMsg *out) {
+    const char *field[5];
+    size_t flen[5];
+    // TIMESTAMP HOSTNAME APP-NAME PROCID MSGID
+    for (int i = 0; i < 5; ++i) {
+        field[i] = p;
+        flen[i] = token_len(p, end);
+        p += flen[i];
+        if (p < end) p++;
+        if (flen[i] == 1 && field[i][0] == '-') flen[i] = 0;
+    }
+    out->ts = field[0];
+    out->ts_len = flen[0];
+    out->host = field[1];
+    out->host_len = flen[1];
+    out->app = field[2];
+    out->app_len = flen[2];
+    // STRUCTURED-DATA is "-" or "[id k="v" ...]..." with \] escapes in values; kept in the message.
+    const char *msg = p;
+    if (p < end && *p == '-') {
+        p++;
+        if (p < end && *p == ' ') p++;
+        msg = p;
+    } else {
+        int quoted = 0;
+        while (p < end && *p == '[') {
+            for (p++; p < end; ++p) {
+                if (quoted && *p == '\\' && p + 1 < end) { p++; continue; }
+                if (*p == '"') quoted = !quoted;
+                else if (*p == ']' && !quoted) { p++; break; }
+            }
+        }
+    }
+    if (msg == p && end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) msg = p + 3; // UTF-8 BOM
+    out->msg = msg;
+    out->msg_len = (size_t)(end - msg);
+}
+
+static void parse_3164(const char *p, const char *end, SyslogMsg *out) {
+    int have_ts = 0;
+    if (is_bsd_stamp(p, end)) {
+        out->ts = p;
+        out->ts_len = 15;
+        have_ts = 1;
+    } else if (is_iso_stamp(p, end)) {
+        out->ts = p;
+        out->ts_len = token_len(p, end);
+        have_ts = 1;
+    }
+    if (have_ts) {
+        p += out->ts_len;
+        while (p < end && *p == ' ') p++;
+    }
+    size_t n = token_len(p, end);
+    size_t tl = tag_len(p, n);
+    // Without a timestamp the sender (e.g. logger over a raw socket) sent no host either.
+    if (tl == 0 && have_ts && n > 0 && p + n < end) {
+        out->host = p;
+        out->host_len = n;
+        p += n + 1;
+        n = token_len(p, end);
+        tl = tag_len(p, n);
+    }
+    if (tl > 0) {
+        out->app = p;
+        out->app_len = tl;
+        p += n;
+        if (p < end && *p == ' ') p++;
+    }
+    out->msg = p;
+    out->msg_len = (size_t)(end - p);
+}
+
+void syslog_parse(const char *buf, size_t len, SyslogMsg *out) {
+    memset(out, 0, sizeof(*out));
+    out->pri = -1;
+    const char *p = buf, *end = buf + len;
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == '\0')) end--;
+    out->msg = p;
+    out->msg_len = (size_t)(end - p);
+    if (p >= end || *p != '<') return;
+    int pri = 0, digits = 0;
+    for (p++; p < end && is_digit(*p) && digits < 3; ++p, ++digits) pri = pri * 10 + (*p - '0');
+    if (digits == 0 || p >= end || *p != '>' || pri > 191) {
+        out->msg = buf;
+        return;
+    }
+    out->pri = pri;
+    p++;
+    if (end - p >= 2 && p[0] == '1' && p[1] == ' ') parse_5424(p + 2, end, out);
+    else parse_3164(p, end, out);
+}
+
+// ---- batching into the ingest queue ----
+
+typedef struct {
+    LogRecord recs[BATCH];
+    char source[BATCH][SRC_MAX];
+    char unit[BATCH][UNIT_MAX];
+    char ts[BATCH][TS_BUF];
+    size_t msg_off[BATCH];
+    char *text;          // message bytes of the batch, NUL-separated
+    size_t text_len, text_cap;
+    size_t n;
+} Batch;
+
+// Per receiver thread: TsParsers learn one format each, so RFC 3164 and ISO stamps get their own.
+typedef struct {
+    Batch batch;
+    TsParser *bsd, *iso;
+    int64_t bsd_day;     // BSD stamps carry no year; re-anchor the parser once a day
+    int64_t now_us;      // receive time of the current read, for messages without a stamp
+} Receiver;
+
+static int64_t wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void batch_flush(Batch *b) {
+    if (b->n == 0) return;
+    for (size_t i = 0; i < b->n; ++i) b->recs[i].message = b->text + b->msg_off[i];
+    ingest_submit_many(METRIC_SRC_SYSLOG, b->recs, b->n);
+    b->n = 0;
+    b->text_len = 0;
+}
+
+static void copy_field(char *dst, size_t cap, const char *prefix, const char *s, size_t n) {
+    size_t pl = strlen(prefix);
+    if (n > cap - pl - 1) n = cap - pl - 1;
+    memcpy(dst, prefix, pl);
+    memcpy(dst + pl, s, n);
+    dst[pl + n] = '\0';
+}
+
+static void receive_message(Receiver *r, const char *buf, size_t len, const struct sockaddr_storage *peer) {
+    SyslogMsg m;
+    syslog_parse(buf, len, &m);
+    if (m.pri < 0) atomic_fetch_add_explicit(&g_malformed, 1, memory_order_relaxed);
+
+    Batch *b = &r->batch;
+    if (b->text_len + m.msg_len + 1 > b->text_cap) {
+        size_t cap = b->text_cap ? b->text_cap : 64 * 1024;
+        while (cap < b->text_len + m.msg_len + 1) cap *= 2;
+        char *p = realloc(b->text, cap);
+        if (!p) return;
+        b->text = p;
+        b->text_cap = cap;
+    }
+    size_t i = b->n;
+    LogRecord *rec = &b->recs[i];
+
+    if (m.host_len > 0) {
+        copy_field(b->source[i], SRC_MAX, "syslog:", m.host, m.host_len);
+    } else {
+        // No host in the message: name the source after the peer address.
+        char addr[INET6_ADDRSTRLEN] = "unknown";
+        if (peer->ss_family == AF_INET)
+            inet_ntop(AF_INET, &((const struct sockaddr_in *)peer)->sin_addr, addr, sizeof(addr));
+        else if (peer->ss_family == AF_INET6)
+            inet_ntop(AF_INET6, &((const struct sockaddr_in6 *)peer)->sin6_addr, addr, sizeof(addr));
+        copy_field(b->source[i], SRC_MAX, "syslog:", addr, strlen(addr));
+    }
+    rec->source = b->source[i];
+    // Without an APP-NAME the unit is "", as for other inputs, so the context view can seek on it.
+    if (m.app_len > 0) copy_field(b->unit[i], UNIT_MAX, "", m.app, m.app_len);
+    else b->unit[i][0] = '\0';
+    rec->unit = b->unit[i];
+
+    int have_ts = 0;
+    if (m.ts_len > 0) {
+        TsParser *p;
+        if (is_digit(m.ts[0])) {
+            p = r->iso;
+        } else {
+            int64_t day = r->now_us / 86400000000LL;
+            if (day != r->bsd_day) {
+                ts_parser_free(r->bsd);
+                r->bsd = ts_parser_new(0);
+                r->bsd_day = day;
+            }
+            p = r->bsd;
+        }
+        have_ts = p && ts_parse(p, m.ts, m.ts_len, b->ts[i]);
+    }
+    if (!have_ts) ts_format_us(r->now_us, b->ts[i]);
+    rec->ts = b->ts[i];
+    rec->pri = m.pri;
+
+    b->msg_off[i] = b->text_len;
+    memcpy(b->text + b->text_len, m.msg, m.msg_len);
+    b->text_len += m.msg_len;
+    b->text[b->text_len++] = '\0';
+    if (++b->n == BATCH) batch_flush(b);
+}
+
+static void receiver_init(Receiver *r) {
+    memset(r, 0, sizeof(*r));
+    r->iso = ts_parser_new(0);
+    r->bsd_day = -1;
+}
+
+static void receiver_free(Receiver *r) {
+    batch_flush(&r->batch);
+    free(r->batch.text);
+    ts_parser_free(r->iso);
+    ts_parser_free(r->bsd);
+}
+
+// ---- sockets ----
+
+// "[host:]port", with IPv6 hosts in brackets ("[::1]:514").
+static int open_socket(const char *addr, int type) {
+    char host[256] = "";
+    const char *port = addr;
+    if (addr[0] == '[') {
+        const char *close = strchr(addr, ']');
+        if (!close || close[1] != ':') return -1;
+        snprintf(host, sizeof(host), "%.*s", (int)(close - addr - 1), addr + 1);
+        port = close + 2;
+    } else {
+        const char *colon = strrchr(addr, ':');
+        if (colon) {
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - addr), addr);
+            port = colon + 1;
+        }
+    }
+    struct addrinfo hints = { .ai_flags = AI_PASSIVE, .ai_family = AF_UNSPEC, .ai_socktype = type };
+    struct addrinfo *res = NULL;
+    int rc = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+    if (rc != 0) {
+        fprintf(stderr, "syslog: %s: %s\n", addr, gai_strerror(rc));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (type == SOCK_DGRAM) {
+            // A burst must fit in the socket buffer while the thread is busy handing rows to ingest.
+            int sz = RCVBUF;
+            if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &sz, sizeof(sz)) != 0)
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+            setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+        }
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && (type != SOCK_STREAM || listen(fd, 128) == 0)) break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) fprintf(stderr, "syslog: cannot listen on %s: %s\n", addr, strerror(errno));
+    freeaddrinfo(res);
+    return fd;
+}
+
+// ---- sources (see reactor.h) ----
+
+/* A listening socket. TCP connections are sources of their own and share
+ * their listener's Receiver: they run on the same reactor thread and are
+ * closed before it. */
+typedef struct {
+    Reactor *reactor;
+    const char *addr;
+    int type;            // SOCK_DGRAM or SOCK_STREAM
+    int fd;
+    Receiver r;
+    char *bufs;          // UDP: BATCH datagram buffers
+} Listener;
+
+static int listener_open(void *ctx) {
+    Listener *l = ctx;
+    l->fd = open_socket(l->addr, l->type);
+    if (l->fd < 0) return -1;
+    if (l->type == SOCK_DGRAM && !(l->bufs = malloc((size_t)BATCH * UDP_MAX))) {
+        close(l->fd);
+        return -1;
+    }
+    receiver_init(&l->r);
+    return 0;
+}
+
+static int listener_fd(void *ctx) {
+    return ((Listener *)ctx)->fd;
+}
+
+static void listener_close(void *ctx) {
+    Listener *l = ctx;
+    receiver_free(&l->r);
+    close(l->fd);
+    free(l->bufs);
+    free(l);
+}
+
+// One recvmmsg; the kernel buffer absorbs bursts between calls.
+static int udp_read_batch(void *ctx) {
+    Listener *l = ctx;
+    struct mmsghdr msgs[BATCH];
+    struct iovec iov[BATCH];
+    struct sockaddr_storage peers[BATCH];
+    char ctrl[BATCH][CMSG_SPACE(sizeof(uint32_t))];
+    for (int i = 0; i < BATCH; ++i) {
+        iov[i].iov_base = l->bufs + (size_t)i * UDP_MAX;
+        iov[i].iov_len = UDP_MAX;
+        msgs[i].msg_hdr = (struct msghdr){
+            .msg_name = &peers[i], .msg_namelen = sizeof(peers[i]),
+            .msg_iov = &iov[i], .msg_iovlen = 1,
+            .msg_control = ctrl[i], .msg_controllen = sizeof(ctrl[i]),
+        };
+    }
+    int n = recvmmsg(l->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0) return 0;
+    l->r.now_us = wall_us();
+    for (int i = 0; i < n; ++i) {
+        struct msghdr *h = &msgs[i].msg_hdr;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t dropped;
+                memcpy(&dropped, CMSG_DATA(c), sizeof(dropped));
+                atomic_store_explicit(&g_udp_dropped, dropped, memory_order_relaxed);
+            }
+        }
+        receive_message(&l->r, iov[i].iov_base, msgs[i].msg_len, &peers[i]);
+    }
+    atomic_fetch_add_explicit(&g_udp_messages, (uint64_t)n, memory_order_relaxed);
+    batch_flush(&l->r.batch);
+    return n == BATCH;
+}
+
+static const SourceOps udp_ops = {
+    .name = "syslog-udp", .open = listener_open, .fd = listener_fd,
+    .read_batch = udp_read_batch, .close = listener_close,
+};
+
+typedef struct {
+    int fd;
+    struct sockaddr_storage peer;
+    Receiver *r;         // the listener's
+    char *buf;
+    size_t len, cap;
+} Conn;
+
+/* Split buffered bytes into messages. A frame starting with a digit is
+ * octet-counted ("LEN SP MSG"); anything else is terminated by LF.
+ * Returns -1 if the peer sent an impossible frame length. */
+static int conn_frames(Receiver *r, Conn *c, int eof) {
+    size_t pos = 0;
+    uint64_t count = 0;
+    while (pos < c->len) {
+        char *p = c->buf + pos;
+        size_t avail = c->len - pos;
+        if (*p == '\n' || *p == '\r' || *p == '\0') { pos++; continue; }
+        if (is_digit(*p)) {
+            size_t i = 0, flen = 0;
+            while (i < avail && i < 8 && is_digit(p[i])) flen = flen * 10 + (size_t)(p[i++] - '0');
+            if (i == avail) break;
+            if (p[i] != ' ' || flen > TCP_MAX_FRAME) return -1;
+            if (avail - i - 1 < flen) break;
+            receive_message(r, p + i + 1, flen, &c->peer);
+            pos += i + 1 + flen;
+        } else {
+            char *nl = memchr(p, '\n', avail);
+            if (!nl) {
+                if (!eof && avail < TCP_MAX_FRAME) break;
+                nl = p + avail; // unterminated last line, or one too long to buffer: take it as is
+            }
+            receive_message(r, p, (size_t)(nl - p), &c->peer);
+            pos += (size_t)(nl - p) + (nl < p + avail);
+        }
+        count++;
+    }
+    if (pos > 0) {
+        memmove(c->buf, c->buf + pos, c->len - pos);
+        c->len -= pos;
+    }
+    atomic_fetch_add_explicit(&g_tcp_messages, count, memory_order_relaxed);
+    return 0;
+}
+
+// Reads per conn_read_batch call, so one busy sender cannot hold up the reactor.
+#define CONN_READS 16
+
+static int conn_read_batch(void *ctx) {
+    Conn *c = ctx;
+    int rc = -1;
+    for (int reads = 0;; ++reads) {
+        if (reads == CONN_READS) { rc = 1; break; }
+        if (c->cap - c->len < 16 * 1024) {
+            size_t cap = c->cap ? c->cap * 2 : 64 * 1024;
+            if (cap > TCP_MAX_FRAME + 64 * 1024) cap = TCP_MAX_FRAME + 64 * 1024;
+            if (cap > c->cap) {
+                char *p = realloc(c->buf, cap);
+                if (!p) break;
+                c->buf = p;
+                c->cap = cap;
+            }
+        }
+        ssize_t n = read(c->fd, c->buf + c->len, c->cap - c->len);
+        if (n == 0) {
+            conn_frames(c->r, c, 1);
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) rc = 0;
+            break;
+        }
+        c->len += (size_t)n;
+        c->r->now_us = wall_us();
+        if (conn_frames(c->r, c, 0) != 0) break;
+    }
+    batch_flush(&c->r->batch);
+    return rc;
+}
+
+static int conn_fd(void *ctx) {
+    return ((Conn *)ctx)->fd;
+}
+
+// Complete frames already buffered are kept; senders resend the rest after reconnecting.
+static void conn_close(void *ctx) {
+    Conn *c = ctx;
+    conn_frames(c->r, c, 0);
+    batch_flush(&c->r->batch);
+    close(c->fd);
+    free(c->buf);
+    free(c);
+    atomic_fetch_sub_explicit(&g_tcp_connections, 1, memory_order_relaxed);
+}
+
+static const SourceOps conn_ops = {
+    .name = "syslog-tcp-conn", .fd = conn_fd, .read_batch = conn_read_batch, .close = conn_close,
+};
+
+static int tcp_accept_batch(void *ctx) {
+    Listener *l = ctx;
+    for (int i = 0; i < BATCH; ++i) {
+        Conn *c = calloc(1, sizeof(*c));
+        if (!c) return 0;
+        socklen_t sl = sizeof(c->peer);
+        c->fd = accept4(l->fd, (struct sockaddr *)&c->peer, &sl, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (c->fd < 0) { free(c); return 0; }
+        c->r = &l->r;
+        atomic_fetch_add_explicit(&g_tcp_connections, 1, memory_order_relaxed);
+        if (reactor_add(l->reactor, &conn_ops, c) != 0) conn_close(c);
+    }
+    return 1;
+}
+
+static const SourceOps tcp_ops = {
+    .name = "syslog-tcp", .open = listener_open, .fd = listener_fd,
+    .read_batch = tcp_accept_batch, .close = listener_close,
+};
+
+static int add_listener(Reactor *reactor, const char *addr, int type) {
+    Listener *l = calloc(1, sizeof(*l));
+    if (!l) return -1;
+    l->reactor = reactor;
+    l->addr = addr;
+    l->type = type;
+    if (reactor_add(reactor, type == SOCK_DGRAM ? &udp_ops : &tcp_ops, l) != 0) {
+        free(l);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- lifecycle ----
+
+int syslog_add_sources(Reactor *reactor, const char *udp_addr, const char *tcp_addr) {
+    int rc = 0;
+    if (udp_addr && *udp_addr && add_listener(reactor, udp_addr, SOCK_DGRAM) != 0) rc = -1;
+    if (tcp_addr && *tcp_addr && add_listener(reactor, tcp_addr, SOCK_STREAM) != 0) rc = -1;
+    return rc;
+}
+
+int syslog_add_from_env(Reactor *reactor) {
+    return syslog_add_sources(reactor, getenv("LOG_EXPLORER_SYSLOG_UDP"), getenv("LOG_EXPLORER_SYSLOG_TCP"));
+}
+
+int syslog_start(const char *udp_addr, const char *tcp_addr) {
+    if (g_reactor) return 0;
+    if ((!udp_addr || !*udp_addr) && (!tcp_addr || !*tcp_addr)) return 0;
+    g_reactor = reactor_new();
+    if (!g_reactor) return -1;
+    if (syslog_add_sources(g_reactor, udp_addr, tcp_addr) != 0 || reactor_start(g_reactor) != 0) {
+        syslog_stop();
+        return -1;
+    }
+    return 0;
+}
+
+void syslog_stop(void) {
+    reactor_free(g_reactor);
+    g_reactor = NULL;
+}
+
+void syslog_get_stats(SyslogStats *out) {
+    out->udp_messages = atomic_load_explicit(&g_udp_messages, memory_order_relaxed);
+    out->tcp_messages = atomic_load_explicit(&g_tcp_messages, memory_order_relaxed);
+    out->tcp_connections = atomic_load_explicit(&g_tcp_connections, memory_order_relaxed);
+    out->udp_dropped = atomic_load_explicit(&g_udp_dropped, memory_order_relaxed);
+    out->malformed = atomic_load_explicit(&g_malformed, memory_order_relaxed);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "reactor.h"
+
+/* Network syslog receiver, so other machines' rsyslog/syslog-ng can forward
+ * to this indexer. The listeners are reactor sources (reactor.h): UDP is
+ * read with recvmmsg, many datagrams per system call, and each TCP
+ * connection becomes a source of its own, accepting both octet-counting
+ * (RFC 6587 "LEN <PRI>...") and newline-delimited framing.
+ * RFC 5424 and RFC 3164 messages are parsed: the sending host becomes the
+ * source ("syslog:<host>"), the app name / tag the unit, and PRI is kept in
+ * its own column. Rows go to the ingest writer in batches
+ * (ingest_submit_many), so ingest_start must have been called.
+ *
+ * Listen addresses are "[host:]port", e.g. "5514" or "127.0.0.1:5514"; the
+ * indexer reads them from LOG_EXPLORER_SYSLOG_UDP / LOG_EXPLORER_SYSLOG_TCP. */
+
+typedef struct {
+    uint64_t udp_messages;
+    uint64_t tcp_messages;
+    uint64_t tcp_connections;   // currently open
+    uint64_t udp_dropped;       // datagrams the kernel dropped for lack of buffer space
+    uint64_t malformed;         // messages without a PRI header, stored whole
+} SyslogStats;
+
+// Add listeners to a reactor. Either address may be NULL. Returns 0 if every requested one is listening.
+int syslog_add_sources(Reactor *reactor, const char *udp_addr, const char *tcp_addr);
+// syslog_add_sources with the addresses from the environment; 0 if none are set.
+int syslog_add_from_env(Reactor *reactor);
+// Run the listeners on a reactor of their own, for the headless receiver and benchmarks.
+int syslog_start(const char *udp_addr, const char *tcp_addr);
+void syslog_stop(void);
+void syslog_get_stats(SyslogStats *out);
+
+// Fields of one message; pointers into the parsed buffer, not NUL-terminated.
+typedef struct {
+    int pri;             // -1 without a PRI header
+    const char *ts;      // timestamp text, in the message's own format
+    size_t ts_len;       // 0 if absent (or "-" in RFC 5424)
+    const char *host;
+    size_t host_len;
+    const char *app;
+    size_t app_len;
+    const char *msg;
+    size_t msg_len;
+} SyslogMsg;
+
+// Parse one framed message. Never fails: anything unrecognised becomes the message.
+void syslog_parse(const char *buf, size_t len, SyslogMsg *out);
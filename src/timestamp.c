@@ -0,0 +1,357 @@
+#include "timestamp.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lines tried before a file is treated as having no recognisable stamps.
+#define TS_DETECT_LINES 32
+// Consecutive misses after which the format is detected again.
+#define TS_REDETECT_MISSES 256
+// Longest cached hour prefix ("17/Oct/2025:12:" is the longest).
+#define TS_KEY_MAX 16
+
+typedef enum {
+    TS_FMT_NONE = 0,
+    TS_FMT_RFC3164,
+    TS_FMT_ISO,
+    TS_FMT_APACHE,
+    TS_FMT_APACHE_ERROR,
+    TS_FMT_KERNEL,
+    TS_FMT_GAVE_UP
+} TsFormat;
+
+static const char *const fmt_names[] = {
+    "none", "rfc3164", "iso8601", "apache", "apache-error", "kernel", "none"
+};
+
+struct TsParser {
+    TsFormat fmt;
+    int tried;     // lines probed while fmt is NONE
+    int misses;    // consecutive lines the detected format did not match
+    int ref_year, ref_mon;
+    // Last hour prefix: the key bytes and the epoch of that hour's start.
+    char key[TS_KEY_MAX];
+    size_t key_len;
+    int64_t hour_naive; // the civil hour read as if it were UTC
+    int64_t hour_local; // the same hour in local time; valid if has_local
+    int has_local;
+    int y, mo, d, h;
+};
+
+/* Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant's
+ * days_from_civil), and the inverse. No libc, no time zone. */
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int *y, int *m, int *d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = (int)(yoe + era * 400 + (*m <= 2));
+}
+
+static void put2(char *o, int v) { o[0] = (char)('0' + v / 10); o[1] = (char)('0' + v % 10); }
+
+void ts_format_us(int64_t us, char out[TS_BUF]) {
+    int64_t secs = us >= 0 ? us / 1000000 : -((-us + 999999) / 1000000);
+    int64_t frac = us - secs * 1000000;
+    int64_t days = secs >= 0 ? secs / 86400 : -((-secs + 86399) / 86400);
+    int64_t sod = secs - days * 86400;
+    int y, m, d;
+    civil_from_days(days, &y, &m, &d);
+    if (y < 0 || y > 9999) { out[0] = '\0'; return; }
+    put2(out, y / 100);
+    put2(out + 2, y % 100);
+    out[4] = '-'; put2(out + 5, m);
+    out[7] = '-'; put2(out + 8, d);
+    out[10] = 'T'; put2(out + 11, (int)(sod / 3600));
+    out[13] = ':'; put2(out + 14, (int)(sod / 60 % 60));
+    out[16] = ':'; put2(out + 17, (int)(sod % 60));
+    out[19] = '.';
+    for (int i = 25; i >= 20; --i) { out[i] = (char)('0' + frac % 10); frac /= 10; }
+    out[26] = 'Z';
+    out[27] = '\0';
+}
+
+static inline int dig(char c) { return c >= '0' && c <= '9'; }
+static inline int num2(const char *s) { return (s[0] - '0') * 10 + (s[1] - '0'); }
+static inline int is2(const char *s) { return dig(s[0]) && dig(s[1]); }
+
+static int month_index(const char *s) {
+    // Case-sensitive, as every format here writes "Jan".."Dec".
+    switch (s[0]) {
+    case 'J': return s[1] == 'a' && s[2] == 'n' ? 1 : s[1] != 'u' ? 0 : s[2] == 'n' ? 6 : s[2] == 'l' ? 7 : 0;
+    case 'F': return s[1] == 'e' && s[2] == 'b' ? 2 : 0;
+    case 'M': return s[1] != 'a' ? 0 : s[2] == 'r' ? 3 : s[2] == 'y' ? 5 : 0;
+    case 'A': return s[1] == 'p' && s[2] == 'r' ? 4 : s[1] == 'u' && s[2] == 'g' ? 8 : 0;
+    case 'S': return s[1] == 'e' && s[2] == 'p' ? 9 : 0;
+    case 'O': return s[1] == 'c' && s[2] == 't' ? 10 : 0;
+    case 'N': return s[1] == 'o' && s[2] == 'v' ? 11 : 0;
+    case 'D': return s[1] == 'e' && s[2] == 'c' ? 12 : 0;
+    }
+    return 0;
+}
+
+static int valid_date(int y, int mo, int d, int h) {
+    return y >= 1970 && y <= 9999 && mo >= 1 && mo <= 12 && d >= 1 && d <= 31 && h >= 0 && h < 24;
+}
+
+static int key_cached(const TsParser *p, const char *key, size_t len) {
+    return p->key_len == len && memcmp(p->key, key, len) == 0;
+}
+
+static void key_store(TsParser *p, const char *key, size_t len, int y, int mo, int d, int h) {
+    memcpy(p->key, key, len);
+    p->key_len = len;
+    p->hour_naive = days_from_civil(y, mo, d) * 86400 + (int64_t)h * 3600;
+    p->has_local = 0;
+    p->y = y; p->mo = mo; p->d = d; p->h = h;
+}
+
+// Start of the cached hour in local time; mktime once per hour prefix.
+static int64_t hour_local(TsParser *p) {
+    if (!p->has_local) {
+        struct tm tm = {0};
+        tm.tm_year = p->y - 1900;
+        tm.tm_mon = p->mo - 1;
+        tm.tm_mday = p->d;
+        tm.tm_hour = p->h;
+        tm.tm_isdst = -1;
+        time_t t = mktime(&tm);
+        p->hour_local = t == (time_t)-1 ? p->hour_naive : (int64_t)t;
+        p->has_local = 1;
+    }
+    return p->hour_local;
+}
+
+/* "MM:SS" then an optional ".fff" / ",fff" fraction. Returns bytes used or 0. */
+static size_t parse_min_sec(const char *s, size_t n, int *secs, int64_t *us) {
+    if (n < 5 || !is2(s) || s[2] != ':' || !is2(s + 3)) return 0;
+    int mi = num2(s), se = num2(s + 3);
+    if (mi > 59 || se > 60) return 0;
+    *secs = mi * 60 + se;
+    *us = 0;
+    size_t i = 5;
+    if (i + 1 < n && (s[i] == '.' || s[i] == ',') && dig(s[i + 1])) {
+        int64_t scale = 100000;
+        for (++i; i < n && dig(s[i]); ++i) {
+            *us += (s[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    return i;
+}
+
+// "Z", "+HH:MM", "+HHMM" or "+HH". Returns bytes used, 0 if none.
+static size_t parse_zone(const char *s, size_t n, int *off) {
+    if (n >= 1 && s[0] == 'Z') { *off = 0; return 1; }
+    if (n < 3 || (s[0] != '+' && s[0] != '-') || !is2(s + 1)) return 0;
+    int sign = s[0] == '-' ? -1 : 1;
+    int h = num2(s + 1), m = 0;
+    size_t i = 3;
+    if (n >= 6 && s[3] == ':' && is2(s + 4)) { m = num2(s + 4); i = 6; }
+    else if (n >= 5 && is2(s + 3)) { m = num2(s + 3); i = 5; }
+    *off = sign * (h * 3600 + m * 60);
+    return i;
+}
+
+// "Oct 17 12:00:01" / "Oct  7 12:00:01"
+static int parse_rfc3164(TsParser *p, const char *s, size_t n, int64_t *out) {
+    if (n < 15 || s[3] != ' ' || s[9] != ':') return 0;
+    if (!key_cached(p, s, 10)) {
+        int mo = month_index(s);
+        if (!mo || !(s[4] == ' ' || dig(s[4])) || !dig(s[5]) || s[6] != ' ' || !is2(s + 7)) return 0;
+        int d = (s[4] == ' ' ? 0 : s[4] - '0') * 10 + (s[5] - '0');
+        int y = p->ref_year - (mo > p->ref_mon);
+        int h = num2(s + 7);
+        if (!valid_date(y, mo, d, h)) return 0;
+        key_store(p, s, 10, y, mo, d, h);
+    }
+    int secs;
+    int64_t us;
+    if (!parse_min_sec(s + 10, n - 10, &secs, &us)) return 0;
+    *out = (hour_local(p) + secs) * 1000000 + us;
+    return 1;
+}
+
+// "2025-10-17T12:00:01[.frac][zone]", "2025-10-17 12:00:01" (dpkg)
+static int parse_iso(TsParser *p, const char *s, size_t n, int64_t *out) {
+    // RFC5424 as written by some relays: "<PRI>1 " before the stamp
+    if (n > 0 && s[0] == '<') {
+        size_t i = 1;
+        while (i < n && i < 5 && dig(s[i])) ++i;
+        if (i + 3 > n || s[i] != '>' || s[i + 1] != '1' || s[i + 2] != ' ') return 0;
+        s += i + 3;
+        n -= i + 3;
+    }
+    if (n < 19 || s[4] != '-' || s[7] != '-' || (s[10] != 'T' && s[10] != ' ') || s[13] != ':') return 0;
+    if (!key_cached(p, s, 14)) {
+        if (!is2(s) || !is2(s + 2) || !is2(s + 5) || !is2(s + 8) || !is2(s + 11)) return 0;
+        int y = num2(s) * 100 + num2(s + 2), mo = num2(s + 5), d = num2(s + 8), h = num2(s + 11);
+        if (!valid_date(y, mo, d, h)) return 0;
+        key_store(p, s, 14, y, mo, d, h);
+    }
+    int secs, off;
+    int64_t us;
+    size_t i = parse_min_sec(s + 14, n - 14, &secs, &us);
+    if (!i) return 0;
+    i += 14;
+    if (parse_zone(s + i, n - i, &off)) *out = (p->hour_naive + secs - off) * 1000000 + us;
+    else *out = (hour_local(p) + secs) * 1000000 + us;
+    return 1;
+}
+
+// "[17/Oct/2025:12:00:01 +0200]" after the client address and user fields
+static int parse_apache(TsParser *p, const char *s, size_t n, int64_t *out) {
+    const char *b = memchr(s, '[', n < 256 ? n : 256);
+    if (!b) return 0;
+    n -= (size_t)(b + 1 - s);
+    s = b + 1;
+    if (n < 21 || s[2] != '/' || s[6] != '/' || s[11] != ':' || s[14] != ':') return 0;
+    if (!key_cached(p, s, 15)) {
+        int mo = month_index(s + 3);
+        if (!mo || !is2(s) || !is2(s + 7) || !is2(s + 9) || !is2(s + 12)) return 0;
+        int y = num2(s + 7) * 100 + num2(s + 9), d = num2(s), h = num2(s + 12);
+        if (!valid_date(y, mo, d, h)) return 0;
+        key_store(p, s, 15, y, mo, d, h);
+    }
+    int secs, off;
+    int64_t us;
+    size_t i = parse_min_sec(s + 15, n - 15, &secs, &us);
+    if (!i) return 0;
+    i += 15;
+    if (i >= n || s[i] != ' ' || !parse_zone(s + i + 1, n - i - 1, &off)) return 0;
+    *out = (p->hour_naive + secs - off) * 1000000 + us;
+    return 1;
+}
+
+// "[Fri Oct 17 12:00:01.123456 2025]"
+static int parse_apache_error(TsParser *p, const char *s, size_t n, int64_t *out) {
+    if (n < 26 || s[0] != '[' || s[4] != ' ' || s[8] != ' ' || s[14] != ':') return 0;
+    int secs;
+    int64_t us;
+    size_t i = parse_min_sec(s + 15, n - 15, &secs, &us);
+    if (!i) return 0;
+    i += 15;
+    if (i + 6 > n || s[i] != ' ' || !is2(s + i + 1) || !is2(s + i + 3) || s[i + 5] != ']') return 0;
+    // The year follows the time, so the cache key is "Oct 17 12:" plus the year.
+    char key[14];
+    memcpy(key, s + 5, 10);
+    memcpy(key + 10, s + i + 1, 4);
+    if (!key_cached(p, key, sizeof(key))) {
+        int mo = month_index(s + 5);
+        if (!mo || !(s[9] == ' ' || dig(s[9])) || !dig(s[10]) || s[11] != ' ' || !is2(s + 12)) return 0;
+        int d = (s[9] == ' ' ? 0 : s[9] - '0') * 10 + (s[10] - '0');
+        int y = num2(s + i + 1) * 100 + num2(s + i + 3), h = num2(s + 12);
+        if (!valid_date(y, mo, d, h)) return 0;
+        key_store(p, key, sizeof(key), y, mo, d, h);
+    }
+    *out = (hour_local(p) + secs) * 1000000 + us;
+    return 1;
+}
+
+static int64_t g_boot_sec = -1;
+static pthread_once_t g_boot_once = PTHREAD_ONCE_INIT;
+
+static void load_boot_time(void) {
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f) return;
+    char line[256];
+    long long bt;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "btime %lld", &bt) == 1) { g_boot_sec = bt; break; }
+    fclose(f);
+}
+
+/* "[   12.345678]". Uptime stamps are placed relative to the current boot,
+ * which is right for dmesg output written since that boot. */
+static int parse_kernel(TsParser *p, const char *s, size_t n, int64_t *out) {
+    (void)p;
+    if (n < 4 || s[0] != '[') return 0;
+    size_t i = 1;
+    while (i < n && s[i] == ' ') ++i;
+    int64_t sec = 0;
+    size_t start = i;
+    while (i < n && dig(s[i]) && i - start < 12) sec = sec * 10 + (s[i++] - '0');
+    if (i == start || i + 1 >= n || s[i] != '.' || !dig(s[i + 1])) return 0;
+    int64_t us = 0, scale = 100000;
+    for (++i; i < n && dig(s[i]); ++i) { us += (s[i] - '0') * scale; scale /= 10; }
+    if (i >= n || s[i] != ']') return 0;
+    pthread_once(&g_boot_once, load_boot_time);
+    if (g_boot_sec < 0) return 0;
+    *out = (g_boot_sec + sec) * 1000000 + us;
+    return 1;
+}
+
+typedef int (*ParseFn)(TsParser *p, const char *s, size_t n, int64_t *out);
+
+static const ParseFn parsers[] = {
+    [TS_FMT_RFC3164] = parse_rfc3164,
+    [TS_FMT_ISO] = parse_iso,
+    [TS_FMT_APACHE] = parse_apache,
+    [TS_FMT_APACHE_ERROR] = parse_apache_error,
+    [TS_FMT_KERNEL] = parse_kernel,
+};
+
+// Detection order: anchored formats first, the '[' search of Apache last.
+static const TsFormat detect_order[] = {
+    TS_FMT_RFC3164, TS_FMT_ISO, TS_FMT_KERNEL, TS_FMT_APACHE_ERROR, TS_FMT_APACHE
+};
+
+TsParser *ts_parser_new(time_t ref) {
+    TsParser *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    if (ref == 0) ref = time(NULL);
+    struct tm tm;
+    localtime_r(&ref, &tm);
+    p->ref_year = tm.tm_year + 1900;
+    p->ref_mon = tm.tm_mon + 1;
+    return p;
+}
+
+void ts_parser_free(TsParser *p) {
+    free(p);
+}
+
+const char *ts_parser_format(const TsParser *p) {
+    return fmt_names[p->fmt];
+}
+
+int ts_parse(TsParser *p, const char *line, size_t len, char out[TS_BUF]) {
+    int64_t us;
+    out[0] = '\0';
+    if (p->fmt == TS_FMT_GAVE_UP) return 0;
+    if (p->fmt != TS_FMT_NONE) {
+        if (parsers[p->fmt](p, line, len, &us)) {
+            p->misses = 0;
+            ts_format_us(us, out);
+            return out[0] != '\0';
+        }
+        // Continuation lines miss; only a long run means the format changed.
+        if (++p->misses < TS_REDETECT_MISSES) return 0;
+        p->fmt = TS_FMT_NONE;
+        p->misses = 0;
+        p->tried = 0;
+    }
+    for (size_t i = 0; i < sizeof(detect_order) / sizeof(detect_order[0]); ++i) {
+        if (parsers[detect_order[i]](p, line, len, &us)) {
+            p->fmt = detect_order[i];
+            ts_format_us(us, out);
+            return out[0] != '\0';
+        }
+    }
+    if (++p->tried >= TS_DETECT_LINES) p->fmt = TS_FMT_GAVE_UP;
+    return 0;
+}
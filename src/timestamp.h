@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Timestamp recognition for plain-text log lines. Recognised stamps are
+ * rewritten to one fixed-width UTC form, "YYYY-MM-DDTHH:MM:SS.ffffffZ",
+ * so the ts column sorts and range-filters as text whatever the source.
+ *
+ * Formats, tried at the start of a line unless noted:
+ *   RFC3164   "Oct 17 12:00:01"                 local time, year inferred
+ *   ISO-8601  "2025-10-17T12:00:01.123+02:00"   also RFC5424 ("<13>1 " prefix)
+ *             and dpkg.log "2025-10-17 12:00:01"; no zone means local time
+ *   Apache    "... [17/Oct/2025:12:00:01 +0200]" access log (first '[')
+ *             "[Fri Oct 17 12:00:01.123456 2025]" error log, local time
+ *   kernel    "[   12.345678]" seconds since boot
+ *
+ * A TsParser belongs to one file: it learns the format from the first lines
+ * and caches the date/hour prefix of the last stamp, so mktime runs once per
+ * local hour rather than once per line and strptime is never used. */
+
+#define TS_LEN 27
+#define TS_BUF (TS_LEN + 1)
+
+typedef struct TsParser TsParser;
+
+/* ref is the newest time the file can contain (e.g. its mtime, or 0 for
+ * now); RFC3164 stamps, which carry no year, are placed at or before it. */
+TsParser *ts_parser_new(time_t ref);
+void ts_parser_free(TsParser *p);
+/* Parse the stamp of one line (len bytes, need not be NUL-terminated).
+ * Returns 1 and writes the normalised stamp to out, or 0 and writes "". */
+int ts_parse(TsParser *p, const char *line, size_t len, char out[TS_BUF]);
+// Name of the detected format ("none" until one matched), for diagnostics.
+const char *ts_parser_format(const TsParser *p);
+
+// Format microseconds since the epoch (e.g. journal __REALTIME_TIMESTAMP).
+void ts_format_us(int64_t us, char out[TS_BUF]);
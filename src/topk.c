@@ -0,0 +1,394 @@
+#include "topk.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Count-Min table per window and dimension: each estimate is off by at most ~e/CM_WIDTH of the window's rows.
+#define CM_DEPTH 4
+#define CM_WIDTH 512
+// Checkpoint interval of the window being filled.
+#define TOPK_CHECKPOINT_MS 10000
+
+#define BLOB_MAGIC 0x4b504f54u  // "TOPK"
+#define BLOB_VERSION 1
+
+/* Space-Saving entries are kept as parallel arrays so the per-row scan
+ * for a key's hash (and for the smallest count) stays within a few cache
+ * lines. */
+typedef struct {
+    uint32_t cm[CM_DEPTH][CM_WIDTH];
+    uint64_t total;
+    uint32_t n;
+    uint64_t hash[TOPK_TRACKED];
+    uint64_t count[TOPK_TRACKED];
+    uint64_t error[TOPK_TRACKED];   // count may overstate the key's rows by this much
+    char key[TOPK_TRACKED][TOPK_KEY_MAX];
+} Sketch;
+
+typedef struct {
+    int64_t start;       // unix seconds, a multiple of TOPK_WINDOW_SEC
+    int dirty;
+    Sketch dim[TOPK_DIM_COUNT];
+} Window;
+
+// Ring of windows indexed by (start / TOPK_WINDOW_SEC) % TOPK_WINDOWS, allocated on first use.
+static Window *g_win[TOPK_WINDOWS];
+static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_last_checkpoint_ms = 0;
+
+static uint64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static int64_t window_now(void) {
+    int64_t t = (int64_t)time(NULL);
+    return t - t % TOPK_WINDOW_SEC;
+}
+
+// FNV-1a with a final mix, so both 32-bit halves are usable as Count-Min hashes.
+static uint64_t key_hash(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static size_t cm_col(uint64_t hash, int row) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    return (h1 + (uint32_t)row * h2) % CM_WIDTH;
+}
+
+static uint64_t cm_estimate(const Sketch *s, uint64_t hash) {
+    uint64_t est = UINT64_MAX;
+    for (int r = 0; r < CM_DEPTH; ++r) {
+        uint64_t v = s->cm[r][cm_col(hash, r)];
+        if (v < est) est = v;
+    }
+    return est;
+}
+
+static void sketch_add(Sketch *s, const char *full_key) {
+    char key[TOPK_KEY_MAX];
+    size_t len = strnlen(full_key, TOPK_KEY_MAX - 1);
+    memcpy(key, full_key, len);
+    key[len] = '\0';
+    uint64_t hash = key_hash(key);
+    s->total++;
+    for (int r = 0; r < CM_DEPTH; ++r) {
+        uint32_t *c = &s->cm[r][cm_col(hash, r)];
+        if (*c < UINT32_MAX) (*c)++;
+    }
+    for (size_t i = 0; i < s->n; ++i) {
+        if (s->hash[i] == hash) {
+            s->count[i]++;
+            return;
+        }
+    }
+    // Space-Saving: a key not tracked takes over the entry with the smallest count.
+    size_t i = s->n;
+    if (s->n < TOPK_TRACKED) {
+        s->n++;
+        s->count[i] = s->error[i] = 0;
+    } else {
+        i = 0;
+        for (size_t j = 1; j < TOPK_TRACKED; ++j)
+            if (s->count[j] < s->count[i]) i = j;
+        s->error[i] = s->count[i];
+    }
+    s->hash[i] = hash;
+    s->count[i]++;
+    memcpy(s->key[i], key, len + 1);
+}
+
+static uint64_t sketch_min(const Sketch *s) {
+    if (s->n < TOPK_TRACKED) return 0; // not full: untracked keys were never seen
+    uint64_t min = UINT64_MAX;
+    for (size_t i = 0; i < s->n; ++i)
+        if (s->count[i] < min) min = s->count[i];
+    return min;
+}
+
+// ASCII only, without the locale lookups of <ctype.h>.
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+static int is_alnum(char c) { return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z'); }
+static int is_hex(char c) { return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f'); }
+
+void topk_normalize(const char *m, char out[TOPK_KEY_MAX]) {
+    size_t o = 0;
+    while (*m && *m != '\n' && *m != '\r' && o < TOPK_KEY_MAX - 1) {
+        if (!is_alnum(*m)) {
+            out[o++] = *m++;
+            continue;
+        }
+        // A token counts as a number or id if it has a digit and is hex, or is mostly digits.
+        const char *t = m;
+        size_t len = 0, digits = 0, hex = 0;
+        for (; is_alnum(t[len]); ++len) {
+            if (is_digit(t[len])) digits++;
+            if (is_hex(t[len])) hex++;
+        }
+        m += len;
+        if (digits && (hex == len || digits * 2 >= len)) {
+            out[o++] = '#';
+        } else {
+            size_t take = len < TOPK_KEY_MAX - 1 - o ? len : TOPK_KEY_MAX - 1 - o;
+            memcpy(out + o, t, take);
+            o += take;
+        }
+    }
+    out[o] = '\0';
+}
+
+static Window *window_for(int64_t start) {
+    size_t slot = (size_t)(start / TOPK_WINDOW_SEC) % TOPK_WINDOWS;
+    Window *w = g_win[slot];
+    if (!w) {
+        if (!(w = g_win[slot] = calloc(1, sizeof(*w)))) return NULL;
+    } else if (w->start != start) {
+        memset(w, 0, sizeof(*w));
+    }
+    w->start = start;
+    return w;
+}
+
+void topk_observe(const LogRecord *recs, size_t n) {
+    if (!n) return;
+    int64_t start = window_now();
+    char norm[TOPK_KEY_MAX];
+    pthread_mutex_lock(&g_mu);
+    Window *w = window_for(start);
+    if (w) {
+        for (size_t i = 0; i < n; ++i) {
+            const char *unit = recs[i].unit && *recs[i].unit ? recs[i].unit : recs[i].source ? recs[i].source : "";
+            sketch_add(&w->dim[TOPK_UNITS], unit);
+            topk_normalize(recs[i].message ? recs[i].message : "", norm);
+            sketch_add(&w->dim[TOPK_MESSAGES], norm);
+        }
+        w->dirty = 1;
+    }
+    pthread_mutex_unlock(&g_mu);
+}
+
+// ---- checkpoint blobs: header, Count-Min table, then count, error, key length and key per entry ----
+
+typedef struct {
+    uint32_t magic, version, n, width;
+    uint64_t total;
+} BlobHdr;
+
+static size_t blob_size(const Sketch *s) {
+    size_t len = sizeof(BlobHdr) + sizeof(s->cm);
+    for (size_t i = 0; i < s->n; ++i) len += 2 * sizeof(uint64_t) + sizeof(uint16_t) + strlen(s->key[i]);
+    return len;
+}
+
+static void blob_write(const Sketch *s, char *p) {
+    BlobHdr h = { BLOB_MAGIC, BLOB_VERSION, s->n, CM_WIDTH, s->total };
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    memcpy(p, s->cm, sizeof(s->cm));
+    p += sizeof(s->cm);
+    for (size_t i = 0; i < s->n; ++i) {
+        uint16_t len = (uint16_t)strlen(s->key[i]);
+        memcpy(p, &s->count[i], sizeof(uint64_t));
+        memcpy(p + 8, &s->error[i], sizeof(uint64_t));
+        memcpy(p + 16, &len, sizeof(len));
+        memcpy(p + 18, s->key[i], len);
+        p += 18 + len;
+    }
+}
+
+static int blob_read(Sketch *s, const char *p, size_t len) {
+    BlobHdr h;
+    if (len < sizeof(h) + sizeof(s->cm)) return -1;
+    memcpy(&h, p, sizeof(h));
+    if (h.magic != BLOB_MAGIC || h.version != BLOB_VERSION || h.width != CM_WIDTH || h.n > TOPK_TRACKED) return -1;
+    const char *end = p + len;
+    p += sizeof(h);
+    memcpy(s->cm, p, sizeof(s->cm));
+    p += sizeof(s->cm);
+    s->total = h.total;
+    s->n = 0;
+    for (uint32_t i = 0; i < h.n; ++i) {
+        uint16_t klen;
+        if (end - p < 18) return -1;
+        memcpy(&s->count[i], p, sizeof(uint64_t));
+        memcpy(&s->error[i], p + 8, sizeof(uint64_t));
+        memcpy(&klen, p + 16, sizeof(klen));
+        p += 18;
+        if (klen >= TOPK_KEY_MAX || end - p < klen) return -1;
+        memcpy(s->key[i], p, klen);
+        s->key[i][klen] = '\0';
+        s->hash[i] = key_hash(s->key[i]);
+        p += klen;
+        s->n++;
+    }
+    return 0;
+}
+
+void topk_checkpoint(DB *d, int force) {
+    uint64_t now = mono_ms();
+    DBTopWindow out[TOPK_WINDOWS * TOPK_DIM_COUNT];
+    size_t n = 0;
+    pthread_mutex_lock(&g_mu);
+    if (!force && now - g_last_checkpoint_ms < TOPK_CHECKPOINT_MS) {
+        pthread_mutex_unlock(&g_mu);
+        return;
+    }
+    g_last_checkpoint_ms = now;
+    for (size_t i = 0; i < TOPK_WINDOWS; ++i) {
+        Window *w = g_win[i];
+        if (!w || !w->dirty) continue;
+        for (int dim = 0; dim < TOPK_DIM_COUNT; ++dim) {
+            size_t len = blob_size(&w->dim[dim]);
+            char *blob = malloc(len);
+            if (!blob) continue;
+            blob_write(&w->dim[dim], blob);
+            out[n++] = (DBTopWindow){ w->start, dim, blob, len };
+        }
+        w->dirty = 0;
+    }
+    pthread_mutex_unlock(&g_mu);
+    if (n && db_top_save(d, out, n, window_now() - (int64_t)(TOPK_WINDOWS - 1) * TOPK_WINDOW_SEC) != 0)
+        fprintf(stderr, "topk: cannot checkpoint: %s\n", sqlite3_errmsg(d->db));
+    for (size_t i = 0; i < n; ++i) free((void *)out[i].data);
+}
+
+static void load_cb(void *ctx, const DBTopWindow *dw) {
+    (void)ctx;
+    if (dw->dim < 0 || dw->dim >= TOPK_DIM_COUNT || dw->start % TOPK_WINDOW_SEC != 0) return;
+    Window *w = window_for(dw->start);
+    if (w && blob_read(&w->dim[dw->dim], dw->data, dw->len) != 0) memset(&w->dim[dw->dim], 0, sizeof(Sketch));
+}
+
+void topk_load(DB *d) {
+    pthread_mutex_lock(&g_mu);
+    db_top_load(d, window_now() - (int64_t)(TOPK_WINDOWS - 1) * TOPK_WINDOW_SEC, load_cb, NULL);
+    pthread_mutex_unlock(&g_mu);
+}
+
+// ---- queries: merge the Space-Saving lists of several windows, bounded by the summed Count-Min ----
+
+typedef struct {
+    uint64_t hash;
+    const char *key;
+} Candidate;
+
+static int cmp_hash(const void *a, const void *b) {
+    uint64_t x = ((const Candidate *)a)->hash, y = ((const Candidate *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_count_desc(const void *a, const void *b) {
+    uint64_t x = ((const TopkItem *)a)->count, y = ((const TopkItem *)b)->count;
+    return x > y ? -1 : x < y;
+}
+
+static int sketch_find(const Sketch *s, uint64_t hash) {
+    for (size_t i = 0; i < s->n; ++i)
+        if (s->hash[i] == hash) return (int)i;
+    return -1;
+}
+
+/* A key missing from a full window may still have had up to that window's
+ * smallest tracked count, so that much is added to both its count and its
+ * error; the summed Count-Min estimate caps the result. */
+static int merge(const Sketch *const *w, size_t nw, TopkItem *out, size_t max, uint64_t *out_total) {
+    uint64_t total = 0, mins[TOPK_WINDOWS];
+    size_t nc = 0;
+    Candidate *cand = malloc(sizeof(*cand) * (nw * TOPK_TRACKED + 1));
+    TopkItem *items = malloc(sizeof(*items) * (nw * TOPK_TRACKED + 1));
+    if (!cand || !items) {
+        free(cand);
+        free(items);
+        return -1;
+    }
+    for (size_t i = 0; i < nw; ++i) {
+        total += w[i]->total;
+        mins[i] = sketch_min(w[i]);
+        for (size_t j = 0; j < w[i]->n; ++j) cand[nc++] = (Candidate){ w[i]->hash[j], w[i]->key[j] };
+    }
+    qsort(cand, nc, sizeof(*cand), cmp_hash);
+    size_t ni = 0;
+    for (size_t c = 0; c < nc; ++c) {
+        if (c > 0 && cand[c].hash == cand[c - 1].hash) continue;
+        uint64_t ss = 0, err = 0, cm = 0;
+        for (size_t i = 0; i < nw; ++i) {
+            int e = sketch_find(w[i], cand[c].hash);
+            ss += e >= 0 ? w[i]->count[e] : mins[i];
+            err += e >= 0 ? w[i]->error[e] : mins[i];
+            cm += cm_estimate(w[i], cand[c].hash);
+        }
+        uint64_t est = ss < cm ? ss : cm, lower = ss - err;
+        TopkItem *it = &items[ni++];
+        snprintf(it->key, sizeof(it->key), "%s", cand[c].key);
+        it->count = est;
+        it->error = lower < est ? est - lower : 0;
+    }
+    qsort(items, ni, sizeof(*items), cmp_count_desc);
+    if (ni > max) ni = max;
+    memcpy(out, items, sizeof(*items) * ni);
+    free(cand);
+    free(items);
+    if (out_total) *out_total = total;
+    return (int)ni;
+}
+
+static int64_t since_for(int minutes) {
+    if (minutes < 1) minutes = 1;
+    if (minutes > TOPK_WINDOWS) minutes = TOPK_WINDOWS;
+    return window_now() - (int64_t)(minutes - 1) * TOPK_WINDOW_SEC;
+}
+
+int topk_top(TopkDim dim, int minutes, TopkItem *out, size_t max, uint64_t *out_total) {
+    if (dim < 0 || dim >= TOPK_DIM_COUNT) return -1;
+    int64_t since = since_for(minutes);
+    const Sketch *w[TOPK_WINDOWS];
+    size_t nw = 0;
+    pthread_mutex_lock(&g_mu);
+    for (size_t i = 0; i < TOPK_WINDOWS; ++i)
+        if (g_win[i] && g_win[i]->start >= since) w[nw++] = &g_win[i]->dim[dim];
+    int n = merge(w, nw, out, max, out_total);
+    pthread_mutex_unlock(&g_mu);
+    return n;
+}
+
+typedef struct {
+    int dim;
+    Sketch *w;
+    size_t n;
+} DBLoad;
+
+static void db_load_cb(void *ctx, const DBTopWindow *dw) {
+    DBLoad *l = ctx;
+    if (dw->dim != l->dim || l->n == TOPK_WINDOWS) return;
+    if (blob_read(&l->w[l->n], dw->data, dw->len) == 0) l->n++;
+}
+
+int topk_top_db(DB *d, TopkDim dim, int minutes, TopkItem *out, size_t max, uint64_t *out_total) {
+    if (dim < 0 || dim >= TOPK_DIM_COUNT) return -1;
+    DBLoad l = { dim, malloc(sizeof(Sketch) * TOPK_WINDOWS), 0 };
+    if (!l.w) return -1;
+    int n = -1;
+    if (db_top_load(d, since_for(minutes), db_load_cb, &l) == 0) {
+        const Sketch *w[TOPK_WINDOWS];
+        for (size_t i = 0; i < l.n; ++i) w[i] = &l.w[i];
+        n = merge(w, l.n, out, max, out_total);
+    }
+    free(l.w);
+    return n;
+}
+
+const char *topk_dim_name(TopkDim dim) {
+    switch (dim) {
+    case TOPK_UNITS: return "units";
+    case TOPK_MESSAGES: return "messages";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "db.h"
+
+/* Top talkers: which units and which messages are loudest right now,
+ * without a GROUP BY over the logs table.
+ *
+ * The ingest writer feeds every stored row into per-minute sketches, one
+ * keyed by unit and one by normalised message (the first line, with tokens
+ * that look like numbers or ids replaced by '#'). Each sketch is a
+ * Count-Min table plus a Space-Saving list of the TOPK_TRACKED heaviest
+ * keys; the last TOPK_WINDOWS minutes are kept, so memory is bounded
+ * however many distinct keys arrive. Counts are estimates: never below the
+ * true count, and at most `error` above it.
+ *
+ * Windows are checkpointed into the top_windows table every few seconds
+ * and at shutdown, and loaded again by topk_load, so the CLI can answer
+ * from the database in constant time and a restart keeps the last hour. */
+
+#define TOPK_KEY_MAX 128     // longer keys are cut
+#define TOPK_TRACKED 64      // Space-Saving entries per window and dimension
+#define TOPK_WINDOW_SEC 60
+#define TOPK_WINDOWS 60
+
+typedef enum {
+    TOPK_UNITS = 0,
+    TOPK_MESSAGES,
+    TOPK_DIM_COUNT
+} TopkDim;
+
+typedef struct {
+    char key[TOPK_KEY_MAX];
+    uint64_t count;          // estimate, >= the true count
+    uint64_t error;          // the true count is at least count - error
+} TopkItem;
+
+// Count stored rows. Called by the ingest writer.
+void topk_observe(const LogRecord *recs, size_t n);
+// Write windows changed since the last checkpoint; unless force, at most every few seconds.
+void topk_checkpoint(DB *d, int force);
+// Load the checkpointed windows of the last TOPK_WINDOWS minutes.
+void topk_load(DB *d);
+
+/* The heaviest keys of dim over the last `minutes` minutes (including the
+ * current one), heaviest first. topk_top reads this process's sketches,
+ * topk_top_db the checkpoints in d. *out_total is the number of rows the
+ * windows counted. Returns the number of items written, or -1. */
+int topk_top(TopkDim dim, int minutes, TopkItem *out, size_t max, uint64_t *out_total);
+int topk_top_db(DB *d, TopkDim dim, int minutes, TopkItem *out, size_t max, uint64_t *out_total);
+
+const char *topk_dim_name(TopkDim dim);
+// Normalised form of a message, as used for TOPK_MESSAGES keys.
+void topk_normalize(const char *message, char out[TOPK_KEY_MAX]);
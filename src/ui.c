@@ -1,5 +1,16 @@
 #include "ui.h"
+#include "metrics.h"
+#include "export.h"
+#include "rowpage.h"
+#include "import.h"
+#include "ingest.h"
+#include "topk.h"
+#include "countjob.h"
+#include "saved.h"
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <glib-object.h>
 
 /* Small, embedded CSS to improve visuals */
@@ -19,15 +30,19 @@ void setup_css(void) {
 }
 
 static const int PAGE_SIZE = 100;
-
-/* Small GObject to represent a log item in the list model. */
+/* Result previews are cut to this many bytes to keep the UI snappy. With a
+ * query they are FTS5 snippets around the match, made by the database, so
+ * whole messages never reach the result list. */
+static const size_t PREVIEW_MAX = 200;
+
+/* Result rows live in RowPage arenas (see rowpage.h). A LogItem is only a
+ * lightweight handle on one row of a page: list views create them as rows
+ * are bound and drop them when they scroll out, and each handle keeps its
+ * page alive, so an open details window still works after a new search. */
 typedef struct _LogItem {
     GObject parent_instance;
-    int id;
-    gchar *source;
-    gchar *unit;
-    gchar *ts;
-    gchar *preview;
+    RowPage *page;
+    guint row;
 } LogItem;
 
 typedef struct _LogItemClass { GObjectClass parent_class; } LogItemClass;
@@ -39,19 +54,14 @@ G_DEFINE_TYPE(LogItem, log_item, G_TYPE_OBJECT)
 
 static void log_item_dispose(GObject *object) {
     LogItem *self = (LogItem*)object;
-    g_free(self->source);
-    g_free(self->unit);
-    g_free(self->ts);
-    g_free(self->preview);
+    rowpage_unref(self->page);
+    self->page = NULL;
     G_OBJECT_CLASS(log_item_parent_class)->dispose(object);
 }
 
 static void log_item_init(LogItem *self) {
-    self->id = -1;
-    self->source = NULL;
-    self->unit = NULL;
-    self->ts = NULL;
-    self->preview = NULL;
+    self->page = NULL;
+    self->row = 0;
 }
 
 static void log_item_class_init(LogItemClass *klass) {
@@ -59,16 +69,115 @@ static void log_item_class_init(LogItemClass *klass) {
     oclass->dispose = log_item_dispose;
 }
 
-static LogItem *log_item_new(int id, const char *source, const char *unit, const char *ts, const char *preview) {
+static LogItem *log_item_new(RowPage *page, guint row) {
     LogItem *li = g_object_new(log_item_get_type(), NULL);
-    li->id = id;
-    li->source = source ? g_strdup(source) : g_strdup("");
-    li->unit = unit ? g_strdup(unit) : g_strdup("");
-    li->ts = ts ? g_strdup(ts) : g_strdup("");
-    li->preview = preview ? g_strdup(preview) : g_strdup("");
+    li->page = rowpage_ref(page);
+    li->row = row;
     return li;
 }
 
+static int log_item_id(LogItem *li) { return (int)rowpage_id(li->page, li->row); }
+static const char *log_item_source(LogItem *li) { return rowpage_source(li->page, li->row); }
+static const char *log_item_unit(LogItem *li) { return rowpage_unit(li->page, li->row); }
+static const char *log_item_ts(LogItem *li) { return rowpage_ts(li->page, li->row); }
+static const char *log_item_preview(LogItem *li) { return rowpage_preview(li->page, li->row); }
+
+/* List model of the main results: the loaded pages in order. Load More
+ * appends a page; a new search evicts them all at once. Items are created
+ * on demand by get_item, so only the rows a view has bound exist as
+ * GObjects. */
+typedef struct _LogRowModel {
+    GObject parent_instance;
+    GPtrArray *pages;    // RowPage*, owned
+    GArray *starts;      // guint: position of each page's first row
+    guint n_items;
+} LogRowModel;
+
+typedef struct _LogRowModelClass { GObjectClass parent_class; } LogRowModelClass;
+
+static void log_row_model_list_model_init(GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(LogRowModel, log_row_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, log_row_model_list_model_init))
+
+static GType log_row_model_get_item_type(GListModel *list) {
+    (void)list;
+    return LOG_ITEM_TYPE;
+}
+
+static guint log_row_model_get_n_items(GListModel *list) {
+    return ((LogRowModel*)list)->n_items;
+}
+
+static gpointer log_row_model_get_item(GListModel *list, guint position) {
+    LogRowModel *m = (LogRowModel*)list;
+    if (position >= m->n_items) return NULL;
+    // last page starting at or before position
+    guint lo = 0, hi = m->pages->len;
+    while (hi - lo > 1) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(m->starts, guint, mid) <= position) lo = mid;
+        else hi = mid;
+    }
+    return log_item_new(g_ptr_array_index(m->pages, lo), position - g_array_index(m->starts, guint, lo));
+}
+
+static void log_row_model_list_model_init(GListModelInterface *iface) {
+    iface->get_item_type = log_row_model_get_item_type;
+    iface->get_n_items = log_row_model_get_n_items;
+    iface->get_item = log_row_model_get_item;
+}
+
+static void log_row_model_finalize(GObject *object) {
+    LogRowModel *m = (LogRowModel*)object;
+    g_ptr_array_unref(m->pages);
+    g_array_unref(m->starts);
+    G_OBJECT_CLASS(log_row_model_parent_class)->finalize(object);
+}
+
+static void log_row_model_init(LogRowModel *m) {
+    m->pages = g_ptr_array_new_with_free_func((GDestroyNotify)rowpage_unref);
+    m->starts = g_array_new(FALSE, FALSE, sizeof(guint));
+    m->n_items = 0;
+}
+
+static void log_row_model_class_init(LogRowModelClass *klass) {
+    GObjectClass *oclass = G_OBJECT_CLASS(klass);
+    oclass->finalize = log_row_model_finalize;
+}
+
+static LogRowModel *log_row_model_new(void) {
+    return g_object_new(log_row_model_get_type(), NULL);
+}
+
+/* Replace the loaded pages with page (evict=TRUE) or append page after
+ * them, with a single items-changed. Takes ownership of page. */
+static void log_row_model_add_page(LogRowModel *m, RowPage *page, gboolean evict) {
+    guint removed = 0;
+    if (evict) {
+        removed = m->n_items;
+        g_ptr_array_set_size(m->pages, 0);
+        g_array_set_size(m->starts, 0);
+        m->n_items = 0;
+    }
+    guint pos = m->n_items;
+    guint added = page ? (guint)rowpage_size(page) : 0;
+    if (added > 0) {
+        g_ptr_array_add(m->pages, page);
+        g_array_append_val(m->starts, pos);
+        m->n_items += added;
+    } else {
+        rowpage_unref(page);
+    }
+    if (removed > 0 || added > 0) g_list_model_items_changed(G_LIST_MODEL(m), pos, removed, added);
+}
+
+static size_t log_row_model_bytes(LogRowModel *m) {
+    size_t bytes = 0;
+    for (guint i = 0; i < m->pages->len; ++i) bytes += rowpage_bytes(g_ptr_array_index(m->pages, i));
+    return bytes;
+}
+
 /* Tag item as simple GObject wrapping a string */
 typedef struct _TagItem { GObject parent_instance; gchar *name; } TagItem;
 typedef struct _TagItemClass { GObjectClass parent_class; } TagItemClass;
@@ -95,11 +204,42 @@ static void win_set_offset(GtkWidget *win, int off) {
 
 /* forward declaration: create_details_window is defined later but used by
  * per-item handlers; declare it here to avoid implicit declaration warnings. */
-static void create_details_window(DB *db, LogItem *li);
+static void create_details_window(DB *db, LogItem *li, const char *query, gboolean read_only);
 /* forward declare the per-item pressed handler so the factory setup can
  * reference it. */
 static void list_item_pressed_cb(GtkGesture *gesture, int n_press, double x, double y, gpointer user_data);
 
+/* Pango markup for text with DB_MARK_START/DB_MARK_END match markers:
+ * matches in bold, the rest escaped. A preview cut inside a match still
+ * closes it. Other control characters, which markup cannot carry, become
+ * spaces. */
+static char *marked_to_markup(const char *s) {
+    GString *out = g_string_new(NULL);
+    gboolean open = FALSE;
+    while (*s) {
+        const char *run = s;
+        while (*s && ((unsigned char)*s >= 0x20 || *s == '\t' || *s == '\n')) s++;
+        if (s > run) {
+            char *esc = g_markup_escape_text(run, s - run);
+            g_string_append(out, esc);
+            g_free(esc);
+        }
+        if (!*s) break;
+        if (*s == DB_MARK_START[0]) {
+            if (!open) g_string_append(out, "<b>");
+            open = TRUE;
+        } else if (*s == DB_MARK_END[0]) {
+            if (open) g_string_append(out, "</b>");
+            open = FALSE;
+        } else {
+            g_string_append_c(out, ' ');
+        }
+        s++;
+    }
+    if (open) g_string_append(out, "</b>");
+    return g_string_free(out, FALSE);
+}
+
 /* Result list item factory callbacks */
 static void result_factory_setup(GtkListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
     (void)factory;
@@ -160,12 +300,14 @@ static void result_factory_bind(GtkListItemFactory *factory, GtkListItem *list_i
     GtkWidget *ts_label = g_object_get_data(G_OBJECT(list_item), "ts_label");
     GtkWidget *preview_label = g_object_get_data(G_OBJECT(list_item), "preview_label");
     char buf[64];
-    snprintf(buf, sizeof(buf), "%d", li->id);
+    snprintf(buf, sizeof(buf), "%d", log_item_id(li));
     gtk_label_set_text(GTK_LABEL(id_label), buf);
-    gtk_label_set_text(GTK_LABEL(source_label), li->source ? li->source : "");
-    gtk_label_set_text(GTK_LABEL(unit_label), li->unit ? li->unit : "");
-    gtk_label_set_text(GTK_LABEL(ts_label), li->ts ? li->ts : "");
-    gtk_label_set_text(GTK_LABEL(preview_label), li->preview ? li->preview : "");
+    gtk_label_set_text(GTK_LABEL(source_label), log_item_source(li));
+    gtk_label_set_text(GTK_LABEL(unit_label), log_item_unit(li));
+    gtk_label_set_text(GTK_LABEL(ts_label), log_item_ts(li));
+    char *markup = marked_to_markup(log_item_preview(li));
+    gtk_label_set_markup(GTK_LABEL(preview_label), markup);
+    g_free(markup);
     /* Ensure newly bound items follow the current responsive visibility state */
     if (user_data) {
         GtkWidget *win = (GtkWidget*)user_data;
@@ -188,7 +330,8 @@ static void list_item_pressed_cb(GtkGesture *gesture, int n_press, double x, dou
     GtkWidget *win = g_object_get_data(G_OBJECT(list_item), "main_window");
     if (!win) return;
     DB *db = g_object_get_data(G_OBJECT(win), "db");
-    create_details_window(db, li);
+    create_details_window(db, li, g_object_get_data(G_OBJECT(win), "results_query"),
+                          GPOINTER_TO_INT(g_object_get_data(G_OBJECT(win), "read_only")));
 }
 
 static void window_size_allocate_cb(GtkWidget *win, GtkAllocation *alloc, gpointer user_data) {
@@ -223,7 +366,7 @@ static void window_size_allocate_cb(GtkWidget *win, GtkAllocation *alloc, gpoint
 /* forward declaration: create_details_window is defined later but used by the
  * results view pressed handler (double-click). Declare it here to avoid an
  * implicit declaration warning/error. */
-static void create_details_window(DB *db, LogItem *li);
+static void create_details_window(DB *db, LogItem *li, const char *query, gboolean read_only);
 
 
 /* results_view_pressed_cb removed: per-item gestures (list_item_pressed_cb)
@@ -245,19 +388,144 @@ static void tag_factory_bind(GtkListItemFactory *factory, GtkListItem *list_item
     gtk_label_set_text(GTK_LABEL(lbl), t->name ? t->name : "");
 }
 
+/* Search options for the main window: the search entry text plus the
+ * optional tag filter. Strings point into the entries and are only valid
+ * until they are next edited. */
+static DBSearchOpts ui_search_opts(GtkWidget *win, const char *q, int limit, int offset) {
+    DBSearchOpts opts = {0};
+    opts.query = q;
+    opts.limit = limit;
+    opts.offset = offset;
+    GtkWidget *tag_filter = win ? g_object_get_data(G_OBJECT(win), "tag_filter_entry") : NULL;
+    if (tag_filter) opts.tag = gtk_editable_get_text(GTK_EDITABLE(tag_filter));
+    return opts;
+}
+
+/* Startup: main() holds background ingest (ingest_hold) so the first query
+ * has the database to itself. The first search, successful or not, ends
+ * the hold and records time-to-first-results. */
+static uint64_t g_startup_ns = 0;
+static gboolean g_first_search_done = FALSE;
+
+void ui_set_startup_ns(uint64_t ns) {
+    g_startup_ns = ns;
+}
+
+static void first_search_done(void) {
+    if (g_first_search_done) return;
+    g_first_search_done = TRUE;
+    if (g_startup_ns) {
+        uint64_t ms = (metrics_now_ns() - g_startup_ns) / 1000000;
+        metrics_gauge_set(METRIC_GAUGE_UI_FIRST_RESULTS_MS, (int64_t)ms);
+        g_debug("first results %llu ms after start", (unsigned long long)ms);
+    }
+    ingest_release();
+}
+
+/* Viewing the database of log-explorer-indexerd (main.c): the bottom bar
+ * notes when rows newer than the shown results were committed. A search
+ * records the end of the table it ran against. */
+static GList *g_main_windows = NULL;
+
+static void new_rows_mark(GtkWidget *win, DB *db) {
+    long long *shown = g_new(long long, 1);
+    if (db_max_id(db, shown) != 0) *shown = 0;
+    g_object_set_data_full(G_OBJECT(win), "results_max_id", shown, g_free);
+    GtkWidget *label = g_object_get_data(G_OBJECT(win), "new_rows_label");
+    if (label) gtk_label_set_text(GTK_LABEL(label), "");
+}
+
+void ui_rows_committed(long long max_id) {
+    for (GList *l = g_main_windows; l; l = l->next) {
+        GtkWidget *win = l->data;
+        const long long *shown = g_object_get_data(G_OBJECT(win), "results_max_id");
+        GtkWidget *label = g_object_get_data(G_OBJECT(win), "new_rows_label");
+        if (!shown || !label || max_id <= *shown) continue;
+        char *text = g_strdup_printf("New rows up to #%lld, press Enter to refresh", max_id);
+        gtk_label_set_text(GTK_LABEL(label), text);
+        g_free(text);
+    }
+}
+
+/* Match count for the bottom bar: db_count_estimate is shown at once, and
+ * unless it was exact a background CountJob replaces it with the real
+ * count. A new search or closing the window cancels the job. */
+static void result_count_stop(GtkWidget *win) {
+    guint tick = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(win), "count_tick"));
+    if (tick) g_source_remove(tick);
+    g_object_set_data(G_OBJECT(win), "count_tick", NULL);
+    CountJob *job = g_object_get_data(G_OBJECT(win), "count_job");
+    if (job) {
+        count_cancel(job);
+        count_finish(job, NULL);
+    }
+    g_object_set_data(G_OBJECT(win), "count_job", NULL);
+}
+
+static gboolean result_count_tick(gpointer user_data) {
+    GtkWidget *win = GTK_WIDGET(user_data);
+    GtkWidget *label = g_object_get_data(G_OBJECT(win), "result_count_label");
+    CountJob *job = g_object_get_data(G_OBJECT(win), "count_job");
+    CountProgress p;
+    count_poll(job, &p);
+    if (p.state == COUNT_RUNNING) {
+        char *text = g_strdup_printf("%s (counting, %d%%)",
+                                     (const char*)g_object_get_data(G_OBJECT(win), "count_estimate"),
+                                     (int)(p.done * 100));
+        gtk_label_set_text(GTK_LABEL(label), text);
+        g_free(text);
+        return G_SOURCE_CONTINUE;
+    }
+    CountState state = count_finish(job, &p);
+    g_object_set_data(G_OBJECT(win), "count_job", NULL);
+    g_object_set_data(G_OBJECT(win), "count_tick", NULL);
+    if (state == COUNT_DONE) {
+        char *text = g_strdup_printf("%lld matches", p.count);
+        gtk_label_set_text(GTK_LABEL(label), text);
+        g_free(text);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void result_count_start(GtkWidget *win, DB *db, const DBSearchOpts *opts) {
+    GtkWidget *label = g_object_get_data(G_OBJECT(win), "result_count_label");
+    if (!label) return;
+    result_count_stop(win);
+    long long n = 0;
+    int exact = 0;
+    if (db_count_estimate(db, opts, &n, &exact) != 0) {
+        gtk_label_set_text(GTK_LABEL(label), "");
+        return;
+    }
+    char *text = g_strdup_printf(exact ? "%lld matches" : "~%lld matches", n);
+    gtk_label_set_text(GTK_LABEL(label), text);
+    // kept for the progress text while the exact count runs
+    g_object_set_data_full(G_OBJECT(win), "count_estimate", text, g_free);
+    if (exact) return;
+    CountJob *job = count_start(db, opts);
+    if (!job) return;
+    g_object_set_data(G_OBJECT(win), "count_job", job);
+    g_object_set_data(G_OBJECT(win), "count_tick", GUINT_TO_POINTER(g_timeout_add(250, result_count_tick, win)));
+}
+
 static void on_search_activate(GtkWidget *entry, gpointer user_data) {
     DB *db = (DB*)user_data;
     const char *q = gtk_editable_get_text(GTK_EDITABLE(entry));
     GtkWidget *win = g_object_get_data(G_OBJECT(entry), "main_window");
     if (!win) win = g_object_get_data(G_OBJECT(entry), "results_main");
     if (!win) win = g_object_get_data(G_OBJECT(entry), "main_window");
+    uint64_t t0 = metrics_now_ns();
     // reset offset on new search
     win_set_offset(win, 0);
     int offset = win_get_offset(win);
 
     sqlite3_stmt *stmt = NULL;
-    if (db_search(db, q, PAGE_SIZE, offset, &stmt) != 0) {
+    DBSearchOpts opts = ui_search_opts(win, q, PAGE_SIZE, offset);
+    opts.preview = (int)PREVIEW_MAX;
+    new_rows_mark(win, db);
+    if (db_search_ex(db, &opts, &stmt) != 0) {
         g_warning("Search failed");
+        first_search_done();
         return;
     }
 
@@ -267,38 +535,19 @@ static void on_search_activate(GtkWidget *entry, gpointer user_data) {
         sqlite3_finalize(stmt);
         return;
     }
-    GListStore *store = g_object_get_data(G_OBJECT(view), "results_store");
+    LogRowModel *store = g_object_get_data(G_OBJECT(view), "results_store");
     if (!store) {
         g_warning("results_store not found on view");
         sqlite3_finalize(stmt);
         return;
     }
-    // if offset==0 clear existing rows, otherwise append
-    if (offset == 0) {
-        while (g_list_model_get_n_items((GListModel*)store) > 0) g_list_store_remove(store, 0);
-    }
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        gint id = sqlite3_column_int(stmt, 0);
-        const char *source = (const char*)sqlite3_column_text(stmt, 1);
-        const char *unit = (const char*)sqlite3_column_text(stmt, 2);
-        const char *ts = (const char*)sqlite3_column_text(stmt, 3);
-        const char *message = (const char*)sqlite3_column_text(stmt, 4);
-        // truncate preview to keep UI snappy
-        char preview[512];
-        if (!message) message = "";
-        if ((int)strlen(message) > 200) {
-            strncpy(preview, message, 197);
-            preview[197] = '\0';
-            strcat(preview, "...");
-        } else {
-            strncpy(preview, message, sizeof(preview)-1);
-            preview[sizeof(preview)-1] = '\0';
-        }
-        LogItem *li = log_item_new(id, source ? source : "", unit ? unit : "", ts ? ts : "", preview);
-        g_list_store_append(store, G_OBJECT(li));
-        g_object_unref(li);
-    }
+    RowPage *page = rowpage_from_stmt(stmt, PAGE_SIZE, PREVIEW_MAX, ROWPAGE_ELLIPSIS);
+    if (!page) g_warning("Out of memory loading results");
+    // offset is 0 here: the new page replaces (and frees) every loaded one
+    log_row_model_add_page(store, page, offset == 0);
+    // the details window highlights the terms of the query the rows came from
+    g_object_set_data_full(G_OBJECT(win), "results_query", g_strdup(q), g_free);
+    result_count_start(win, db, &opts);
     sqlite3_finalize(stmt);
     // if we filled PAGE_SIZE rows, enable Load More button
     GtkWidget *load_more = g_object_get_data(G_OBJECT(win), "load_more_btn");
@@ -310,7 +559,10 @@ static void on_search_activate(GtkWidget *entry, gpointer user_data) {
         if (rows >= PAGE_SIZE + offset) gtk_widget_set_sensitive(load_more, TRUE);
         else gtk_widget_set_sensitive(load_more, FALSE);
     }
-    g_debug("search: after populate rows=%d offset=%d", g_list_model_get_n_items((GListModel*)store), offset);
+    metrics_observe_ns(METRIC_HIST_UI_SEARCH, metrics_now_ns() - t0);
+    first_search_done();
+    g_debug("search: after populate rows=%d offset=%d bytes=%zu", g_list_model_get_n_items((GListModel*)store), offset,
+            log_row_model_bytes(store));
 }
 
 // Load next page and append to results
@@ -321,10 +573,13 @@ static void on_load_more_clicked(GtkWidget *button, gpointer user_data) {
     if (!win) return;
     DB *db = g_object_get_data(G_OBJECT(win), "db");
     const char *q = gtk_editable_get_text(GTK_EDITABLE(search));
+    uint64_t t0 = metrics_now_ns();
     int offset = win_get_offset(win);
     offset += PAGE_SIZE;
     sqlite3_stmt *stmt = NULL;
-    if (db_search(db, q, PAGE_SIZE, offset, &stmt) != 0) {
+    DBSearchOpts opts = ui_search_opts(win, q, PAGE_SIZE, offset);
+    opts.preview = (int)PREVIEW_MAX;
+    if (db_search_ex(db, &opts, &stmt) != 0) {
         g_warning("Load more failed");
         return;
     }
@@ -334,29 +589,12 @@ static void on_load_more_clicked(GtkWidget *button, gpointer user_data) {
         sqlite3_finalize(stmt);
         return;
     }
-    GListStore *store = g_object_get_data(G_OBJECT(view), "results_store");
+    LogRowModel *store = g_object_get_data(G_OBJECT(view), "results_store");
     if (!store) { sqlite3_finalize(stmt); return; }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        gint id = sqlite3_column_int(stmt, 0);
-        const char *source = (const char*)sqlite3_column_text(stmt, 1);
-        const char *unit = (const char*)sqlite3_column_text(stmt, 2);
-        const char *ts = (const char*)sqlite3_column_text(stmt, 3);
-        const char *message = (const char*)sqlite3_column_text(stmt, 4);
-        char preview[512];
-        if (!message) message = "";
-        if ((int)strlen(message) > 200) {
-            strncpy(preview, message, 197);
-            preview[197] = '\0';
-            strcat(preview, "...");
-        } else {
-            strncpy(preview, message, sizeof(preview)-1);
-            preview[sizeof(preview)-1] = '\0';
-        }
-        LogItem *li = log_item_new(id, source ? source : "", unit ? unit : "", ts ? ts : "", preview);
-        g_list_store_append(store, G_OBJECT(li));
-        g_object_unref(li);
-    }
+    RowPage *page = rowpage_from_stmt(stmt, PAGE_SIZE, PREVIEW_MAX, ROWPAGE_ELLIPSIS);
+    if (!page) g_warning("Out of memory loading results");
+    log_row_model_add_page(store, page, FALSE);
     sqlite3_finalize(stmt);
     win_set_offset(win, offset);
     // adjust load more sensitivity
@@ -366,7 +604,44 @@ static void on_load_more_clicked(GtkWidget *button, gpointer user_data) {
         if (rows >= PAGE_SIZE + offset) gtk_widget_set_sensitive(load_more, TRUE);
         else gtk_widget_set_sensitive(load_more, FALSE);
     }
-    g_debug("load_more: appended page offset=%d rows=%d", offset, g_list_model_get_n_items((GListModel*)store));
+    metrics_observe_ns(METRIC_HIST_UI_SEARCH, metrics_now_ns() - t0);
+    g_debug("load_more: appended page offset=%d rows=%d bytes=%zu", offset, g_list_model_get_n_items((GListModel*)store),
+            log_row_model_bytes(store));
+}
+
+/* Bulk tag/untag every row matching the current search and tag filter,
+ * not just the loaded page. user_data is the main window; the button's
+ * "untag" data selects the direction. */
+static void on_bulk_tag_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *win = (GtkWidget*)user_data;
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    GtkWidget *search = g_object_get_data(G_OBJECT(win), "search_entry");
+    GtkWidget *entry = g_object_get_data(G_OBJECT(win), "bulk_tag_entry");
+    GtkWidget *status = g_object_get_data(G_OBJECT(win), "bulk_tag_status");
+    if (!db || !search || !entry) return;
+    const char *tag = gtk_editable_get_text(GTK_EDITABLE(entry));
+    if (!tag || !*tag) return;
+    int untag = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(button), "untag"));
+    DBSearchOpts opts = ui_search_opts(win, gtk_editable_get_text(GTK_EDITABLE(search)), 0, 0);
+    long long n = 0;
+    int rc = untag ? db_untag_matching(db, &opts, tag, &n) : db_tag_matching(db, &opts, tag, &n);
+    if (status) {
+        char buf[128];
+        if (rc == 0) snprintf(buf, sizeof(buf), "%s %lld rows", untag ? "Untagged" : "Tagged", n);
+        else snprintf(buf, sizeof(buf), "%s failed", untag ? "Untag" : "Tag");
+        gtk_label_set_text(GTK_LABEL(status), buf);
+    }
+    /* Rows may have entered or left the tag filter. */
+    if (rc == 0 && opts.tag && opts.tag[0]) on_search_activate(search, db);
+}
+
+// Enter in the tag filter re-runs the search with the new filter.
+static void on_tag_filter_activate(GtkWidget *entry, gpointer user_data) {
+    (void)entry;
+    GtkWidget *win = (GtkWidget*)user_data;
+    GtkWidget *search = g_object_get_data(G_OBJECT(win), "search_entry");
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    if (search && db) on_search_activate(search, db);
 }
 
 /* set_message_view removed — details are shown in a separate window now.
@@ -418,7 +693,7 @@ void on_add_tag_clicked(GtkWidget *button, gpointer user_data) {
     GObject *item = gtk_single_selection_get_selected_item(sel);
     if (!item) return;
     LogItem *li = LOG_ITEM(item);
-    int id = li->id;
+    int id = log_item_id(li);
     DB *db = g_object_get_data(G_OBJECT(win), "db");
     db_add_tag(db, id, tag);
     populate_tags(win, db, id);
@@ -453,7 +728,7 @@ void on_remove_tag_clicked(GtkWidget *button, gpointer user_data) {
     GObject *item = gtk_single_selection_get_selected_item(sel);
     if (!item) return;
     LogItem *li = LOG_ITEM(item);
-    int id = li->id;
+    int id = log_item_id(li);
     DB *db = g_object_get_data(G_OBJECT(win), "db");
     db_remove_tag(db, id, tag);
     populate_tags(win, db, id);
@@ -515,11 +790,101 @@ static void on_remove_tag_detail_clicked(GtkWidget *button, gpointer user_data)
 }
 
 /* Create a new top-level window that shows full message and tag controls */
-static void create_details_window(DB *db, LogItem *li) {
+/* Context pane: the rows around the opened hit from the same source and
+ * unit. CONTEXT_PAGE rows are loaded on each side initially, and another
+ * page whenever the scroller reaches the top or bottom edge. The first and
+ * last items in the store are the cursors for the next page. */
+static const int CONTEXT_PAGE = 50;
+static const size_t CONTEXT_PREVIEW_MAX = 255;
+
+static void context_factory_setup(GtkListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    (void)factory; (void)user_data;
+    GtkWidget *lbl = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(lbl), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(lbl), PANGO_ELLIPSIZE_END);
+    gtk_widget_add_css_class(lbl, "preview");
+    gtk_list_item_set_child(list_item, lbl);
+}
+
+static void context_factory_bind(GtkListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
+    (void)factory; (void)user_data;
+    LogItem *li = LOG_ITEM(gtk_list_item_get_item(list_item));
+    GtkWidget *lbl = gtk_list_item_get_child(list_item);
+    char *text = g_strdup_printf("%d  %s  %s", log_item_id(li), log_item_ts(li), log_item_preview(li));
+    gtk_label_set_text(GTK_LABEL(lbl), text);
+    g_free(text);
+}
+
+/* Load one page next to the edge item of the store and splice it in with a
+ * single items-changed. Older rows come back nearest first, so they are
+ * reversed before going in at the front. Returns the number of rows added. */
+static int context_load(GtkWidget *dwin, int direction) {
+    DB *db = g_object_get_data(G_OBJECT(dwin), "db");
+    GListStore *store = g_object_get_data(G_OBJECT(dwin), "context_store");
+    guint n = g_list_model_get_n_items(G_LIST_MODEL(store));
+    if (!db || n == 0) return 0;
+    LogItem *edge = g_list_model_get_item(G_LIST_MODEL(store), direction < 0 ? 0 : n - 1);
+    DBContextKey key = { log_item_source(edge), log_item_unit(edge), log_item_ts(edge), log_item_id(edge) };
+    sqlite3_stmt *stmt = NULL;
+    RowPage *rows = NULL;
+    if (db_context(db, &key, direction, CONTEXT_PAGE, &stmt) == 0) {
+        /* one line per row: stop at the first newline */
+        rows = rowpage_from_stmt(stmt, CONTEXT_PAGE, CONTEXT_PREVIEW_MAX, ROWPAGE_FIRST_LINE);
+        sqlite3_finalize(stmt);
+    }
+    g_object_unref(edge);
+    int added = rows ? (int)rowpage_size(rows) : 0;
+    GPtrArray *page = g_ptr_array_new_full((guint)added, g_object_unref);
+    for (int i = 0; i < added; ++i)
+        g_ptr_array_add(page, log_item_new(rows, (guint)(direction < 0 ? added - 1 - i : i)));
+    rowpage_unref(rows);
+    g_list_store_splice(store, direction < 0 ? 0 : n, 0, page->pdata, page->len);
+    g_ptr_array_unref(page);
+    /* A short page means this side is exhausted; stop querying it. */
+    if (added < CONTEXT_PAGE)
+        g_object_set_data(G_OBJECT(dwin), direction < 0 ? "context_top_done" : "context_bottom_done", GINT_TO_POINTER(1));
+    return added;
+}
+
+static void context_edge_reached_cb(GtkScrolledWindow *sw, GtkPositionType pos, gpointer user_data) {
+    (void)sw;
+    GtkWidget *dwin = GTK_WIDGET(user_data);
+    if (pos == GTK_POS_TOP && !g_object_get_data(G_OBJECT(dwin), "context_top_done")) {
+        int added = context_load(dwin, -1);
+        /* keep the selection on the hit, which moved down by the rows inserted above it */
+        GtkSingleSelection *sel = g_object_get_data(G_OBJECT(dwin), "context_sel");
+        guint cur = gtk_single_selection_get_selected(sel);
+        if (added > 0 && cur != GTK_INVALID_LIST_POSITION) gtk_single_selection_set_selected(sel, cur + (guint)added);
+    } else if (pos == GTK_POS_BOTTOM && !g_object_get_data(G_OBJECT(dwin), "context_bottom_done")) {
+        context_load(dwin, 1);
+    }
+}
+
+/* Fill the details text with a message carrying match markers, the
+ * matched terms set in the "match" tag. */
+static void detail_set_message(GtkTextBuffer *buf, const char *marked) {
+    GtkTextTag *match = gtk_text_buffer_create_tag(buf, "match", "weight", PANGO_WEIGHT_BOLD,
+                                                   "background", "yellow", NULL);
+    GtkTextIter end;
+    const char *s = marked;
+    gboolean in_match = FALSE;
+    while (*s) {
+        size_t n = strcspn(s, DB_MARK_START DB_MARK_END);
+        gtk_text_buffer_get_end_iter(buf, &end);
+        if (in_match) gtk_text_buffer_insert_with_tags(buf, &end, s, (int)n, match, NULL);
+        else gtk_text_buffer_insert(buf, &end, s, (int)n);
+        s += n;
+        if (!*s) break;
+        in_match = *s == DB_MARK_START[0];
+        s++;
+    }
+}
+
+static void create_details_window(DB *db, LogItem *li, const char *query, gboolean read_only) {
     if (!db || !li) return;
     GtkWidget *dwin = gtk_window_new();
     char title[128];
-    snprintf(title, sizeof(title), "Log #%d Details", li->id);
+    snprintf(title, sizeof(title), "Log #%d Details", log_item_id(li));
     gtk_window_set_title(GTK_WINDOW(dwin), title);
     gtk_window_set_default_size(GTK_WINDOW(dwin), 600, 400);
 
@@ -556,6 +921,8 @@ static void create_details_window(DB *db, LogItem *li) {
     GtkWidget *remove_btn = gtk_button_new_with_label("Remove Tag");
     gtk_widget_set_halign(remove_btn, GTK_ALIGN_CENTER);
     gtk_box_append(GTK_BOX(tag_hbox), remove_btn);
+    // Viewers of the daemon's database can see tags but not change them
+    if (read_only) gtk_widget_set_sensitive(tag_hbox, FALSE);
 
     /* Tag list */
     GListStore *tag_store = g_list_store_new(tag_item_get_type());
@@ -571,31 +938,713 @@ static void create_details_window(DB *db, LogItem *li) {
 
     /* store references on detail window */
     g_object_set_data(G_OBJECT(dwin), "db", db);
-    g_object_set_data(G_OBJECT(dwin), "log_id", GINT_TO_POINTER(li->id));
+    g_object_set_data(G_OBJECT(dwin), "log_id", GINT_TO_POINTER(log_item_id(li)));
     g_object_set_data(G_OBJECT(dwin), "tag_entry", tag_entry);
     g_object_set_data(G_OBJECT(dwin), "tag_view", tag_view);
 
     g_signal_connect(add_btn, "clicked", G_CALLBACK(on_add_tag_detail_clicked), dwin);
     g_signal_connect(remove_btn, "clicked", G_CALLBACK(on_remove_tag_detail_clicked), dwin);
 
-    /* populate message and tags */
+    /* populate message and tags: the full text is only read now, with the
+     * query's matches marked */
     char *full = NULL;
-    if (db_get_message(db, li->id, &full) == 0 && full) {
-        GtkTextBuffer *buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(msg_view));
-        gtk_text_buffer_set_text(buf, full, -1);
+    GtkTextBuffer *msg_buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(msg_view));
+    if (db_get_message_marked(db, log_item_id(li), query, &full) == 0 && full) {
+        detail_set_message(msg_buf, full);
         free(full);
     } else {
-        GtkTextBuffer *buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(msg_view));
-        gtk_text_buffer_set_text(buf, li->preview ? li->preview : "", -1);
+        detail_set_message(msg_buf, log_item_preview(li));
     }
 
     detail_populate_tags(dwin);
+
+    /* Context pane, seeded with the hit itself and one page either side */
+    GtkWidget *ctx_label = gtk_label_new("Context (same source and unit)");
+    gtk_label_set_xalign(GTK_LABEL(ctx_label), 0.0);
+    gtk_box_append(GTK_BOX(vbox), ctx_label);
+    GListStore *ctx_store = g_list_store_new(LOG_ITEM_TYPE);
+    g_list_store_append(ctx_store, li);
+    GtkListItemFactory *ctx_factory = gtk_signal_list_item_factory_new();
+    g_signal_connect(ctx_factory, "setup", G_CALLBACK(context_factory_setup), NULL);
+    g_signal_connect(ctx_factory, "bind", G_CALLBACK(context_factory_bind), NULL);
+    GtkSingleSelection *ctx_sel = GTK_SINGLE_SELECTION(gtk_single_selection_new(G_LIST_MODEL(ctx_store)));
+    GtkWidget *ctx_view = gtk_list_view_new(GTK_SELECTION_MODEL(ctx_sel), ctx_factory);
+    GtkWidget *ctx_scroller = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(ctx_scroller), ctx_view);
+    gtk_widget_set_vexpand(ctx_scroller, TRUE);
+    gtk_widget_set_size_request(ctx_scroller, -1, 200);
+    gtk_box_append(GTK_BOX(vbox), ctx_scroller);
+    g_object_set_data(G_OBJECT(dwin), "context_store", ctx_store);
+    g_object_set_data(G_OBJECT(dwin), "context_sel", ctx_sel);
+    int above = context_load(dwin, -1);
+    context_load(dwin, 1);
+    gtk_single_selection_set_selected(ctx_sel, (guint)above);
+    g_signal_connect(ctx_scroller, "edge-reached", G_CALLBACK(context_edge_reached_cb), dwin);
+
     gtk_widget_show(dwin);
+    gtk_widget_activate_action(ctx_view, "list.scroll-to-item", "u", (guint)above);
+}
+
+/* Stats panel: a small window with a text summary of the process metrics,
+ * refreshed every second. Rates are computed from the previous snapshot,
+ * which is kept on the window. */
+static void stats_append_hist(GString *out, const MetricsSnapshot *s, MetricHist h) {
+    g_string_append_printf(out, "%-14s n=%-9llu p50 %8.3f ms  p99 %8.3f ms\n", metrics_hist_name(h),
+                           (unsigned long long)s->hist_count[h],
+                           metrics_hist_quantile_ns(s, h, 0.50) / 1e6,
+                           metrics_hist_quantile_ns(s, h, 0.99) / 1e6);
 }
 
-GtkWidget *create_main_window(DB *db) {
+static gboolean stats_refresh(gpointer user_data) {
+    GtkWidget *swin = GTK_WIDGET(user_data);
+    GtkWidget *label = g_object_get_data(G_OBJECT(swin), "stats_label");
+    DB *db = g_object_get_data(G_OBJECT(swin), "db");
+    MetricsSnapshot *prev = g_object_get_data(G_OBJECT(swin), "stats_prev");
+    gint64 prev_us = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(swin), "stats_prev_us"));
+    gint64 now_us = g_get_monotonic_time();
+    double dt = prev_us ? (double)(now_us - prev_us) / 1e6 : 0;
+
+    MetricsSnapshot cur;
+    metrics_snapshot(&cur);
+    GString *out = g_string_new(NULL);
+    g_string_append(out, "Ingest\n");
+    for (int i = 0; i < METRIC_SRC_COUNT; ++i) {
+        double rate = dt > 0 ? (double)(cur.ingest_rows[i] - prev->ingest_rows[i]) / dt : 0;
+        g_string_append_printf(out, "  %-10s %12llu rows  %10.1f rows/s  %12llu bytes\n",
+                               metrics_source_name((MetricSource)i), (unsigned long long)cur.ingest_rows[i],
+                               rate, (unsigned long long)cur.ingest_bytes[i]);
+    }
+    g_string_append_printf(out, "  errors     %12llu\n", (unsigned long long)cur.counters[METRIC_INGEST_ERRORS]);
+    g_string_append_printf(out, "  queue      %12lld rows\n",
+                           (long long)cur.gauges[METRIC_GAUGE_INGEST_QUEUE_DEPTH]);
+    g_string_append_printf(out, "  spill      %12lld bytes pending  %llu spilled  %llu replayed  lag %.1f s\n",
+                           (long long)cur.gauges[METRIC_GAUGE_SPILL_PENDING_BYTES],
+                           (unsigned long long)cur.counters[METRIC_INGEST_SPILLED],
+                           (unsigned long long)cur.counters[METRIC_INGEST_REPLAYED],
+                           (double)cur.gauges[METRIC_GAUGE_REPLAY_LAG_MS] / 1e3);
+    g_string_append_printf(out, "  suppressed %12llu rows over rate limits\n",
+                           (unsigned long long)cur.counters[METRIC_INGEST_SUPPRESSED]);
+    g_string_append_printf(out, "\nStartup\n  first view %.3f s  first results %.3f s\n\nLatency\n",
+                           (double)cur.gauges[METRIC_GAUGE_UI_FIRST_VIEW_MS] / 1e3,
+                           (double)cur.gauges[METRIC_GAUGE_UI_FIRST_RESULTS_MS] / 1e3);
+    for (int h = 0; h < METRIC_HIST_COUNT; ++h) {
+        g_string_append(out, "  ");
+        stats_append_hist(out, &cur, (MetricHist)h);
+    }
+    g_string_append(out, "\nSQLite\n");
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&buf, &len);
+    if (mem) {
+        db_write_stats(mem, db);
+        fclose(mem);
+        /* Drop the metric-name prefix to keep the panel readable. */
+        for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+            const char *l = g_str_has_prefix(line, "logexplorer_") ? line + strlen("logexplorer_") : line;
+            g_string_append_printf(out, "  %s\n", l);
+        }
+        free(buf);
+    }
+    /* Statements over LOG_EXPLORER_SLOW_QUERY_MS, newest first, with
+     * their counters and query plans (slowlog.h). */
+    g_string_append(out, "\nSlow queries\n");
+    buf = NULL;
+    len = 0;
+    mem = open_memstream(&buf, &len);
+    if (mem) {
+        db_write_slow_queries(mem, db);
+        fclose(mem);
+        g_string_append(out, buf);
+        free(buf);
+    }
+    gtk_label_set_text(GTK_LABEL(label), out->str);
+    g_string_free(out, TRUE);
+    *prev = cur;
+    g_object_set_data(G_OBJECT(swin), "stats_prev_us", GSIZE_TO_POINTER((gsize)now_us));
+    return G_SOURCE_CONTINUE;
+}
+
+static void stats_window_destroy_cb(GtkWidget *swin, gpointer user_data) {
+    (void)user_data;
+    guint id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(swin), "stats_timer"));
+    if (id) g_source_remove(id);
+}
+
+static void on_stats_clicked(GtkWidget *button, gpointer user_data) {
+    (void)button;
+    GtkWidget *win = GTK_WIDGET(user_data);
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    GtkWidget *swin = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(swin), "Log Explorer Stats");
+    gtk_window_set_default_size(GTK_WINDOW(swin), 560, 480);
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_widget_set_valign(label, GTK_ALIGN_START);
+    gtk_style_context_add_class(gtk_widget_get_style_context(label), "preview");
+    GtkWidget *scroller = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroller), label);
+    gtk_window_set_child(GTK_WINDOW(swin), scroller);
+    g_object_set_data(G_OBJECT(swin), "db", db);
+    g_object_set_data(G_OBJECT(swin), "stats_label", label);
+    g_object_set_data_full(G_OBJECT(swin), "stats_prev", g_new0(MetricsSnapshot, 1), g_free);
+    stats_refresh(swin);
+    guint id = g_timeout_add_seconds(1, stats_refresh, swin);
+    g_object_set_data(G_OBJECT(swin), "stats_timer", GUINT_TO_POINTER(id));
+    g_signal_connect(swin, "destroy", G_CALLBACK(stats_window_destroy_cb), NULL);
+    gtk_widget_show(swin);
+}
+
+/* Top talkers panel: the loudest units and messages of the last few
+ * minutes, read from the ingest writer's sketches (topk.h), so refreshing
+ * it costs no query. */
+#define TOP_PANEL_MINUTES 5
+#define TOP_PANEL_ROWS 15
+
+static gboolean top_refresh(gpointer user_data) {
+    GtkWidget *twin = GTK_WIDGET(user_data);
+    GtkWidget *label = g_object_get_data(G_OBJECT(twin), "top_label");
+    GString *out = g_string_new(NULL);
+    TopkItem items[TOP_PANEL_ROWS];
+    for (int dim = 0; dim < TOPK_DIM_COUNT; ++dim) {
+        uint64_t total = 0;
+        int n = topk_top((TopkDim)dim, TOP_PANEL_MINUTES, items, TOP_PANEL_ROWS, &total);
+        g_string_append_printf(out, "%sTop %s, last %d minutes (%llu rows)\n", dim ? "\n" : "",
+                               topk_dim_name((TopkDim)dim), TOP_PANEL_MINUTES, (unsigned long long)total);
+        for (int i = 0; i < n; ++i) {
+            g_string_append_printf(out, "  %10llu %5.1f%%  %s", (unsigned long long)items[i].count,
+                                   total ? 100.0 * (double)items[i].count / (double)total : 0.0, items[i].key);
+            if (items[i].error) g_string_append_printf(out, "  (±%llu)", (unsigned long long)items[i].error);
+            g_string_append_c(out, '\n');
+        }
+    }
+    gtk_label_set_text(GTK_LABEL(label), out->str);
+    g_string_free(out, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+static void top_window_destroy_cb(GtkWidget *twin, gpointer user_data) {
+    (void)user_data;
+    guint id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(twin), "top_timer"));
+    if (id) g_source_remove(id);
+}
+
+static void on_top_clicked(GtkWidget *button, gpointer user_data) {
+    (void)button;
+    (void)user_data;
+    GtkWidget *twin = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(twin), "Top Talkers");
+    gtk_window_set_default_size(GTK_WINDOW(twin), 640, 480);
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_widget_set_valign(label, GTK_ALIGN_START);
+    gtk_style_context_add_class(gtk_widget_get_style_context(label), "preview");
+    GtkWidget *scroller = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroller), label);
+    gtk_window_set_child(GTK_WINDOW(twin), scroller);
+    g_object_set_data(G_OBJECT(twin), "top_label", label);
+    top_refresh(twin);
+    guint id = g_timeout_add_seconds(2, top_refresh, twin);
+    g_object_set_data(G_OBJECT(twin), "top_timer", GUINT_TO_POINTER(id));
+    g_signal_connect(twin, "destroy", G_CALLBACK(top_window_destroy_cb), NULL);
+    gtk_widget_show(twin);
+}
+
+/* Saved searches sidebar: one row per search with its unread count, and
+ * the newest matches (saved_recent) as the row's tooltip. Evaluation runs
+ * in the background (saved.h); the sidebar re-reads the table every
+ * SAVED_REFRESH_SEC and rebuilds its rows only when something changed. */
+#define SAVED_REFRESH_SEC 1
+
+typedef struct {
+    GString *sig;       // ids, names and unread counts, to skip identical refreshes
+    GPtrArray *rows;    // GtkListBoxRow, built as the list is read
+} SavedListing;
+
+static GtkWidget *saved_row_new(const DBSavedSearch *s) {
+    char *name = g_markup_escape_text(s->name, -1);
+    char *text = s->unread > 0 ? g_strdup_printf("<b>%s</b>  (%lld)", name, s->unread) : g_strdup(name);
+    GtkWidget *label = gtk_label_new(NULL);
+    gtk_label_set_markup(GTK_LABEL(label), text);
+    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    g_free(text);
+    g_free(name);
+
+    GString *tip = g_string_new(NULL);
+    char *q = g_markup_escape_text(s->query ? s->query : "", -1);
+    g_string_append_printf(tip, "<b>%s</b>", s->query && s->query[0] ? q : "(any message)");
+    g_free(q);
+    const char *filters[][2] = { { "unit", s->unit }, { "tag", s->tag }, { "priority", s->severity } };
+    for (size_t i = 0; i < G_N_ELEMENTS(filters); ++i) {
+        if (!filters[i][1] || !filters[i][1][0]) continue;
+        char *v = g_markup_escape_text(filters[i][1], -1);
+        g_string_append_printf(tip, "  %s=%s", filters[i][0], v);
+        g_free(v);
+    }
+    SavedHit hits[SAVED_RECENT];
+    size_t n = saved_recent(s->id, hits, SAVED_RECENT);
+    if (n == 0) g_string_append(tip, "\nNo matches since start");
+    for (size_t i = 0; i < n; ++i) {
+        char *ts = g_markup_escape_text(hits[i].ts, -1);
+        char *msg = marked_to_markup(hits[i].preview);
+        g_string_append_printf(tip, "\n<tt>%s</tt>  %s", ts, msg);
+        g_free(msg);
+        g_free(ts);
+    }
+
+    GtkWidget *row = gtk_list_box_row_new();
+    gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(row), label);
+    gtk_widget_set_tooltip_markup(row, tip->str);
+    g_string_free(tip, TRUE);
+    long long *id = g_new(long long, 1);
+    *id = s->id;
+    g_object_set_data_full(G_OBJECT(row), "saved_id", id, g_free);
+    g_object_set_data_full(G_OBJECT(row), "saved_query", g_strdup(s->query ? s->query : ""), g_free);
+    g_object_set_data_full(G_OBJECT(row), "saved_tag", g_strdup(s->tag ? s->tag : ""), g_free);
+    return row;
+}
+
+static void saved_listing_add(void *ctx, const DBSavedSearch *s) {
+    SavedListing *l = ctx;
+    g_string_append_printf(l->sig, "%lld:%lld:%s\n", s->id, s->unread, s->name);
+    g_ptr_array_add(l->rows, g_object_ref_sink(saved_row_new(s)));
+}
+
+static gboolean saved_refresh(gpointer user_data) {
+    GtkWidget *win = GTK_WIDGET(user_data);
+    GtkWidget *list = g_object_get_data(G_OBJECT(win), "saved_list");
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    if (!list || !db) return G_SOURCE_CONTINUE;
+    uint64_t gen = saved_generation();
+    SavedListing l = { g_string_new(NULL), g_ptr_array_new_with_free_func(g_object_unref) };
+    g_string_append_printf(l.sig, "%llu\n", (unsigned long long)gen);
+    if (db_saved_list(db, saved_listing_add, &l) == 0) {
+        const char *old = g_object_get_data(G_OBJECT(win), "saved_sig");
+        if (g_strcmp0(old, l.sig->str) != 0) {
+            GtkWidget *child;
+            while ((child = gtk_widget_get_first_child(list)) != NULL)
+                gtk_list_box_remove(GTK_LIST_BOX(list), child);
+            for (guint i = 0; i < l.rows->len; ++i)
+                gtk_list_box_append(GTK_LIST_BOX(list), g_ptr_array_index(l.rows, i));
+            g_object_set_data_full(G_OBJECT(win), "saved_sig", g_strdup(l.sig->str), g_free);
+        }
+    }
+    g_ptr_array_free(l.rows, TRUE);
+    g_string_free(l.sig, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+/* Read-only windows cannot write the read state themselves; main.c sends
+ * it to the daemon (see ui_set_mark_read). */
+static int (*g_mark_read)(void *ctx, long long id) = NULL;
+static void *g_mark_read_ctx = NULL;
+
+void ui_set_mark_read(int (*mark_read)(void *ctx, long long id), void *ctx) {
+    g_mark_read = mark_read;
+    g_mark_read_ctx = ctx;
+}
+
+// Activating a saved search runs it in the main view and marks its matches read.
+static void on_saved_row_activated(GtkListBox *list, GtkListBoxRow *row, gpointer user_data) {
+    (void)list;
+    GtkWidget *win = GTK_WIDGET(user_data);
+    GtkWidget *search = g_object_get_data(G_OBJECT(win), "search_entry");
+    GtkWidget *tag_filter = g_object_get_data(G_OBJECT(win), "tag_filter_entry");
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    const long long *id = g_object_get_data(G_OBJECT(row), "saved_id");
+    if (!search || !tag_filter || !db || !id) return;
+    gtk_editable_set_text(GTK_EDITABLE(search), g_object_get_data(G_OBJECT(row), "saved_query"));
+    gtk_editable_set_text(GTK_EDITABLE(tag_filter), g_object_get_data(G_OBJECT(row), "saved_tag"));
+    on_search_activate(search, db);
+    int rc;
+    if (!GPOINTER_TO_INT(g_object_get_data(G_OBJECT(win), "read_only"))) rc = saved_mark_read(db, *id);
+    else rc = g_mark_read ? g_mark_read(g_mark_read_ctx, *id) : -1;
+    if (rc != 0) g_warning("Could not mark saved search as read");
+    saved_refresh(win);
+}
+
+// Save the current search text and tag filter under the name typed in the sidebar.
+static void on_save_search_clicked(GtkWidget *button, gpointer user_data) {
+    (void)button;
+    GtkWidget *win = GTK_WIDGET(user_data);
+    GtkWidget *name_entry = g_object_get_data(G_OBJECT(win), "saved_name_entry");
+    GtkWidget *status = g_object_get_data(G_OBJECT(win), "saved_status");
+    GtkWidget *search = g_object_get_data(G_OBJECT(win), "search_entry");
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    if (!name_entry || !status || !search || !db) return;
+    const char *name = gtk_editable_get_text(GTK_EDITABLE(name_entry));
+    if (!name[0]) {
+        gtk_label_set_text(GTK_LABEL(status), "Enter a name first");
+        return;
+    }
+    DBSearchOpts opts = ui_search_opts(win, gtk_editable_get_text(GTK_EDITABLE(search)), 0, 0);
+    if (saved_add(db, name, &opts) != 0) {
+        gtk_label_set_text(GTK_LABEL(status), "Not saved: invalid query");
+        return;
+    }
+    gtk_label_set_text(GTK_LABEL(status), "");
+    gtk_editable_set_text(GTK_EDITABLE(name_entry), "");
+    saved_refresh(win);
+}
+
+static void saved_sidebar_stop(GtkWidget *win) {
+    guint id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(win), "saved_timer"));
+    if (id) g_source_remove(id);
+    g_object_set_data(G_OBJECT(win), "saved_timer", NULL);
+}
+
+static GtkWidget *saved_sidebar_new(GtkWidget *win) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_widget_set_size_request(box, 200, -1);
+    gtk_widget_set_margin_start(box, 6);
+    gtk_widget_set_margin_top(box, 6);
+    GtkWidget *title = gtk_label_new("Saved searches");
+    gtk_widget_set_halign(title, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(box), title);
+
+    GtkWidget *list = gtk_list_box_new();
+    gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(list), TRUE);
+    GtkWidget *scroller = gtk_scrolled_window_new();
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroller), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroller), list);
+    gtk_widget_set_vexpand(scroller, TRUE);
+    gtk_box_append(GTK_BOX(box), scroller);
+
+    GtkWidget *name_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(name_entry), "Name");
+    gtk_box_append(GTK_BOX(box), name_entry);
+    GtkWidget *save_btn = gtk_button_new_with_label("Save search");
+    gtk_box_append(GTK_BOX(box), save_btn);
+    GtkWidget *status = gtk_label_new(NULL);
+    gtk_label_set_wrap(GTK_LABEL(status), TRUE);
+    gtk_box_append(GTK_BOX(box), status);
+    if (GPOINTER_TO_INT(g_object_get_data(G_OBJECT(win), "read_only"))) {
+        gtk_widget_set_sensitive(name_entry, FALSE);
+        gtk_widget_set_sensitive(save_btn, FALSE);
+    }
+
+    g_object_set_data(G_OBJECT(win), "saved_list", list);
+    g_object_set_data(G_OBJECT(win), "saved_name_entry", name_entry);
+    g_object_set_data(G_OBJECT(win), "saved_status", status);
+    g_signal_connect(list, "row-activated", G_CALLBACK(on_saved_row_activated), win);
+    g_signal_connect(save_btn, "clicked", G_CALLBACK(on_save_search_clicked), win);
+    g_signal_connect(name_entry, "activate", G_CALLBACK(on_save_search_clicked), win);
+    guint id = g_timeout_add_seconds(SAVED_REFRESH_SEC, saved_refresh, win);
+    g_object_set_data(G_OBJECT(win), "saved_timer", GUINT_TO_POINTER(id));
+    return box;
+}
+
+/* Progress window shared by background jobs (export, import). The running
+ * job is kept on the window under "export_job" or "import_job"; each job's
+ * tick callback polls it and clears the key once the job is finished. */
+static gboolean job_window_cancel(GtkWidget *pwin) {
+    ExportJob *ej = g_object_get_data(G_OBJECT(pwin), "export_job");
+    ImportJob *ij = g_object_get_data(G_OBJECT(pwin), "import_job");
+    if (ej) export_cancel(ej);
+    if (ij) import_cancel(ij);
+    return ej || ij;
+}
+
+// Cancel while running (the tick then reports it); close once finished.
+static void on_job_button_clicked(GtkWidget *button, gpointer user_data) {
+    (void)button;
+    GtkWidget *pwin = GTK_WIDGET(user_data);
+    if (!job_window_cancel(pwin)) gtk_window_destroy(GTK_WINDOW(pwin));
+}
+
+/* The job thread must be joined before the window goes away, so closing a
+ * running job only cancels it. */
+static gboolean job_close_request_cb(GtkWindow *pwin, gpointer user_data) {
+    (void)user_data;
+    return job_window_cancel(GTK_WIDGET(pwin));
+}
+
+static GtkWidget *job_window_new(GtkWidget *parent, const char *title, const char *subject) {
+    GtkWidget *pwin = gtk_window_new();
+    gtk_window_set_title(GTK_WINDOW(pwin), title);
+    gtk_window_set_transient_for(GTK_WINDOW(pwin), GTK_WINDOW(parent));
+    gtk_window_set_default_size(GTK_WINDOW(pwin), 420, -1);
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_widget_set_margin_top(vbox, 12);
+    gtk_widget_set_margin_bottom(vbox, 12);
+    gtk_widget_set_margin_start(vbox, 12);
+    gtk_widget_set_margin_end(vbox, 12);
+    gtk_window_set_child(GTK_WINDOW(pwin), vbox);
+    GtkWidget *name = gtk_label_new(subject);
+    gtk_label_set_ellipsize(GTK_LABEL(name), PANGO_ELLIPSIZE_START);
+    gtk_box_append(GTK_BOX(vbox), name);
+    GtkWidget *bar = gtk_progress_bar_new();
+    gtk_box_append(GTK_BOX(vbox), bar);
+    GtkWidget *label = gtk_label_new("Starting...");
+    gtk_box_append(GTK_BOX(vbox), label);
+    GtkWidget *button = gtk_button_new_with_label("Cancel");
+    gtk_widget_set_halign(button, GTK_ALIGN_END);
+    gtk_box_append(GTK_BOX(vbox), button);
+    g_object_set_data(G_OBJECT(pwin), "job_label", label);
+    g_object_set_data(G_OBJECT(pwin), "job_bar", bar);
+    g_object_set_data(G_OBJECT(pwin), "job_button", button);
+    g_signal_connect(button, "clicked", G_CALLBACK(on_job_button_clicked), pwin);
+    g_signal_connect(pwin, "close-request", G_CALLBACK(job_close_request_cb), NULL);
+    return pwin;
+}
+
+// Show the final message and turn Cancel into Close.
+static void job_window_done(GtkWidget *pwin, const char *msg, double fraction) {
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(pwin), "job_label")), msg);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(g_object_get_data(G_OBJECT(pwin), "job_bar")), fraction);
+    gtk_button_set_label(GTK_BUTTON(g_object_get_data(G_OBJECT(pwin), "job_button")), "Close");
+}
+
+/* Export: the current search (text and tag filter, all pages) is written
+ * by a background ExportJob. Format and compression follow the chosen file
+ * name. */
+static gboolean export_progress_tick(gpointer user_data) {
+    GtkWidget *pwin = GTK_WIDGET(user_data);
+    ExportJob *job = g_object_get_data(G_OBJECT(pwin), "export_job");
+    ExportProgress p;
+    export_poll(job, &p);
+    char buf[512];
+    if (p.state == EXPORT_RUNNING) {
+        snprintf(buf, sizeof(buf), "%lld rows, %.1f MB written", p.rows, (double)p.out_bytes / (1024.0 * 1024.0));
+        gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(pwin), "job_label")), buf);
+        gtk_progress_bar_pulse(GTK_PROGRESS_BAR(g_object_get_data(G_OBJECT(pwin), "job_bar")));
+        return G_SOURCE_CONTINUE;
+    }
+    ExportState state = export_finish(job, &p);
+    g_object_set_data(G_OBJECT(pwin), "export_job", NULL);
+    if (state == EXPORT_DONE)
+        snprintf(buf, sizeof(buf), "Exported %lld rows (%.1f MB)", p.rows, (double)p.out_bytes / (1024.0 * 1024.0));
+    else if (state == EXPORT_CANCELLED)
+        snprintf(buf, sizeof(buf), "Cancelled after %lld rows", p.rows);
+    else
+        snprintf(buf, sizeof(buf), "Export failed: %s", p.error);
+    job_window_done(pwin, buf, state == EXPORT_DONE ? 1.0 : 0.0);
+    return G_SOURCE_REMOVE;
+}
+
+static void start_export(GtkWidget *win, const char *path) {
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    GtkWidget *search = g_object_get_data(G_OBJECT(win), "search_entry");
+    if (!db || !search) return;
+    ExportFormat fmt;
+    ExportCompression comp;
+    export_guess(path, &fmt, &comp);
+    GtkWidget *pwin = job_window_new(win, "Export", path);
+    ExportJob *job = NULL;
+    if (!export_supported(comp)) {
+        job_window_done(pwin, "zstd output is not available in this build", 0.0);
+    } else {
+        DBSearchOpts opts = ui_search_opts(win, gtk_editable_get_text(GTK_EDITABLE(search)), 0, 0);
+        job = export_start(db, &opts, path, fmt, comp);
+        if (!job) job_window_done(pwin, "Could not start export", 0.0);
+    }
+    g_object_set_data(G_OBJECT(pwin), "export_job", job);
+    if (job) g_timeout_add(200, export_progress_tick, pwin);
+    gtk_widget_show(pwin);
+}
+
+/* Import: files dropped on the main window are bulk-loaded as their own
+ * source. The results are refreshed once the rows are indexed. */
+static gboolean import_progress_tick(gpointer user_data) {
+    GtkWidget *pwin = GTK_WIDGET(user_data);
+    ImportJob *job = g_object_get_data(G_OBJECT(pwin), "import_job");
+    GtkWidget *bar = g_object_get_data(G_OBJECT(pwin), "job_bar");
+    ImportProgress p;
+    import_poll(job, &p);
+    char buf[768];
+    if (p.state == IMPORT_RUNNING || p.state == IMPORT_INDEXING) {
+        if (p.state == IMPORT_INDEXING) {
+            snprintf(buf, sizeof(buf), "%lld rows stored, building search index...", p.rows);
+            gtk_progress_bar_pulse(GTK_PROGRESS_BAR(bar));
+        } else {
+            snprintf(buf, sizeof(buf), "%lld rows", p.rows);
+            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(bar),
+                                          p.total_bytes > 0 ? (double)p.in_bytes / (double)p.total_bytes : 0.0);
+        }
+        gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(pwin), "job_label")), buf);
+        return G_SOURCE_CONTINUE;
+    }
+    ImportState state = import_finish(job, &p);
+    g_object_set_data(G_OBJECT(pwin), "import_job", NULL);
+    if (state == IMPORT_DONE)
+        snprintf(buf, sizeof(buf), "Imported %lld rows as source \"%s\"", p.rows, p.source);
+    else if (state == IMPORT_CANCELLED)
+        snprintf(buf, sizeof(buf), "Cancelled; %lld rows kept as source \"%s\"", p.rows, p.source);
+    else
+        snprintf(buf, sizeof(buf), "Import failed: %s", p.error);
+    job_window_done(pwin, buf, state == IMPORT_DONE ? 1.0 : 0.0);
+    GtkWidget *win = GTK_WIDGET(gtk_window_get_transient_for(GTK_WINDOW(pwin)));
+    GtkWidget *search = win ? g_object_get_data(G_OBJECT(win), "search_entry") : NULL;
+    DB *db = win ? g_object_get_data(G_OBJECT(win), "db") : NULL;
+    if (search && db) on_search_activate(search, db);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_file_dropped(GtkDropTarget *target, const GValue *value, double x, double y, gpointer user_data) {
+    (void)target; (void)x; (void)y;
+    GtkWidget *win = GTK_WIDGET(user_data);
+    DB *db = g_object_get_data(G_OBJECT(win), "db");
+    if (!db || !G_VALUE_HOLDS(value, G_TYPE_FILE)) return FALSE;
+    char *path = g_file_get_path(G_FILE(g_value_get_object(value)));
+    if (!path) return FALSE;
+    GtkWidget *pwin = job_window_new(win, "Import", path);
+    ImportJob *job = import_start(db, path, NULL);
+    if (!job) job_window_done(pwin, "Could not start import", 0.0);
+    g_object_set_data(G_OBJECT(pwin), "import_job", job);
+    if (job) g_timeout_add(200, import_progress_tick, pwin);
+    gtk_widget_show(pwin);
+    g_free(path);
+    return job != NULL;
+}
+
+static void on_export_response(GtkNativeDialog *native, int response, gpointer user_data) {
+    GtkWidget *win = GTK_WIDGET(user_data);
+    if (response == GTK_RESPONSE_ACCEPT) {
+        GFile *file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(native));
+        char *path = file ? g_file_get_path(file) : NULL;
+        if (path) start_export(win, path);
+        g_free(path);
+        if (file) g_object_unref(file);
+    }
+    g_object_unref(native);
+}
+
+static void on_export_clicked(GtkWidget *button, gpointer user_data) {
+    (void)button;
+    GtkWidget *win = GTK_WIDGET(user_data);
+    GtkFileChooserNative *native = gtk_file_chooser_native_new("Export results", GTK_WINDOW(win),
+                                                               GTK_FILE_CHOOSER_ACTION_SAVE, "_Export", "_Cancel");
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(native), "logs.ndjson.gz");
+    g_signal_connect(native, "response", G_CALLBACK(on_export_response), win);
+    gtk_native_dialog_show(GTK_NATIVE_DIALOG(native));
+}
+
+/* Last view: the search text, tag filter and first result page are saved
+ * when the main window closes and shown straight away on the next start,
+ * while the real search runs after the first frame. The file holds log
+ * rows, so it lives in the user's own state directory and only they can
+ * read it. */
+static const char *last_view_path(void) {
+    static char *path = NULL;
+    if (!path) {
+        const char *p = getenv("LOG_EXPLORER_VIEW_FILE");
+#if GLIB_CHECK_VERSION(2, 72, 0)
+        const char *dir = g_get_user_state_dir();
+#else
+        const char *dir = g_get_user_data_dir();
+#endif
+        path = p && *p ? g_strdup(p) : g_build_filename(dir, "log-explorer", "last_view", NULL);
+    }
+    return path;
+}
+
+#define LAST_VIEW_HEADER "log-explorer view 1\n"
+
+static void last_view_save(GtkWidget *win) {
+    GtkWidget *search = g_object_get_data(G_OBJECT(win), "search_entry");
+    GtkWidget *tag_filter = g_object_get_data(G_OBJECT(win), "tag_filter_entry");
+    GtkWidget *view = g_object_get_data(G_OBJECT(win), "results_list");
+    LogRowModel *store = view ? g_object_get_data(G_OBJECT(view), "results_store") : NULL;
+    if (!search || !tag_filter || !store) return;
+    const char *path = last_view_path();
+    char *dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+    char *tmp = g_strconcat(path, ".tmp", NULL);
+    unlink(tmp); // left by a crash, maybe with other permissions
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!f) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        g_warning("Could not save the last view to %s", path);
+        g_free(tmp);
+        return;
+    }
+    char *q = g_strescape(gtk_editable_get_text(GTK_EDITABLE(search)), NULL);
+    char *tag = g_strescape(gtk_editable_get_text(GTK_EDITABLE(tag_filter)), NULL);
+    fprintf(f, LAST_VIEW_HEADER "%s\n%s\n", q, tag);
+    g_free(q);
+    g_free(tag);
+    int rc = store->pages->len > 0 ? rowpage_save(g_ptr_array_index(store->pages, 0), f) : 0;
+    if (fclose(f) != 0 || rc != 0 || rename(tmp, path) != 0) {
+        g_warning("Could not save the last view to %s", path);
+        unlink(tmp);
+    }
+    g_free(tmp);
+}
+
+// Line without its newline, unescaped (g_strescape), or NULL at EOF.
+static char *last_view_line(FILE *f) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, f);
+    if (n <= 0) { free(line); return NULL; }
+    if (line[n - 1] == '\n') line[n - 1] = '\0';
+    char *out = g_strcompress(line);
+    free(line);
+    return out;
+}
+
+static gboolean last_view_restore(GtkWidget *search, GtkWidget *tag_filter, LogRowModel *store) {
+    FILE *f = fopen(last_view_path(), "r");
+    if (!f) return FALSE;
+    char header[sizeof(LAST_VIEW_HEADER)];
+    gboolean ok = FALSE;
+    if (fgets(header, sizeof(header), f) && strcmp(header, LAST_VIEW_HEADER) == 0) {
+        char *q = last_view_line(f);
+        char *tag = last_view_line(f);
+        RowPage *page = q && tag ? rowpage_load(f, PAGE_SIZE) : NULL;
+        if (page) {
+            gtk_editable_set_text(GTK_EDITABLE(search), q);
+            gtk_editable_set_text(GTK_EDITABLE(tag_filter), tag);
+            log_row_model_add_page(store, page, TRUE);
+            GtkWidget *win = g_object_get_data(G_OBJECT(search), "main_window");
+            if (win) g_object_set_data_full(G_OBJECT(win), "results_query", g_strdup(q), g_free);
+            ok = TRUE;
+        }
+        g_free(q);
+        g_free(tag);
+    }
+    fclose(f);
+    return ok;
+}
+
+static gboolean on_main_window_close(GtkWindow *win, gpointer user_data) {
+    (void)user_data;
+    result_count_stop(GTK_WIDGET(win));
+    saved_sidebar_stop(GTK_WIDGET(win));
+    last_view_save(GTK_WIDGET(win));
+    g_main_windows = g_list_remove(g_main_windows, win);
+    return FALSE;
+}
+
+static gboolean first_search_idle(gpointer user_data) {
+    GtkWidget *search = GTK_WIDGET(user_data);
+    GtkWidget *win = g_object_get_data(G_OBJECT(search), "main_window");
+    DB *db = win ? g_object_get_data(G_OBJECT(win), "db") : NULL;
+    if (db) on_search_activate(search, db);
+    return G_SOURCE_REMOVE;
+}
+
+/* Runs once, as the first frame is drawn. The search is queued behind the
+ * paint so the window (and any restored view) is on screen first. */
+static gboolean first_frame_tick(GtkWidget *win, GdkFrameClock *clock, gpointer user_data) {
+    (void)win; (void)clock;
+    if (g_startup_ns)
+        metrics_gauge_set(METRIC_GAUGE_UI_FIRST_VIEW_MS, (int64_t)((metrics_now_ns() - g_startup_ns) / 1000000));
+    g_idle_add(first_search_idle, user_data);
+    return G_SOURCE_REMOVE;
+}
+
+GtkWidget *create_main_window(DB *db, gboolean read_only) {
     GtkWidget *win = gtk_window_new();
     gtk_window_set_title(GTK_WINDOW(win), "Log Explorer");
+    g_object_set_data(G_OBJECT(win), "read_only", GINT_TO_POINTER(read_only));
     /* Use a slightly smaller default size and allow the window to be resized
      * by the user. Some desktop environments may create a non-resizable
      * window by default depending on how the app is started; make it
@@ -624,9 +1673,12 @@ GtkWidget *create_main_window(DB *db) {
     /* Do not set an explicit size request on the left_vbox; letting the
      * child widgets determine minimum sizes ensures the window manager
      * can offer vertical resize handles. */
-    /* set the left column as the window child directly so the list view's
-     * internal scrolling is used. */
-    gtk_window_set_child(GTK_WINDOW(win), left_vbox);
+    /* The left column and the saved searches sidebar share the window; the
+     * list view still does its own scrolling. */
+    GtkWidget *main_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_append(GTK_BOX(main_hbox), left_vbox);
+    gtk_box_append(GTK_BOX(main_hbox), gtk_separator_new(GTK_ORIENTATION_VERTICAL));
+    gtk_window_set_child(GTK_WINDOW(win), main_hbox);
 
     /* Center area: search + results (expands to fill available space) */
     GtkWidget *center_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
@@ -634,12 +1686,21 @@ GtkWidget *create_main_window(DB *db) {
     gtk_widget_set_vexpand(center_box, TRUE);
     gtk_box_append(GTK_BOX(left_vbox), center_box);
 
+    GtkWidget *search_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_widget_set_valign(search_row, GTK_ALIGN_START);
+    gtk_box_append(GTK_BOX(center_box), search_row);
     GtkWidget *search = gtk_search_entry_new();
-    gtk_box_append(GTK_BOX(center_box), search);
-    gtk_widget_set_valign(search, GTK_ALIGN_START);
-
-    /* Results model/view using modern GtkListView + GListStore */
-    GListStore *results_store = g_list_store_new(LOG_ITEM_TYPE);
+    gtk_widget_set_hexpand(search, TRUE);
+    gtk_box_append(GTK_BOX(search_row), search);
+    /* Optional tag filter applied together with the search text */
+    GtkWidget *tag_filter = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(tag_filter), "Tag filter");
+    gtk_box_append(GTK_BOX(search_row), tag_filter);
+    g_object_set_data(G_OBJECT(win), "tag_filter_entry", tag_filter);
+    g_object_set_data(G_OBJECT(win), "search_entry", search);
+
+    /* Results model/view: GtkListView over the paged row model */
+    LogRowModel *results_store = log_row_model_new();
     GtkListItemFactory *res_factory = gtk_signal_list_item_factory_new();
     g_signal_connect(res_factory, "setup", G_CALLBACK(result_factory_setup), win);
     g_signal_connect(res_factory, "bind", G_CALLBACK(result_factory_bind), win);
@@ -682,6 +1743,50 @@ GtkWidget *create_main_window(DB *db) {
     gtk_widget_set_margin_start(load_more, 12);
     gtk_widget_set_margin_end(load_more, 12);
     gtk_box_append(GTK_BOX(bottom_bar), load_more);
+    GtkWidget *count_label = gtk_label_new(NULL);
+    gtk_box_append(GTK_BOX(bottom_bar), count_label);
+    g_object_set_data(G_OBJECT(win), "result_count_label", count_label);
+    GtkWidget *new_rows_label = gtk_label_new(NULL);
+    gtk_box_append(GTK_BOX(bottom_bar), new_rows_label);
+    g_object_set_data(G_OBJECT(win), "new_rows_label", new_rows_label);
+    GtkWidget *stats_btn = gtk_button_new_with_label("Stats");
+    gtk_widget_set_halign(stats_btn, GTK_ALIGN_END);
+    gtk_widget_set_margin_top(stats_btn, 8);
+    gtk_widget_set_margin_bottom(stats_btn, 8);
+    gtk_widget_set_margin_end(stats_btn, 12);
+    gtk_box_append(GTK_BOX(bottom_bar), stats_btn);
+    GtkWidget *top_btn = gtk_button_new_with_label("Top talkers");
+    gtk_widget_set_valign(top_btn, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(bottom_bar), top_btn);
+    g_signal_connect(top_btn, "clicked", G_CALLBACK(on_top_clicked), win);
+    /* Bulk tagging applies to every row matching the search, not only the loaded page */
+    GtkWidget *bulk_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(bulk_entry), "Tag");
+    gtk_widget_set_valign(bulk_entry, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(bottom_bar), bulk_entry);
+    GtkWidget *bulk_tag_btn = gtk_button_new_with_label("Tag matches");
+    GtkWidget *bulk_untag_btn = gtk_button_new_with_label("Untag matches");
+    g_object_set_data(G_OBJECT(bulk_untag_btn), "untag", GINT_TO_POINTER(1));
+    gtk_widget_set_valign(bulk_tag_btn, GTK_ALIGN_CENTER);
+    gtk_widget_set_valign(bulk_untag_btn, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(bottom_bar), bulk_tag_btn);
+    gtk_box_append(GTK_BOX(bottom_bar), bulk_untag_btn);
+    GtkWidget *bulk_status = gtk_label_new(NULL);
+    gtk_box_append(GTK_BOX(bottom_bar), bulk_status);
+    g_object_set_data(G_OBJECT(win), "bulk_tag_entry", bulk_entry);
+    g_object_set_data(G_OBJECT(win), "bulk_tag_status", bulk_status);
+    g_signal_connect(bulk_tag_btn, "clicked", G_CALLBACK(on_bulk_tag_clicked), win);
+    g_signal_connect(bulk_untag_btn, "clicked", G_CALLBACK(on_bulk_tag_clicked), win);
+    if (read_only) {
+        gtk_widget_set_sensitive(bulk_entry, FALSE);
+        gtk_widget_set_sensitive(bulk_tag_btn, FALSE);
+        gtk_widget_set_sensitive(bulk_untag_btn, FALSE);
+    }
+    g_signal_connect(stats_btn, "clicked", G_CALLBACK(on_stats_clicked), win);
+    GtkWidget *export_btn = gtk_button_new_with_label("Export...");
+    gtk_widget_set_valign(export_btn, GTK_ALIGN_CENTER);
+    gtk_box_append(GTK_BOX(bottom_bar), export_btn);
+    g_signal_connect(export_btn, "clicked", G_CALLBACK(on_export_clicked), win);
     /* keep a reference to the bottom_bar on the window so the size-allocate
      * handler can adjust its height to be ~10% of the window height. */
     g_object_set_data(G_OBJECT(win), "bottom_bar", bottom_bar);
@@ -701,6 +1806,13 @@ GtkWidget *create_main_window(DB *db) {
     /* Initialize narrow mode flag and size-allocate handler */
     g_object_set_data(G_OBJECT(win), "narrow_mode", GINT_TO_POINTER(0));
     g_signal_connect(win, "size-allocate", G_CALLBACK(window_size_allocate_cb), NULL);
+    /* Dropping a log file on the window bulk-imports it, unless the
+     * database is only viewed */
+    if (!read_only) {
+        GtkDropTarget *drop = gtk_drop_target_new(G_TYPE_FILE, GDK_ACTION_COPY);
+        g_signal_connect(drop, "drop", G_CALLBACK(on_file_dropped), win);
+        gtk_widget_add_controller(win, GTK_EVENT_CONTROLLER(drop));
+    }
 
     /* The item-level gesture handlers are attached in the factory setup so
      * double-clicking a list-item reliably opens the details window. */
@@ -709,18 +1821,25 @@ GtkWidget *create_main_window(DB *db) {
     win_set_offset(win, 0);
         /* keep DB pointer on the main window for callbacks */
         g_object_set_data(G_OBJECT(win), "db", db);
+    g_main_windows = g_list_prepend(g_main_windows, win);
 
     g_signal_connect(search, "activate", G_CALLBACK(on_search_activate), db);
+    g_signal_connect(tag_filter, "activate", G_CALLBACK(on_tag_filter_activate), win);
 
     // Load more callback: load next page
     g_signal_connect(load_more, "clicked", G_CALLBACK(on_load_more_clicked), search);
 
-    /* populate initial results with recent logs */
-    on_search_activate(search, db);
+    /* Show the last view at once; the search for current results (recent
+     * logs if there was none) runs after the first frame. */
+    last_view_restore(search, tag_filter, results_store);
+    gtk_box_append(GTK_BOX(main_hbox), saved_sidebar_new(win));
+    saved_refresh(win);
+    gtk_widget_add_tick_callback(win, first_frame_tick, search, NULL);
+    g_signal_connect(win, "close-request", G_CALLBACK(on_main_window_close), NULL);
 
     // Selection changed callback is handled via GtkSingleSelection notify on the model
 
-    // No tag controls in the main window; tagging is handled in the details window
+    // Per-row tagging is in the details window; the bottom bar tags whole result sets
 
     return win;
 }
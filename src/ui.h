@@ -1,9 +1,23 @@
 #pragma once
 
 #include <gtk/gtk.h>
+#include <stdint.h>
 #include "db.h"
 
-GtkWidget *create_main_window(DB *db);
+/* With read_only (viewing the database of log-explorer-indexerd), the
+ * actions that write to it are insensitive: tagging, importing dropped
+ * files and saving searches. Marking a saved search read goes through
+ * the hook set with ui_set_mark_read instead. */
+GtkWidget *create_main_window(DB *db, gboolean read_only);
+/* How a read-only window marks saved search id read; returns 0 or -1.
+ * Without a hook those windows leave searches unread. */
+void ui_set_mark_read(int (*mark_read)(void *ctx, long long id), void *ctx);
+/* metrics_now_ns() when main() started, the reference for the time-to-first
+ * view/results gauges. Call before create_main_window. */
+void ui_set_startup_ns(uint64_t ns);
+/* Rows up to max_id were committed by log-explorer-indexerd. Main windows
+ * whose results are older say so in their bottom bar. */
+void ui_rows_committed(long long max_id);
 void on_add_tag_clicked(GtkWidget *button, gpointer user_data);
 void on_remove_tag_clicked(GtkWidget *button, gpointer user_data);
 /* Apply bundled CSS for small visual improvements. Call early during startup. */
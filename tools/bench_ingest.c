@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "../src/db.h"
+#include "../src/indexer.h"
+#include "../src/ingest.h"
+#include "loggen.h"
+
+/* Ingest throughput benchmark. Generates a synthetic syslog or journal-JSON
+ * corpus, then feeds it through the same entry points the indexer threads
+ * use (indexer_ingest_file / indexer_ingest_journal_line) into a fresh
+ * database. Run from a scratch directory: the indexer keeps its .offsets/
+ * and .journal_cursor state in the working directory. */
+
+typedef enum { FMT_SYSLOG, FMT_JOURNAL } CorpusFormat;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double cpu_sec(const struct rusage *ru) {
+    return (double)ru->ru_utime.tv_sec + (double)ru->ru_utime.tv_usec / 1e6 +
+           (double)ru->ru_stime.tv_sec + (double)ru->ru_stime.tv_usec / 1e6;
+}
+
+static long long db_file_bytes(DB *db) {
+    sqlite3_stmt *stmt = NULL;
+    long long bytes = 0;
+    if (sqlite3_prepare_v2(db->db, "SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size();",
+                           -1, &stmt, NULL) != SQLITE_OK) return 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) bytes = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return bytes;
+}
+
+static int write_corpus(const char *path, CorpusFormat fmt, long rows, double skew, unsigned long seed,
+                        long long *out_bytes) {
+    FILE *f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    LogGen *g = loggen_new(seed, skew);
+    if (!g) { fclose(f); return -1; }
+    char line[2048];
+    long long bytes = 0;
+    for (long i = 0; i < rows; ++i) {
+        size_t n = fmt == FMT_SYSLOG ? loggen_syslog_line(g, line, sizeof(line))
+                                     : loggen_journal_line(g, line, sizeof(line));
+        fwrite(line, 1, n, f);
+        bytes += (long long)n;
+    }
+    loggen_free(g);
+    *out_bytes = bytes;
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static long ingest_journal_corpus(DB *db, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+    char *line = NULL;
+    size_t cap = 0;
+    long n = 0;
+    while (getline(&line, &cap, f) > 0) {
+        indexer_ingest_journal_line(db, line);
+        n++;
+    }
+    free(line);
+    fclose(f);
+    return n;
+}
+
+static void usage(FILE *out) {
+    fprintf(out,
+        "Usage: bench-ingest [options]\n"
+        "  -f, --format F    syslog (default) or journal\n"
+        "  -n, --rows N      corpus size in lines (default 100000)\n"
+        "  -k, --skew S      Zipf exponent of template popularity (default 1.1)\n"
+        "  -s, --seed N      generator seed (default 1)\n"
+        "  -d, --dir PATH    scratch directory (default: a new mkdtemp dir under /tmp)\n"
+        "  -j, --json        print one JSON object instead of a text report\n"
+        "                    (queue size and spill file: LOG_EXPLORER_INGEST_QUEUE, _SPILL_FILE)\n"
+        "      --keep        leave the scratch directory in place\n");
+}
+
+int main(int argc, char **argv) {
+    CorpusFormat fmt = FMT_SYSLOG;
+    long rows = 100000;
+    double skew = 1.1;
+    unsigned long seed = 1;
+    const char *dir = NULL;
+    int json = 0;
+    int keep = 0;
+
+    static const struct option long_opts[] = {
+        { "format", required_argument, NULL, 'f' },
+        { "rows", required_argument, NULL, 'n' },
+        { "skew", required_argument, NULL, 'k' },
+        { "seed", required_argument, NULL, 's' },
+        { "dir", required_argument, NULL, 'd' },
+        { "json", no_argument, NULL, 'j' },
+        { "keep", no_argument, NULL, 'K' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:n:k:s:d:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            if (strcmp(optarg, "syslog") == 0) fmt = FMT_SYSLOG;
+            else if (strcmp(optarg, "journal") == 0) fmt = FMT_JOURNAL;
+            else { fprintf(stderr, "unknown format: %s\n", optarg); return 2; }
+            break;
+        case 'n': rows = atol(optarg); break;
+        case 'k': skew = atof(optarg); break;
+        case 's': seed = strtoul(optarg, NULL, 10); break;
+        case 'd': dir = optarg; break;
+        case 'j': json = 1; break;
+        case 'K': keep = 1; break;
+        case 'h': usage(stdout); return 0;
+        default: usage(stderr); return 2;
+        }
+    }
+    if (rows <= 0) { usage(stderr); return 2; }
+
+    char tmpl[] = "/tmp/bench-ingest-XXXXXX";
+    if (!dir) {
+        dir = mkdtemp(tmpl);
+        if (!dir) { perror("mkdtemp"); return 1; }
+    } else {
+        mkdir(dir, 0700);
+    }
+    if (chdir(dir) != 0) { perror(dir); return 1; }
+    /* Start from clean indexer state so every line is ingested. */
+    unlink("bench.db");
+    unlink(".journal_cursor");
+    unlink(".offsets/corpus.log.offset");
+
+    long long corpus_bytes = 0;
+    const char *corpus = fmt == FMT_SYSLOG ? "corpus.log" : "corpus.json";
+    if (write_corpus(corpus, fmt, rows, skew, seed, &corpus_bytes) != 0) return 1;
+
+    DB db;
+    if (db_open(&db, "bench.db") != 0) return 1;
+
+    struct rusage ru0, ru1;
+    getrusage(RUSAGE_SELF, &ru0);
+    double t0 = now_sec();
+    if (ingest_start(&db) != 0) return 1;
+    if (fmt == FMT_SYSLOG) {
+        char path[4096];
+        if (!getcwd(path, sizeof(path) - 16)) { perror("getcwd"); return 1; }
+        strcat(path, "/corpus.log");
+        indexer_ingest_file(&db, path);
+    } else {
+        ingest_journal_corpus(&db, corpus);
+    }
+    /* Count time until the writer has stored (and replayed) everything. */
+    ingest_stop();
+    double wall = now_sec() - t0;
+    getrusage(RUSAGE_SELF, &ru1);
+
+    long long stored = 0;
+    DBSearchOpts all = {0};
+    db_count(&db, &all, &stored);
+    long long db_bytes = db_file_bytes(&db);
+    db_close(&db);
+
+    double cpu = cpu_sec(&ru1) - cpu_sec(&ru0);
+    double rows_per_sec = wall > 0 ? (double)stored / wall : 0;
+    double mb_per_sec = wall > 0 ? (double)corpus_bytes / (1024.0 * 1024.0) / wall : 0;
+    double bytes_per_row = stored > 0 ? (double)db_bytes / (double)stored : 0;
+    MetricsSnapshot snap;
+    metrics_snapshot(&snap);
+    long long spilled = (long long)snap.counters[METRIC_INGEST_SPILLED];
+    long peak_rss_kb = ru1.ru_maxrss;
+    const char *fmt_name = fmt == FMT_SYSLOG ? "syslog" : "journal";
+
+    if (json) {
+        printf("{\"bench\":\"ingest\",\"format\":\"%s\",\"rows\":%ld,\"stored\":%lld,\"skew\":%.2f,"
+               "\"seed\":%lu,\"corpus_bytes\":%lld,\"wall_sec\":%.3f,\"cpu_sec\":%.3f,"
+               "\"rows_per_sec\":%.0f,\"mb_per_sec\":%.2f,\"peak_rss_kb\":%ld,"
+               "\"db_bytes\":%lld,\"db_bytes_per_row\":%.1f,\"spilled_rows\":%lld}\n",
+               fmt_name, rows, stored, skew, seed, corpus_bytes, wall, cpu,
+               rows_per_sec, mb_per_sec, peak_rss_kb, db_bytes, bytes_per_row, spilled);
+    } else {
+        printf("ingest %s: %lld/%ld rows, %.1f MB corpus\n", fmt_name, stored, rows,
+               (double)corpus_bytes / (1024.0 * 1024.0));
+        printf("  wall        %.3f s\n", wall);
+        printf("  cpu         %.3f s\n", cpu);
+        printf("  rows/sec    %.0f\n", rows_per_sec);
+        printf("  MB/sec      %.2f\n", mb_per_sec);
+        printf("  peak RSS    %ld KiB\n", peak_rss_kb);
+        printf("  DB size     %lld bytes (%.1f bytes/row)\n", db_bytes, bytes_per_row);
+        printf("  spilled     %lld rows\n", spilled);
+    }
+
+    if (!keep) {
+        unlink(corpus);
+        unlink("bench.db");
+        unlink(".journal_cursor");
+        unlink(".offsets/corpus.log.offset");
+        rmdir(".offsets");
+        if (dir == tmpl && chdir("/") == 0) rmdir(tmpl);
+    }
+    return stored == rows ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../src/db.h"
+#include "loggen.h"
+
+/* Search latency benchmark. Builds a fixture database of synthetic logs
+ * (cached under the fixture directory and reused on later runs), then runs
+ * a fixed mix of query shapes through db_search_ex (and count estimates
+ * through db_count_estimate) and reports latency percentiles plus the
+ * statement's scan counters. Each mix runs on an idle database and again
+ * while a writer thread inserts via db_insert_log, the way the indexer
+ * competes with the UI. */
+
+typedef enum { SHAPE_SEARCH, SHAPE_TAGS, SHAPE_ESTIMATE } ShapeKind;
+
+typedef struct {
+    const char *name;
+    ShapeKind kind;
+    const char *query;
+    int limit;
+    int offset;
+    const char *tag;
+    const char *unit;
+} QueryShape;
+
+static const QueryShape shapes[] = {
+    { "recent",         SHAPE_SEARCH, NULL, 100, 0, NULL, NULL },
+    { "recent-deep",    SHAPE_SEARCH, NULL, 100, 10000, NULL, NULL },
+    { "term-common",    SHAPE_SEARCH, "session", 100, 0, NULL, NULL },
+    { "term-rare",      SHAPE_SEARCH, "keyring", 100, 0, NULL, NULL },
+    { "term-absent",    SHAPE_SEARCH, "xyzzy", 100, 0, NULL, NULL },
+    { "multi-term",     SHAPE_SEARCH, "failed password invalid", 100, 0, NULL, NULL },
+    { "phrase",         SHAPE_SEARCH, "\"segfault at\"", 100, 0, NULL, NULL },
+    { "term-deep",      SHAPE_SEARCH, "session", 100, 5000, NULL, NULL },
+    { "tag-lookup",     SHAPE_TAGS, NULL, 0, 0, NULL, NULL },
+    { "tag-filter",     SHAPE_SEARCH, NULL, 100, 0, "bench-a", NULL },
+    { "tag-term",       SHAPE_SEARCH, "session", 100, 0, "bench-a", NULL },
+    { "unit-recent",    SHAPE_SEARCH, NULL, 100, 0, NULL, "cron.service" },
+    { "estimate-all",   SHAPE_ESTIMATE, NULL, 0, 0, NULL, NULL },
+    { "estimate-term",  SHAPE_ESTIMATE, "session", 0, 0, NULL, NULL },
+    { "estimate-unit",  SHAPE_ESTIMATE, NULL, 0, 0, NULL, "cron.service" },
+};
+
+#define N_SHAPES (sizeof(shapes) / sizeof(shapes[0]))
+
+// Fraction of fixture rows that carry a tag, so tag lookups hit both tagged and untagged rows.
+#define TAG_EVERY 50
+
+typedef struct {
+    double *lat_ms;
+    long long fullscan_steps;
+    long long sorts;
+    long long vm_steps;
+    long long rows;
+} ShapeResult;
+
+typedef struct {
+    DB *db;
+    volatile int stop;
+    long long inserted;
+} LoadCtx;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    if (n <= 0) return 0;
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+static long long fixture_rows(DB *db) {
+    sqlite3_stmt *stmt = NULL;
+    long long n = -1;
+    if (sqlite3_prepare_v2(db->db, "SELECT rows FROM bench_meta LIMIT 1;", -1, &stmt, NULL) != SQLITE_OK) return -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) n = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+/* Bulk-load the fixture directly through the connection in large
+ * transactions; going through db_insert_log row by row would take hours at
+ * the 10M/50M sizes. The schema (and its FTS trigger) is the real one. */
+static int build_fixture(DB *db, long long rows, double skew) {
+    fprintf(stderr, "building fixture with %lld rows...\n", rows);
+    double t0 = now_ms();
+    sqlite3_exec(db->db, "PRAGMA synchronous=OFF; PRAGMA journal_mode=MEMORY;", NULL, NULL, NULL);
+    sqlite3_stmt *ins = NULL;
+    if (sqlite3_prepare_v2(db->db, "INSERT INTO logs(source_id, unit_id, ts, message) VALUES(?, ?, ?, ?);",
+                           -1, &ins, NULL) != SQLITE_OK) return -1;
+    /* Intern source and unit names the way db_insert_logs does. */
+    sqlite3_stmt *unit_ins = NULL;
+    if (sqlite3_prepare_v2(db->db, "INSERT INTO units(name) VALUES(?);", -1, &unit_ins, NULL) != SQLITE_OK) return -1;
+    sqlite3_exec(db->db, "INSERT OR IGNORE INTO sources(name) VALUES('journal');", NULL, NULL, NULL);
+    long long source_id = 0;
+    sqlite3_stmt *q = NULL;
+    if (sqlite3_prepare_v2(db->db, "SELECT id FROM sources WHERE name = 'journal';", -1, &q, NULL) == SQLITE_OK &&
+        sqlite3_step(q) == SQLITE_ROW)
+        source_id = sqlite3_column_int64(q, 0);
+    sqlite3_finalize(q);
+    StrMap *unit_ids = strmap_new();
+    LogGen *g = loggen_new(42, skew);
+    char msg[512];
+    char ts[40];
+    const char *unit;
+    sqlite3_exec(db->db, "BEGIN;", NULL, NULL, NULL);
+    for (long long i = 1; i <= rows; ++i) {
+        size_t len = loggen_message(g, msg, sizeof(msg), &unit, NULL);
+        loggen_iso_timestamp(g, ts, sizeof(ts));
+        int64_t unit_id;
+        if (!strmap_get(unit_ids, unit, &unit_id)) {
+            sqlite3_bind_text(unit_ins, 1, unit, -1, SQLITE_STATIC);
+            sqlite3_step(unit_ins);
+            sqlite3_reset(unit_ins);
+            unit_id = sqlite3_last_insert_rowid(db->db);
+            strmap_put(unit_ids, unit, unit_id);
+        }
+        sqlite3_bind_int64(ins, 1, source_id);
+        sqlite3_bind_int64(ins, 2, unit_id);
+        sqlite3_bind_text(ins, 3, ts, -1, SQLITE_STATIC);
+        sqlite3_bind_text(ins, 4, msg, (int)len, SQLITE_STATIC);
+        if (sqlite3_step(ins) != SQLITE_DONE) {
+            fprintf(stderr, "fixture insert failed: %s\n", sqlite3_errmsg(db->db));
+            sqlite3_finalize(ins);
+            sqlite3_finalize(unit_ins);
+            strmap_free(unit_ids);
+            loggen_free(g);
+            return -1;
+        }
+        sqlite3_reset(ins);
+        if (i % 200000 == 0) {
+            sqlite3_exec(db->db, "COMMIT; BEGIN;", NULL, NULL, NULL);
+            fprintf(stderr, "  %lld rows (%.0f s)\n", i, (now_ms() - t0) / 1e3);
+        }
+    }
+    sqlite3_finalize(ins);
+    sqlite3_finalize(unit_ins);
+    strmap_free(unit_ids);
+    loggen_free(g);
+    char sql[512];
+    snprintf(sql, sizeof(sql),
+             "INSERT OR IGNORE INTO tags(name) VALUES('bench-a'), ('bench-b');"
+             "INSERT OR IGNORE INTO log_tags(log_id, tag_id) SELECT id, (SELECT id FROM tags WHERE name="
+             "CASE WHEN id %% 2 THEN 'bench-a' ELSE 'bench-b' END) FROM logs WHERE id %% %d = 0;"
+             "CREATE TABLE IF NOT EXISTS bench_meta(rows INTEGER);"
+             "DELETE FROM bench_meta; INSERT INTO bench_meta(rows) VALUES(%lld);"
+             "COMMIT;",
+             TAG_EVERY, rows);
+    char *err = NULL;
+    if (sqlite3_exec(db->db, sql, NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "fixture finish failed: %s\n", err);
+        sqlite3_free(err);
+        return -1;
+    }
+    sqlite3_exec(db->db, "PRAGMA synchronous=FULL; PRAGMA journal_mode=DELETE;", NULL, NULL, NULL);
+    fprintf(stderr, "fixture ready in %.0f s\n", (now_ms() - t0) / 1e3);
+    return 0;
+}
+
+static void *load_thread(void *arg) {
+    LoadCtx *ctx = arg;
+    LogGen *g = loggen_new(7, 1.1);
+    char msg[512];
+    char ts[40];
+    const char *unit;
+    while (!ctx->stop) {
+        loggen_message(g, msg, sizeof(msg), &unit, NULL);
+        loggen_iso_timestamp(g, ts, sizeof(ts));
+        if (db_insert_log(ctx->db, "bench-load", unit, msg, ts) == 0) ctx->inserted++;
+    }
+    loggen_free(g);
+    return NULL;
+}
+
+static void run_shape(DB *db, const QueryShape *q, int iters, long long max_id, ShapeResult *r) {
+    memset(r, 0, sizeof(*r));
+    r->lat_ms = calloc((size_t)iters, sizeof(double));
+    unsigned long long rnd = 12345;
+    for (int it = 0; it < iters; ++it) {
+        double t0 = now_ms();
+        if (q->kind == SHAPE_TAGS) {
+            rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+            int id = (int)((rnd >> 33) % (unsigned long long)(max_id > 0 ? max_id : 1)) + 1;
+            char **tags = db_list_tags(db, id);
+            for (size_t i = 0; tags && tags[i]; ++i) r->rows++;
+            db_free_string_array(tags);
+            r->lat_ms[it] = now_ms() - t0;
+            continue;
+        }
+        DBSearchOpts opts = {0};
+        opts.query = q->query;
+        opts.limit = q->limit;
+        opts.offset = q->offset;
+        opts.tag = q->tag;
+        opts.unit = q->unit;
+        if (q->kind == SHAPE_ESTIMATE) {
+            long long n = 0;
+            if (db_count_estimate(db, &opts, &n, NULL) != 0) fprintf(stderr, "%s: estimate failed\n", q->name);
+            r->rows += n;
+            r->lat_ms[it] = now_ms() - t0;
+            continue;
+        }
+        sqlite3_stmt *stmt = NULL;
+        if (db_search_ex(db, &opts, &stmt) != 0) {
+            fprintf(stderr, "%s: search failed: %s\n", q->name, sqlite3_errmsg(db->db));
+            r->lat_ms[it] = 0;
+            continue;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            (void)sqlite3_column_text(stmt, 4);
+            r->rows++;
+        }
+        r->lat_ms[it] = now_ms() - t0;
+        r->fullscan_steps += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+        r->sorts += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+        r->vm_steps += sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+        sqlite3_finalize(stmt);
+    }
+    qsort(r->lat_ms, (size_t)iters, sizeof(double), cmp_double);
+}
+
+static void report(const char *phase, const QueryShape *q, const ShapeResult *r, int iters,
+                   long long fixture, int json) {
+    double p50 = percentile(r->lat_ms, iters, 0.50);
+    double p95 = percentile(r->lat_ms, iters, 0.95);
+    double p99 = percentile(r->lat_ms, iters, 0.99);
+    if (json) {
+        printf("{\"bench\":\"search\",\"fixture_rows\":%lld,\"phase\":\"%s\",\"shape\":\"%s\",\"iters\":%d,"
+               "\"p50_ms\":%.3f,\"p95_ms\":%.3f,\"p99_ms\":%.3f,\"rows_per_iter\":%.1f,"
+               "\"fullscan_steps_per_iter\":%.0f,\"sorts_per_iter\":%.1f,\"vm_steps_per_iter\":%.0f}\n",
+               fixture, phase, q->name, iters, p50, p95, p99, (double)r->rows / iters,
+               (double)r->fullscan_steps / iters, (double)r->sorts / iters, (double)r->vm_steps / iters);
+    } else {
+        printf("%-5s %-14s p50 %9.3f  p95 %9.3f  p99 %9.3f ms  rows %6.1f  scan %10.0f  vm %12.0f\n",
+               phase, q->name, p50, p95, p99, (double)r->rows / iters,
+               (double)r->fullscan_steps / iters, (double)r->vm_steps / iters);
+    }
+    fflush(stdout);
+}
+
+static void run_mix(DB *db, const char *phase, int iters, long long fixture, int json) {
+    long long max_id = 0;
+    db_max_id(db, &max_id);
+    for (size_t i = 0; i < N_SHAPES; ++i) {
+        ShapeResult r;
+        run_shape(db, &shapes[i], iters, max_id, &r);
+        report(phase, &shapes[i], &r, iters, fixture, json);
+        free(r.lat_ms);
+    }
+}
+
+static void usage(FILE *out) {
+    fprintf(out,
+        "Usage: bench-search [options]\n"
+        "  -n, --rows N          fixture size (default 1000000; e.g. 10000000, 50000000)\n"
+        "  -F, --fixture-dir D   where fixtures are cached (default ./bench-fixtures)\n"
+        "  -i, --iters N         iterations per query shape (default 50)\n"
+        "  -k, --skew S          template skew for a newly built fixture (default 1.1)\n"
+        "      --no-load         skip the run with concurrent ingest\n"
+        "  -j, --json            one JSON object per shape and phase\n");
+}
+
+int main(int argc, char **argv) {
+    long long rows = 1000000;
+    const char *fixture_dir = "bench-fixtures";
+    int iters = 50;
+    double skew = 1.1;
+    int with_load = 1;
+    int json = 0;
+
+    static const struct option long_opts[] = {
+        { "rows", required_argument, NULL, 'n' },
+        { "fixture-dir", required_argument, NULL, 'F' },
+        { "iters", required_argument, NULL, 'i' },
+        { "skew", required_argument, NULL, 'k' },
+        { "no-load", no_argument, NULL, 'L' },
+        { "json", no_argument, NULL, 'j' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:F:i:k:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n': rows = atoll(optarg); break;
+        case 'F': fixture_dir = optarg; break;
+        case 'i': iters = atoi(optarg); break;
+        case 'k': skew = atof(optarg); break;
+        case 'L': with_load = 0; break;
+        case 'j': json = 1; break;
+        case 'h': usage(stdout); return 0;
+        default: usage(stderr); return 2;
+        }
+    }
+    if (rows <= 0 || iters <= 0) { usage(stderr); return 2; }
+
+    mkdir(fixture_dir, 0755);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/search-%lld.db", fixture_dir, rows);
+    char work[4096];
+    snprintf(work, sizeof(work), "%s/search-%lld.work.db", fixture_dir, rows);
+
+    /* Build the fixture once; later runs reuse it if bench_meta says it is complete. */
+    DB db;
+    if (db_open(&db, path) != 0) return 1;
+    if (fixture_rows(&db) != rows) {
+        db_close(&db);
+        unlink(path);
+        if (db_open(&db, path) != 0) return 1;
+        if (build_fixture(&db, rows, skew) != 0) { db_close(&db); return 1; }
+    }
+    db_close(&db);
+
+    /* The load phase writes into the database, so run against a copy and
+     * keep the cached fixture pristine. */
+    char cmd[8400];
+    snprintf(cmd, sizeof(cmd), "cp '%s' '%s'", path, work);
+    if (system(cmd) != 0) { fprintf(stderr, "cannot copy fixture to %s\n", work); return 1; }
+    if (db_open(&db, work) != 0) return 1;
+
+    run_mix(&db, "idle", iters, rows, json);
+
+    if (with_load) {
+        LoadCtx ctx = { &db, 0, 0 };
+        pthread_t th;
+        if (pthread_create(&th, NULL, load_thread, &ctx) == 0) {
+            double t0 = now_ms();
+            run_mix(&db, "load", iters, rows, json);
+            ctx.stop = 1;
+            pthread_join(th, NULL);
+            double secs = (now_ms() - t0) / 1e3;
+            if (json)
+                printf("{\"bench\":\"search\",\"fixture_rows\":%lld,\"phase\":\"load\",\"shape\":\"ingest\","
+                       "\"inserted\":%lld,\"rows_per_sec\":%.0f}\n", rows, ctx.inserted,
+                       secs > 0 ? (double)ctx.inserted / secs : 0);
+            else
+                printf("load  concurrent ingest: %lld rows (%.0f rows/sec)\n", ctx.inserted,
+                       secs > 0 ? (double)ctx.inserted / secs : 0);
+        }
+    }
+
+    db_close(&db);
+    unlink(work);
+    return 0;
+}
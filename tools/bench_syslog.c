@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "../src/db.h"
+#include "../src/ingest.h"
+#include "../src/syslog.h"
+#include "loggen.h"
+
+/* Syslog receiver throughput on localhost. Sender threads replay a
+ * pre-generated RFC3164 or RFC5424 corpus over UDP (sendmmsg) or TCP
+ * (octet-counted frames) to a receiver running in this process, which
+ * hands the rows to the ingest writer of a scratch database. The report is
+ * the receive rate and UDP loss; with --drain it also waits until the
+ * writer has stored every row. With --target the tool is only a load
+ * generator, e.g. for a running log-explorer-cli --syslog-udp. */
+
+typedef enum { P_UDP, P_TCP } Proto;
+typedef enum { F_RFC3164, F_RFC5424 } MsgFormat;
+
+typedef struct {
+    const char *corpus;
+    const size_t *offs;   // offs[i]..offs[i+1] is message i
+    long first, last;
+    Proto proto;
+    struct addrinfo *addr;
+    double rate;          // messages per second for this sender, 0 = unlimited
+    long sent;
+    int failed;
+} Sender;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void sleep_sec(double s) {
+    struct timespec ts = { (time_t)s, (long)((s - (double)(time_t)s) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+// Mostly info, with the occasional more urgent severity; facility user(1).
+static int pri_for(long i) {
+    static const int sev[] = { 6, 6, 6, 6, 6, 5, 6, 4, 6, 3, 6, 7, 6, 6, 2, 6 };
+    return 8 + sev[i % 16];
+}
+
+static size_t make_message(LogGen *g, MsgFormat fmt, long i, char *buf, size_t n) {
+    int len;
+    if (fmt == F_RFC3164) {
+        char line[1024];
+        size_t ln = loggen_syslog_line(g, line, sizeof(line));
+        if (ln > 0 && line[ln - 1] == '\n') ln--;
+        len = snprintf(buf, n, "<%d>%.*s", pri_for(i), (int)ln, line);
+    } else {
+        char msg[512], iso[64];
+        const char *unit;
+        unsigned pid;
+        loggen_message(g, msg, sizeof(msg), &unit, &pid);
+        loggen_iso_timestamp(g, iso, sizeof(iso));
+        len = snprintf(buf, n, "<%d>1 %s host%02ld %.*s %u - - %s", pri_for(i), iso, i % 16,
+                       (int)strcspn(unit, "."), unit, pid, msg);
+    }
+    return len < 0 ? 0 : ((size_t)len < n ? (size_t)len : n - 1);
+}
+
+static void pace(const Sender *s, long sent, double t0) {
+    if (s->rate <= 0) return;
+    double ahead = (double)sent / s->rate - (now_sec() - t0);
+    if (ahead > 0.0005) sleep_sec(ahead);
+}
+
+static void *udp_sender(void *arg) {
+    Sender *s = arg;
+    int fd = socket(s->addr->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, s->addr->ai_addr, s->addr->ai_addrlen) != 0) {
+        perror("udp sender");
+        s->failed = 1;
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    struct mmsghdr msgs[64];
+    struct iovec iov[64];
+    double t0 = now_sec();
+    for (long i = s->first; i < s->last;) {
+        int n = 0;
+        for (; n < 64 && i + n < s->last; ++n) {
+            iov[n].iov_base = (void *)(s->corpus + s->offs[i + n]);
+            iov[n].iov_len = s->offs[i + n + 1] - s->offs[i + n];
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(fd, msgs, (unsigned)n, 0);
+        if (sent < 0) {
+            if (errno == EINTR || errno == ENOBUFS || errno == ECONNREFUSED) continue;
+            perror("sendmmsg");
+            s->failed = 1;
+            break;
+        }
+        i += sent;
+        s->sent += sent;
+        pace(s, s->sent, t0);
+    }
+    close(fd);
+    return NULL;
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void *tcp_sender(void *arg) {
+    Sender *s = arg;
+    int fd = socket(s->addr->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, s->addr->ai_addr, s->addr->ai_addrlen) != 0) {
+        perror("tcp sender");
+        s->failed = 1;
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    // Frames are "LEN SP MSG" (RFC 6587 octet counting), written 64 KiB at a time.
+    size_t cap = 64 * 1024, len = 0;
+    char *out = malloc(cap + 16 * 1024);
+    double t0 = now_sec();
+    for (long i = s->first; out && i < s->last; ++i) {
+        size_t n = s->offs[i + 1] - s->offs[i];
+        len += (size_t)sprintf(out + len, "%zu ", n);
+        memcpy(out + len, s->corpus + s->offs[i], n);
+        len += n;
+        if (len >= cap || i + 1 == s->last) {
+            if (write_all(fd, out, len) != 0) {
+                perror("tcp sender");
+                s->failed = 1;
+                break;
+            }
+            len = 0;
+            s->sent = i + 1 - s->first;
+            pace(s, s->sent, t0);
+        }
+    }
+    free(out);
+    close(fd);
+    return NULL;
+}
+
+static void usage(FILE *out) {
+    fprintf(out,
+        "Usage: bench-syslog [options]\n"
+        "  -p, --proto P     udp (default) or tcp\n"
+        "  -f, --format F    rfc3164 (default) or rfc5424\n"
+        "  -n, --rows N      messages to send (default 500000)\n"
+        "  -c, --senders N   sender threads (default 2)\n"
+        "  -r, --rate N      total messages per second, 0 = as fast as possible (default)\n"
+        "  -P, --port N      receiver port on 127.0.0.1 (default 15514)\n"
+        "  -t, --target HOST:PORT  only send, to an already running receiver\n"
+        "  -D, --drain       also wait until the writer has stored every received row\n"
+        "  -d, --dir PATH    scratch directory (default: a new mkdtemp dir under /tmp)\n"
+        "  -s, --seed N      generator seed (default 1)\n"
+        "  -j, --json        print one JSON object instead of a text report\n");
+}
+
+int main(int argc, char **argv) {
+    Proto proto = P_UDP;
+    MsgFormat fmt = F_RFC3164;
+    long rows = 500000;
+    int senders = 2;
+    double rate = 0;
+    int port = 15514;
+    const char *target = NULL;
+    int drain = 0;
+    const char *dir = NULL;
+    unsigned long seed = 1;
+    int json = 0;
+
+    static const struct option long_opts[] = {
+        { "proto", required_argument, NULL, 'p' },
+        { "format", required_argument, NULL, 'f' },
+        { "rows", required_argument, NULL, 'n' },
+        { "senders", required_argument, NULL, 'c' },
+        { "rate", required_argument, NULL, 'r' },
+        { "port", required_argument, NULL, 'P' },
+        { "target", required_argument, NULL, 't' },
+        { "drain", no_argument, NULL, 'D' },
+        { "dir", required_argument, NULL, 'd' },
+        { "seed", required_argument, NULL, 's' },
+        { "json", no_argument, NULL, 'j' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:f:n:c:r:P:t:Dd:s:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            if (strcmp(optarg, "udp") == 0) proto = P_UDP;
+            else if (strcmp(optarg, "tcp") == 0) proto = P_TCP;
+            else { fprintf(stderr, "unknown protocol: %s\n", optarg); return 2; }
+            break;
+        case 'f':
+            if (strcmp(optarg, "rfc3164") == 0) fmt = F_RFC3164;
+            else if (strcmp(optarg, "rfc5424") == 0) fmt = F_RFC5424;
+            else { fprintf(stderr, "unknown format: %s\n", optarg); return 2; }
+            break;
+        case 'n': rows = atol(optarg); break;
+        case 'c': senders = atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'P': port = atoi(optarg); break;
+        case 't': target = optarg; break;
+        case 'D': drain = 1; break;
+        case 'd': dir = optarg; break;
+        case 's': seed = strtoul(optarg, NULL, 10); break;
+        case 'j': json = 1; break;
+        case 'h': usage(stdout); return 0;
+        default: usage(stderr); return 2;
+        }
+    }
+    if (rows <= 0 || senders <= 0 || senders > 64) { usage(stderr); return 2; }
+
+    // Corpus: all messages back to back, so the timed loop only sends.
+    size_t cap = (size_t)rows * 160, len = 0;
+    char *corpus = malloc(cap);
+    size_t *offs = malloc(sizeof(size_t) * (size_t)(rows + 1));
+    LogGen *g = loggen_new(seed, 1.1);
+    if (!corpus || !offs || !g) { fprintf(stderr, "out of memory\n"); return 1; }
+    char msg[1024];
+    for (long i = 0; i < rows; ++i) {
+        size_t n = make_message(g, fmt, i, msg, sizeof(msg));
+        if (len + n > cap) {
+            cap *= 2;
+            char *p = realloc(corpus, cap);
+            if (!p) { fprintf(stderr, "out of memory\n"); return 1; }
+            corpus = p;
+        }
+        offs[i] = len;
+        memcpy(corpus + len, msg, n);
+        len += n;
+    }
+    offs[rows] = len;
+    loggen_free(g);
+
+    char host[256] = "127.0.0.1", portstr[16];
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    if (target) {
+        const char *colon = strrchr(target, ':');
+        if (!colon) { fprintf(stderr, "--target wants HOST:PORT\n"); return 2; }
+        snprintf(host, sizeof(host), "%.*s", (int)(colon - target), target);
+        snprintf(portstr, sizeof(portstr), "%s", colon + 1);
+    }
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = proto == P_UDP ? SOCK_DGRAM : SOCK_STREAM };
+    struct addrinfo *addr = NULL;
+    int rc = getaddrinfo(host, portstr, &hints, &addr);
+    if (rc != 0) { fprintf(stderr, "%s: %s\n", host, gai_strerror(rc)); return 1; }
+
+    DB db;
+    char tmpl[] = "/tmp/bench-syslog-XXXXXX";
+    if (!target) {
+        if (!dir) {
+            dir = mkdtemp(tmpl);
+            if (!dir) { perror("mkdtemp"); return 1; }
+        } else {
+            mkdir(dir, 0700);
+        }
+        // The spill file is created in the working directory.
+        if (chdir(dir) != 0) { perror(dir); return 1; }
+        unlink("bench.db");
+        unlink(".ingest_spill");
+        /* Without --drain the writer is abandoned at exit, still inserting;
+         * an in-memory database leaves nothing behind in the scratch dir. */
+        if (db_open(&db, drain ? "bench.db" : ":memory:") != 0) { fprintf(stderr, "cannot open the database\n"); return 1; }
+        if (ingest_start(&db) != 0) return 1;
+        char listen[64];
+        snprintf(listen, sizeof(listen), "127.0.0.1:%d", port);
+        if (syslog_start(proto == P_UDP ? listen : NULL, proto == P_TCP ? listen : NULL) != 0) return 1;
+    }
+
+    Sender s[64];
+    pthread_t th[64];
+    double t0 = now_sec();
+    for (int i = 0; i < senders; ++i) {
+        s[i] = (Sender){
+            .corpus = corpus, .offs = offs, .proto = proto, .addr = addr,
+            .first = rows * i / senders, .last = rows * (i + 1) / senders,
+            .rate = rate / senders,
+        };
+        pthread_create(&th[i], NULL, proto == P_UDP ? udp_sender : tcp_sender, &s[i]);
+    }
+    long sent = 0;
+    int failed = 0;
+    for (int i = 0; i < senders; ++i) {
+        pthread_join(th[i], NULL);
+        sent += s[i].sent;
+        failed |= s[i].failed;
+    }
+    double send_wall = now_sec() - t0;
+    freeaddrinfo(addr);
+
+    // Received: wait for the receiver to catch up, or until it stops making progress (UDP loss).
+    SyslogStats st = {0};
+    double recv_wall = send_wall;
+    if (!target) {
+        uint64_t last = 0;
+        double idle_since = now_sec();
+        for (;;) {
+            syslog_get_stats(&st);
+            uint64_t got = st.udp_messages + st.tcp_messages;
+            double now = now_sec();
+            if (got != last) {
+                last = got;
+                idle_since = now;
+                recv_wall = now - t0;
+            }
+            if (got >= (uint64_t)sent || now - idle_since > 1.0) break;
+            sleep_sec(0.001);
+        }
+        syslog_stop();
+    }
+    uint64_t received = st.udp_messages + st.tcp_messages;
+    long long lost = target ? 0 : (long long)sent - (long long)received;
+
+    double drain_wall = 0;
+    long long stored = 0, spilled = 0;
+    if (!target) {
+        IngestStats is;
+        ingest_get_stats(&is);
+        spilled = is.spilled_total;
+        if (drain) {
+            ingest_stop();
+            drain_wall = now_sec() - t0;
+            DBSearchOpts all = {0};
+            db_count(&db, &all, &stored);
+            db_close(&db);
+        }
+        unlink(".ingest_spill");
+        unlink("bench.db");
+        if (dir == tmpl && chdir("/") == 0) rmdir(tmpl);
+    }
+
+    const char *proto_name = proto == P_UDP ? "udp" : "tcp";
+    const char *fmt_name = fmt == F_RFC3164 ? "rfc3164" : "rfc5424";
+    double send_rate = send_wall > 0 ? (double)sent / send_wall : 0;
+    double recv_rate = recv_wall > 0 ? (double)received / recv_wall : 0;
+    double loss = sent > 0 ? 100.0 * (double)lost / (double)sent : 0;
+    if (json) {
+        printf("{\"bench\":\"syslog\",\"proto\":\"%s\",\"format\":\"%s\",\"rows\":%ld,\"senders\":%d,"
+               "\"sent\":%ld,\"received\":%llu,\"lost\":%lld,\"loss_pct\":%.2f,\"kernel_dropped\":%llu,"
+               "\"send_msgs_per_sec\":%.0f,\"recv_msgs_per_sec\":%.0f,\"spilled_rows\":%lld",
+               proto_name, fmt_name, rows, senders, sent, (unsigned long long)received, lost, loss,
+               (unsigned long long)st.udp_dropped, send_rate, recv_rate, spilled);
+        if (drain)
+            printf(",\"stored\":%lld,\"drain_sec\":%.3f,\"stored_rows_per_sec\":%.0f", stored, drain_wall,
+                   drain_wall > 0 ? (double)stored / drain_wall : 0);
+        printf("}\n");
+    } else {
+        printf("syslog %s %s: %ld messages from %d sender%s\n", proto_name, fmt_name, sent, senders,
+               senders == 1 ? "" : "s");
+        printf("  sent        %.0f msgs/sec (%.3f s)\n", send_rate, send_wall);
+        if (!target) {
+            printf("  received    %llu, %.0f msgs/sec (%.3f s)\n", (unsigned long long)received, recv_rate,
+                   recv_wall);
+            printf("  lost        %lld (%.2f%%, %llu dropped by the kernel)\n", lost, loss,
+                   (unsigned long long)st.udp_dropped);
+            printf("  spilled     %lld rows\n", spilled);
+        }
+        if (drain)
+            printf("  stored      %lld rows after %.3f s (%.0f rows/sec)\n", stored, drain_wall,
+                   drain_wall > 0 ? (double)stored / drain_wall : 0);
+    }
+    free(corpus);
+    free(offs);
+    if (failed) return 1;
+    if (target) return 0;
+    return drain ? stored == (long long)received ? 0 : 1 : (proto == P_TCP && lost != 0);
+}
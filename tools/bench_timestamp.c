@@ -0,0 +1,160 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "../src/timestamp.h"
+#include "loggen.h"
+
+/* Timestamp parsing throughput. Builds an in-memory corpus of lines in one
+ * of the recognised formats and runs it through ts_parse on a single
+ * thread; "--format baseline" parses the RFC3164 corpus with
+ * strptime + mktime per line for comparison. */
+
+typedef enum { F_RFC3164, F_ISO, F_DPKG, F_APACHE, F_KERNEL, F_BASELINE } BenchFormat;
+
+static const char *const format_names[] = { "rfc3164", "iso8601", "dpkg", "apache", "kernel", "baseline" };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t make_line(LogGen *g, BenchFormat fmt, long i, char *buf, size_t n) {
+    static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    char iso[64];
+    size_t len = 0;
+    switch (fmt) {
+    case F_RFC3164:
+    case F_BASELINE:
+        return loggen_syslog_line(g, buf, n);
+    case F_ISO:
+        len = loggen_iso_timestamp(g, iso, sizeof(iso));
+        return (size_t)snprintf(buf, n, "%.*s host sshd[42]: session opened\n", (int)len, iso);
+    case F_DPKG:
+        loggen_iso_timestamp(g, iso, sizeof(iso));
+        return (size_t)snprintf(buf, n, "%.10s %.8s status installed libfoo:amd64 1.2-%ld\n", iso, iso + 11, i % 10);
+    case F_APACHE:
+        loggen_iso_timestamp(g, iso, sizeof(iso));
+        return (size_t)snprintf(buf, n, "10.0.0.%ld - - [%.2s/%s/%.4s:%.8s +0000] \"GET / HTTP/1.1\" 200 512\n",
+                                i % 250, iso + 8, months[atoi(iso + 5) - 1], iso, iso + 11);
+    case F_KERNEL:
+        return (size_t)snprintf(buf, n, "[%5ld.%06ld] usb 1-1: new high-speed USB device\n", i / 1000, (i % 1000) * 997);
+    }
+    return 0;
+}
+
+static int parse_baseline(const char *line, char out[TS_BUF]) {
+    struct tm tm = {0};
+    time_t now = time(NULL);
+    struct tm ref;
+    localtime_r(&now, &ref);
+    if (!strptime(line, "%b %d %H:%M:%S", &tm)) { out[0] = '\0'; return 0; }
+    tm.tm_year = ref.tm_year;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    ts_format_us((int64_t)t * 1000000, out);
+    return 1;
+}
+
+static void usage(FILE *out) {
+    fprintf(out,
+        "Usage: bench-timestamp [options]\n"
+        "  -f, --format F    rfc3164 (default), iso8601, dpkg, apache, kernel, or baseline\n"
+        "                    (RFC3164 lines through strptime + mktime)\n"
+        "  -n, --rows N      corpus size in lines (default 2000000)\n"
+        "  -s, --seed N      generator seed (default 1)\n"
+        "  -j, --json        print one JSON object instead of a text report\n");
+}
+
+int main(int argc, char **argv) {
+    BenchFormat fmt = F_RFC3164;
+    long rows = 2000000;
+    unsigned long seed = 1;
+    int json = 0;
+
+    static const struct option long_opts[] = {
+        { "format", required_argument, NULL, 'f' },
+        { "rows", required_argument, NULL, 'n' },
+        { "seed", required_argument, NULL, 's' },
+        { "json", no_argument, NULL, 'j' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:n:s:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f': {
+            int found = 0;
+            for (int i = 0; i <= F_BASELINE; ++i)
+                if (strcmp(optarg, format_names[i]) == 0) { fmt = (BenchFormat)i; found = 1; }
+            if (!found) { fprintf(stderr, "unknown format: %s\n", optarg); return 2; }
+            break;
+        }
+        case 'n': rows = atol(optarg); break;
+        case 's': seed = strtoul(optarg, NULL, 10); break;
+        case 'j': json = 1; break;
+        case 'h': usage(stdout); return 0;
+        default: usage(stderr); return 2;
+        }
+    }
+    if (rows <= 0) { usage(stderr); return 2; }
+
+    // One buffer of NUL-separated lines, so the timed loop only parses.
+    size_t cap = (size_t)rows * 128, len = 0;
+    char *corpus = malloc(cap);
+    size_t *offs = malloc(sizeof(size_t) * (size_t)rows);
+    LogGen *g = loggen_new(seed, 1.1);
+    if (!corpus || !offs || !g) { fprintf(stderr, "out of memory\n"); return 1; }
+    char line[1024];
+    for (long i = 0; i < rows; ++i) {
+        size_t n = make_line(g, fmt, i, line, sizeof(line));
+        if (len + n + 1 > cap) {
+            cap *= 2;
+            char *p = realloc(corpus, cap);
+            if (!p) { fprintf(stderr, "out of memory\n"); return 1; }
+            corpus = p;
+        }
+        offs[i] = len;
+        memcpy(corpus + len, line, n);
+        len += n;
+        corpus[len++] = '\0';
+    }
+    loggen_free(g);
+
+    TsParser *p = ts_parser_new(0);
+    char out[TS_BUF], first[TS_BUF] = "";
+    long parsed = 0;
+    double t0 = now_sec();
+    for (long i = 0; i < rows; ++i) {
+        const char *s = corpus + offs[i];
+        size_t n = (i + 1 < rows ? offs[i + 1] : len) - offs[i] - 1;
+        parsed += fmt == F_BASELINE ? parse_baseline(s, out) : ts_parse(p, s, n, out);
+        if (i == 0) memcpy(first, out, sizeof(out));
+    }
+    double wall = now_sec() - t0;
+    double lines_per_sec = wall > 0 ? (double)rows / wall : 0;
+    double mb_per_sec = wall > 0 ? (double)len / (1024.0 * 1024.0) / wall : 0;
+    const char *detected = fmt == F_BASELINE ? "strptime" : ts_parser_format(p);
+
+    if (json) {
+        printf("{\"bench\":\"timestamp\",\"format\":\"%s\",\"detected\":\"%s\",\"rows\":%ld,\"parsed\":%ld,"
+               "\"wall_sec\":%.3f,\"lines_per_sec\":%.0f,\"ns_per_line\":%.1f,\"mb_per_sec\":%.1f}\n",
+               format_names[fmt], detected, rows, parsed, wall, lines_per_sec,
+               rows > 0 ? wall * 1e9 / (double)rows : 0, mb_per_sec);
+    } else {
+        printf("timestamp %s: %ld/%ld lines parsed as %s (first: %s)\n", format_names[fmt], parsed, rows,
+               detected, first);
+        printf("  wall        %.3f s\n", wall);
+        printf("  lines/sec   %.0f\n", lines_per_sec);
+        printf("  ns/line     %.1f\n", rows > 0 ? wall * 1e9 / (double)rows : 0);
+        printf("  MB/sec      %.1f\n", mb_per_sec);
+    }
+    ts_parser_free(p);
+    free(corpus);
+    free(offs);
+    return parsed == rows ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include "loggen.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Template placeholders:
+ *   %u  small unsigned number      %n  large unsigned number
+ *   %i  IPv4 address               %h  8 hex digits
+ *   %w  word from a small pool     %p  filesystem path
+ */
+typedef struct {
+    const char *unit;
+    const char *fmt;
+} Template;
+
+static const Template templates[] = {
+    { "sshd.service", "Accepted publickey for %w from %i port %n ssh2: RSA SHA256:%h" },
+    { "sshd.service", "Failed password for invalid user %w from %i port %n ssh2" },
+    { "sshd.service", "pam_unix(sshd:session): session closed for user %w" },
+    { "systemd-logind.service", "New session %u of user %w." },
+    { "systemd-logind.service", "Removed session %u." },
+    { "cron.service", "(%w) CMD (%p --quiet)" },
+    { "NetworkManager.service", "<info>  [%n.%u] dhcp4 (wlp2s0): state changed bound -> bound" },
+    { "NetworkManager.service", "<info>  [%n.%u] device (wlp2s0): carrier: link connected" },
+    { "kernel", "[UFW BLOCK] IN=eth0 OUT= MAC=%h SRC=%i DST=%i LEN=%u PROTO=TCP SPT=%n DPT=%u" },
+    { "kernel", "usb %u-%u: new high-speed USB device number %u using xhci_hcd" },
+    { "kernel", "EXT4-fs (sda%u): mounted filesystem with ordered data mode. Quota mode: none." },
+    { "kernel", "Out of memory: Killed process %n (%w) total-vm:%nkB, anon-rss:%nkB" },
+    { "kernel", "%w[%n]: segfault at %h ip %h sp %h error %u in libc.so.6" },
+    { "nginx.service", "%i - - \"GET %p HTTP/1.1\" 200 %n \"-\" \"curl/7.%u.0\"" },
+    { "nginx.service", "%i - - \"POST %p HTTP/1.1\" 502 %u \"-\" \"Mozilla/5.0\"" },
+    { "postgresql.service", "LOG:  duration: %u.%u ms  statement: SELECT * FROM %w WHERE id = %n" },
+    { "postgresql.service", "ERROR:  deadlock detected DETAIL: Process %n waits for ShareLock on transaction %n" },
+    { "docker.service", "time=\"%n\" level=info msg=\"ignoring event\" container=%h module=libcontainerd" },
+    { "docker.service", "time=\"%n\" level=warning msg=\"cleaning up after shim disconnected\" id=%h" },
+    { "systemd", "Started %w.service - %w daemon." },
+    { "systemd", "%w.service: Main process exited, code=exited, status=%u/FAILURE" },
+    { "systemd", "%w.service: Scheduled restart job, restart counter is at %u." },
+    { "systemd-resolved.service", "Using degraded feature set UDP instead of UDP+EDNS0 for DNS server %i." },
+    { "polkitd.service", "Registered Authentication Agent for unix-session:%u (system bus name :1.%n)" },
+    { "CRON", "pam_unix(cron:session): session opened for user %w(uid=%u) by (uid=0)" },
+    { "sudo", "%w : TTY=pts/%u ; PWD=%p ; USER=root ; COMMAND=%p" },
+    { "snapd.service", "storehelpers.go:%u: cannot refresh: snap has no updates available: \"%w\"" },
+    { "gdm-password]", "gkr-pam: unlocked login keyring" },
+    { "avahi-daemon.service", "Registering new address record for %i on eth0.IPv4." },
+    { "rsyslogd", "action 'action-%u-builtin:omfile' resumed (module 'builtin:omfile') [v8.%n]" },
+    { "containerd.service", "shim disconnected id=%h namespace=moby" },
+    { "app.service", "request id=%h method=GET path=%p status=200 duration_ms=%u user=%w" },
+};
+
+#define N_TEMPLATES (sizeof(templates) / sizeof(templates[0]))
+
+static const char *words[] = {
+    "alice", "bob", "carol", "dave", "erin", "www-data", "postgres", "backup",
+    "ubuntu", "deploy", "nobody", "root", "grafana", "prometheus", "redis", "worker",
+};
+
+static const char *paths[] = {
+    "/usr/bin/backup.sh", "/api/v1/users", "/index.html", "/var/lib/app/cache",
+    "/healthz", "/api/v2/orders", "/etc/nginx/nginx.conf", "/usr/local/bin/rotate",
+};
+
+static const char *hosts[] = { "web-01", "web-02", "db-01", "build", "edge-7" };
+
+struct LogGen {
+    uint64_t state;
+    double cdf[N_TEMPLATES];
+    time_t clock;
+    unsigned clock_us;
+    uint64_t seq;
+};
+
+static uint64_t next_rand(LogGen *g) {
+    /* xorshift64* */
+    uint64_t x = g->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    g->state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double next_unit(LogGen *g) {
+    return (double)(next_rand(g) >> 11) / (double)(1ULL << 53);
+}
+
+LogGen *loggen_new(uint64_t seed, double skew) {
+    LogGen *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    double total = 0;
+    for (size_t i = 0; i < N_TEMPLATES; ++i) {
+        total += 1.0 / pow((double)(i + 1), skew);
+        g->cdf[i] = total;
+    }
+    for (size_t i = 0; i < N_TEMPLATES; ++i) g->cdf[i] /= total;
+    g->clock = 1760659200; /* 2025-10-17T00:00:00Z */
+    return g;
+}
+
+void loggen_free(LogGen *g) {
+    free(g);
+}
+
+size_t loggen_template_count(void) {
+    return N_TEMPLATES;
+}
+
+static const Template *pick_template(LogGen *g) {
+    double u = next_unit(g);
+    size_t lo = 0, hi = N_TEMPLATES - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (g->cdf[mid] < u) lo = mid + 1; else hi = mid;
+    }
+    return &templates[lo];
+}
+
+static void advance_clock(LogGen *g) {
+    g->clock_us += (unsigned)(next_rand(g) % 20000);
+    g->clock += g->clock_us / 1000000;
+    g->clock_us %= 1000000;
+}
+
+size_t loggen_message(LogGen *g, char *buf, size_t n, const char **unit, unsigned *pid) {
+    const Template *t = pick_template(g);
+    size_t len = 0;
+    for (const char *f = t->fmt; *f && len + 1 < n; ++f) {
+        if (*f != '%' || !f[1]) {
+            buf[len++] = *f;
+            continue;
+        }
+        uint64_t r = next_rand(g);
+        int w = 0;
+        switch (*++f) {
+        case 'u': w = snprintf(buf + len, n - len, "%u", (unsigned)(r % 100)); break;
+        case 'n': w = snprintf(buf + len, n - len, "%u", (unsigned)(r % 100000)); break;
+        case 'i': w = snprintf(buf + len, n - len, "%u.%u.%u.%u", 10u, (unsigned)(r >> 8) & 255u,
+                               (unsigned)(r >> 16) & 255u, (unsigned)(r >> 24) & 255u); break;
+        case 'h': w = snprintf(buf + len, n - len, "%08x", (unsigned)(r >> 32)); break;
+        case 'w': w = snprintf(buf + len, n - len, "%s", words[r % (sizeof(words) / sizeof(words[0]))]); break;
+        case 'p': w = snprintf(buf + len, n - len, "%s", paths[r % (sizeof(paths) / sizeof(paths[0]))]); break;
+        default: buf[len++] = *f; break;
+        }
+        if (w > 0) len += (size_t)w < n - len ? (size_t)w : n - len - 1;
+    }
+    buf[len] = '\0';
+    if (unit) *unit = t->unit;
+    if (pid) *pid = 300 + (unsigned)(next_rand(g) % 60000);
+    return len;
+}
+
+size_t loggen_iso_timestamp(LogGen *g, char *buf, size_t n) {
+    advance_clock(g);
+    struct tm tm;
+    gmtime_r(&g->clock, &tm);
+    int w = snprintf(buf, n, "%04d-%02d-%02dT%02d:%02d:%02d.%06uZ", tm.tm_year + 1900, tm.tm_mon + 1,
+                     tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, g->clock_us);
+    return w < 0 ? 0 : ((size_t)w < n ? (size_t)w : n - 1);
+}
+
+size_t loggen_syslog_line(LogGen *g, char *buf, size_t n) {
+    static const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    char msg[512];
+    const char *unit;
+    unsigned pid;
+    loggen_message(g, msg, sizeof(msg), &unit, &pid);
+    advance_clock(g);
+    struct tm tm;
+    gmtime_r(&g->clock, &tm);
+    /* Strip the ".service" suffix the way rsyslog shows program names. */
+    size_t ulen = strcspn(unit, ".");
+    int w = snprintf(buf, n, "%s %2d %02d:%02d:%02d %s %.*s[%u]: %s\n",
+                     months[tm.tm_mon], tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                     hosts[g->seq++ % (sizeof(hosts) / sizeof(hosts[0]))], (int)ulen, unit, pid, msg);
+    return w < 0 ? 0 : ((size_t)w < n ? (size_t)w : n - 1);
+}
+
+size_t loggen_journal_line(LogGen *g, char *buf, size_t n) {
+    char msg[512];
+    char esc[1024];
+    const char *unit;
+    unsigned pid;
+    loggen_message(g, msg, sizeof(msg), &unit, &pid);
+    advance_clock(g);
+    /* Templates only contain '"' as special character. */
+    size_t e = 0;
+    for (const char *m = msg; *m && e + 2 < sizeof(esc); ++m) {
+        if (*m == '"' || *m == '\\') esc[e++] = '\\';
+        esc[e++] = *m;
+    }
+    esc[e] = '\0';
+    unsigned long long usec = (unsigned long long)g->clock * 1000000ULL + g->clock_us;
+    int w = snprintf(buf, n,
+                     "{\"__CURSOR\":\"s=bench;i=%llx;b=0;m=0;t=%llx\",\"__REALTIME_TIMESTAMP\":\"%llu\","
+                     "\"_PID\":\"%u\",\"_SYSTEMD_UNIT\":\"%s\",\"PRIORITY\":\"6\",\"MESSAGE\":\"%s\"}\n",
+                     (unsigned long long)g->seq, usec, usec, pid, unit, esc);
+    g->seq++;
+    return w < 0 ? 0 : ((size_t)w < n ? (size_t)w : n - 1);
+}
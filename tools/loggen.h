@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Synthetic log generator for benchmarks. Messages are drawn from a fixed
+ * set of templates modelled on common /var/log and journal traffic; the
+ * template popularity follows a Zipf distribution so `skew` controls how
+ * repetitive the corpus is (0 = uniform, ~1.2 = typical server logs).
+ * Output is deterministic for a given seed. */
+
+typedef struct LogGen LogGen;
+
+LogGen *loggen_new(uint64_t seed, double skew);
+void loggen_free(LogGen *g);
+
+// Write one message (no trailing newline) into buf. Returns its length.
+// *unit receives the unit name of the template; *pid a plausible process id.
+size_t loggen_message(LogGen *g, char *buf, size_t n, const char **unit, unsigned *pid);
+// One RFC3164-style syslog line including the trailing newline.
+size_t loggen_syslog_line(LogGen *g, char *buf, size_t n);
+// One `journalctl -o json` style line including the trailing newline.
+size_t loggen_journal_line(LogGen *g, char *buf, size_t n);
+// Advance the generator clock and write it as an ISO-8601 UTC timestamp.
+size_t loggen_iso_timestamp(LogGen *g, char *buf, size_t n);
+// Number of distinct templates (useful for choosing rare/common query terms).
+size_t loggen_template_count(void);